@@ -0,0 +1,76 @@
+#ifndef __ANALYSIS_ENGINE_DESCRIPTOR_H__
+#define __ANALYSIS_ENGINE_DESCRIPTOR_H__
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace percepteros
+{
+
+/**
+ * @brief Aggregate analysis engine descriptor which can be cut down to a set of delegates.
+ *
+ * The generated descriptors list every annotator of every package, creating
+ * the engine initializes all of them. A trimmed copy only contains the
+ * delegates a pipeline needs, the parameter overrides and the fixed flow of
+ * the removed ones are dropped with them.
+ */
+class AnalysisEngineDescriptor
+{
+public:
+  /**
+   * @brief load Reads an aggregate descriptor
+   * @return false on error, see getError
+   */
+  bool load(const std::string &file);
+
+  /**
+   * @brief getDelegates The keys of all delegates, in the order of the descriptor
+   */
+  std::vector<std::string> getDelegates() const;
+
+  /**
+   * @brief getDelegateFile The absolute path of the descriptor of a delegate, empty if it is unknown
+   */
+  std::string getDelegateFile(const std::string &key) const;
+
+  /**
+   * @brief setParameter Overrides a parameter of a delegate in the copies written afterwards
+   * @param type the UIMA type of the parameter: String, Boolean, Integer or Float
+   * @return false if the descriptor has no parameter sections, see getError
+   */
+  bool setParameter(const std::string &delegate, const std::string &name, const std::string &type, const std::string &value);
+
+  /**
+   * @brief writeTrimmed Writes a copy containing only the given delegates, unknown ones are ignored
+   * @param file the copy, the imports are made absolute so it can be placed anywhere
+   * @return false on error, see getError
+   */
+  bool writeTrimmed(const std::set<std::string> &delegates, const std::string &file);
+
+  /**
+   * @brief writeTrimmedTemporary Like writeTrimmed, into a new temporary file
+   * @return the path of the file, empty on error
+   */
+  std::string writeTrimmedTemporary(const std::set<std::string> &delegates);
+
+  inline const std::string &getError() const
+  {
+    return error;
+  }
+
+private:
+  boost::property_tree::ptree tree;
+  //directory of the descriptor, the imports are relative to it
+  std::string directory;
+  std::string error;
+
+  std::string absolute(const std::string &location) const;
+};
+
+}
+
+#endif //__ANALYSIS_ENGINE_DESCRIPTOR_H__
@@ -0,0 +1,104 @@
+#ifndef __ASYNC_SCENE_WRITER_H__
+#define __ASYNC_SCENE_WRITER_H__
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <tf/transform_datatypes.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Writes recorded scenes to disk on a background thread.
+ *
+ * Every scene is stored as <name>.pcd (binary or binary compressed),
+ * <name>_depth.png (16 bit, millimeters) and <name>_viewpoint.yml. The queue
+ * is bounded, scenes pushed while it is full are dropped and counted, so the
+ * caller never waits for the disk.
+ */
+class AsyncSceneWriter
+{
+public:
+  struct Scene
+  {
+    std::string name;
+    uint64_t stamp;
+    pcl::PointCloud<pcl::PointXYZRGBA>::ConstPtr cloud;
+    cv::Mat depth;
+    bool hasViewpoint;
+    tf::StampedTransform viewpoint;
+  };
+
+  AsyncSceneWriter(const std::string &path, size_t maxQueue, bool compress);
+  ~AsyncSceneWriter();
+
+  /**
+   * @brief push Queues a scene for writing. The cloud and depth image must not
+   * be modified afterwards, the writer only keeps references to them.
+   * @return false if the queue was full and the scene was dropped
+   */
+  bool push(const Scene &scene);
+
+  inline size_t pending()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+  }
+
+  inline size_t getWritten() const
+  {
+    return written;
+  }
+
+  inline size_t getDropped() const
+  {
+    return dropped;
+  }
+
+  inline size_t getFailed() const
+  {
+    return failed;
+  }
+
+  inline size_t getHighWater() const
+  {
+    return highWater;
+  }
+
+  inline size_t getMaxQueue() const
+  {
+    return maxQueue;
+  }
+
+private:
+  std::string path;
+  size_t maxQueue;
+  bool compress;
+
+  std::deque<Scene> queue;
+  std::mutex mutex;
+  std::condition_variable available;
+  bool stop;
+
+  std::atomic<size_t> written, dropped, failed, highWater;
+
+  std::thread worker;
+
+  void run();
+  bool write(const Scene &scene);
+};
+
+}
+
+#endif //__ASYNC_SCENE_WRITER_H__
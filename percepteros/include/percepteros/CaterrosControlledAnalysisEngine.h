@@ -17,6 +17,16 @@
 
 #include <tf_conversions/tf_eigen.h>
 
+#include <percepteros/LastDetections.h>
+#include <percepteros/SceneSignature.h>
+#include <percepteros/ObjectDetectionArray.h>
+#include <percepteros/AnalysisEngineDescriptor.h>
+#include <percepteros/PerfCounters.h>
+
+#include <map>
+#include <memory>
+#include <set>
+
 class CaterrosControlledAnalysisEngine: public RSAnalysisEngine
 {
 
@@ -24,6 +34,7 @@ private:
   RSPipelineManager *rspm;
   std::string currentAEName;
   std::vector<std::string> next_pipeline_order;
+  std::vector<std::string> default_pipeline_order, current_pipeline_order;
   boost::shared_ptr<std::mutex> process_mutex;
 
   ros::NodeHandle nh_;
@@ -34,13 +45,67 @@ private:
 
   bool useIdentityResolution_;
 
+  /**
+   * Latency history of one annotator. expectedMs is an exponential moving
+   * average over the runs which were not cut short by the deadline.
+   */
+  struct AnnotatorTiming
+  {
+    double expectedMs = 0;
+    size_t runs = 0, degraded = 0, skipped = 0;
+  };
+
+  //0 runs every annotator to completion
+  double deadlineMs_, nextDeadlineMs_;
+  //annotators which run even if the deadline has passed
+  std::set<std::string> alwaysRun_, nextAlwaysRun_;
+  std::map<std::string, AnnotatorTiming> timings_;
+
+  //scene of the last processed frame, compared against the result cache
+  percepteros::SceneSignature signature_;
+
+  //lazy engines only contain the annotators their pipelines used so far, off by default
+  bool lazy_;
+  bool initReport_;
+  percepteros::AnalysisEngineDescriptor descriptor_;
+  std::set<std::string> loaded_;
+
+  /**
+   * Latency and performance counters of one annotator, summed over all
+   * profiled runs. counted tells how many runs a counter could be read in.
+   */
+  struct AnnotatorProfile
+  {
+    size_t runs = 0;
+    double totalMs = 0;
+    uint64_t counters[percepteros::PerfCounters::COUNT] = {};
+    size_t counted[percepteros::PerfCounters::COUNT] = {};
+  };
+
+  //profiling runs every annotator on its own, opened by the processing thread
+  bool profile_;
+  std::unique_ptr<percepteros::PerfCounters> perf_;
+  std::map<std::string, AnnotatorProfile> profiles_;
+  boost::shared_ptr<std::mutex> profile_mutex_;
+
+  bool runEngine();
+  bool runAnnotator(const std::string &annotator);
+  void processWithDeadline();
+  void updateSignature();
+  void createEngine(const std::string &file);
+  void releaseEngine();
+  void loadAnnotators(const std::vector<std::string> &pipeline);
+  void reportInit(const double engineMs);
+
 public:
   bool queued = false;
 
   CaterrosControlledAnalysisEngine(ros::NodeHandle nh) : RSAnalysisEngine(),
-    rspm(NULL),currentAEName(""),nh_(nh),it_(nh_),useIdentityResolution_(false)
+    rspm(NULL),currentAEName(""),nh_(nh),it_(nh_),useIdentityResolution_(false),
+    deadlineMs_(0),nextDeadlineMs_(0),lazy_(false),initReport_(false),profile_(false)
   {
     process_mutex = boost::shared_ptr<std::mutex>(new std::mutex);
+    profile_mutex_ = boost::shared_ptr<std::mutex>(new std::mutex);
   }
 
   ~CaterrosControlledAnalysisEngine()
@@ -70,6 +135,23 @@ public:
     queued = true;
   }
 
+  /*set the deadline of the next pipeline, 0 disables it*/
+  void setNextDeadline(double deadlineMs, const std::vector<std::string> &alwaysRun)
+  {
+    nextDeadlineMs_ = deadlineMs;
+    nextAlwaysRun_ = std::set<std::string>(alwaysRun.begin(), alwaysRun.end());
+  }
+
+  inline double getDeadline() const
+  {
+    return deadlineMs_;
+  }
+
+  inline const percepteros::SceneSignature &getSceneSignature() const
+  {
+    return signature_;
+  }
+
 
   /*get the next order of AEs to be executed*/
   inline std::vector<std::string> &getNextPipeline()
@@ -81,7 +163,13 @@ public:
   {
     if(rspm)
     {
+      loadAnnotators(next_pipeline_order);
       rspm->setPipelineOrdering(next_pipeline_order);
+      current_pipeline_order = next_pipeline_order;
+      //results of the old pipeline must not be repeated for the new one
+      percepteros::LastDetections::invalidate();
+      deadlineMs_ = nextDeadlineMs_;
+      alwaysRun_ = nextAlwaysRun_;
       queued = false;
     }
   }
@@ -91,6 +179,8 @@ public:
     if(rspm)
     {
       rspm->resetPipelineOrdering();
+      current_pipeline_order = default_pipeline_order;
+      percepteros::LastDetections::invalidate();
     }
   }
 
@@ -110,6 +200,29 @@ public:
 
   void init(const std::string &file,const std::vector<std::string> &lowLvLPipeline);
 
+  /*create only the annotators of the pipelines, the others when a pipeline needs them. UIMA cannot add delegates
+   *to a running engine, so loading them recreates the engine and every annotator starts over with a fresh
+   *state: recorder rings, the TSDF volume, the scene change reference and the publisher rings are lost*/
+  inline void setLazy(const bool lazy)
+  {
+    lazy_ = lazy;
+  }
+
+  /*time the initialization of every annotator on its own, doubles the start up time*/
+  inline void setInitReport(const bool initReport)
+  {
+    initReport_ = initReport;
+  }
+
+  /*read the performance counters around every annotator*/
+  inline void setProfiling(const bool profile)
+  {
+    profile_ = profile;
+  }
+
+  /*profile of every annotator, one line each, may be called from any thread*/
+  std::string getProfile();
+
   inline void useIdentityResolution(const bool useIDres)
   {
       useIdentityResolution_=useIDres;
@@ -119,5 +232,29 @@ public:
   // decide if the pipeline should be reset or not
   void process(bool reset_pipeline_after_process);
 
+  /**
+   * Time one annotator took in a frame which was run one annotator at a time.
+   */
+  struct StageTiming
+  {
+    std::string annotator;
+    double ms;
+  };
+
+  /**
+   * @brief processStepwise Runs the current pipeline one annotator at a time
+   * @param stages the annotators which ran and their times
+   * @return false if an annotator aborted the frame
+   */
+  bool processStepwise(std::vector<StageTiming> &stages);
+
+  /**
+   * @brief processOnce Runs pipeline on one frame, the current pipeline is restored afterwards
+   * @param detections what ROSPublisher published for the frame
+   * @return false if the frame did not reach ROSPublisher
+   */
+  bool processOnce(const std::vector<std::string> &pipeline, percepteros::ObjectDetectionArray &detections,
+                   std::vector<StageTiming> &stages);
+
 };
 #endif // CATERROSCONTROLEDANALYSISENGINE_H
@@ -0,0 +1,148 @@
+#ifndef CATERROSENGINEWORKER_H
+#define CATERROSENGINEWORKER_H
+
+#include <percepteros/CaterrosControlledAnalysisEngine.h>
+#include <percepteros/ResultCache.h>
+#include <percepteros/ObjectDetectionArray.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/**
+ * One engine of the pool with its own CAS. Runs the pipeline it was last
+ * asked for, either in its own thread or, if it is the only engine, stepped
+ * by the manager. Requests may come from any thread, they are applied
+ * between two frames.
+ */
+class CaterrosEngineWorker
+{
+
+private:
+  CaterrosControlledAnalysisEngine engine;
+
+  //shared by all engines of the pool
+  percepteros::ResultCache &resultCache_;
+  std::mutex &cacheMutex_;
+
+  //guards the queued request
+  std::mutex request_mutex_;
+  bool queued_;
+  std::string nextPipelineName_;
+  std::vector<std::string> nextPipeline_;
+  double nextDeadline_;
+  std::vector<std::string> nextAlwaysRun_;
+  //detections found in the cache for the queued pipeline
+  percepteros::ObjectDetectionArray cachedDetections_;
+  percepteros::SceneSignature cachedScene_;
+  bool hasCachedDetections_;
+  //empty while the engine is idle
+  std::string requestedName_;
+  ros::WallTime lastRequest_;
+
+  std::string pipelineName_;
+  uint32_t lastCachedFrame_;
+  bool hasLastCachedFrame_;
+
+  std::atomic<bool> running_;
+  //set by the manager while it is paused or waits for a service call
+  std::atomic<bool> paused_;
+  std::thread thread_;
+
+  void applyRequest();
+  void cacheResult();
+  void loop();
+
+public:
+
+  CaterrosEngineWorker(ros::NodeHandle nh, percepteros::ResultCache &resultCache, std::mutex &cacheMutex) :
+    engine(nh), resultCache_(resultCache), cacheMutex_(cacheMutex), queued_(false), nextDeadline_(0),
+    hasCachedDetections_(false), lastCachedFrame_(0), hasLastCachedFrame_(false), running_(false), paused_(false)
+  {
+  }
+
+  ~CaterrosEngineWorker()
+  {
+    stop();
+  }
+
+  /**
+   * @brief init Creates the engine and its CAS, call from the main thread before start
+   * @param pipelineName name of the initial pipeline, empty leaves the engine idle
+   */
+  void init(const std::string &xmlFile, const std::vector<std::string> &pipeline,
+            const std::string &pipelineName, double deadline, const std::vector<std::string> &alwaysRun);
+
+  /**
+   * @brief request Queues a pipeline, it replaces the current one before the next frame
+   * @param cached detections of this pipeline for the current scene, NULL if there are none
+   * @param scene the scene the cached detections were found for
+   */
+  void request(const std::string &pipelineName, const std::vector<std::string> &pipeline, double deadline,
+               const std::vector<std::string> &alwaysRun, const percepteros::ObjectDetectionArray *cached,
+               const percepteros::SceneSignature &scene);
+
+  /**
+   * @brief release Stops running the current pipeline once the frame is done
+   */
+  void release();
+
+  /**
+   * @brief step Processes one frame with the current pipeline
+   * @return false if the engine is idle
+   */
+  bool step();
+
+  void start();
+  void stop();
+
+  /**
+   * @brief setPaused Keeps the thread of a pool engine from processing frames
+   */
+  inline void setPaused(const bool paused)
+  {
+    paused_ = paused;
+  }
+
+  /**
+   * @brief getPipelineName The pipeline the engine was last asked for, empty if it is idle
+   */
+  std::string getPipelineName();
+  ros::WallTime getLastRequest();
+
+  inline void setLazy(const bool lazy)
+  {
+    engine.setLazy(lazy);
+  }
+
+  inline void setInitReport(const bool initReport)
+  {
+    engine.setInitReport(initReport);
+  }
+
+  inline void setProfiling(const bool profile)
+  {
+    engine.setProfiling(profile);
+  }
+
+  inline std::string getProfile()
+  {
+    return engine.getProfile();
+  }
+
+  /**
+   * @brief processOnce Runs pipeline on the next frame, only from the thread stepping the engine
+   */
+  inline bool processOnce(const std::vector<std::string> &pipeline, percepteros::ObjectDetectionArray &detections,
+                          std::vector<CaterrosControlledAnalysisEngine::StageTiming> &stages)
+  {
+    return engine.processOnce(pipeline, detections, stages);
+  }
+
+  inline const percepteros::SceneSignature &getSceneSignature() const
+  {
+    return engine.getSceneSignature();
+  }
+};
+
+#endif // CATERROSENGINEWORKER_H
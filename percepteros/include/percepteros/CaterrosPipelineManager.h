@@ -4,38 +4,68 @@
 #include <rs/utils/RSAnalysisEngineManager.h>
 #include <suturo_perception_msgs/RunPipeline.h>
 #include <percepteros/CaterrosControlledAnalysisEngine.h>
+#include <percepteros/CaterrosEngineWorker.h>
+#include <percepteros/ResultCache.h>
+#include <percepteros/ObjectDetectionArray.h>
+#include <percepteros/RunQuery.h>
+#include <std_srvs/Trigger.h>
 #include <ros/ros.h>
 
+#include <algorithm>
+#include <memory>
+#include <sstream>
+
 
 class CaterrosPipelineManager
 {
 
 private:
 
-  CaterrosControlledAnalysisEngine engine;
   ros::NodeHandle nh_;
   bool waitForServiceCall_;
   rs::Visualizer visualizer_;
   bool useVisualizer_;
   bool useIdentityResolution_;
   bool pause_;
+  //annotators are created when a pipeline first needs them
+  bool lazy_;
+  bool initReport_;
+  bool profile_;
 
   ros::Publisher desig_pub_;
-  ros::ServiceServer service, singleService, setContextService, jsonService;
+  ros::ServiceServer service, singleService, setContextService, jsonService, cacheStatsService, queryService, annotatorStatsService;
+  ros::Publisher batch_pub;
 
   std::mutex processing_mutex_;
 
   std::string configFile;
   std::vector<std::string> lowLvlPipeline_;
-	
+
+  //latest detections of every pipeline for the scene they were computed in
+  percepteros::ResultCache resultCache_;
+  std::mutex cacheMutex_;
+
+  //with more than one engine the feeder runs the shared annotators once per
+  //frame and every engine of the pool starts from its result
+  size_t poolSize_;
+  CaterrosControlledAnalysisEngine feeder_;
+  std::vector<std::string> sharedAnnotators_;
+  std::vector<std::unique_ptr<CaterrosEngineWorker>> workers_;
+
+  std::vector<std::string> workerPipeline(const std::vector<std::string> &pipeline) const;
+  CaterrosEngineWorker &selectWorker(const std::string &pipelineName);
+  const percepteros::SceneSignature &currentScene() const;
 
 public:
 
   CaterrosPipelineManager(const bool useVisualizer, const std::string &savePath,
-                   const bool &waitForServiceCall, ros::NodeHandle n):
-    engine(n), nh_(n), waitForServiceCall_(waitForServiceCall), visualizer_(savePath),
-    useVisualizer_(useVisualizer), useIdentityResolution_(false), pause_(true)
+                   const bool &waitForServiceCall, ros::NodeHandle n, const size_t poolSize = 1):
+    nh_(n), waitForServiceCall_(waitForServiceCall), visualizer_(savePath),
+    useVisualizer_(useVisualizer), useIdentityResolution_(false), pause_(true),
+    lazy_(false), initReport_(false), profile_(false), poolSize_(std::max<size_t>(poolSize, 1)), feeder_(n)
   {
+    sharedAnnotators_.push_back("CollectionReader");
+    sharedAnnotators_.push_back("ImagePreprocessor");
 
     outInfo("Creating resource manager"); // TODO: DEBUG
     uima::ResourceManager &resourceManager = uima::ResourceManager::createInstance("RoboSherlock"); // TODO: change topic?
@@ -58,11 +88,17 @@ public:
     // Call this service to switch between AEs
     //setContextService = nh_.advertiseService("set_context", &CaterrosPipelineManager::resetAECallback, this);
     setContextService = nh_.advertiseService("set_pipeline", &CaterrosPipelineManager::setPipelineCallback, this);
+    cacheStatsService = nh_.advertiseService("cache_stats", &CaterrosPipelineManager::cacheStatsCallback, this);
+    queryService = nh_.advertiseService("run_query", &CaterrosPipelineManager::runQueryCallback, this);
+    annotatorStatsService = nh_.advertiseService("annotator_stats", &CaterrosPipelineManager::annotatorStatsCallback, this);
+    //the topic of ROSPublisher, cached results are answered like fresh ones
+    batch_pub = nh_.advertise<percepteros::ObjectDetectionArray>("/percepteros/object_detections", 1, true);
 
 
   }
   ~CaterrosPipelineManager()
   {
+    workers_.clear();
     uima::ResourceManager::deleteInstance();
     outInfo("RSControledAnalysisEngine Stoped");
   }
@@ -70,20 +106,7 @@ public:
   /*brief
    * init the AE Manager
    **/
-  void init(std::string &xmlFile, std::string &configFile)
-  {
-    this->configFile = configFile;
-    cv::FileStorage fs(configFile, cv::FileStorage::READ);
-    if(lowLvlPipeline_.empty()) //if not set programatically, load from a config file
-    {
-      fs["annotators"] >> lowLvlPipeline_;
-    }
-    engine.init(xmlFile, lowLvlPipeline_);
-    if(useVisualizer_)
-    {
-      visualizer_.start();
-    }
-  }
+  void init(std::string &xmlFile, std::string &configFile);
 
   /* brief
    * run the AE in the manager
@@ -116,33 +139,103 @@ public:
       std::string pipelineName = "";
       //TODO multiple objects can be given, decide on annotators depending on given objects
       for(std::string object : objects){
-          if(object == "cake"){
-            pipelineName = "cake";
-          } else if(object == "cylinder"){
-            pipelineName = "cylinder";
-          } else if(object =="knife"){
-            pipelineName = "knife";
-          } else if (object == "end") {
-			      pipelineName = "end";
-          } else if (object == "spatula") {
-            pipelineName = "spatulaRecognition";
-          } else if (object == "plate") {
-            pipelineName = "plate";
-          } else if (object == "board") {
-            pipelineName = "board";
-		      } else {
-            outInfo("No Corresponding Object found, setting pipelineName to 'config'!");
-            pipelineName= "config";
-          }
+          pipelineName = pipelineForObject(object);
+      }
+      //the feeder keeps reading frames, no engine has to run
+      if(pipelineName == "end" && workers_.size() > 1)
+      {
+        for(auto &worker : workers_)
+        {
+          worker->release();
+        }
+        return true;
       }
       std::string configFile_ = ros::package::getPath("percepteros") +"/config/"+pipelineName+".yaml";
       cv::FileStorage fs(configFile_, cv::FileStorage::READ);
       std::vector<std::string> lowLvlPipeline;
       fs["annotators"] >> lowLvlPipeline;
-      engine.setNextPipeline(lowLvlPipeline);
+      double deadline;
+      std::vector<std::string> alwaysRun;
+      readDeadline(fs, deadline, alwaysRun);
+
+      //answer right away if this pipeline already ran on the current scene
+      percepteros::ObjectDetectionArray cachedDetections;
+      const percepteros::SceneSignature scene = currentScene();
+      bool cached;
+      {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        cached = resultCache_.lookup(pipelineName, scene, cachedDetections);
+      }
+      if(cached)
+      {
+        outInfo("Answering " << pipelineName << " from cache with " << cachedDetections.detections.size() << " detections.");
+        batch_pub.publish(cachedDetections);
+      }
+      selectWorker(pipelineName).request(pipelineName, workerPipeline(lowLvlPipeline), deadline, alwaysRun,
+                                         cached ? &cachedDetections : NULL, scene);
       return true;
   }
 
+  /**
+   * @brief runQueryCallback Runs the merged pipelines of the requested objects on the next frame and answers
+   * with what they found, the annotators which ran and their times
+   */
+  bool runQueryCallback(percepteros::RunQuery::Request &req, percepteros::RunQuery::Response &res);
+
+  /**
+   * @brief pipelineForObject The name of the pipeline config detecting object
+   */
+  static std::string pipelineForObject(const std::string &object);
+
+  /**
+   * @brief mergePipeline Adds the annotators of pipeline which are missing in merged, each right after the
+   * annotator preceding it in pipeline
+   */
+  static void mergePipeline(std::vector<std::string> &merged, const std::vector<std::string> &pipeline);
+
+  /**
+   * @brief cacheStatsCallback Reports the hit and miss counters of the result cache
+   */
+  bool cacheStatsCallback(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res)
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    std::ostringstream stats;
+    stats << "hits: " << resultCache_.getHits() << ", misses: " << resultCache_.getMisses()
+          << ", evictions: " << resultCache_.getEvictions() << ", entries: " << resultCache_.size()
+          << "/" << resultCache_.getCapacity();
+    res.success = true;
+    res.message = stats.str();
+    return true;
+  }
+
+  /**
+   * @brief annotatorStatsCallback Reports latency, IPC and miss rates of every annotator, per engine
+   */
+  bool annotatorStatsCallback(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res);
+
+  /**
+   * @brief readDeadline Reads the optional deadline (ms) and always_run list of a pipeline config
+   * @param fs The opened pipeline config
+   */
+  void readDeadline(cv::FileStorage &fs, double &deadline, std::vector<std::string> &alwaysRun)
+  {
+    deadline = 0;
+    alwaysRun.clear();
+    if(!fs["deadline"].empty())
+    {
+      fs["deadline"] >> deadline;
+    }
+    if(!fs["always_run"].empty())
+    {
+      fs["always_run"] >> alwaysRun;
+    }
+    else
+    {
+      //the results of a cut short frame still have to be published
+      alwaysRun.push_back("ROSPublisher");
+    }
+  }
+
   /**
    * @brief resetAECallback
    * @param req
@@ -180,6 +273,25 @@ public:
 
 
 
+  /*create annotators on first use instead of at start up, a pipeline switch that needs new annotators resets
+   *the state of all annotators of the engine*/
+  inline void setLazy(const bool lazy)
+  {
+    lazy_ = lazy;
+  }
+
+  /*log how long every annotator takes to initialize*/
+  inline void setInitReport(const bool initReport)
+  {
+    initReport_ = initReport;
+  }
+
+  /*profile every annotator with the performance counters of the cpu*/
+  inline void setProfiling(const bool profile)
+  {
+    profile_ = profile;
+  }
+
   inline void setUseIdentityResolution(bool useIdentityResoltuion)
   {
     useIdentityResolution_ = useIdentityResoltuion;
@@ -0,0 +1,236 @@
+#ifndef __CLUSTER_COLOR_H__
+#define __CLUSTER_COLOR_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <uima/api.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <rs/scene_cas.h>
+#include <percepteros/types/all_types.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/ModelStore.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief A named box in HSV space, hue in degrees, saturation and value in [0, 1].
+ * The hue range wraps around if minHue is larger than maxHue.
+ */
+struct ColorClass
+{
+  std::string name;
+  float minHue, maxHue;
+  float minSaturation, maxSaturation;
+  float minValue, maxValue;
+
+  bool contains(float h, float s, float v) const;
+
+  /**
+   * @brief parse Reads "name minHue maxHue minSaturation maxSaturation minValue maxValue"
+   */
+  static bool parse(const std::string &text, ColorClass &colorClass);
+};
+
+/**
+ * @brief Color class as stored in a ModelStore
+ */
+struct ColorClassRecord
+{
+  char name[32];
+  float minHue, maxHue;
+  float minSaturation, maxSaturation;
+  float minValue, maxValue;
+};
+
+/**
+ * @brief Lookup table from quantized HSV to the configured color classes.
+ *
+ * The bins are fine enough for the class boundaries (2 degrees of hue, 16
+ * steps of saturation and value), every bin belongs to the first class
+ * containing its center. The table used for all clusters is configured once
+ * by the ClusterColorStatistics stage and shared by every engine, pipelines
+ * without that stage load it on first use. A table compiled into a
+ * ModelStore is used from the mapped store.
+ */
+class ColorClassTable
+{
+public:
+  enum
+  {
+    HUE_BINS = 180,
+    SATURATION_BINS = 16,
+    VALUE_BINS = 16,
+    BINS = HUE_BINS * SATURATION_BINS * VALUE_BINS
+  };
+
+  //histogram published with the statistics, hue major
+  enum
+  {
+    HISTOGRAM_HUE = 12,
+    HISTOGRAM_SATURATION = 4,
+    HISTOGRAM_VALUE = 4,
+    HISTOGRAM_BINS = HISTOGRAM_HUE * HISTOGRAM_SATURATION * HISTOGRAM_VALUE
+  };
+
+  explicit ColorClassTable(const std::vector<ColorClass> &classes = std::vector<ColorClass>());
+
+  /**
+   * @brief ColorClassTable The table of a store, empty if the store has none
+   */
+  explicit ColorClassTable(const std::shared_ptr<const ModelStore> &store);
+  ColorClassTable(const ColorClassTable &) = delete;
+  ColorClassTable &operator=(const ColorClassTable &) = delete;
+
+  inline static int hueBin(float h)
+  {
+    const int bin = (int)(h * (HUE_BINS / 360.0f));
+    return bin < 0 ? 0 : (bin >= HUE_BINS ? HUE_BINS - 1 : bin);
+  }
+
+  inline static int unitBin(float x, int bins)
+  {
+    const int bin = (int)(x * bins);
+    return bin < 0 ? 0 : (bin >= bins ? bins - 1 : bin);
+  }
+
+  /**
+   * @brief classOf Class of a bin, 0 for none, i + 1 for classes()[i]
+   */
+  inline uint8_t classOf(int bin) const
+  {
+    return lut[bin];
+  }
+
+  inline const std::vector<ColorClass> &classes() const
+  {
+    return colorClasses;
+  }
+
+  /**
+   * @brief save Adds the classes and the lookup table as sections of a store
+   */
+  void save(ModelStoreWriter &writer) const;
+
+  /**
+   * @brief configure Replaces the table shared by all annotators
+   */
+  static void configure(const std::vector<ColorClass> &classes);
+  static void configure(const std::shared_ptr<const ColorClassTable> &table);
+
+  /**
+   * @brief shared The table shared by all annotators, loaded from models/percepteros.models if none was configured
+   */
+  static std::shared_ptr<const ColorClassTable> shared();
+
+  /**
+   * @brief load Reads the classes of a model store, see ModelStore::compiled, or of config/colors.yaml if the
+   * store has none or is older than colors.yaml
+   * @return NULL if neither has color classes, error is set then
+   */
+  static std::shared_ptr<const ColorClassTable> load(const std::string &storeName, std::string &error);
+
+private:
+  std::vector<ColorClass> colorClasses;
+  //points into ownLut or into the store
+  const uint8_t *lut;
+  std::vector<uint8_t> ownLut;
+  std::shared_ptr<const ModelStore> store;
+};
+
+/**
+ * @brief Color statistics of one cluster.
+ *
+ * Computed once per cluster and frame and stored in the CAS as a
+ * ColorStatistics annotation, all color gated annotators read that one.
+ * The points are gathered into contiguous arrays first, so the HSV
+ * conversion and the binning run as plain loops the compiler vectorizes.
+ */
+class ClusterColor
+{
+public:
+  float hue = 0;
+  float saturation = 0;
+  float value = 0;
+  size_t points = 0;
+  std::vector<float> histogram;
+  //share of the points in every class of the table
+  std::vector<float> ratios;
+
+  void compute(const pcl::PointCloud<pcl::PointXYZHSV> &cloud, const std::vector<int> &indices, const ColorClassTable &table);
+
+  template<typename PointT>
+  void compute(const pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices, const ColorClassTable &table)
+  {
+    Buffers &buffers = resize(indices.size());
+    for(size_t i = 0; i < indices.size(); ++i)
+    {
+      const PointT &point = cloud.points[indices[i]];
+      buffers.r[i] = point.r;
+      buffers.g[i] = point.g;
+      buffers.b[i] = point.b;
+    }
+    rgbToHsv(buffers, indices.size());
+    accumulate(buffers, indices.size(), table);
+  }
+
+  /**
+   * @brief annotate Creates the CAS annotation holding the statistics
+   */
+  ColorStatistics annotate(uima::CAS &tcas, const ColorClassTable &table) const;
+
+  /**
+   * @brief of Statistics of a cluster of the scene. Computed from cloud and
+   * appended to the cluster if no stage did that before in this frame.
+   */
+  template<typename PointT>
+  static ColorStatistics of(uima::CAS &tcas, SceneIndex &index, size_t cluster, const pcl::PointCloud<PointT> &cloud)
+  {
+    const std::vector<ColorStatistics> &existing = index.annotations<ColorStatistics>(cluster);
+    if(!existing.empty())
+    {
+      return existing[0];
+    }
+    pcl::PointIndices::Ptr indices = FrameArena::get<pcl::PointIndices>();
+    rs::ReferenceClusterPoints clusterPoints(index.cluster(cluster).points());
+    rs::conversion::from(clusterPoints.indices(), *indices);
+
+    std::shared_ptr<const ColorClassTable> table = ColorClassTable::shared();
+    if(table->classes().empty())
+    {
+      reportNoClasses();
+    }
+    ClusterColor color;
+    color.compute(cloud, indices->indices, *table);
+    ColorStatistics statistics = color.annotate(tcas, *table);
+    index.append(cluster, statistics);
+    return statistics;
+  }
+
+  /**
+   * @brief ratio Share of the points of the statistics in the named class, 0 if the class is unknown
+   */
+  static float ratio(ColorStatistics &statistics, const std::string &name);
+
+private:
+  struct Buffers
+  {
+    std::vector<float> r, g, b, h, s, v;
+  };
+
+  static void reportNoClasses();
+  static Buffers &resize(size_t size);
+  static void rgbToHsv(Buffers &buffers, size_t size);
+  void accumulate(const Buffers &buffers, size_t size, const ColorClassTable &table);
+};
+
+}
+
+#endif //__CLUSTER_COLOR_H__
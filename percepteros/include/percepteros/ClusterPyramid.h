@@ -0,0 +1,172 @@
+#ifndef __CLUSTER_PYRAMID_H__
+#define __CLUSTER_PYRAMID_H__
+
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <percepteros/SceneIndex.h>
+#include <percepteros/VoxelDownsampler.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Points of a cluster at several resolutions.
+ *
+ * Level FINE holds all points of the cluster, MEDIUM and COARSE their
+ * centroids in 5 mm and 1 cm voxels, each built from the level below with the
+ * hash based VoxelDownsampler. Every point knows the voxel of the next level
+ * it went into, so models fitted on a coarse level can be checked and refined
+ * on the points they stand for.
+ *
+ * ClusterPyramid::of builds the pyramid of a cluster once per frame and keeps
+ * it in the SceneIndex, the following annotators of the frame get the same
+ * one. The pyramid is shared, annotators changing points work on a copy.
+ */
+template<typename PointT>
+class ClusterPyramid
+{
+public:
+  enum Level
+  {
+    FINE,
+    MEDIUM,
+    COARSE,
+    LEVELS
+  };
+
+  /**
+   * @brief leafSize Voxel size of a level in meters, 0 for the full resolution
+   */
+  inline static float leafSize(Level level)
+  {
+    return level == FINE ? 0.0f : level == MEDIUM ? 0.005f : 0.01f;
+  }
+
+  /**
+   * @brief of The pyramid of a cluster of the current frame, built on the first call
+   * @param cloud the scene cloud
+   * @param indices points of the cluster in the scene cloud
+   */
+  static const ClusterPyramid &of(SceneIndex &index, size_t cluster, const pcl::PointCloud<PointT> &cloud,
+                                  const std::vector<int> &indices)
+  {
+    bool created;
+    ClusterPyramid &pyramid = index.derived<ClusterPyramid>(cluster, created);
+    if(created)
+    {
+      pyramid.build(cloud, indices);
+    }
+    return pyramid;
+  }
+
+  /**
+   * @brief of The pyramid of a cluster whose points were already gathered into a cloud
+   */
+  static const ClusterPyramid &of(SceneIndex &index, size_t cluster, const pcl::PointCloud<PointT> &points)
+  {
+    bool created;
+    ClusterPyramid &pyramid = index.derived<ClusterPyramid>(cluster, created);
+    if(created)
+    {
+      pyramid.build(points);
+    }
+    return pyramid;
+  }
+
+  ClusterPyramid()
+  {
+    for(int l = 0; l < LEVELS; ++l)
+    {
+      clouds[l].reset(new pcl::PointCloud<PointT>);
+    }
+  }
+
+  void build(const pcl::PointCloud<PointT> &cloud, const std::vector<int> &indices)
+  {
+    pcl::PointCloud<PointT> &fine = *clouds[FINE];
+    fine.points.resize(indices.size());
+    for(size_t i = 0; i < indices.size(); ++i)
+    {
+      fine.points[i] = cloud.points[indices[i]];
+    }
+    fine.width = fine.points.size();
+    fine.height = 1;
+    fine.is_dense = false;
+    fine.header = cloud.header;
+    buildLevels();
+  }
+
+  void build(const pcl::PointCloud<PointT> &points)
+  {
+    *clouds[FINE] = points;
+    buildLevels();
+  }
+
+  inline typename pcl::PointCloud<PointT>::ConstPtr cloud(Level level) const
+  {
+    return clouds[level];
+  }
+
+  /**
+   * @brief voxels Point of the next coarser level every point of the level went into, -1 for non finite points
+   */
+  inline const std::vector<int> &voxels(Level level) const
+  {
+    return parents[level];
+  }
+
+  /**
+   * @brief counts Points of FINE every point of the level stands for
+   */
+  inline const std::vector<int> &counts(Level level) const
+  {
+    return weights[level];
+  }
+
+  /**
+   * @brief support Points of FINE the given points of the level stand for
+   */
+  size_t support(const std::vector<int> &points, Level level) const
+  {
+    size_t sum = 0;
+    for(int point : points)
+    {
+      sum += weights[level][point];
+    }
+    return sum;
+  }
+
+  /**
+   * @brief voxel Point of a level a point of FINE went into, -1 if it was not finite
+   */
+  int voxel(int point, Level level) const
+  {
+    for(int l = FINE; l < level && point >= 0; ++l)
+    {
+      point = parents[l][point];
+    }
+    return point;
+  }
+
+private:
+  typename pcl::PointCloud<PointT>::Ptr clouds[LEVELS];
+  std::vector<int> parents[LEVELS], weights[LEVELS];
+
+  void buildLevels()
+  {
+    weights[FINE].assign(clouds[FINE]->points.size(), 1);
+    for(int l = FINE + 1; l < LEVELS; ++l)
+    {
+      VoxelDownsampler<PointT> downsampler(leafSize((Level)l));
+      downsampler.downsample(*clouds[l - 1], weights[l - 1], *clouds[l], parents[l - 1], weights[l]);
+    }
+    parents[LEVELS - 1].assign(clouds[LEVELS - 1]->points.size(), -1);
+  }
+};
+
+}
+
+#endif //__CLUSTER_PYRAMID_H__
@@ -0,0 +1,148 @@
+#ifndef __COLUMN_TABLE_H__
+#define __COLUMN_TABLE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace percepteros
+{
+
+/**
+ * @brief Table of results stored column by column.
+ *
+ * Every column holds doubles, 64 bit integers or strings. A row is added by
+ * setting the cells of the new row, cells left out keep their default (NaN,
+ * 0 or empty), columns may be added at any time and are filled with defaults
+ * for the rows before. The file holds a header, the column names and types,
+ * and then the values of every column in one block: numbers as arrays in
+ * the byte order of the machine, strings as rows + 1 offsets followed by
+ * their characters. Reading one column of a large table only touches its
+ * block. The layout is described in the README of the package, writeCsv
+ * exports a table for tools that do not read it, see also caterrosTable.
+ */
+class ColumnTable
+{
+public:
+  static const uint32_t MAGIC = 0x4c425443;
+  static const uint32_t VERSION = 1;
+
+  enum Type
+  {
+    DOUBLE,
+    INTEGER,
+    STRING
+  };
+
+  ColumnTable();
+
+  /**
+   * @brief column Index of a column, added if it does not exist yet
+   * @return -1 if a column of that name has another type
+   */
+  int column(const std::string &name, Type type);
+
+  /**
+   * @brief find Index of a column, -1 if there is none of that name
+   */
+  int find(const std::string &name) const;
+
+  /**
+   * @brief addRow Appends a row of default values, the set functions fill it
+   */
+  void addRow();
+
+  void set(const std::string &name, double value);
+  void set(const std::string &name, int64_t value);
+  void set(const std::string &name, const std::string &value);
+
+  inline void set(const std::string &name, int value)
+  {
+    set(name, (int64_t)value);
+  }
+
+  inline void set(const std::string &name, const char *value)
+  {
+    set(name, std::string(value));
+  }
+
+  /**
+   * @brief append Adds the rows of another table, matching its columns by name
+   * @return false if a column has different types in both tables
+   */
+  bool append(const ColumnTable &other);
+
+  bool write(const std::string &path);
+  bool read(const std::string &path);
+
+  /**
+   * @brief writeCsv Writes the table as CSV (RFC 4180): a row of column names, then one line per row. NaN
+   * doubles are left empty, doubles are written with enough digits to read them back exactly.
+   */
+  void writeCsv(std::ostream &out) const;
+  bool writeCsv(const std::string &path);
+
+  inline size_t rows() const
+  {
+    return rowCount;
+  }
+
+  inline size_t columns() const
+  {
+    return data.size();
+  }
+
+  inline const std::string &name(size_t column) const
+  {
+    return data[column].name;
+  }
+
+  inline Type type(size_t column) const
+  {
+    return data[column].type;
+  }
+
+  inline const std::vector<double> &doubles(size_t column) const
+  {
+    return data[column].doubles;
+  }
+
+  inline const std::vector<int64_t> &integers(size_t column) const
+  {
+    return data[column].integers;
+  }
+
+  inline const std::vector<std::string> &strings(size_t column) const
+  {
+    return data[column].strings;
+  }
+
+  inline const std::string &getError() const
+  {
+    return error;
+  }
+
+private:
+  struct Column
+  {
+    std::string name;
+    Type type;
+    //only the one of the type is used
+    std::vector<double> doubles;
+    std::vector<int64_t> integers;
+    std::vector<std::string> strings;
+  };
+
+  std::vector<Column> data;
+  size_t rowCount;
+  std::string error;
+
+  void resize(Column &column, size_t rows) const;
+  Column *cell(const std::string &name, Type type);
+};
+
+}
+
+#endif //__COLUMN_TABLE_H__
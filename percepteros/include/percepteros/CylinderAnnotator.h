@@ -18,12 +18,6 @@
 #include <pcl/filters/extract_indices.h>
 #include <pcl/segmentation/extract_clusters.h>
 #include <pcl/features/normal_3d.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/sample_consensus/ransac.h>
-#include <pcl/sample_consensus/sac_model_plane.h>
-#include <pcl/sample_consensus/sac_model_cylinder.h>
-#include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/common/transforms.h>
 #include <pcl/impl/point_types.hpp>
 #include <pcl/PointIndices.h>
@@ -33,6 +27,12 @@
 #include <pcl/visualization/pcl_visualizer.h>
 
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/FrameDeadline.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/Ransac.h>
+#include <percepteros/ClusterPyramid.h>
 
 #include <uima/api.hpp>
 using namespace uima;
@@ -47,6 +47,18 @@ private:
     pcl::PointCloud<PointT>::Ptr cloud_ptr;
     std::vector<pcl::PointIndices> clusterIndices;
     double pointSize = 1;
+
+    percepteros::OverlayBuffer overlay;
+    percepteros::OverlayRenderer renderer;
+
+    percepteros::Ransac ransac;
+
+    typedef percepteros::ClusterPyramid<pcl::PointXYZRGBNormal> Pyramid;
+    //pyramid of the current cluster, the cylinder is fitted on its medium level
+    const Pyramid *pyramid;
+    //image pixels of the current cluster, the full resolution fallback samples around them
+    const std::vector<int> *clusterPixels;
+    int imageWidth;
     //default
     /*
     constexpr static double CYLINDER_NORMAL_WEIGHT = 0.024;
@@ -88,7 +100,7 @@ private:
 
 public:
 
-  CylinderAnnotator(): DrawingAnnotator(__func__){
+  CylinderAnnotator(): DrawingAnnotator(__func__), pyramid(NULL), clusterPixels(NULL), imageWidth(0){
 
   }
 
@@ -101,7 +113,7 @@ public:
   void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun);
 
   int segmentPlane(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_input,
-                   int model_type,
+                   percepteros::Ransac::Model model_type,
                    double distance,
                    pcl::ModelCoefficients::Ptr coefficients,
                    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_remaining,
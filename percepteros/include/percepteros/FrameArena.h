@@ -0,0 +1,132 @@
+#ifndef __FRAME_ARENA_H__
+#define __FRAME_ARENA_H__
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Scratch objects of the current frame, reused in the next ones.
+ *
+ * Annotators get their temporary clouds, indices and coefficients from the
+ * arena instead of allocating new ones. The objects are handed out empty but
+ * keep their capacity, after a few frames their buffers have grown to what a
+ * frame needs and no allocation is left. Point clouds store their points
+ * with Eigen's aligned allocator, like every pcl cloud.
+ *
+ * The engine calls reset before every frame, which makes all objects
+ * available again. An object still referenced outside of the arena, e.g. a
+ * cloud handed to the visualizer, is skipped until it is released. The arena
+ * is kept per thread, every engine of a pool has its own.
+ */
+class FrameArena
+{
+public:
+  /**
+   * @brief get An empty object of type T for the current frame
+   */
+  template<typename T>
+  static boost::shared_ptr<T> get()
+  {
+    Pool<T> &pool = Pool<T>::local();
+    while(pool.next < pool.items.size())
+    {
+      boost::shared_ptr<T> &item = pool.items[pool.next++];
+      if(item.unique())
+      {
+        clear(*item);
+        return item;
+      }
+    }
+    pool.items.push_back(boost::shared_ptr<T>(new T));
+    pool.next = pool.items.size();
+    return pool.items.back();
+  }
+
+  /**
+   * @brief reset Makes every object of the calling thread available again, called before each frame
+   */
+  static void reset();
+
+  /**
+   * @brief size Number of objects the calling thread holds, used or not
+   */
+  static size_t size();
+
+private:
+  struct PoolBase
+  {
+    size_t next = 0;
+    virtual ~PoolBase()
+    {
+    }
+    virtual size_t size() const = 0;
+  };
+
+  template<typename T>
+  struct Pool : public PoolBase
+  {
+    std::vector<boost::shared_ptr<T>> items;
+
+    size_t size() const
+    {
+      return items.size();
+    }
+
+    static Pool &local()
+    {
+      static thread_local Pool pool;
+      static thread_local bool registered = false;
+      if(!registered)
+      {
+        pools().push_back(&pool);
+        registered = true;
+      }
+      return pool;
+    }
+  };
+
+  static std::vector<PoolBase *> &pools();
+
+  template<typename PointT>
+  static void clear(pcl::PointCloud<PointT> &cloud)
+  {
+    //keeps the capacity of the points
+    cloud.points.clear();
+    cloud.width = 0;
+    cloud.height = 0;
+    cloud.is_dense = true;
+    cloud.header = pcl::PCLHeader();
+    cloud.sensor_origin_ = Eigen::Vector4f::Zero();
+    cloud.sensor_orientation_ = Eigen::Quaternionf::Identity();
+  }
+
+  static void clear(pcl::PointIndices &indices)
+  {
+    indices.indices.clear();
+    indices.header = pcl::PCLHeader();
+  }
+
+  static void clear(pcl::ModelCoefficients &coefficients)
+  {
+    coefficients.values.clear();
+    coefficients.header = pcl::PCLHeader();
+  }
+
+  template<typename T>
+  static void clear(std::vector<T> &values)
+  {
+    values.clear();
+  }
+};
+
+}
+
+#endif //__FRAME_ARENA_H__
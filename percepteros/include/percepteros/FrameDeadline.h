@@ -0,0 +1,58 @@
+#ifndef __FRAME_DEADLINE_H__
+#define __FRAME_DEADLINE_H__
+
+namespace percepteros
+{
+
+/**
+ * @brief Time budget of the current frame and of the annotator running in it.
+ *
+ * The analysis engine opens a frame with the pipeline deadline and a stage
+ * with the budget of every annotator it runs. Annotators with long loops or
+ * RANSAC runs poll it (expired, capIterations) and cut their work short,
+ * which marks the frame as degraded. The state is thread local, so every
+ * engine thread has its own. Without an open frame nothing is limited.
+ */
+class FrameDeadline
+{
+public:
+  /**
+   * @brief beginFrame Starts a frame which has to be done within deadlineMs
+   */
+  static void beginFrame(double deadlineMs);
+  static void endFrame();
+
+  /**
+   * @brief beginStage Starts the next annotator
+   * @param budgetMs time the annotator may use, bounded by the frame deadline
+   * @param expectedMs historical latency of a full run, 0 if unknown
+   */
+  static void beginStage(double budgetMs, double expectedMs);
+
+  static bool active();
+
+  /**
+   * @brief expired True if the budget of the current annotator is used up.
+   * Annotators returning early because of it call markDegraded.
+   */
+  static bool expired();
+  static double remainingMs();
+
+  /**
+   * @brief capIterations Scales an iteration count down to what fits into the
+   * budget of the current annotator, never below minIterations
+   */
+  static int capIterations(int iterations, int minIterations = 50);
+
+  static void markDegraded();
+
+  /**
+   * @brief degraded True if results of the current deadline frame are incomplete, false outside of one
+   */
+  static bool degraded();
+  static bool stageDegraded();
+};
+
+}
+
+#endif //__FRAME_DEADLINE_H__
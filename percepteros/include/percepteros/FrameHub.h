@@ -0,0 +1,64 @@
+#ifndef __FRAME_HUB_H__
+#define __FRAME_HUB_H__
+
+#include <cstdint>
+#include <memory>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/CameraInfo.h>
+#include <tf/transform_datatypes.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief One preprocessed camera frame, immutable once published.
+ *
+ * These are all views the pool engines get, views the shared annotators
+ * produce beyond them are not forwarded. Empty images and camera infos
+ * without a size are not set in the CAS.
+ */
+struct SharedSensorFrame
+{
+  uint64_t id;
+  uint64_t timestamp;
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+  pcl::PointCloud<pcl::Normal>::Ptr normals;
+  cv::Mat color, depth, mask;
+  cv::Mat colorHD, depthHD;
+  sensor_msgs::CameraInfo cameraInfo, cameraInfoHD;
+  bool hasViewpoint;
+  tf::StampedTransform viewpoint;
+};
+
+/**
+ * @brief Hands the newest frame from the feeder engine to the engine pool.
+ *
+ * SharedFrameWriter publishes what the shared annotators produced,
+ * SharedFrameReader waits for a frame its engine has not processed yet. Only
+ * the newest frame is kept, a slow engine skips frames instead of queuing
+ * them. Frames are shared, never copied, between the engines.
+ */
+class FrameHub
+{
+public:
+  typedef std::shared_ptr<const SharedSensorFrame> FramePtr;
+
+  /**
+   * @brief publish Makes frame the newest one and assigns its id
+   */
+  static void publish(const std::shared_ptr<SharedSensorFrame> &frame);
+
+  /**
+   * @brief waitNewer Waits for a frame with an id greater than lastId
+   * @param timeoutMs maximum time to wait
+   * @return the newest frame, empty if none arrived in time
+   */
+  static FramePtr waitNewer(uint64_t lastId, double timeoutMs);
+};
+
+}
+
+#endif //__FRAME_HUB_H__
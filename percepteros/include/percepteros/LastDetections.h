@@ -0,0 +1,53 @@
+#ifndef __LAST_DETECTIONS_H__
+#define __LAST_DETECTIONS_H__
+
+#include <percepteros/ObjectDetectionArray.h>
+#include <percepteros/SceneSignature.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Detections of the last complete run of the current pipeline.
+ *
+ * ROSPublisher stores every message it publishes, SceneChangeGate hands it
+ * out again for frames it skips. SceneChangeGate announces the scene of the
+ * running frame with beginScene, it is kept together with the result only
+ * once the result of that frame is stored. The engine invalidates it when the pipeline
+ * changes, so a result is never repeated for a different request. Kept per
+ * thread, every engine of the pool only sees the results of its own pipeline.
+ */
+class LastDetections
+{
+public:
+  static void store(const ObjectDetectionArray &detections);
+
+  /**
+   * @brief beginScene The scene of the running frame, becomes the scene of the stored detections with store
+   */
+  static void beginScene(const SceneSignature &scene);
+
+  /**
+   * @brief get Copies the stored detections
+   * @return false if there are none
+   */
+  static bool get(ObjectDetectionArray &detections);
+
+  /**
+   * @brief get Copies the stored detections and the scene they were found in, which is empty if none was announced
+   * @return false if there are none
+   */
+  static bool get(ObjectDetectionArray &detections, SceneSignature &scene);
+
+  static void invalidate();
+
+  /**
+   * @brief setPipeline Name of the pipeline the thread runs, sent along with its detections
+   */
+  static void setPipeline(const std::string &name);
+  static const std::string &getPipeline();
+};
+
+}
+
+#endif //__LAST_DETECTIONS_H__
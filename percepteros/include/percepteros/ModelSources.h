@@ -0,0 +1,95 @@
+#ifndef __MODEL_SOURCES_H__
+#define __MODEL_SOURCES_H__
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <opencv2/core/core.hpp>
+
+#include <percepteros/TemplateIndex.h>
+#include <percepteros/ClusterColor.h>
+
+namespace percepteros
+{
+
+/**
+ * Readers of the yaml model sources in config, used by caterrosModelCompiler
+ * and by the annotators if there is no compiled ModelStore.
+ */
+
+/**
+ * @brief readTemplates Reads the object templates and the scales of their feature groups
+ * @param error set to the reason if false is returned
+ */
+inline bool readTemplates(const cv::FileStorage &fs, std::vector<ObjectTemplate> &objects, TemplateIndex::Scales &scales,
+                          std::string &error)
+{
+  cv::FileNode scaleNode = fs["scales"];
+  if(!scaleNode.empty())
+  {
+    scaleNode["axis"] >> scales.axis;
+    scaleNode["eigen_values"] >> scales.eigenValues;
+    scaleNode["hue"] >> scales.hue;
+    scaleNode["saturation"] >> scales.saturation;
+    scaleNode["value"] >> scales.value;
+  }
+
+  cv::FileNode templateNodes = fs["templates"];
+  for(cv::FileNodeIterator it = templateNodes.begin(); it != templateNodes.end(); ++it)
+  {
+    std::string name;
+    std::vector<float> axis, eigenValues, hsv, size;
+    ObjectTemplate object;
+    memset(&object, 0, sizeof(object));
+    (*it)["name"] >> name;
+    (*it)["type"] >> object.type;
+    (*it)["axis"] >> axis;
+    (*it)["eigen_values"] >> eigenValues;
+    (*it)["hsv"] >> hsv;
+    (*it)["size"] >> size;
+    if(name.empty() || name.size() >= sizeof(object.name))
+    {
+      error = "template name '" + name + "' is empty or too long";
+      return false;
+    }
+    if(axis.size() != 3 || eigenValues.size() != 3 || hsv.size() != 3 || size.size() != 3)
+    {
+      error = "template " + name + " needs three values for axis, eigen_values, hsv and size";
+      return false;
+    }
+    strncpy(object.name, name.c_str(), sizeof(object.name) - 1);
+    std::copy(axis.begin(), axis.end(), object.axis);
+    std::copy(eigenValues.begin(), eigenValues.end(), object.eigenValues);
+    std::copy(hsv.begin(), hsv.end(), object.hsv);
+    std::copy(size.begin(), size.end(), object.size);
+    objects.push_back(object);
+  }
+  return true;
+}
+
+/**
+ * @brief readColorClasses Reads color classes given as "name minHue maxHue minSaturation maxSaturation minValue maxValue"
+ */
+inline bool readColorClasses(const cv::FileStorage &fs, std::vector<ColorClass> &classes, std::string &error)
+{
+  cv::FileNode classNodes = fs["color_classes"];
+  for(cv::FileNodeIterator it = classNodes.begin(); it != classNodes.end(); ++it)
+  {
+    std::string text;
+    *it >> text;
+    ColorClass colorClass;
+    if(!ColorClass::parse(text, colorClass))
+    {
+      error = "invalid color class: " + text;
+      return false;
+    }
+    classes.push_back(colorClass);
+  }
+  return true;
+}
+
+}
+
+#endif //__MODEL_SOURCES_H__
@@ -0,0 +1,151 @@
+#ifndef __MODEL_STORE_H__
+#define __MODEL_STORE_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace percepteros
+{
+
+/**
+ * Compiled models read by the annotators: object templates with their
+ * search tree, color class tables and similar precomputed data.
+ *
+ * The file holds a header, a table of named sections and the section data,
+ * every section is an array of fixed layout records starting at a 64 byte
+ * boundary. It is mapped read only, the records are used in place without
+ * any parsing, so opening it costs the same however large the catalogue is.
+ * All engines of a process share one mapping (ModelStore::shared) and the
+ * pages are shared with every other process mapping the same file.
+ *
+ * The files are written by caterrosModelCompiler from the yaml sources in
+ * config into the share directory of the package, in the devel space when
+ * building and in the install space when installed. A store with another
+ * version or record size than the code expects, or one older than its yaml
+ * sources, is rejected, the annotators then fall back to the yaml sources.
+ */
+class ModelStore
+{
+public:
+  static const uint32_t MAGIC = 0x4c444f4d;
+  static const uint32_t VERSION = 1;
+
+  ModelStore();
+  ~ModelStore();
+
+  /**
+   * @brief open Maps a store read only
+   * @return false on error or if the file has an incompatible layout, see getError
+   */
+  bool open(const std::string &path);
+
+  void close();
+
+  /**
+   * @brief shared The store of path mapped once for the whole process
+   * @return NULL if it could not be opened, error is set then
+   */
+  static std::shared_ptr<const ModelStore> shared(const std::string &path, std::string &error);
+
+  /**
+   * @brief compiled The store name (like models/percepteros.models) of the package share directory in the first
+   * workspace of CMAKE_PREFIX_PATH having it, mapped with shared
+   * @param sources yaml files the needed sections were compiled from
+   * @return NULL if there is no such store or one of the sources was changed after it was compiled, error is set then
+   */
+  static std::shared_ptr<const ModelStore> compiled(const std::string &name, const std::vector<std::string> &sources,
+                                                    std::string &error);
+
+  /**
+   * @brief section Records of a section
+   * @return NULL if there is no section of that name with records of type T
+   */
+  template<typename T>
+  const T *section(const std::string &name, size_t &count) const
+  {
+    return static_cast<const T *>(find(name, sizeof(T), count));
+  }
+
+  inline const std::string &getPath() const
+  {
+    return path;
+  }
+
+  inline const std::string &getError() const
+  {
+    return error;
+  }
+
+private:
+  friend class ModelStoreWriter;
+
+  struct Header
+  {
+    uint32_t magic, version;
+    uint32_t sections, reserved;
+    uint64_t size;
+  };
+
+  struct Section
+  {
+    char name[48];
+    uint32_t recordSize, reserved;
+    uint64_t offset, count;
+  };
+
+  std::string path, error;
+  int fd;
+  size_t size;
+  const Header *header;
+
+  const void *find(const std::string &name, size_t recordSize, size_t &count) const;
+  bool fail(const std::string &what);
+};
+
+/**
+ * @brief Collects sections and writes them as a store.
+ *
+ * The file is written next to the target and renamed over it, processes
+ * still mapping the old store keep using it until they open it again.
+ */
+class ModelStoreWriter
+{
+public:
+  template<typename T>
+  void add(const std::string &name, const T *records, size_t count)
+  {
+    addSection(name, sizeof(T), records, count);
+  }
+
+  template<typename T>
+  void add(const std::string &name, const std::vector<T> &records)
+  {
+    addSection(name, sizeof(T), records.data(), records.size());
+  }
+
+  bool write(const std::string &path);
+
+  inline const std::string &getError() const
+  {
+    return error;
+  }
+
+private:
+  struct Data
+  {
+    ModelStore::Section section;
+    std::vector<char> bytes;
+  };
+
+  std::vector<Data> sections;
+  std::string error;
+
+  void addSection(const std::string &name, size_t recordSize, const void *records, size_t count);
+};
+
+}
+
+#endif //__MODEL_STORE_H__
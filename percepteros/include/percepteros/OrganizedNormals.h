@@ -0,0 +1,111 @@
+#ifndef __ORGANIZED_NORMALS_H__
+#define __ORGANIZED_NORMALS_H__
+
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Normals of an organized cloud from integral images.
+ *
+ * The points are summed into integral images once, after that the mean (and
+ * for the covariance method the second moments) of any window of the image
+ * costs four lookups, whatever its size. The window grows with the depth of
+ * the point, so far away surfaces are smoothed over a similar metric area as
+ * near ones. A window reaching over a depth discontinuity is shrunk until it
+ * stays on one surface, points without such a window get a NaN normal.
+ *
+ * Building the integral images and estimating the normals are split into
+ * bands of rows (and columns) processed by a number of threads.
+ */
+class OrganizedNormals
+{
+public:
+  enum Method
+  {
+    //normal of the horizontal and vertical mean gradient, fastest
+    AVERAGE_3D_GRADIENT,
+    //smallest eigen vector of the window covariance, also gives the curvature
+    COVARIANCE
+  };
+
+  struct Parameters
+  {
+    Method method = AVERAGE_3D_GRADIENT;
+    //window size in pixels, at 1 m if depthDependent is set
+    float smoothing = 10.0f;
+    bool depthDependent = true;
+    int maxRadius = 20;
+    //largest depth jump inside a window, relative to the depth of the point
+    float maxDepthChange = 0.02f;
+    int threads = 4;
+  };
+
+  OrganizedNormals();
+  explicit OrganizedNormals(const Parameters &parameters);
+
+  template<typename PointT>
+  void compute(const pcl::PointCloud<PointT> &cloud, pcl::PointCloud<pcl::Normal> &normals)
+  {
+    x.resize(cloud.points.size());
+    y.resize(cloud.points.size());
+    z.resize(cloud.points.size());
+    for(size_t i = 0; i < cloud.points.size(); ++i)
+    {
+      x[i] = cloud.points[i].x;
+      y[i] = cloud.points[i].y;
+      z[i] = cloud.points[i].z;
+    }
+    compute(cloud.width, cloud.height, normals);
+  }
+
+  inline const Parameters &getParameters() const
+  {
+    return parameters;
+  }
+
+private:
+  //channels of the integral images
+  enum
+  {
+    COUNT, SX, SY, SZ, SXX, SXY, SXZ, SYY, SYZ, SZZ, CHANNELS
+  };
+
+  Parameters parameters;
+  int width, height, channels;
+  std::vector<float> x, y, z;
+  //(width + 1) x (height + 1) sums per channel, the first row and column are 0
+  std::vector<double> integral;
+
+  void compute(int width, int height, pcl::PointCloud<pcl::Normal> &normals);
+  void integrateRows(int begin, int end);
+  void integrateColumns(int begin, int end);
+  void estimateRows(int begin, int end, pcl::PointCloud<pcl::Normal> &normals) const;
+  bool estimate(int u, int v, int radius, pcl::Normal &normal) const;
+
+  template<typename Function>
+  void parallel(int size, Function function);
+
+  inline const double *channel(int c) const
+  {
+    return integral.data() + (size_t)c * (width + 1) * (height + 1);
+  }
+
+  /**
+   * @brief sum Sum of a channel over the window [u0, u1) x [v0, v1)
+   */
+  inline double sum(int c, int u0, int v0, int u1, int v1) const
+  {
+    const double *data = channel(c);
+    const int stride = width + 1;
+    return data[v1 * stride + u1] - data[v0 * stride + u1] - data[v1 * stride + u0] + data[v0 * stride + u0];
+  }
+};
+
+}
+
+#endif //__ORGANIZED_NORMALS_H__
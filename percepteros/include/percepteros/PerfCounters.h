@@ -0,0 +1,69 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <cstdint>
+
+namespace percepteros
+{
+
+/**
+ * @brief Hardware and software performance counters of the calling thread.
+ *
+ * Uses perf_event_open on Linux. Counters the kernel or the CPU does not
+ * offer (virtual machines, perf_event_paranoid, other platforms) are simply
+ * not available, start and stop are no-ops if none is.
+ */
+class PerfCounters
+{
+public:
+  enum Counter
+  {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    CONTEXT_SWITCHES,
+    COUNT
+  };
+
+  struct Sample
+  {
+    uint64_t values[COUNT];
+    bool valid[COUNT];
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  /**
+   * @brief open Opens the counters for the calling thread, which has to be the one calling start and stop
+   * @return false if no counter is available
+   */
+  bool open();
+
+  void close();
+
+  bool available() const;
+
+  /**
+   * @brief start Resets and enables the counters
+   */
+  void start();
+
+  /**
+   * @brief stop Disables the counters and reads them, scaled up if the kernel multiplexed them
+   */
+  void stop(Sample &sample);
+
+  static const char *name(Counter counter);
+
+private:
+  int fds[COUNT];
+};
+
+}
+
+#endif //__PERF_COUNTERS_H__
@@ -0,0 +1,243 @@
+#ifndef __RANSAC_H__
+#define __RANSAC_H__
+
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief RANSAC segmentation shared by the annotators.
+ *
+ * Hypotheses are drawn and scored in rounds on a number of threads, each with
+ * its own random generator, so the result does not depend on the scheduling.
+ * The threads are started once per segment call and run the rounds in
+ * lockstep, the best model is merged between rounds.
+ * Once a model has been found, the remaining hypotheses are checked with
+ * Wald's sequential probability ratio test: the points are visited in a random
+ * order and a hypothesis is abandoned as soon as its inliers make it unlikely
+ * to beat the best one, which for most of them happens after a few points.
+ * The number of iterations shrinks with the inlier ratio of the best model.
+ *
+ * If the points lie on an image grid (an organized cloud or a cluster given
+ * with its image indices), every other sample is drawn from a window around
+ * its first point, which hits a surface much more often than uniform samples.
+ *
+ * Coefficients follow the pcl sample consensus models: planes [a b c d],
+ * cylinders [point on axis, axis direction, radius] and circles
+ * [center, radius, normal].
+ */
+class Ransac
+{
+public:
+  enum Model
+  {
+    PLANE,
+    //plane whose normal is within epsAngle of the axis
+    PERPENDICULAR_PLANE,
+    //plane containing the direction of the axis, up to epsAngle
+    PARALLEL_PLANE,
+    //needs normals
+    CYLINDER,
+    CIRCLE3D
+  };
+
+  struct Parameters
+  {
+    Model model = PLANE;
+    float distance = 0.01f;
+    //weight of the angle between point and model normal against the distance, needs normals
+    float normalWeight = 0.0f;
+    Eigen::Vector3f axis = Eigen::Vector3f::UnitX();
+    float epsAngle = 0.1f;
+    float minRadius = 0.0f;
+    float maxRadius = std::numeric_limits<float>::max();
+    int maxIterations = 2000;
+    //probability of having drawn a sample of inliers only when stopping early
+    float probability = 0.99f;
+    //refit the model to its inliers
+    bool optimize = true;
+    int threads = 4;
+    //half size in pixels of the window local samples are drawn from, 0 disables them
+    int neighbourhood = 8;
+  };
+
+  Ransac();
+  explicit Ransac(const Parameters &parameters);
+
+  template<typename PointT>
+  void setInputCloud(const pcl::PointCloud<PointT> &cloud)
+  {
+    const size_t size = cloud.points.size();
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+    for(size_t i = 0; i < size; ++i)
+    {
+      x[i] = cloud.points[i].x;
+      y[i] = cloud.points[i].y;
+      z[i] = cloud.points[i].z;
+    }
+    nx.clear();
+    ny.clear();
+    nz.clear();
+    if(cloud.isOrganized())
+    {
+      setGrid(cloud.width);
+    }
+    else if(pixels.size() != size)
+    {
+      clearGrid();
+    }
+  }
+
+  /**
+   * @brief setInputNormals Normals of the input cloud, any point type with normal fields
+   */
+  template<typename NormalT>
+  void setInputNormals(const pcl::PointCloud<NormalT> &normals)
+  {
+    const size_t size = normals.points.size();
+    nx.resize(size);
+    ny.resize(size);
+    nz.resize(size);
+    for(size_t i = 0; i < size; ++i)
+    {
+      nx[i] = normals.points[i].normal_x;
+      ny[i] = normals.points[i].normal_y;
+      nz[i] = normals.points[i].normal_z;
+    }
+  }
+
+  /**
+   * @brief setGrid Places the points of the next input clouds on an image
+   * @param pixels image index of every point, e.g. the indices of a cluster
+   * @param width width of the image
+   *
+   * The grid is kept for following clouds of the same size.
+   */
+  void setGrid(const std::vector<int> &pixels, int width);
+  void clearGrid();
+
+  /**
+   * @brief segment Finds the model with the most inliers
+   * @return false if no valid model was found, inliers and coefficients are empty then
+   */
+  bool segment(std::vector<int> &inliers, std::vector<float> &coefficients);
+
+  inline bool segment(pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients)
+  {
+    return segment(inliers.indices, coefficients.values);
+  }
+
+  /**
+   * @brief refine Selects the inliers of a model in the input cloud and refits the model to them,
+   * used for a model found on a coarser level of the same points
+   * @param minInliers inliers the model needs in the input cloud, e.g. a share of the points the coarse
+   * inliers stand for
+   * @return false if the coefficients do not describe a model of the configured type or the model has
+   * less than minInliers inliers, or none
+   */
+  bool refine(std::vector<int> &inliers, std::vector<float> &coefficients, size_t minInliers = 1);
+
+  inline bool refine(pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients, size_t minInliers = 1)
+  {
+    return refine(inliers.indices, coefficients.values, minInliers);
+  }
+
+  inline Parameters &getParameters()
+  {
+    return parameters;
+  }
+
+  /**
+   * @brief getIterations Hypotheses scored by the last segment call
+   */
+  inline int getIterations() const
+  {
+    return iterations;
+  }
+
+  /**
+   * @brief getRejected Hypotheses of the last segment call abandoned before all points were checked
+   */
+  inline int getRejected() const
+  {
+    return rejected;
+  }
+
+private:
+  struct Hypothesis
+  {
+    //model coefficients, as returned by segment
+    float c[7];
+    int inliers;
+  };
+
+  //inputs of a round of hypotheses, shared by its threads
+  struct Round
+  {
+    int hypotheses;
+    int best;
+    //SPRT decision threshold and likelihood factors, inactive if threshold is infinite
+    double threshold, inlierFactor, outlierFactor;
+  };
+
+  //outputs of a thread in a round
+  struct Scores
+  {
+    Hypothesis best;
+    int evaluated, rejected;
+    //inliers and points checked of the hypotheses which were not the best
+    double badInliers, badPoints;
+  };
+
+  Parameters parameters;
+  std::vector<float> x, y, z, nx, ny, nz;
+  //pixel of every point and (pixel, point) pairs sorted by pixel, empty without a grid
+  std::vector<int> pixels;
+  std::vector<std::pair<int, int>> grid;
+  int gridWidth;
+  //finite points and the order in which hypotheses visit them
+  std::vector<int> valid, order;
+  int iterations, rejected;
+
+  int sampleSize() const;
+  int coefficientCount() const;
+  bool usesNormals() const;
+  void setGrid(int width);
+  bool collectValid();
+  void finish(Hypothesis &best, std::vector<int> &inliers, std::vector<float> &coefficients) const;
+
+  void score(const Round &round, std::minstd_rand &random, Scores &scores) const;
+  bool drawSample(std::minstd_rand &random, bool local, int *sample) const;
+  bool fit(const int *sample, Hypothesis &hypothesis) const;
+  bool refit(const std::vector<int> &inliers, Hypothesis &hypothesis) const;
+  bool satisfiesConstraints(const Hypothesis &hypothesis) const;
+  float distance(const Hypothesis &hypothesis, int i) const;
+  void select(const Hypothesis &hypothesis, std::vector<int> &inliers) const;
+
+  inline Eigen::Vector3f point(int i) const
+  {
+    return Eigen::Vector3f(x[i], y[i], z[i]);
+  }
+
+  inline Eigen::Vector3f normal(int i) const
+  {
+    return Eigen::Vector3f(nx[i], ny[i], nz[i]);
+  }
+};
+
+}
+
+#endif //__RANSAC_H__
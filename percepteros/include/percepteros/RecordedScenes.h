@@ -0,0 +1,58 @@
+#ifndef __RECORDED_SCENES_H__
+#define __RECORDED_SCENES_H__
+
+#include <string>
+#include <vector>
+
+#include <percepteros/FrameHub.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Scenes recorded by SzeneRecorder, read back as frames.
+ *
+ * A scene is <name>.pcd with the optional <name>_depth.png and
+ * <name>_viewpoint.yml next to it, as AsyncSceneWriter writes them. The
+ * color image is taken from the organized cloud, the camera info only
+ * carries the size of the image since it is not recorded.
+ */
+class RecordedScenes
+{
+public:
+  /**
+   * @brief open Lists the scenes of a directory, sorted by name
+   * @return false on error, see getError
+   */
+  bool open(const std::string &directory);
+
+  inline size_t size() const
+  {
+    return names.size();
+  }
+
+  inline const std::string &name(size_t scene) const
+  {
+    return names[scene];
+  }
+
+  /**
+   * @brief load Reads a scene into a new frame
+   * @return false on error, see getError
+   */
+  bool load(size_t scene, SharedSensorFrame &frame);
+
+  inline const std::string &getError() const
+  {
+    return error;
+  }
+
+private:
+  std::string directory;
+  std::vector<std::string> names;
+  std::string error;
+};
+
+}
+
+#endif //__RECORDED_SCENES_H__
@@ -0,0 +1,105 @@
+#ifndef __RESULT_CACHE_H__
+#define __RESULT_CACHE_H__
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <percepteros/ObjectDetectionArray.h>
+#include <percepteros/SceneSignature.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Bounded LRU cache of the latest detections of every pipeline.
+ *
+ * Every entry remembers the scene it was computed for. A lookup only hits if
+ * the pipeline is known and the current scene matches that signature within
+ * the tolerances, otherwise the pipeline has to run.
+ */
+class ResultCache
+{
+public:
+  struct Tolerances
+  {
+    float depthThreshold = 0.02f;
+    float changeRatio = 0.01f;
+    float maxTranslation = 0.01f;
+    float maxRotation = 0.02f;
+  };
+
+  explicit ResultCache(size_t capacity = 8);
+
+  //the index points into entries
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  /**
+   * @brief lookup Finds the detections of pipeline for the given scene
+   * @return false on a miss
+   */
+  bool lookup(const std::string &pipeline, const SceneSignature &scene, ObjectDetectionArray &detections);
+
+  /**
+   * @brief insert Stores the detections of pipeline, replacing older ones of the same pipeline
+   */
+  void insert(const std::string &pipeline, const SceneSignature &scene, const ObjectDetectionArray &detections);
+
+  void clear();
+
+  /**
+   * @brief setCapacity Changes the number of pipelines kept, evicts the least recently used ones
+   */
+  void setCapacity(size_t capacity);
+
+  inline void setTolerances(const Tolerances &tolerances)
+  {
+    this->tolerances = tolerances;
+  }
+
+  inline size_t size() const
+  {
+    return entries.size();
+  }
+
+  inline size_t getCapacity() const
+  {
+    return capacity;
+  }
+
+  inline size_t getHits() const
+  {
+    return hits;
+  }
+
+  inline size_t getMisses() const
+  {
+    return misses;
+  }
+
+  inline size_t getEvictions() const
+  {
+    return evictions;
+  }
+
+private:
+  struct Entry
+  {
+    std::string pipeline;
+    SceneSignature scene;
+    ObjectDetectionArray detections;
+  };
+
+  size_t capacity;
+  Tolerances tolerances;
+  size_t hits, misses, evictions;
+
+  //most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+}
+
+#endif //__RESULT_CACHE_H__
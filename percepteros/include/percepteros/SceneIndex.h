@@ -0,0 +1,245 @@
+#ifndef __SCENE_INDEX_H__
+#define __SCENE_INDEX_H__
+
+#include <rs/scene_cas.h>
+#include <rs/types/all_types.h>
+#include <percepteros/types/all_types.h>
+
+#include <map>
+#include <memory>
+#include <typeindex>
+#include <vector>
+
+namespace percepteros
+{
+
+/**
+ * @brief Clusters of the current scene and their annotations, by type.
+ *
+ * Filtering the identifiables and the annotations of every cluster walks the
+ * CAS and wraps each feature structure, which every annotator did again for
+ * the same frame. The index does it once per type and keeps the results:
+ * annotations of a type are scanned on their first lookup, annotations and
+ * clusters appended through the index are added to it directly.
+ *
+ * SceneIndex::of rebuilds the index on a new frame (the timestamp changed or
+ * the engine called reset) and otherwise trusts it, the percepteros
+ * annotators append through the index. RS annotators write to the CAS
+ * directly, so annotators reading clusters or RS annotations that may have
+ * been added since the index was built use SceneIndex::refresh instead. It
+ * also compares the cluster and annotation counts, which walks the lists of
+ * the CAS: clusters appended by other annotators rebuild the cluster list,
+ * clusters whose annotation count changed are scanned again. Kept per thread,
+ * like the scene of every engine of a pool.
+ *
+ * Data annotators derive from a cluster can be stored in the index as well,
+ * so the next annotators of the frame reuse it. It is dropped on a rebuild.
+ */
+class SceneIndex
+{
+public:
+  template<typename T>
+  struct Entry
+  {
+    size_t cluster;
+    T annotation;
+  };
+
+  /**
+   * @brief of The index of the scene, rebuilt for a new frame
+   */
+  static SceneIndex &of(rs::Scene &scene);
+
+  /**
+   * @brief refresh The index of the scene, with what other annotators added to the CAS
+   */
+  static SceneIndex &refresh(rs::Scene &scene);
+
+  /**
+   * @brief reset Drops the index of the calling thread, called before each frame
+   */
+  static void reset();
+
+  const std::vector<rs::Cluster> &clusters() const
+  {
+    return clusters_;
+  }
+
+  rs::Cluster &cluster(size_t index)
+  {
+    return clusters_[index];
+  }
+
+  /**
+   * @brief annotations Annotations of type T of one cluster
+   */
+  template<typename T>
+  const std::vector<T> &annotations(size_t cluster)
+  {
+    return typeIndex<T>().byCluster[cluster];
+  }
+
+  /**
+   * @brief annotations Annotations of type T of all clusters
+   */
+  template<typename T>
+  const std::vector<Entry<T>> &annotations()
+  {
+    TypeIndex<T> &index = typeIndex<T>();
+    if(!index.entriesValid)
+    {
+      index.entries.clear();
+      for(size_t i = 0; i < index.byCluster.size(); ++i)
+      {
+        for(const T &annotation : index.byCluster[i])
+        {
+          index.entries.push_back(Entry<T>{i, annotation});
+        }
+      }
+      index.entriesValid = true;
+    }
+    return index.entries;
+  }
+
+  /**
+   * @brief recognized Clusters with a RecognitionObject of the given type
+   */
+  const std::vector<size_t> &recognized(int type);
+
+  /**
+   * @brief append Appends an annotation to a cluster of the scene and the index
+   */
+  template<typename T>
+  void append(size_t cluster, T &annotation)
+  {
+    clusters_[cluster].annotations.append(annotation);
+    ++annotationCounts_[cluster];
+
+    auto it = types_.find(std::type_index(typeid(T)));
+    if(it == types_.end())
+    {
+      //scanned from the scene once it is looked up
+      return;
+    }
+    TypeIndex<T> &index = static_cast<TypeIndex<T> &>(*it->second);
+    index.byCluster[cluster].push_back(annotation);
+    if(index.entriesValid)
+    {
+      index.entries.push_back(Entry<T>{cluster, annotation});
+    }
+    appended(cluster, annotation);
+  }
+
+  /**
+   * @brief appendCluster Appends a cluster to the scene and the index
+   * @return index of the cluster
+   */
+  size_t appendCluster(rs::Scene &scene, rs::Cluster &cluster);
+
+  /**
+   * @brief derived Data of type T derived from a cluster, e.g. its downsampled
+   * points, shared by the annotators of a frame and dropped with the index
+   * @param created set if the entry was created empty by this call
+   */
+  template<typename T>
+  T &derived(size_t cluster, bool &created)
+  {
+    std::unique_ptr<DerivedBase> &entry = derived_[std::type_index(typeid(T))];
+    if(!entry)
+    {
+      entry.reset(new Derived<T>());
+    }
+    std::vector<std::unique_ptr<T>> &byCluster = static_cast<Derived<T> &>(*entry).byCluster;
+    if(cluster >= byCluster.size())
+    {
+      byCluster.resize(cluster + 1);
+    }
+    created = !byCluster[cluster];
+    if(created)
+    {
+      byCluster[cluster].reset(new T());
+    }
+    return *byCluster[cluster];
+  }
+
+private:
+  struct TypeIndexBase
+  {
+    virtual ~TypeIndexBase()
+    {
+    }
+    virtual void scan(size_t index, rs::Cluster &cluster) = 0;
+  };
+
+  template<typename T>
+  struct TypeIndex : public TypeIndexBase
+  {
+    std::vector<std::vector<T>> byCluster;
+    std::vector<Entry<T>> entries;
+    bool entriesValid = false;
+
+    void scan(size_t index, rs::Cluster &cluster)
+    {
+      if(index >= byCluster.size())
+      {
+        byCluster.resize(index + 1);
+      }
+      byCluster[index].clear();
+      cluster.annotations.filter(byCluster[index]);
+      entriesValid = false;
+    }
+  };
+
+  struct DerivedBase
+  {
+    virtual ~DerivedBase()
+    {
+    }
+  };
+
+  template<typename T>
+  struct Derived : public DerivedBase
+  {
+    std::vector<std::unique_ptr<T>> byCluster;
+  };
+
+  bool valid_ = false;
+  uint64_t timestamp_ = 0;
+  size_t identifiableCount_ = 0;
+  std::vector<rs::Cluster> clusters_;
+  std::vector<size_t> annotationCounts_;
+  std::map<std::type_index, std::unique_ptr<TypeIndexBase>> types_;
+  std::map<int, std::vector<size_t>> recognized_;
+  bool recognizedValid_ = false;
+  std::map<std::type_index, std::unique_ptr<DerivedBase>> derived_;
+
+  void rebuild(rs::Scene &scene);
+  void scan(size_t index);
+
+  template<typename T>
+  TypeIndex<T> &typeIndex()
+  {
+    std::unique_ptr<TypeIndexBase> &entry = types_[std::type_index(typeid(T))];
+    if(!entry)
+    {
+      entry.reset(new TypeIndex<T>());
+      for(size_t i = 0; i < clusters_.size(); ++i)
+      {
+        entry->scan(i, clusters_[i]);
+      }
+    }
+    return static_cast<TypeIndex<T> &>(*entry);
+  }
+
+  template<typename T>
+  void appended(size_t, T &)
+  {
+  }
+
+  void appended(size_t cluster, RecognitionObject &object);
+  void addRecognized(size_t cluster, int type);
+};
+
+}
+
+#endif //__SCENE_INDEX_H__
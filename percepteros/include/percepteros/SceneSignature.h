@@ -0,0 +1,51 @@
+#ifndef __SCENE_SIGNATURE_H__
+#define __SCENE_SIGNATURE_H__
+
+#include <opencv2/core/core.hpp>
+#include <tf/transform_datatypes.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Compact description of a scene: the mean depth of gridStep x gridStep
+ * blocks of the depth image and the camera pose.
+ *
+ * Two signatures are compared with tolerances instead of an exact hash, so
+ * sensor noise on a static scene does not make it look different.
+ */
+struct SceneSignature
+{
+  //block size of SceneChangeGate and the engines, signatures of different block sizes never match
+  static const int GRID_STEP = 8;
+
+  //block means in meters, 0 for blocks without enough measurements
+  cv::Mat grid;
+  bool hasViewpoint = false;
+  tf::Transform viewpoint;
+
+  inline bool empty() const
+  {
+    return grid.empty();
+  }
+
+  /**
+   * @brief compute Fills the signature from a frame
+   * @param depth CV_16UC1 in millimeters or CV_32FC1 in meters
+   * @param gridStep block size in pixels
+   * @param viewpoint camera pose, NULL if the frame has none
+   */
+  void compute(const cv::Mat &depth, int gridStep, const tf::Transform *viewpoint);
+
+  /**
+   * @brief depthChanged True if more than changeRatio of the blocks differ by
+   * more than depthThreshold or lost or gained their measurement
+   */
+  bool depthChanged(const SceneSignature &other, float depthThreshold, float changeRatio) const;
+
+  bool cameraMoved(const SceneSignature &other, float maxTranslation, float maxRotation) const;
+};
+
+}
+
+#endif //__SCENE_SIGNATURE_H__
@@ -0,0 +1,153 @@
+#ifndef __SHARED_DETECTION_RING_H__
+#define __SHARED_DETECTION_RING_H__
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace percepteros
+{
+
+/**
+ * Layout of the shared memory channel between caterrosRun and local
+ * consumers. The segment holds a header followed by a ring of slots, every
+ * slot contains one frame: a slot header, maxDetections detection records and
+ * maxPoints cluster points. All records have a fixed layout, so readers copy
+ * them out without any deserialization.
+ *
+ * There is exactly one writer. Every slot is guarded by a sequence counter
+ * which is odd while the writer fills the slot (seqlock), readers retry if
+ * the counter changed while they copied.
+ */
+struct SharedDetection
+{
+  char name[64];
+  int32_t type;
+  float width, height, depth;
+  double position[3];
+  //x, y, z, w
+  double orientation[4];
+  //slice of the slot points belonging to the cluster of this detection
+  uint32_t pointOffset, pointCount;
+};
+
+struct SharedPoint
+{
+  float x, y, z;
+  uint32_t rgba;
+};
+
+struct SharedFrame
+{
+  uint64_t frame;
+  //nanoseconds
+  uint64_t stamp;
+  std::string frameId;
+  uint32_t flags;
+  std::vector<SharedDetection> detections;
+  std::vector<SharedPoint> points;
+};
+
+class SharedDetectionRing
+{
+public:
+  static const uint32_t MAGIC = 0x50455244;
+  static const uint32_t VERSION = 1;
+  static const uint32_t FLAG_DEGRADED = 1;
+
+  SharedDetectionRing();
+  ~SharedDetectionRing();
+
+  /**
+   * @brief create Creates (or replaces) the segment, the caller becomes the writer
+   * @param name POSIX shared memory name, e.g. /percepteros_detections
+   * @return false on error, see getError
+   */
+  bool create(const std::string &name, uint32_t slots, uint32_t maxDetections, uint32_t maxPoints);
+
+  /**
+   * @brief open Maps an existing segment read only
+   * @return false on error or if the segment has an incompatible layout
+   */
+  bool open(const std::string &name);
+
+  void close();
+
+  /**
+   * @brief beginFrame Starts writing the next slot, readers skip it until commitFrame
+   */
+  void beginFrame(uint64_t stamp, const std::string &frameId, uint32_t flags);
+
+  /**
+   * @brief addPoints Appends cluster points to the current frame
+   * @return offset of the first point, the slice is cut to the free space
+   */
+  uint32_t addPoints(const SharedPoint *points, uint32_t &count);
+
+  /**
+   * @brief addDetection Appends a detection to the current frame
+   * @return false if the slot is full
+   */
+  bool addDetection(const SharedDetection &detection);
+
+  void commitFrame();
+
+  /**
+   * @brief read Copies the newest frame if it was not read before
+   * @return false if there is no new frame
+   */
+  bool read(SharedFrame &frame);
+
+  inline uint64_t getFrames() const
+  {
+    return header ? header->frames.load(std::memory_order_acquire) : 0;
+  }
+
+  inline const std::string &getError() const
+  {
+    return error;
+  }
+
+private:
+  struct Header
+  {
+    uint32_t magic, version;
+    uint32_t slots, maxDetections, maxPoints, reserved;
+    uint64_t slotSize;
+    //number of committed frames
+    std::atomic<uint64_t> frames;
+  };
+
+  struct SlotHeader
+  {
+    std::atomic<uint64_t> seq;
+    uint64_t frame, stamp;
+    char frameId[64];
+    uint32_t detections, points, flags, reserved;
+  };
+
+  std::string name, error;
+  bool owner;
+  int fd;
+  size_t size;
+  Header *header;
+  uint64_t lastRead;
+
+  //slot currently written
+  SlotHeader *current;
+  uint64_t currentFrame;
+
+  static size_t headerSize();
+  static size_t slotSize(uint32_t maxDetections, uint32_t maxPoints);
+
+  SlotHeader *slot(uint64_t frame) const;
+  SharedDetection *detections(SlotHeader *slot) const;
+  SharedPoint *points(SlotHeader *slot) const;
+  bool fail(const std::string &what);
+};
+
+}
+
+#endif //__SHARED_DETECTION_RING_H__
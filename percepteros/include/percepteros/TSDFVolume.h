@@ -0,0 +1,128 @@
+#ifndef __TSDF_VOLUME_H__
+#define __TSDF_VOLUME_H__
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <opencv2/core/core.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Sparse, block hashed truncated signed distance volume.
+ *
+ * Space is divided into blocks of BLOCK_SIZE^3 voxels which are only allocated
+ * close to observed surfaces. Voxel data inside a block is stored as separate
+ * arrays (tsdf, weight, color), so the integration of one block row is a plain
+ * loop over contiguous memory the compiler can vectorize.
+ *
+ * The number of blocks is bounded by maxBlocks. All blocks are allocated up
+ * front, blocks which have not been observed for the longest time are recycled
+ * once the pool runs empty. This keeps memory and per frame cost bounded while
+ * the robot moves around.
+ */
+class TSDFVolume
+{
+public:
+  //blocks are a power of two wide, voxel coordinates are shifted to get the block
+  static const int BLOCK_SHIFT = 3;
+  static const int BLOCK_SIZE = 1 << BLOCK_SHIFT;
+  static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+  struct Intrinsics
+  {
+    float fx, fy, cx, cy;
+    int width, height;
+  };
+
+  TSDFVolume(float voxelSize, float truncation, float maxWeight, size_t maxBlocks, int threads);
+
+  /**
+   * @brief integrate Fuses a depth image into the volume
+   * @param depth depth image, either CV_16UC1 in millimeters or CV_32FC1 in meters
+   * @param colors organized cloud with the same size as depth, used for coloring (may be empty)
+   * @param intrinsics pinhole parameters of the depth camera
+   * @param camToWorld pose of the camera in the volume frame
+   * @param maxDepth measurements further away are ignored
+   */
+  void integrate(const cv::Mat &depth, const pcl::PointCloud<pcl::PointXYZRGBA> &colors,
+                 const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld, float maxDepth);
+
+  /**
+   * @brief raycast Renders the zero crossing of the volume into an organized cloud
+   * @param intrinsics pinhole parameters of the virtual camera
+   * @param camToWorld pose of the virtual camera in the volume frame
+   * @param maxDepth rays are marched until this distance
+   * @param cloud the resulting cloud in camera coordinates, NaN where no surface was hit
+   */
+  void raycast(const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld, float maxDepth,
+               pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const;
+
+  void reset();
+
+  inline size_t getNumberOfBlocks() const
+  {
+    return blockMap.size();
+  }
+
+  inline size_t getMaxBlocks() const
+  {
+    return blocks.size();
+  }
+
+private:
+  struct Block
+  {
+    float tsdf[BLOCK_VOXELS];
+    float weight[BLOCK_VOXELS];
+    uint8_t r[BLOCK_VOXELS], g[BLOCK_VOXELS], b[BLOCK_VOXELS];
+    Eigen::Vector3i coords;
+    uint64_t lastSeen;
+  };
+
+  float voxelSize, truncation, maxWeight;
+  int threads;
+  uint64_t frame;
+
+  std::vector<Block> blocks;
+  std::vector<size_t> freeBlocks;
+  std::unordered_map<uint64_t, size_t> blockMap;
+
+  //blocks touched by the current frame, reused between frames
+  std::vector<size_t> visibleBlocks;
+
+  static inline uint64_t key(const Eigen::Vector3i &c)
+  {
+    //21 bits per axis, offset to keep negative coordinates positive
+    return ((uint64_t)(c.x() + (1 << 20)) << 42) | ((uint64_t)(c.y() + (1 << 20)) << 21) | (uint64_t)(c.z() + (1 << 20));
+  }
+
+  inline Eigen::Vector3i blockCoords(const Eigen::Vector3f &p) const
+  {
+    const float blockLength = voxelSize * BLOCK_SIZE;
+    return Eigen::Vector3i((int)std::floor(p.x() / blockLength),
+                           (int)std::floor(p.y() / blockLength),
+                           (int)std::floor(p.z() / blockLength));
+  }
+
+  void allocateBlocks(const cv::Mat &depth, const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld, float maxDepth);
+  size_t acquireBlock(const Eigen::Vector3i &coords);
+  void integrateBlock(Block &block, const cv::Mat &depth, const pcl::PointCloud<pcl::PointXYZRGBA> &colors,
+                      const Intrinsics &intrinsics, const Eigen::Affine3f &worldToCam, float maxDepth);
+  void raycastRows(int rowBegin, int rowEnd, const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld,
+                   float maxDepth, pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const;
+  const Block *findBlock(const Eigen::Vector3i &coords) const;
+  bool sample(const Eigen::Vector3f &p, float &tsdf, const Block *&cached, Eigen::Vector3i &cachedCoords, int &voxel) const;
+};
+
+}
+
+#endif //__TSDF_VOLUME_H__
@@ -0,0 +1,136 @@
+#ifndef __TEMPLATE_INDEX_H__
+#define __TEMPLATE_INDEX_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <percepteros/ModelStore.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Shape and color of a known object, compared against the clusters of a scene.
+ * Fixed layout, stored as is in a ModelStore.
+ */
+struct ObjectTemplate
+{
+  char name[64];
+  int32_t type;
+  //main axis and eigen values of the point PCA
+  float axis[3];
+  float eigenValues[3];
+  //hue in degrees, saturation and value in [0, 1]
+  float hsv[3];
+  //size published with the RecognitionObject
+  float size[3];
+};
+
+/**
+ * @brief Nearest template lookup for the feature vectors of clusters.
+ *
+ * Every template is turned into a descriptor whose feature groups (axis,
+ * eigen values, hue, saturation, value) are divided by their scale, so a
+ * distance of 1 means the same in every group. The hue is placed on a
+ * circle, 359 and 1 degrees are neighbours. The descriptors are kept in a
+ * kd-tree built once, a cluster costs one nearest neighbour query however
+ * many templates there are.
+ *
+ * The templates, descriptors and tree can be saved to a ModelStore and used
+ * from the mapped store directly instead of building them at startup.
+ */
+class TemplateIndex
+{
+public:
+  enum
+  {
+    DIMENSIONS = 10
+  };
+  typedef Eigen::Matrix<float, DIMENSIONS, 1> Descriptor;
+
+  /**
+   * @brief Divisors of the feature groups, a template matches within distance 1 in every group
+   */
+  struct Scales
+  {
+    float axis = 1;
+    float eigenValues = 1;
+    float hue = 1;
+    float saturation = 1;
+    float value = 1;
+  };
+
+  TemplateIndex();
+  TemplateIndex(const TemplateIndex &) = delete;
+  TemplateIndex &operator=(const TemplateIndex &) = delete;
+
+  void build(const std::vector<ObjectTemplate> &templates, const Scales &scales);
+
+  /**
+   * @brief save Adds the templates, scales and tree as sections of a store
+   */
+  void save(ModelStoreWriter &writer) const;
+
+  /**
+   * @brief attach Uses the templates and tree of a store in place
+   * @return false if the store has no templates
+   */
+  bool attach(const std::shared_ptr<const ModelStore> &store);
+
+  Descriptor describe(const Eigen::Vector3f &axis, const Eigen::Vector3f &eigenValues, const Eigen::Vector3f &hsv) const;
+
+  /**
+   * @brief nearest The template closest to the descriptor
+   * @param radius rejection radius in scaled units
+   * @param distance set to the distance of the template if one is found
+   * @return index of the template for at(), -1 if none is within radius
+   */
+  int nearest(const Descriptor &descriptor, float radius, float *distance = NULL) const;
+
+  const ObjectTemplate &at(size_t index) const
+  {
+    return templates_[index];
+  }
+
+  size_t size() const
+  {
+    return size_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+private:
+  struct Node
+  {
+    //template of the node, split dimension and the children, -1 if there is none
+    int item;
+    int dimension;
+    int left, right;
+  };
+
+  //point into the vectors if built here, into the store if attached
+  const ObjectTemplate *templates_;
+  const Descriptor *descriptors_;
+  const Node *nodes_;
+  size_t size_;
+  Scales scales_;
+
+  std::vector<ObjectTemplate> ownTemplates_;
+  std::vector<Descriptor> ownDescriptors_;
+  std::vector<Node> ownNodes_;
+  std::shared_ptr<const ModelStore> store_;
+
+  int buildNode(std::vector<int> &items, size_t begin, size_t end);
+  void search(int node, const Descriptor &descriptor, int &best, float &bestDistance) const;
+};
+
+}
+
+#endif //__TEMPLATE_INDEX_H__
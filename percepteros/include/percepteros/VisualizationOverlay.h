@@ -0,0 +1,262 @@
+#ifndef __VISUALIZATION_OVERLAY_H__
+#define __VISUALIZATION_OVERLAY_H__
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/visualization/pcl_visualizer.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief What an annotator wants to show for one frame.
+ *
+ * The cloud is an immutable snapshot of the frame, the annotator must not
+ * touch it after publishing (see detachCloud). Results are only described
+ * (index lists with a colour, cones, text), the visualizer thread composes
+ * them when it draws.
+ */
+struct VisualizationOverlay
+{
+  typedef pcl::PointXYZRGBA PointT;
+
+  struct Highlight
+  {
+    std::vector<int> indices;
+    uint32_t rgba;
+  };
+
+  struct Cone
+  {
+    std::string id;
+    pcl::ModelCoefficients coefficients;
+    double r, g, b;
+  };
+
+  struct Text
+  {
+    std::string id, text;
+    pcl::PointXYZ position;
+    double scale;
+  };
+
+  pcl::PointCloud<PointT>::ConstPtr cloud;
+  std::vector<Highlight> highlights;
+  std::vector<Cone> cones;
+  std::vector<Text> texts;
+
+  void clear()
+  {
+    cloud.reset();
+    highlights.clear();
+    cones.clear();
+    texts.clear();
+  }
+
+  void addHighlight(const std::vector<int> &indices, uint32_t rgba)
+  {
+    highlights.push_back(Highlight());
+    highlights.back().indices = indices;
+    highlights.back().rgba = rgba;
+  }
+
+  void addCone(const std::string &id, const pcl::ModelCoefficients &coefficients, double r, double g, double b)
+  {
+    Cone cone;
+    cone.id = id;
+    cone.coefficients = coefficients;
+    cone.r = r;
+    cone.g = g;
+    cone.b = b;
+    cones.push_back(cone);
+  }
+
+  void addText(const std::string &id, const std::string &text, const pcl::PointXYZ &position, double scale)
+  {
+    Text t;
+    t.id = id;
+    t.text = text;
+    t.position = position;
+    t.scale = scale;
+    texts.push_back(t);
+  }
+};
+
+/**
+ * @brief Hands overlays from the processing thread to the visualizer thread.
+ *
+ * Triple buffer: the writer fills back() and publishes it, the reader picks up
+ * the newest published overlay with update(). Neither side ever waits for the
+ * other, a slow visualizer only skips frames.
+ *
+ * Until a visualizer has asked for an overlay the frame cloud is dropped on
+ * publish, so the annotator keeps the only reference to it and detachCloud
+ * reuses it instead of allocating a new one every frame.
+ */
+class OverlayBuffer
+{
+public:
+  OverlayBuffer() : middle(1), attached(false), backIndex(0), frontIndex(2)
+  {
+  }
+
+  /**
+   * @brief back The overlay owned by the writer, cleared for the next frame
+   */
+  VisualizationOverlay &back()
+  {
+    return buffers[backIndex];
+  }
+
+  void publish()
+  {
+    if(!attached.load(std::memory_order_relaxed))
+    {
+      buffers[backIndex].cloud.reset();
+    }
+    const int old = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+    backIndex = old & INDEX;
+    buffers[backIndex].clear();
+  }
+
+  /**
+   * @brief update Switches to the newest published overlay
+   * @return false if nothing was published since the last call
+   */
+  bool update()
+  {
+    attached.store(true, std::memory_order_relaxed);
+    if(!(middle.load(std::memory_order_acquire) & FRESH))
+    {
+      return false;
+    }
+    const int old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+    frontIndex = old & INDEX;
+    return true;
+  }
+
+  const VisualizationOverlay &front() const
+  {
+    return buffers[frontIndex];
+  }
+
+private:
+  static const int INDEX = 3;
+  static const int FRESH = 4;
+
+  VisualizationOverlay buffers[3];
+  std::atomic<int> middle;
+  //set once a visualizer reads the overlays
+  std::atomic<bool> attached;
+  int backIndex, frontIndex;
+};
+
+/**
+ * @brief Draws the overlays of one annotator, runs in the visualizer thread.
+ *
+ * The snapshot is shown as it is, highlighted points are drawn as a second,
+ * small cloud on top, so the frame cloud is never copied or recoloured.
+ */
+class OverlayRenderer
+{
+public:
+  typedef VisualizationOverlay::PointT PointT;
+
+  OverlayRenderer() : highlightCloud(new pcl::PointCloud<PointT>)
+  {
+  }
+
+  void render(OverlayBuffer &buffer, pcl::visualization::PCLVisualizer &visualizer,
+              const std::string &cloudname, double &pointSize, const bool firstRun)
+  {
+    //nothing new and the visualizer still shows the last overlay
+    if(!buffer.update() && !firstRun)
+    {
+      return;
+    }
+    const VisualizationOverlay &overlay = buffer.front();
+    if(!overlay.cloud)
+    {
+      return;
+    }
+
+    if(firstRun || !visualizer.updatePointCloud(overlay.cloud, cloudname))
+    {
+      visualizer.addPointCloud(overlay.cloud, cloudname);
+      visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
+    }
+    else
+    {
+      visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
+    }
+
+    highlightCloud->points.clear();
+    for(const VisualizationOverlay::Highlight &highlight : overlay.highlights)
+    {
+      for(int index : highlight.indices)
+      {
+        if(index < 0 || index >= (int)overlay.cloud->points.size())
+        {
+          continue;
+        }
+        PointT p = overlay.cloud->points[index];
+        p.rgba = highlight.rgba;
+        highlightCloud->points.push_back(p);
+      }
+    }
+    highlightCloud->width = highlightCloud->points.size();
+    highlightCloud->height = 1;
+
+    const std::string highlightName = cloudname + "_highlights";
+    if(firstRun || !visualizer.updatePointCloud(highlightCloud, highlightName))
+    {
+      visualizer.addPointCloud(highlightCloud, highlightName);
+    }
+    visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize + 2, highlightName);
+
+    for(const std::string &id : shapes)
+    {
+      visualizer.removeShape(id);
+    }
+    shapes.clear();
+    for(const VisualizationOverlay::Cone &cone : overlay.cones)
+    {
+      visualizer.addCone(cone.coefficients, cone.id);
+      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, cone.r, cone.g, cone.b, cone.id);
+      shapes.push_back(cone.id);
+    }
+    for(const VisualizationOverlay::Text &text : overlay.texts)
+    {
+      visualizer.addText3D(text.text, text.position, text.scale, 1.0, 1.0, 1.0, text.id);
+      shapes.push_back(text.id);
+    }
+  }
+
+private:
+  pcl::PointCloud<PointT>::Ptr highlightCloud;
+  std::vector<std::string> shapes;
+};
+
+/**
+ * @brief detachCloud Gives the annotator a cloud it may write to. A cloud still
+ * referenced by a published overlay is left to the overlay and replaced, which
+ * only happens while a visualizer is attached.
+ */
+template<typename PointT>
+inline void detachCloud(typename pcl::PointCloud<PointT>::Ptr &cloud)
+{
+  if(!cloud || !cloud.unique())
+  {
+    cloud.reset(new pcl::PointCloud<PointT>);
+  }
+}
+
+}
+
+#endif //__VISUALIZATION_OVERLAY_H__
@@ -0,0 +1,121 @@
+#ifndef __VOXEL_CHANGE_DETECTOR_H__
+#define __VOXEL_CHANGE_DETECTOR_H__
+
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace percepteros
+{
+
+/**
+ * @brief Finds points of a cloud which lie in voxels that are empty in a reference cloud.
+ *
+ * Gives the same result as pcl::octree::OctreePointCloudChangeDetector::getPointIndicesFromNewVoxels,
+ * but the occupied voxels of the reference are kept in a hash set. Setting a
+ * reference costs one pass over its points, every detect call one pass over
+ * the compared cloud, nothing is rebuilt in between.
+ */
+template<typename PointT>
+class VoxelChangeDetector
+{
+public:
+  VoxelChangeDetector(float resolution, size_t minPointsPerVoxel) :
+    resolution(resolution), minPointsPerVoxel(minPointsPerVoxel)
+  {
+  }
+
+  /**
+   * @brief setReference Replaces the set of occupied voxels
+   * @param cloud the cloud before the change
+   */
+  void setReference(const pcl::PointCloud<PointT> &cloud)
+  {
+    occupied.clear();
+    occupied.reserve(cloud.points.size() / 16);
+    for(size_t i = 0; i < cloud.points.size(); ++i)
+    {
+      uint64_t k;
+      if(key(cloud.points[i], k))
+      {
+        occupied.insert(k);
+      }
+    }
+  }
+
+  /**
+   * @brief detect Collects all points of the cloud which lie in voxels not occupied by the reference
+   * @param cloud the cloud after the change
+   * @param indices sorted indices of the changed points
+   */
+  void detect(const pcl::PointCloud<PointT> &cloud, std::vector<int> &indices)
+  {
+    indices.clear();
+    candidates.clear();
+    for(size_t i = 0; i < cloud.points.size(); ++i)
+    {
+      uint64_t k;
+      if(key(cloud.points[i], k) && occupied.find(k) == occupied.end())
+      {
+        candidates.push_back(std::make_pair(k, (int)i));
+      }
+    }
+
+    //group the candidates by voxel, small groups are noise
+    std::sort(candidates.begin(), candidates.end());
+    for(size_t begin = 0; begin < candidates.size();)
+    {
+      size_t end = begin + 1;
+      while(end < candidates.size() && candidates[end].first == candidates[begin].first)
+      {
+        ++end;
+      }
+      if(end - begin >= minPointsPerVoxel)
+      {
+        for(size_t i = begin; i < end; ++i)
+        {
+          indices.push_back(candidates[i].second);
+        }
+      }
+      begin = end;
+    }
+    std::sort(indices.begin(), indices.end());
+  }
+
+  inline size_t getNumberOfOccupiedVoxels() const
+  {
+    return occupied.size();
+  }
+
+private:
+  float resolution;
+  size_t minPointsPerVoxel;
+
+  std::unordered_set<uint64_t> occupied;
+  //reused between calls
+  std::vector<std::pair<uint64_t, int> > candidates;
+
+  inline bool key(const PointT &p, uint64_t &k) const
+  {
+    if(!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+    {
+      return false;
+    }
+    //21 bits per axis, offset to keep negative coordinates positive
+    const int64_t x = (int64_t)std::floor(p.x / resolution) + (1 << 20);
+    const int64_t y = (int64_t)std::floor(p.y / resolution) + (1 << 20);
+    const int64_t z = (int64_t)std::floor(p.z / resolution) + (1 << 20);
+    k = ((uint64_t)x << 42) | ((uint64_t)y << 21) | (uint64_t)z;
+    return true;
+  }
+};
+
+}
+
+#endif //__VOXEL_CHANGE_DETECTOR_H__
@@ -0,0 +1,201 @@
+#ifndef __VOXEL_DOWNSAMPLER_H__
+#define __VOXEL_DOWNSAMPLER_H__
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+namespace percepteros
+{
+
+namespace downsampling
+{
+
+//normals and curvature are averaged for point types having them, other fields come from the first point of a voxel
+template<typename PointT>
+inline void addNormal(const PointT &, float, float *)
+{
+}
+
+template<typename PointT>
+inline void setNormal(PointT &, const float *, float)
+{
+}
+
+template<typename PointT>
+inline void addNormalFields(const PointT &p, float weight, float *sum)
+{
+  if(pcl_isfinite(p.normal_x))
+  {
+    sum[0] += weight * p.normal_x;
+    sum[1] += weight * p.normal_y;
+    sum[2] += weight * p.normal_z;
+    sum[3] += weight * p.curvature;
+  }
+}
+
+template<typename PointT>
+inline void setNormalFields(PointT &p, const float *sum, float weight)
+{
+  const float norm = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+  if(norm > 0)
+  {
+    p.normal_x = sum[0] / norm;
+    p.normal_y = sum[1] / norm;
+    p.normal_z = sum[2] / norm;
+    p.curvature = sum[3] / weight;
+  }
+}
+
+inline void addNormal(const pcl::PointNormal &p, float weight, float *sum)
+{
+  addNormalFields(p, weight, sum);
+}
+
+inline void setNormal(pcl::PointNormal &p, const float *sum, float weight)
+{
+  setNormalFields(p, sum, weight);
+}
+
+inline void addNormal(const pcl::PointXYZRGBNormal &p, float weight, float *sum)
+{
+  addNormalFields(p, weight, sum);
+}
+
+inline void setNormal(pcl::PointXYZRGBNormal &p, const float *sum, float weight)
+{
+  setNormalFields(p, sum, weight);
+}
+
+}
+
+/**
+ * @brief Replaces the points of every occupied voxel by their centroid.
+ *
+ * Does what pcl::VoxelGrid does, but finds the voxels through a hash table
+ * instead of sorting the points by voxel, so a cloud costs one pass over its
+ * points. For every input point the voxel it went into is returned, which
+ * maps results on the downsampled cloud back to the input. Inputs can be
+ * weighted by the points they stand for, so a cloud downsampled again keeps
+ * the centroids of the original points. The output keeps the order in which
+ * the voxels were first hit.
+ */
+template<typename PointT>
+class VoxelDownsampler
+{
+public:
+  explicit VoxelDownsampler(float leaf) : leaf(leaf)
+  {
+  }
+
+  /**
+   * @brief downsample Downsamples a cloud
+   * @param weights points every input point stands for, empty if one each
+   * @param output centroids of the occupied voxels
+   * @param voxels set to the output point of every input point, -1 for non finite points
+   * @param counts set to the summed weights of every output point
+   */
+  void downsample(const pcl::PointCloud<PointT> &cloud, const std::vector<int> &weights, pcl::PointCloud<PointT> &output,
+                  std::vector<int> &voxels, std::vector<int> &counts)
+  {
+    const size_t size = cloud.points.size();
+    size_t capacity = 16;
+    while(capacity < 2 * size)
+    {
+      capacity *= 2;
+    }
+    keys.assign(capacity, EMPTY);
+    slots.resize(capacity);
+    const uint64_t mask = capacity - 1;
+
+    output.points.clear();
+    voxels.resize(size);
+    counts.clear();
+    sums.clear();
+    for(size_t i = 0; i < size; ++i)
+    {
+      const PointT &p = cloud.points[i];
+      if(!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+      {
+        voxels[i] = -1;
+        continue;
+      }
+      const uint64_t k = key(p);
+      uint64_t slot = ((k * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+      while(keys[slot] != EMPTY && keys[slot] != k)
+      {
+        slot = (slot + 1) & mask;
+      }
+      if(keys[slot] == EMPTY)
+      {
+        keys[slot] = k;
+        slots[slot] = (int)output.points.size();
+        output.points.push_back(p);
+        counts.push_back(0);
+        sums.resize(sums.size() + FIELDS, 0.0f);
+      }
+      const int voxel = slots[slot];
+      const int weight = weights.empty() ? 1 : weights[i];
+      float *sum = &sums[(size_t)voxel * FIELDS];
+      sum[0] += weight * p.x;
+      sum[1] += weight * p.y;
+      sum[2] += weight * p.z;
+      downsampling::addNormal(p, (float)weight, sum + 3);
+      counts[voxel] += weight;
+      voxels[i] = voxel;
+    }
+
+    for(size_t v = 0; v < output.points.size(); ++v)
+    {
+      PointT &p = output.points[v];
+      const float *sum = &sums[v * FIELDS];
+      const float weight = (float)counts[v];
+      p.x = sum[0] / weight;
+      p.y = sum[1] / weight;
+      p.z = sum[2] / weight;
+      downsampling::setNormal(p, sum + 3, weight);
+    }
+    output.width = output.points.size();
+    output.height = 1;
+    output.is_dense = true;
+    output.header = cloud.header;
+  }
+
+  inline float getLeafSize() const
+  {
+    return leaf;
+  }
+
+private:
+  static const uint64_t EMPTY = ~0ull;
+  //x, y, z, normal and curvature sums of every voxel
+  static const size_t FIELDS = 7;
+
+  float leaf;
+  //reused between calls
+  std::vector<uint64_t> keys;
+  std::vector<int> slots;
+  std::vector<float> sums;
+
+  inline uint64_t key(const PointT &p) const
+  {
+    //21 bits per axis, offset to keep negative coordinates positive
+    const int64_t x = (int64_t)std::floor(p.x / leaf) + (1 << 20);
+    const int64_t y = (int64_t)std::floor(p.y / leaf) + (1 << 20);
+    const int64_t z = (int64_t)std::floor(p.z / leaf) + (1 << 20);
+    return ((uint64_t)x << 42) | ((uint64_t)y << 21) | (uint64_t)z;
+  }
+};
+
+template<typename PointT>
+const uint64_t VoxelDownsampler<PointT>::EMPTY;
+
+template<typename PointT>
+const size_t VoxelDownsampler<PointT>::FIELDS;
+
+}
+
+#endif //__VOXEL_DOWNSAMPLER_H__
@@ -17,6 +17,51 @@
 namespace percepteros
 {
 
+/*
+ * Color Statistics
+ */
+class ColorStatistics : public rs::Annotation
+{
+private:
+  void initFields()
+  {
+    points.init(this, "points");
+    hue.init(this, "hue");
+    saturation.init(this, "saturation");
+    value.init(this, "value");
+    histogram.init(this, "histogram");
+    color.init(this, "color");
+    ratio.init(this, "ratio");
+  }
+public:
+  // Number of points of the cluster
+  rs::FeatureStructureEntry<int> points;
+  // Circular mean of the hue in degrees
+  rs::FeatureStructureEntry<float> hue;
+  // Mean saturation
+  rs::FeatureStructureEntry<float> saturation;
+  // Mean value
+  rs::FeatureStructureEntry<float> value;
+  // Normalized HSV histogram, hue major
+  rs::ListFeatureStructureEntry<float> histogram;
+  // The configured color classes
+  rs::ListFeatureStructureEntry<std::string> color;
+  // Share of the points in each color class
+  rs::ListFeatureStructureEntry<float> ratio;
+
+  ColorStatistics(const ColorStatistics &other) :
+      rs::Annotation(other)
+  {
+    initFields();
+  }
+
+  ColorStatistics(uima::FeatureStructure fs) :
+      rs::Annotation(fs)
+  {
+    initFields();
+  }
+};
+
 /*
  * Tool Object
  */
@@ -127,6 +172,7 @@ public:
 
 }
 
+TYPE_TRAIT(percepteros::ColorStatistics, PERCEPTEROS_RECOGNITIONTYPES_COLORSTATISTICS)
 TYPE_TRAIT(percepteros::ToolObject, PERCEPTEROS_RECOGNITIONTYPES_TOOLOBJECT)
 TYPE_TRAIT(percepteros::RackObject, PERCEPTEROS_RECOGNITIONTYPES_RACKOBJECT)
 TYPE_TRAIT(percepteros::RecognitionObject, PERCEPTEROS_RECOGNITIONTYPES_RECOGNITIONOBJECT)
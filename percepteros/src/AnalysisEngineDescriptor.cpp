@@ -0,0 +1,265 @@
+#include <percepteros/AnalysisEngineDescriptor.h>
+
+#include <boost/property_tree/xml_parser.hpp>
+
+#include <cctype>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace percepteros
+{
+
+namespace pt = boost::property_tree;
+
+namespace
+{
+
+const char *DELEGATES = "taeDescription.delegateAnalysisEngineSpecifiers";
+const char *PARAMETERS = "taeDescription.analysisEngineMetaData.configurationParameters";
+const char *SETTINGS = "taeDescription.analysisEngineMetaData.configurationParameterSettings";
+const char *FLOW = "taeDescription.analysisEngineMetaData.flowConstraints.fixedFlow";
+
+}
+
+bool AnalysisEngineDescriptor::load(const std::string &file)
+{
+  try
+  {
+    tree.clear();
+    pt::read_xml(file, tree, pt::xml_parser::trim_whitespace);
+  }
+  catch(const pt::xml_parser_error &e)
+  {
+    error = e.what();
+    return false;
+  }
+  if(!tree.get_child_optional(DELEGATES))
+  {
+    error = file + " is not an aggregate analysis engine.";
+    return false;
+  }
+  const size_t pos = file.rfind('/');
+  directory = pos == std::string::npos ? "" : file.substr(0, pos + 1);
+  return true;
+}
+
+std::vector<std::string> AnalysisEngineDescriptor::getDelegates() const
+{
+  std::vector<std::string> delegates;
+  for(const pt::ptree::value_type &delegate : tree.get_child(DELEGATES))
+  {
+    if(delegate.first == "delegateAnalysisEngine")
+    {
+      delegates.push_back(delegate.second.get<std::string>("<xmlattr>.key", ""));
+    }
+  }
+  return delegates;
+}
+
+std::string AnalysisEngineDescriptor::getDelegateFile(const std::string &key) const
+{
+  for(const pt::ptree::value_type &delegate : tree.get_child(DELEGATES))
+  {
+    if(delegate.first == "delegateAnalysisEngine" && delegate.second.get<std::string>("<xmlattr>.key", "") == key)
+    {
+      return absolute(delegate.second.get<std::string>("import.<xmlattr>.location", ""));
+    }
+  }
+  return "";
+}
+
+bool AnalysisEngineDescriptor::setParameter(const std::string &delegate, const std::string &name, const std::string &type,
+                                           const std::string &value)
+{
+  boost::optional<pt::ptree &> parameters = tree.get_child_optional(PARAMETERS);
+  boost::optional<pt::ptree &> settings = tree.get_child_optional(SETTINGS);
+  if(!parameters || !settings)
+  {
+    error = "The descriptor has no configuration parameters to override " + delegate + "/" + name + " with.";
+    return false;
+  }
+
+  //an override of the aggregate is replaced along with its setting
+  const std::string target = delegate + "/" + name, key = delegate + "_" + name;
+  for(pt::ptree::iterator it = parameters->begin(); it != parameters->end();)
+  {
+    bool overrides = false;
+    boost::optional<pt::ptree &> targets = it->second.get_child_optional("overrides");
+    if(targets)
+    {
+      for(const pt::ptree::value_type &o : *targets)
+      {
+        overrides = overrides || o.second.data() == target;
+      }
+    }
+    if(it->first != "configurationParameter" || (!overrides && it->second.get<std::string>("name", "") != key))
+    {
+      ++it;
+      continue;
+    }
+    const std::string replaced = it->second.get<std::string>("name", "");
+    it = parameters->erase(it);
+    for(pt::ptree::iterator v = settings->begin(); v != settings->end();)
+    {
+      if(v->first == "nameValuePair" && v->second.get<std::string>("name", "") == replaced)
+      {
+        v = settings->erase(v);
+      }
+      else
+      {
+        ++v;
+      }
+    }
+  }
+
+  pt::ptree parameter;
+  parameter.put("name", key);
+  parameter.put("type", type);
+  parameter.put("multiValued", "false");
+  parameter.put("mandatory", "false");
+  parameter.put("overrides.parameter", target);
+  parameters->push_back(pt::ptree::value_type("configurationParameter", parameter));
+
+  //the value element is named after the type, like <boolean>true</boolean>
+  std::string element = type;
+  element[0] = tolower(element[0]);
+  pt::ptree setting;
+  setting.put("name", key);
+  setting.put("value." + element, value);
+  settings->push_back(pt::ptree::value_type("nameValuePair", setting));
+  return true;
+}
+
+bool AnalysisEngineDescriptor::writeTrimmed(const std::set<std::string> &delegates, const std::string &file)
+{
+  pt::ptree trimmed = tree;
+
+  pt::ptree &specifiers = trimmed.get_child(DELEGATES);
+  for(pt::ptree::iterator it = specifiers.begin(); it != specifiers.end();)
+  {
+    if(it->first != "delegateAnalysisEngine")
+    {
+      ++it;
+      continue;
+    }
+    if(!delegates.count(it->second.get<std::string>("<xmlattr>.key", "")))
+    {
+      it = specifiers.erase(it);
+      continue;
+    }
+    boost::optional<std::string> location = it->second.get_optional<std::string>("import.<xmlattr>.location");
+    if(location)
+    {
+      it->second.put("import.<xmlattr>.location", absolute(*location));
+    }
+    ++it;
+  }
+
+  //parameters of the aggregate override the ones of its delegates
+  std::set<std::string> removed;
+  boost::optional<pt::ptree &> parameters = trimmed.get_child_optional(PARAMETERS);
+  if(parameters)
+  {
+    for(pt::ptree::iterator it = parameters->begin(); it != parameters->end();)
+    {
+      boost::optional<pt::ptree &> overrides = it->second.get_child_optional("overrides");
+      if(it->first != "configurationParameter" || !overrides)
+      {
+        ++it;
+        continue;
+      }
+      for(pt::ptree::iterator o = overrides->begin(); o != overrides->end();)
+      {
+        const std::string target = o->second.data();
+        if(!delegates.count(target.substr(0, target.find('/'))))
+        {
+          o = overrides->erase(o);
+        }
+        else
+        {
+          ++o;
+        }
+      }
+      if(overrides->empty())
+      {
+        removed.insert(it->second.get<std::string>("name", ""));
+        it = parameters->erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+  boost::optional<pt::ptree &> settings = trimmed.get_child_optional(SETTINGS);
+  if(settings)
+  {
+    for(pt::ptree::iterator it = settings->begin(); it != settings->end();)
+    {
+      if(it->first == "nameValuePair" && removed.count(it->second.get<std::string>("name", "")))
+      {
+        it = settings->erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  boost::optional<pt::ptree &> flow = trimmed.get_child_optional(FLOW);
+  if(flow)
+  {
+    for(pt::ptree::iterator it = flow->begin(); it != flow->end();)
+    {
+      if(it->first == "node" && !delegates.count(it->second.data()))
+      {
+        it = flow->erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  try
+  {
+    pt::write_xml(file, trimmed, std::locale(), pt::xml_writer_make_settings<std::string>(' ', 2));
+  }
+  catch(const pt::xml_parser_error &e)
+  {
+    error = e.what();
+    return false;
+  }
+  return true;
+}
+
+std::string AnalysisEngineDescriptor::writeTrimmedTemporary(const std::set<std::string> &delegates)
+{
+  char name[] = "/tmp/percepteros_ae_XXXXXX.xml";
+  const int fd = mkstemps(name, 4);
+  if(fd < 0)
+  {
+    error = "Could not create a temporary descriptor.";
+    return "";
+  }
+  close(fd);
+  if(!writeTrimmed(delegates, name))
+  {
+    unlink(name);
+    return "";
+  }
+  return name;
+}
+
+std::string AnalysisEngineDescriptor::absolute(const std::string &location) const
+{
+  if(location.empty() || location[0] == '/')
+  {
+    return location;
+  }
+  return directory + location;
+}
+
+}
@@ -0,0 +1,143 @@
+#include <percepteros/AsyncSceneWriter.h>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <pcl/io/pcd_io.h>
+
+#include <rs/utils/output.h>
+
+#include <sstream>
+
+namespace percepteros
+{
+
+/**
+ * @brief AsyncSceneWriter::AsyncSceneWriter Starts the writer thread
+ * @param path directory the scenes are written to
+ * @param maxQueue number of scenes which may wait for the disk
+ * @param compress use binary compressed instead of binary PCD files
+ */
+AsyncSceneWriter::AsyncSceneWriter(const std::string &path, size_t maxQueue, bool compress) :
+  path(path), maxQueue(std::max<size_t>(1, maxQueue)), compress(compress), stop(false),
+  written(0), dropped(0), failed(0), highWater(0)
+{
+  worker = std::thread(&AsyncSceneWriter::run, this);
+}
+
+/**
+ * @brief AsyncSceneWriter::~AsyncSceneWriter Writes the remaining scenes and joins the thread
+ */
+AsyncSceneWriter::~AsyncSceneWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  available.notify_one();
+  worker.join();
+}
+
+bool AsyncSceneWriter::push(const Scene &scene)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(queue.size() >= maxQueue)
+    {
+      ++dropped;
+      return false;
+    }
+    queue.push_back(scene);
+    if(queue.size() > highWater)
+    {
+      highWater = queue.size();
+    }
+  }
+  available.notify_one();
+  return true;
+}
+
+void AsyncSceneWriter::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    available.wait(lock, [this]()
+    {
+      return stop || !queue.empty();
+    });
+    if(queue.empty())
+    {
+      //only reached when stopping
+      return;
+    }
+
+    Scene scene = queue.front();
+    queue.pop_front();
+
+    lock.unlock();
+    if(write(scene))
+    {
+      ++written;
+    }
+    else
+    {
+      ++failed;
+    }
+    lock.lock();
+  }
+}
+
+bool AsyncSceneWriter::write(const Scene &scene)
+{
+  const std::string base = path + "/" + scene.name;
+
+  pcl::PCDWriter writer;
+  int error;
+  if(compress)
+  {
+    error = writer.writeBinaryCompressed(base + ".pcd", *scene.cloud);
+  }
+  else
+  {
+    error = writer.writeBinary(base + ".pcd", *scene.cloud);
+  }
+  if(error != 0)
+  {
+    outError("Could not write " << base << ".pcd");
+    return false;
+  }
+
+  if(!scene.depth.empty())
+  {
+    cv::Mat depth = scene.depth;
+    if(depth.type() == CV_32FC1)
+    {
+      scene.depth.convertTo(depth, CV_16UC1, 1000.0);
+    }
+    if(!cv::imwrite(base + "_depth.png", depth))
+    {
+      outError("Could not write " << base << "_depth.png");
+      return false;
+    }
+  }
+
+  //cv::FileStorage has no 64 bit integers, the stamp is stored as string
+  std::ostringstream stamp;
+  stamp << scene.stamp;
+  cv::FileStorage fs(base + "_viewpoint.yml", cv::FileStorage::WRITE);
+  fs << "stamp" << stamp.str();
+  fs << "has_viewpoint" << (int)scene.hasViewpoint;
+  if(scene.hasViewpoint)
+  {
+    const tf::Vector3 &t = scene.viewpoint.getOrigin();
+    const tf::Quaternion q = scene.viewpoint.getRotation();
+    fs << "frame_id" << scene.viewpoint.frame_id_;
+    fs << "child_frame_id" << scene.viewpoint.child_frame_id_;
+    fs << "translation" << cv::Mat(cv::Mat_<double>(1, 3) << t.x(), t.y(), t.z());
+    fs << "rotation" << cv::Mat(cv::Mat_<double>(1, 4) << q.x(), q.y(), q.z(), q.w());
+  }
+  fs.release();
+  return true;
+}
+
+}
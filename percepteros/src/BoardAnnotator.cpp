@@ -26,11 +26,6 @@
 #include <pcl/point_types.h>
 #include <pcl/point_types_conversion.h>
 #include <pcl/common/transforms.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/sample_consensus/ransac.h>
-#include <pcl/sample_consensus/sac_model_circle.h>
 #include <pcl/filters/extract_indices.h>
 #include <pcl/filters/passthrough.h>
 
@@ -43,6 +38,10 @@
 
 //SUTURO
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/FrameDeadline.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/Ransac.h>
 
 //ROS
 #include <geometry_msgs/PoseStamped.h>
@@ -78,6 +77,14 @@ class BoardAnnotator : public DrawingAnnotator {
 		tf::Vector3 max, min, x, y, z, mid;
 		pcl::PointXYZ middle;
 
+		//visualization
+		percepteros::OverlayBuffer overlay;
+		percepteros::OverlayRenderer renderer;
+		double pointSize = 1;
+
+		//threads of the circle segmentation
+		int threads = percepteros::Ransac::Parameters().threads;
+
 		/**
 		 * Gets coefficients of cone used for visualizing the axis.
 		 * @method getCoeffs
@@ -113,13 +120,14 @@ class BoardAnnotator : public DrawingAnnotator {
 	  }
 
 		/**
-		 * Initializer for BoardAnnotator, currently does nothing.
+		 * Initializer for BoardAnnotator, reads the number of segmentation threads.
 		 * @method initialize
 		 * @param  ctx        The Annotator context (acces to definition of parameters).
 		 * @return            UIMA error id specifying success.
 		 */
 	  TyErrorId initialize(AnnotatorContext &ctx) {
 	    outInfo("Initialize BoardAnnotator.");
+	    if (ctx.isParameterDefined("threads")) ctx.extractValue("threads", threads);
 
 	    return UIMA_ERR_NONE;
 	  }
@@ -145,7 +153,8 @@ class BoardAnnotator : public DrawingAnnotator {
 	    outInfo("Start calculation of board pose.");
 			rs::StopWatch clock;
 
-			//empty containers
+			//empty containers, the last scene may still be shown by the visualizer
+			percepteros::detachCloud<PointR>(cloud);
 			cloud->clear();
 			neighbors->clear();
 			board->clear();
@@ -153,69 +162,63 @@ class BoardAnnotator : public DrawingAnnotator {
 			//get clusters
 			rs::SceneCas cas(tcas);
 			rs::Scene scene = cas.getScene();
-			std::vector<rs::Cluster> clusters;
-			std::vector<std::vector<percepteros::RecognitionObject>> cluster_annotations;
-			scene.identifiables.filter(clusters, cluster_annotations);
+			percepteros::SceneIndex &index = percepteros::SceneIndex::of(scene);
 
 			//get scene points
 			cas.get(VIEW_CLOUD, *cloud);
 			cas.get(VIEW_CLOUD, *neighbors);
 
-			std::vector<rs::PoseAnnotation> poses;
-
 			Eigen::Affine3f iTrans;
 			//check for box and get dimensions
-			int clusterIdx = 0;
 			bool foundBox = false;
-			for (int i = 0; i < clusters.size(); i++) {
-				//check for box
-				if (cluster_annotations[i][0].type.get() == 1) {
-						outInfo("Found box.");
-						clusterIdx = i;
-						foundBox = true;
-
-						//get dimensions
-						percepteros::RecognitionObject rec = cluster_annotations[i][0];
+			for (size_t i : index.recognized(1)) {
+				outInfo("Found box.");
+				foundBox = true;
+
+				//get dimensions
+				for (percepteros::RecognitionObject rec : index.annotations<percepteros::RecognitionObject>(i)) {
+					if (rec.type.get() == 1) {
 						width = rec.width.get();
 						height = rec.height.get();
 						depth = rec.depth.get();
+					}
+				}
 
-						//get pose
-						clusters[i].annotations.filter(poses);
-						rs::PoseAnnotation pose = poses[0];
+				//get pose
+				rs::PoseAnnotation pose = index.annotations<rs::PoseAnnotation>(i)[0];
 
-						//get transformation from camera to object coordinates
-						Eigen::Affine3d eTrans;
-						tf::Transform tTrans;
-						rs::conversion::from(pose.world.get(), tTrans);
-						tf::transformTFToEigen(tTrans, eTrans);
-						iTrans = eTrans.inverse().cast<float>();
-						//transform point cloud to object coordinates
-						pcl::transformPointCloud(*neighbors, *neighbors, eTrans);
+				//get transformation from camera to object coordinates
+				Eigen::Affine3d eTrans;
+				tf::Transform tTrans;
+				rs::conversion::from(pose.world.get(), tTrans);
+				tf::transformTFToEigen(tTrans, eTrans);
+				iTrans = eTrans.inverse().cast<float>();
+				//transform point cloud to object coordinates
+				pcl::transformPointCloud(*neighbors, *neighbors, eTrans);
 
-						//gets middle point of cake
-						middle.x = pose.camera.get().translation.get()[0];
-						middle.y = pose.camera.get().translation.get()[1];
-						middle.z = pose.camera.get().translation.get()[2];
+				//gets middle point of cake
+				middle.x = pose.camera.get().translation.get()[0];
+				middle.y = pose.camera.get().translation.get()[1];
+				middle.z = pose.camera.get().translation.get()[2];
 
-						//transforms to object coordinates
-						middle = pcl::transformPoint(middle, eTrans.cast<float>());
+				//transforms to object coordinates
+				middle = pcl::transformPoint(middle, eTrans.cast<float>());
 
-						//sets limits for point cloud
-						min.setValue(middle.x - 0.15, middle.y - 0.15, middle.z - 0.1);
-						max.setValue(middle.x + 0.15, middle.y + 0.15, middle.z + 0.1);
+				//sets limits for point cloud
+				min.setValue(middle.x - 0.15, middle.y - 0.15, middle.z - 0.1);
+				max.setValue(middle.x + 0.15, middle.y + 0.15, middle.z + 0.1);
 
-						auto rot = pose.camera.get().rotation.get();
+				auto rot = pose.camera.get().rotation.get();
 
-						z.setValue(rot[2], rot[5], rot[8]);
-						x.setValue(rot[0], rot[3], rot[6]);
+				z.setValue(rot[2], rot[5], rot[8]);
+				x.setValue(rot[0], rot[3], rot[6]);
 
-						break;
-				}
+				break;
 			}
 
 			if (!foundBox) {
 				outInfo("No box found in " << clock.getTime() << "ms.");
+				publishOverlay(false);
 				return UIMA_ERR_NONE;
 			}
 
@@ -247,14 +250,15 @@ class BoardAnnotator : public DrawingAnnotator {
 			pcl::transformPointCloud(*neighbors, *neighbors, iTrans);
 
 			//prepare segmenter
-			pcl::SACSegmentation<PointR> seg;
-			seg.setOptimizeCoefficients(true);
-			seg.setMethodType(pcl::SAC_RANSAC);
-			seg.setMaxIterations(10000);
-			seg.setModelType(pcl::SACMODEL_CIRCLE3D);
-			seg.setDistanceThreshold(0.005);
-			seg.setRadiusLimits(0.1, 0.15);
-			seg.setInputCloud(neighbors);
+			percepteros::Ransac::Parameters parameters;
+			parameters.model = percepteros::Ransac::CIRCLE3D;
+			parameters.maxIterations = percepteros::FrameDeadline::capIterations(10000);
+			parameters.distance = 0.005;
+			parameters.minRadius = 0.1;
+			parameters.maxRadius = 0.15;
+			parameters.threads = threads;
+			percepteros::Ransac seg(parameters);
+			seg.setInputCloud(*neighbors);
 
 			seg.segment(*indices, *coefficients);
 
@@ -318,12 +322,29 @@ class BoardAnnotator : public DrawingAnnotator {
 
 			cluster.annotations.append(poseA);
 			cluster.annotations.append(o);
-			scene.identifiables.append(cluster);
+			index.appendCluster(scene, cluster);
 
 			outInfo("Found box in " << clock.getTime() << "ms.");
+			publishOverlay(true);
 			return UIMA_ERR_NONE;
 	  }
 
+		/**
+		 * Hands the scene points and, if the board was found, cones illustrating its pose to the visualizer.
+		 * @method publishOverlay
+		 * @param  foundBoard     Specifies if the board pose was calculated in this frame.
+		 */
+		void publishOverlay(bool foundBoard) {
+			percepteros::VisualizationOverlay &o = overlay.back();
+			o.cloud = cloud;
+			if (foundBoard) {
+				o.addCone("x", getCoeffs(mid.getX(), mid.getY(), mid.getZ(), x.getX(), x.getY(), x.getZ()), 1, 0, 0);
+				o.addCone("y", getCoeffs(mid.getX(), mid.getY(), mid.getZ(), y.getX(), y.getY(), y.getZ()), 0, 1, 0);
+				o.addCone("z", getCoeffs(mid.getX(), mid.getY(), mid.getZ(), z.getX(), z.getY(), z.getZ()), 0, 0, 1);
+			}
+			overlay.publish();
+		}
+
 		/**
 		 * Adds scene points and cones illustrating the pose of the board.
 		 * @method fillVisualizerWithLock
@@ -331,26 +352,7 @@ class BoardAnnotator : public DrawingAnnotator {
 		 * @param  firstRun               Specifies if Visualizer is run for the first time.
 		 */
 		void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun) {
-			////circle
-		  //for (size_t i = 0; i < indices->indices.size(); ++i) {
-		  //	cloud->points[indices->indices[i]].rgba = rs::common::colors[0];
-		  //}
-
-		  if (firstRun) {
-			  visualizer.addPointCloud(cloud, "scene points");
-		  } else {
-			  visualizer.updatePointCloud(cloud, "scene points");
-			  visualizer.removeAllShapes();
-			  //visualizer.removePointCloud("neighbors");
-		  }
-
-		  //axes
-		  visualizer.addCone(getCoeffs(mid.getX(), mid.getY(), mid.getZ(), x.getX(), x.getY(), x.getZ()), "x");
-		  visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-		  visualizer.addCone(getCoeffs(mid.getX(), mid.getY(), mid.getZ(), y.getX(), y.getY(), y.getZ()), "y");
-		  visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-		  visualizer.addCone(getCoeffs(mid.getX(), mid.getY(), mid.getZ(), z.getX(), z.getY(), z.getZ()), "z");
-		  visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
+			renderer.render(overlay, visualizer, "scene points", pointSize, firstRun);
 	  }
 };
 
@@ -10,12 +10,6 @@
 
 #include <pcl/filters/extract_indices.h>
 #include <pcl/features/normal_3d.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/sample_consensus/ransac.h>
-#include <pcl/sample_consensus/sac_model_plane.h>
-#include <pcl/sample_consensus/sac_model_cylinder.h>
-#include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/common/transforms.h>
 #include <percepteros/types/all_types.h>
 
@@ -29,6 +23,13 @@
 
 #include <pcl/visualization/pcl_visualizer.h>
 
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/FrameDeadline.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/Ransac.h>
+#include <percepteros/ClusterPyramid.h>
+
 
 using namespace uima;
 
@@ -66,6 +67,21 @@ private:
 
   double pointSize = 1;
 
+  percepteros::OverlayBuffer overlay;
+  percepteros::OverlayRenderer renderer;
+
+  percepteros::Ransac ransac;
+
+  typedef percepteros::ClusterPyramid<pcl::PointXYZRGBNormal> Pyramid;
+  //pyramid of the current cluster, planes are fitted on a copy of its medium level
+  const Pyramid *pyramid;
+  pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_coarse;
+  //points of the cluster removed from every point of cloud_coarse
+  std::vector<int> coarse_removed;
+  //image pixels of the current cluster, the full resolution fallback samples around them
+  const std::vector<int> *clusterPixels;
+  int imageWidth;
+
   float BOX_DISTANCE_THRESHOLD_PLANE1, BOX_DISTANCE_THRESHOLD_PLANE2,BOX_DISTANCE_THRESHOLD_PLANE3,
   BOX_EPSILON_PLANE1, BOX_MAX_SIZE_RATIO_PLANE1, BOX_MIN_SIZE_RATIO_PLANE1, BOX_MIN_SIZE_RATIO_PLANE2,
   BOX_MIN_SIZE_RATIO_PLANE3, BOX_MIN_MATCHED_POINTS_RATIO, EPSILON_ANGLE;
@@ -88,7 +104,7 @@ private:
 
 public:
 
-  CakeAnnotator(): DrawingAnnotator(__func__){
+  CakeAnnotator(): DrawingAnnotator(__func__), pyramid(NULL), clusterPixels(NULL), imageWidth(0){
 
       cloud_ptr = pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>);
   }
@@ -109,6 +125,7 @@ public:
     ctx.extractValue("EPSILON_ANGLE", EPSILON_ANGLE);
     ctx.extractValue("MIN_CLOUD_SIZE", MIN_CLOUD_SIZE);
     ctx.extractValue("COLOR", COLOR);
+    if(ctx.isParameterDefined("threads")) ctx.extractValue("threads", ransac.getParameters().threads);
 
     return UIMA_ERR_NONE;
   }
@@ -141,12 +158,12 @@ public:
     rs::SceneCas cas(tcas);
 
     rs::Scene scene = cas.getScene();
-    std::vector<rs::Cluster> clusters;
-    scene.identifiables.filter(clusters);
+    percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
 
-    pcl::PointCloud<pcl::Normal>::Ptr normal_ptr(new pcl::PointCloud<pcl::Normal>);
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_cluster_normal (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+    pcl::PointCloud<pcl::Normal>::Ptr normal_ptr = percepteros::FrameArena::get<pcl::PointCloud<pcl::Normal>>();
+    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_cluster_normal = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBNormal>>();
 
+    percepteros::detachCloud<PointT>(cloud_ptr);
     cas.get(VIEW_CLOUD, *cloud_ptr);
     cas.get(VIEW_NORMALS, *normal_ptr);
 
@@ -166,13 +183,20 @@ public:
     box_objects.clear();
 
 
-    for(auto cluster : clusters)
+    const size_t clusterCount = index.clusters().size();
+    for(size_t c = 0; c < clusterCount; ++c)
     {
+      if(percepteros::FrameDeadline::expired())
+      {
+        outInfo("Deadline reached, skipping remaining clusters.");
+        percepteros::FrameDeadline::markDegraded();
+        break;
+      }
 
-      std::vector<rs::SemanticColor> semanticColor;
-      cluster.annotations.filter(semanticColor);
-      std::vector<float> ratios = semanticColor[0].ratio.get();
-      std::vector<std::string> colors = semanticColor[0].color.get();
+      rs::Cluster cluster = index.cluster(c);
+      rs::SemanticColor semanticColor = index.annotations<rs::SemanticColor>(c)[0];
+      std::vector<float> ratios = semanticColor.ratio.get();
+      std::vector<std::string> colors = semanticColor.color.get();
       bool ratioLow = false;
       for(int i = 0; i < colors.size(); i++){
           float ratio = ratios[i];
@@ -184,12 +208,12 @@ public:
       if(ratioLow){
           continue;
       }
-      pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
+      pcl::PointIndices::Ptr cluster_indices = percepteros::FrameArena::get<pcl::PointIndices>();
       rs::ReferenceClusterPoints clusterpoints(cluster.points());
       rs::conversion::from(clusterpoints.indices(), *cluster_indices);
 
-      pcl::PointCloud<PointT>::Ptr cluster_cloud(new pcl::PointCloud<PointT>());
-      pcl::PointCloud<pcl::Normal>::Ptr cluster_normal(new pcl::PointCloud<pcl::Normal>());
+      pcl::PointCloud<PointT>::Ptr cluster_cloud = percepteros::FrameArena::get<pcl::PointCloud<PointT>>();
+      pcl::PointCloud<pcl::Normal>::Ptr cluster_normal = percepteros::FrameArena::get<pcl::PointCloud<pcl::Normal>>();
 
       for(std::vector<int>::const_iterator pit = cluster_indices->indices.begin();
           pit != cluster_indices->indices.end(); pit++)
@@ -204,18 +228,17 @@ public:
       cluster_normal->height = 1;
       cluster_normal->is_dense = true;
 
-      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_clusterRGB (new pcl::PointCloud<pcl::PointXYZRGB>);
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_clusterRGB = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGB>>();
 
       pcl::copyPointCloud(*cluster_cloud,*cloud_clusterRGB);
       pcl::concatenateFields (*cloud_clusterRGB, *cluster_normal, *cloud_cluster_normal);
 
-       pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGBNormal> ());
-
-       // Create the filtering object
-       /*pcl::VoxelGrid<pcl::PointXYZRGBNormal> sor;
-       sor.setInputCloud (cloud_cluster_normal);
-       sor.setLeafSize (0.01f, 0.01f, 0.01f);
-       sor.filter (*cloud_filtered);*/
+      pyramid = &Pyramid::of(index, c, *cloud_cluster_normal);
+      cloud_coarse = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBNormal>>();
+      *cloud_coarse = *pyramid->cloud(Pyramid::MEDIUM);
+      coarse_removed.assign(cloud_coarse->points.size(), 0);
+      clusterPixels = &cluster_indices->indices;
+      imageWidth = cloud_ptr->width;
 
       geometry_msgs::PoseStamped pose;
       percepteros::RecognitionObject o = rs::create<percepteros::RecognitionObject>(tcas);
@@ -223,14 +246,13 @@ public:
       box_object bo;
       bo.clusterInSzene = *cluster_indices;
 
-
       int box = isBox(cloud_cluster_normal, pose, o, transform, bo);
       if(box){
 
           box_objects.push_back(bo);
 
           outInfo("Box");
-          cluster.annotations.append(o);
+          index.append(c, o);
 
           tf::StampedTransform camToWorld;
           camToWorld.setIdentity();
@@ -246,16 +268,42 @@ public:
           poseAnnotation.camera.set(rs::conversion::to(tcas, camera));
           poseAnnotation.world.set(rs::conversion::to(tcas, world));
           poseAnnotation.source.set("3DEstimate");
-          cluster.annotations.append(poseAnnotation);
+          index.append(c, poseAnnotation);
           //scene.identifiables.append(cluster);
       } else{
           outInfo("No Box");
       }
 
     }
+    publishOverlay();
     return UIMA_ERR_NONE;
   }
 
+  /**
+   * @brief publishOverlay Hands the planes of the found boxes and the axes of the first one to the visualizer
+   */
+  void publishOverlay()
+  {
+    percepteros::VisualizationOverlay &o = overlay.back();
+    o.cloud = cloud_ptr;
+    for(const box_object &bo: box_objects){
+        pcl::PointIndices::Ptr plane = percepteros::FrameArena::get<pcl::PointIndices>();
+        lookupIndicesInPointcloud(bo.clusterInSzene, bo.plane1InCluster, plane);
+        o.addHighlight(plane->indices, rs::common::colors[0]);
+        lookupIndicesInPointcloud(bo.clusterInSzene, bo.plane2InCluster, plane);
+        o.addHighlight(plane->indices, rs::common::colors[1]);
+        lookupIndicesInPointcloud(bo.clusterInSzene, bo.plane3InCluster, plane);
+        o.addHighlight(plane->indices, rs::common::colors[2]);
+    }
+    if(!box_objects.empty()){
+        const PointT &origin = cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]];
+        o.addCone("x", getCoefficients(box_objects[0].xVector, origin, depth), 1, 0, 0);
+        o.addCone("y", getCoefficients(box_objects[0].yVector, origin, height), 0, 1, 0);
+        o.addCone("z", getCoefficients(box_objects[0].zVector, origin, width), 0, 0, 1);
+    }
+    overlay.publish();
+  }
+
   /**
    * @brief segmentPlaneFromNormals Computes model coefficients for a plane using the pointclouds normals
    * @param cloud_input
@@ -270,7 +318,7 @@ public:
    * @return
    */
   int segmentPlaneFromNormals(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_input,
-                                          int model_type,
+                                          percepteros::Ransac::Model model_type,
                                           double normal_weight,
                                           double distance,
                                           pcl::ModelCoefficients::Ptr coefficients,
@@ -279,21 +327,20 @@ public:
                                           Eigen::Vector3f axis = Eigen::Vector3f(1,0,0),
                                           double epsilon = 0.1)
   {
-    pcl::SACSegmentationFromNormals <pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal> seg;
     pcl::ExtractIndices <pcl::PointXYZRGBNormal> extract;
 
     // Find largest planar component with RANSAC
-    seg.setOptimizeCoefficients(true);
-    seg.setModelType(model_type);
-    seg.setNormalDistanceWeight(normal_weight);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(MAX_SEGMENTATION_ITERATIONS);
-    seg.setDistanceThreshold(distance);
-    seg.setAxis(axis);
-    seg.setEpsAngle(epsilon);
-    seg.setInputCloud(cloud_input);
-    seg.setInputNormals(cloud_input);
-    seg.segment(*inliers, *coefficients);
+    percepteros::Ransac::Parameters &parameters = ransac.getParameters();
+    parameters.model = model_type;
+    parameters.normalWeight = normal_weight;
+    parameters.maxIterations = percepteros::FrameDeadline::capIterations(MAX_SEGMENTATION_ITERATIONS);
+    parameters.distance = distance;
+    parameters.axis = axis;
+    parameters.epsAngle = epsilon;
+    parameters.optimize = true;
+    ransac.setInputCloud(*cloud_input);
+    ransac.setInputNormals(*cloud_input);
+    ransac.segment(*inliers, *coefficients);
 
     extract.setInputCloud(cloud_input);
     extract.setIndices(inliers);
@@ -338,7 +385,7 @@ public:
    * @return
    */
   int segmentPlane(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_input,
-                               int model_type,
+                               percepteros::Ransac::Model model_type,
                                double distance,
                                pcl::ModelCoefficients::Ptr coefficients,
                                pcl::PointIndices::Ptr inliers,
@@ -346,18 +393,28 @@ public:
                                Eigen::Vector3f axis = Eigen::Vector3f(1,0,0),
                                double epsilon = 0.1)
   {
-    pcl::SACSegmentation <pcl::PointXYZRGBNormal> seg;
     pcl::ExtractIndices <pcl::PointXYZRGBNormal> extract;
 
-    seg.setInputCloud(cloud_input);
-    seg.setModelType(model_type);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(MAX_SEGMENTATION_ITERATIONS);
-    seg.setDistanceThreshold(distance);
-    seg.setAxis(axis);
-    seg.setEpsAngle(epsilon);
-    seg.setOptimizeCoefficients(true);
-    seg.segment(*inliers, *coefficients);
+    percepteros::Ransac::Parameters &parameters = ransac.getParameters();
+    parameters.model = model_type;
+    parameters.normalWeight = 0;
+    parameters.maxIterations = percepteros::FrameDeadline::capIterations(MAX_SEGMENTATION_ITERATIONS);
+    parameters.distance = distance;
+    parameters.axis = axis;
+    parameters.epsAngle = epsilon;
+    parameters.optimize = true;
+    //fit on the medium level of the pyramid, then select and refit the inliers among the points of the cluster
+    ransac.setInputCloud(*cloud_coarse);
+    const bool found = ransac.segment(*inliers, *coefficients);
+    //a model carried by the voxel centroids only, keep at least half of the points they stand for
+    const size_t support = found ? pyramid->support(inliers->indices, Pyramid::MEDIUM) : 0;
+    ransac.setInputCloud(*cloud_input);
+    if(!found || !ransac.refine(*inliers, *coefficients, support / 2))
+    {
+      //local samples are drawn around the pixels of the cluster
+      ransac.setGrid(*clusterPixels, imageWidth);
+      ransac.segment(*inliers, *coefficients);
+    }
 
     extract.setInputCloud(cloud_input);
     extract.setIndices(inliers);
@@ -381,17 +438,27 @@ public:
   }
 
   /**
-   * @brief removeIndicesfromPointcloud Sets points within a pointcloud to NaN
+   * @brief removeIndicesfromPointcloud Sets points within a pointcloud to NaN, and the points of cloud_coarse
+   * of which at least half were removed
    * @param cloud_object the pointcloud
    * @param inliers the indices at which the point should be NaN
    */
   void removeIndicesfromPointcloud(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_object, pcl::PointIndices::Ptr inliers){
+      const float badPoint = std::numeric_limits<float>::quiet_NaN();
+      const std::vector<int> &counts = pyramid->counts(Pyramid::MEDIUM);
       for(int i = 0; i < inliers->indices.size(); i++){
-          const float badPoint = std::numeric_limits<float>::quiet_NaN();
           pcl::PointXYZRGBNormal& invalidPoint = cloud_object->points[inliers->indices[i]];
           invalidPoint.x = badPoint;
           invalidPoint.y = badPoint;
           invalidPoint.z = badPoint;
+
+          const int v = pyramid->voxel(inliers->indices[i], Pyramid::MEDIUM);
+          if(v >= 0 && 2 * ++coarse_removed[v] >= counts[v]){
+              pcl::PointXYZRGBNormal& invalidCoarse = cloud_coarse->points[v];
+              invalidCoarse.x = badPoint;
+              invalidCoarse.y = badPoint;
+              invalidCoarse.z = badPoint;
+          }
       }
   }
 
@@ -419,23 +486,23 @@ public:
 
         Eigen::Vector3f sceneUp(sceneUpTf.getX(),sceneUpTf.getY(), sceneUpTf.getZ());
 
-        cloud_rem1 = pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-        cloud_rem2 = pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-        cloud_rem3 = pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+        cloud_rem1 = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBNormal>>();
+        cloud_rem2 = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBNormal>>();
+        cloud_rem3 = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBNormal>>();
 
-        pcl::ModelCoefficients::Ptr coefficients_plane1(new pcl::ModelCoefficients ());
-        pcl::ModelCoefficients::Ptr coefficients_plane2(new pcl::ModelCoefficients ());
-        pcl::ModelCoefficients::Ptr coefficients_plane3(new pcl::ModelCoefficients ());
+        pcl::ModelCoefficients::Ptr coefficients_plane1 = percepteros::FrameArena::get<pcl::ModelCoefficients>();
+        pcl::ModelCoefficients::Ptr coefficients_plane2 = percepteros::FrameArena::get<pcl::ModelCoefficients>();
+        pcl::ModelCoefficients::Ptr coefficients_plane3 = percepteros::FrameArena::get<pcl::ModelCoefficients>();
 
-        pcl::PointIndices::Ptr inliers1(new pcl::PointIndices ());
-        pcl::PointIndices::Ptr inliers2(new pcl::PointIndices ());
-        pcl::PointIndices::Ptr inliers3(new pcl::PointIndices ());
+        pcl::PointIndices::Ptr inliers1 = percepteros::FrameArena::get<pcl::PointIndices>();
+        pcl::PointIndices::Ptr inliers2 = percepteros::FrameArena::get<pcl::PointIndices>();
+        pcl::PointIndices::Ptr inliers3 = percepteros::FrameArena::get<pcl::PointIndices>();
 
         //up
         bo.zVector = sceneUp;
 
-        pcl::ModelCoefficients::Ptr co(new pcl::ModelCoefficients ());
-        int matched_points = segmentPlane(cloud_object, pcl::SACMODEL_PERPENDICULAR_PLANE, BOX_DISTANCE_THRESHOLD_PLANE1,
+        pcl::ModelCoefficients::Ptr co = percepteros::FrameArena::get<pcl::ModelCoefficients>();
+        int matched_points = segmentPlane(cloud_object, percepteros::Ransac::PERPENDICULAR_PLANE, BOX_DISTANCE_THRESHOLD_PLANE1,
                                       co, inliers1, cloud_rem1, sceneUp, BOX_EPSILON_PLANE1);
         int plane_size = matched_points;
         bo.plane1InCluster = *inliers1;
@@ -454,7 +521,7 @@ public:
           return 0;
         }
 
-        plane_size = segmentPlane(cloud_object, pcl::SACMODEL_PARALLEL_PLANE, BOX_DISTANCE_THRESHOLD_PLANE2,
+        plane_size = segmentPlane(cloud_object, percepteros::Ransac::PARALLEL_PLANE, BOX_DISTANCE_THRESHOLD_PLANE2,
                                    coefficients_plane2, inliers2, cloud_rem2, sceneUp, EPSILON_ANGLE);
         bo.plane2InCluster = *inliers2;
         removeIndicesfromPointcloud(cloud_object, inliers2);
@@ -478,7 +545,7 @@ public:
             return 0;
           }
 
-          plane_size = segmentPlane(cloud_object, pcl::SACMODEL_PARALLEL_PLANE,
+          plane_size = segmentPlane(cloud_object, percepteros::Ransac::PARALLEL_PLANE,
                                     BOX_DISTANCE_THRESHOLD_PLANE3, coefficients_plane3, inliers3, cloud_rem3, sceneUp, EPSILON_ANGLE);
           bo.plane3InCluster = *inliers3;
           matched_points += plane_size;
@@ -610,65 +677,7 @@ public:
 
   void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
   {
-    for(box_object bo: box_objects){
-        pcl::PointIndices::Ptr plane1(new pcl::PointIndices ());
-        pcl::PointIndices::Ptr plane2(new pcl::PointIndices ());
-        pcl::PointIndices::Ptr plane3(new pcl::PointIndices ());
-
-        lookupIndicesInPointcloud(bo.clusterInSzene, bo.plane1InCluster, plane1);
-        lookupIndicesInPointcloud(bo.clusterInSzene, bo.plane2InCluster, plane2);
-        lookupIndicesInPointcloud(bo.clusterInSzene, bo.plane3InCluster, plane3);
-        for(int i = 0; i < plane1->indices.size(); i++){
-            size_t index = plane1->indices[i];
-            cloud_ptr->points[index].rgba = rs::common::colors[0];
-        }
-        for(int i = 0; i < plane2->indices.size(); i++){
-            size_t index = plane2->indices[i];
-            cloud_ptr->points[index].rgba = rs::common::colors[1];
-        }
-        for(int i = 0; i < plane3->indices.size(); i++){
-            size_t index = plane3->indices[i];
-            cloud_ptr->points[index].rgba = rs::common::colors[2];
-        }
-    }
-    const std::string &cloudname = this->name;
-    if(firstRun)
-    {
-      visualizer.addPointCloud(cloud_ptr, cloudname);
-      visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-      if(box_objects.size() == 0){
-          return;
-      }
-      visualizer.addCone(getCoefficients(box_objects[0].xVector, cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]], depth),"x");
-      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-
-      visualizer.addCone(getCoefficients(box_objects[0].yVector, cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]], height),"y");
-      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-
-      visualizer.addCone(getCoefficients(box_objects[0].zVector, cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]], width),"z");
-      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
-    }
-    else
-    {
-      visualizer.removeAllShapes();
-      visualizer.updatePointCloud(cloud_ptr, cloudname);
-      visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-
-      if(box_objects.size() == 0){
-          return;
-      }
-
-      visualizer.addCone(getCoefficients(box_objects[0].xVector, cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]], depth),"x");
-      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-
-      visualizer.addCone(getCoefficients(box_objects[0].yVector, cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]], height),"y");
-      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-
-      visualizer.addCone(getCoefficients(box_objects[0].zVector, cloud_ptr->points[box_objects[0].clusterInSzene.indices[0]], width),"z");
-      visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
-
-    }
-
+    renderer.render(overlay, visualizer, this->name, pointSize, firstRun);
   }
 };
 
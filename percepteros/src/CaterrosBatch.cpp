@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <uima/api.hpp>
+
+#include <rs/utils/common.h>
+#include <rs/utils/time.h>
+
+#include <percepteros/AnalysisEngineDescriptor.h>
+#include <percepteros/CaterrosControlledAnalysisEngine.h>
+#include <percepteros/ColumnTable.h>
+#include <percepteros/FrameHub.h>
+#include <percepteros/LastDetections.h>
+#include <percepteros/RecordedScenes.h>
+
+#include <ros/ros.h>
+#include <ros/package.h>
+
+/**
+ * Runs recorded scenes through pipelines offline. The scenes are split into
+ * contiguous shards, one per worker process, and every worker creates its
+ * own engine, so the workers share nothing but the files they read. The
+ * engine is created once with the annotators of all pipelines, and the
+ * first scene of a shard is run through every pipeline before the timed
+ * runs, so no run pays for creating annotators. The cores are divided
+ * between the workers, annotators running several threads (normals, RANSAC,
+ * fusion) get the cores of their worker only. ROSPublisher takes the pose
+ * of the camera from the recorded viewpoint, there is no tf offline. Every
+ * scene is run through every pipeline, the frame table gets one row per
+ * scene and pipeline with the annotator times, the detection table one row
+ * per detection. The workers write their rows to shard tables, which are
+ * concatenated in scene order at the end.
+ */
+
+namespace
+{
+
+struct Pipeline
+{
+  std::string name;
+  std::vector<std::string> annotators;
+};
+
+struct Options
+{
+  std::string analysisEngineFile, scenes, out;
+  std::vector<Pipeline> pipelines;
+  size_t workers;
+  bool csv;
+  //threads of the threaded annotators of every worker
+  int threads;
+};
+
+//annotators with a threads parameter
+const char *const THREADED_ANNOTATORS[] = {"OrganizedNormalEstimator", "KinectFusion", "CakeAnnotator",
+                                           "CylinderAnnotator", "BoardAnnotator", "PlateAnnotator"};
+
+void help()
+{
+  std::cout << "Usage: caterrosBatch [options] analysisEngine.xml pipeline [...]" << std::endl
+            << "Runs every recorded scene through every pipeline (a config name like cake or a yaml file)." << std::endl
+            << "Options:" << std::endl
+            << "  -scenes DIR  Directory of scenes recorded by SzeneRecorder" << std::endl
+            << "  -workers N   Number of worker processes, each with its own engine and an equal share of the cores," << std::endl
+            << "               default one per core" << std::endl
+            << "  -out PREFIX  Results are written to PREFIX_frames.tab and PREFIX_detections.tab, default batch" << std::endl
+            << "  -csv         Also writes the results as PREFIX_frames.csv and PREFIX_detections.csv" << std::endl;
+}
+
+/**
+ * @brief readPipeline The annotators of a pipeline config as the batch runs them: SharedFrameReader hands out the
+ * recorded scene instead of the shared annotators, and SceneChangeGate is dropped so every scene gets a result
+ */
+bool readPipeline(const std::string &arg, const std::vector<std::string> &shared, Pipeline &pipeline)
+{
+  const std::string extension = ".yaml";
+  const bool isFile = arg.size() > extension.size() && arg.compare(arg.size() - extension.size(), extension.size(), extension) == 0;
+  const std::string file = isFile ? arg : ros::package::getPath("percepteros") + "/config/" + arg + extension;
+  cv::FileStorage fs(file, cv::FileStorage::READ);
+  std::vector<std::string> annotators;
+  if(fs.isOpened())
+  {
+    fs["annotators"] >> annotators;
+  }
+  if(annotators.empty())
+  {
+    outError("No pipeline in " << file);
+    return false;
+  }
+
+  const size_t slash = file.rfind('/');
+  pipeline.name = file.substr(slash == std::string::npos ? 0 : slash + 1);
+  pipeline.name = pipeline.name.substr(0, pipeline.name.size() - extension.size());
+  pipeline.annotators.assign(1, "SharedFrameReader");
+  for(const std::string &annotator : annotators)
+  {
+    if(annotator != "SceneChangeGate" && std::find(shared.begin(), shared.end(), annotator) == shared.end())
+    {
+      pipeline.annotators.push_back(annotator);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief writeDescriptor Writes a copy of the analysis engine with the annotators of all pipelines, the
+ * threaded annotators using the threads of a worker and the publisher using the recorded viewpoints
+ * @return the path of the copy, empty on error
+ */
+std::string writeDescriptor(const Options &options)
+{
+  percepteros::AnalysisEngineDescriptor descriptor;
+  std::set<std::string> annotators;
+  for(const Pipeline &pipeline : options.pipelines)
+  {
+    annotators.insert(pipeline.annotators.begin(), pipeline.annotators.end());
+  }
+  if(!descriptor.load(options.analysisEngineFile) || !descriptor.setParameter("ROSPublisher", "use_viewpoint", "Boolean", "true"))
+  {
+    outError(descriptor.getError());
+    return "";
+  }
+  for(const char *annotator : THREADED_ANNOTATORS)
+  {
+    if(annotators.count(annotator) && !descriptor.setParameter(annotator, "threads", "Integer", std::to_string(options.threads)))
+    {
+      outError(descriptor.getError());
+      return "";
+    }
+  }
+  const std::string file = descriptor.writeTrimmedTemporary(annotators);
+  if(file.empty())
+  {
+    outError(descriptor.getError());
+  }
+  return file;
+}
+
+std::string shardFile(const std::string &table, size_t worker)
+{
+  return table + "." + std::to_string(worker);
+}
+
+/**
+ * @brief addDetections Adds a row for every detection of a scene
+ */
+void addDetections(percepteros::ColumnTable &table, const std::string &scene, const std::string &pipeline,
+                   const percepteros::ObjectDetectionArray &result)
+{
+  for(const suturo_perception_msgs::ObjectDetection &detection : result.detections)
+  {
+    table.addRow();
+    table.set("scene", scene);
+    table.set("pipeline", pipeline);
+    table.set("name", detection.name);
+    table.set("type", (int64_t)detection.type);
+    table.set("frame_id", detection.pose.header.frame_id);
+    table.set("x", detection.pose.pose.position.x);
+    table.set("y", detection.pose.pose.position.y);
+    table.set("z", detection.pose.pose.position.z);
+    table.set("qx", detection.pose.pose.orientation.x);
+    table.set("qy", detection.pose.pose.orientation.y);
+    table.set("qz", detection.pose.pose.orientation.z);
+    table.set("qw", detection.pose.pose.orientation.w);
+    table.set("width", (double)detection.width);
+    table.set("height", (double)detection.height);
+    table.set("depth", (double)detection.depth);
+  }
+}
+
+/**
+ * @brief runWorker Processes the scenes [first, last) in a process of its own
+ * @return the exit status of the process
+ */
+int runWorker(int argc, char *argv[], const Options &options, size_t worker, size_t first, size_t last)
+{
+  ros::init(argc, argv, "percepteros_batch_" + std::to_string(worker), ros::init_options::NoSigintHandler);
+  ros::NodeHandle n("~");
+  uima::ResourceManager &resourceManager = uima::ResourceManager::createInstance("RoboSherlock");
+  resourceManager.setLoggingLevel(uima::LogStream::EnError);
+
+  percepteros::RecordedScenes scenes;
+  if(!scenes.open(options.scenes))
+  {
+    outError(scenes.getError());
+    return 1;
+  }
+
+  const std::string descriptorFile = writeDescriptor(options);
+  if(descriptorFile.empty())
+  {
+    return 1;
+  }
+
+  percepteros::ColumnTable frames, detections;
+  size_t publishedRuns = 0;
+  try
+  {
+    CaterrosControlledAnalysisEngine engine(n);
+    engine.setLazy(false);
+    engine.init(descriptorFile, options.pipelines[0].annotators);
+    unlink(descriptorFile.c_str());
+
+    //the first runs of the annotators are not timed
+    std::shared_ptr<percepteros::SharedSensorFrame> warmUp(new percepteros::SharedSensorFrame);
+    if(scenes.load(first, *warmUp))
+    {
+      for(const Pipeline &pipeline : options.pipelines)
+      {
+        percepteros::FrameHub::publish(warmUp);
+        percepteros::ObjectDetectionArray result;
+        std::vector<CaterrosControlledAnalysisEngine::StageTiming> stages;
+        percepteros::LastDetections::setPipeline(pipeline.name);
+        engine.processOnce(pipeline.annotators, result, stages);
+      }
+    }
+
+    for(size_t s = first; s < last && ros::ok(); ++s)
+    {
+      rs::StopWatch clock;
+      std::shared_ptr<percepteros::SharedSensorFrame> frame(new percepteros::SharedSensorFrame);
+      const bool loaded = scenes.load(s, *frame);
+      const double loadMs = clock.getTime();
+      for(const Pipeline &pipeline : options.pipelines)
+      {
+        frames.addRow();
+        frames.set("scene", scenes.name(s));
+        frames.set("pipeline", pipeline.name);
+        frames.set("worker", (int64_t)worker);
+        frames.set("load_ms", loadMs);
+        if(!loaded)
+        {
+          frames.set("error", scenes.getError());
+          continue;
+        }
+
+        //every pipeline reads the scene as a new frame
+        percepteros::FrameHub::publish(frame);
+        percepteros::ObjectDetectionArray result;
+        std::vector<CaterrosControlledAnalysisEngine::StageTiming> stages;
+        percepteros::LastDetections::setPipeline(pipeline.name);
+        rs::StopWatch run;
+        const bool published = engine.processOnce(pipeline.annotators, result, stages);
+        frames.set("total_ms", run.getTime());
+        frames.set("published", (int64_t)published);
+        frames.set("degraded", (int64_t)(published && result.degraded));
+        publishedRuns += published;
+        frames.set("detections", (int64_t)result.detections.size());
+        frames.set("stages", (int64_t)stages.size());
+        for(const CaterrosControlledAnalysisEngine::StageTiming &stage : stages)
+        {
+          frames.set("ms_" + stage.annotator, stage.ms);
+        }
+        if(!published && stages.size() < pipeline.annotators.size())
+        {
+          frames.set("error", "aborted by " + (stages.empty() ? std::string("the engine") : stages.back().annotator));
+        }
+        else if(!published)
+        {
+          frames.set("error", "no result published");
+        }
+        addDetections(detections, scenes.name(s), pipeline.name, result);
+      }
+    }
+  }
+  catch(const rs::Exception &e)
+  {
+    unlink(descriptorFile.c_str());
+    outError("Exception: " << std::endl << e.what());
+    return 1;
+  }
+  catch(const uima::Exception &e)
+  {
+    unlink(descriptorFile.c_str());
+    outError("Exception: " << std::endl << e);
+    return 1;
+  }
+  catch(const std::exception &e)
+  {
+    unlink(descriptorFile.c_str());
+    outError("Exception: " << std::endl << e.what());
+    return 1;
+  }
+
+  if(!frames.write(shardFile(options.out + "_frames.tab", worker))
+     || !detections.write(shardFile(options.out + "_detections.tab", worker)))
+  {
+    outError(frames.getError() << detections.getError());
+    return 1;
+  }
+  uima::ResourceManager::deleteInstance();
+  if(publishedRuns == 0)
+  {
+    outError("Worker " << worker << ": no run published a result, do the recordings have viewpoints?");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief mergeShards Concatenates the shard tables of the workers in their order and removes them
+ * @param csv file the merged table is exported to as well, none if empty
+ * @param rows set to the rows of the merged table
+ * @return false if a shard could not be read or the table not be written
+ */
+bool mergeShards(const std::string &table, size_t workers, const std::string &csv, size_t &rows)
+{
+  percepteros::ColumnTable merged;
+  bool complete = true;
+  for(size_t w = 0; w < workers; ++w)
+  {
+    percepteros::ColumnTable shard;
+    const std::string file = shardFile(table, w);
+    if(!shard.read(file) || !merged.append(shard))
+    {
+      outError(shard.getError() << merged.getError());
+      complete = false;
+      continue;
+    }
+    unlink(file.c_str());
+  }
+  if(!merged.write(table) || (!csv.empty() && !merged.writeCsv(csv)))
+  {
+    outError(merged.getError());
+    return false;
+  }
+  rows = merged.rows();
+  return complete;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3)
+  {
+    help();
+    return 1;
+  }
+
+  Options options;
+  options.out = "batch";
+  options.csv = false;
+  options.workers = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> args;
+  for(int argI = 1; argI < argc; ++argI)
+  {
+    const std::string arg = argv[argI];
+    if(arg == "-csv")
+    {
+      options.csv = true;
+    }
+    else if(arg == "-scenes" || arg == "-out" || arg == "-workers")
+    {
+      if(++argI >= argc)
+      {
+        outError(arg << " needs a value!");
+        return -1;
+      }
+      if(arg == "-scenes")
+      {
+        options.scenes = argv[argI];
+      }
+      else if(arg == "-out")
+      {
+        options.out = argv[argI];
+      }
+      else if(atoi(argv[argI]) < 1)
+      {
+        outError("-workers needs a positive number of workers!");
+        return -1;
+      }
+      else
+      {
+        options.workers = atoi(argv[argI]);
+      }
+    }
+    else
+    {
+      args.push_back(arg);
+    }
+  }
+  if(options.scenes.empty() || args.size() < 2)
+  {
+    help();
+    return 1;
+  }
+
+  if(!rs::common::getAEPaths(args[0], options.analysisEngineFile))
+  {
+    outError("analysis engine \"" << args[0] << "\" not found.");
+    return -1;
+  }
+  //the annotators the pool runs once for all engines, the recordings were made after them
+  std::vector<std::string> shared;
+  cv::FileStorage config(ros::package::getPath("percepteros") + "/config/config.yaml", cv::FileStorage::READ);
+  if(config.isOpened() && !config["shared_annotators"].empty())
+  {
+    config["shared_annotators"] >> shared;
+  }
+  else
+  {
+    shared.push_back("CollectionReader");
+    shared.push_back("ImagePreprocessor");
+  }
+  for(size_t i = 1; i < args.size(); ++i)
+  {
+    Pipeline pipeline;
+    if(!readPipeline(args[i], shared, pipeline))
+    {
+      return -1;
+    }
+    options.pipelines.push_back(pipeline);
+  }
+
+  percepteros::RecordedScenes scenes;
+  if(!scenes.open(options.scenes))
+  {
+    outError(scenes.getError());
+    return -1;
+  }
+  if(scenes.size() == 0)
+  {
+    outError("No scenes in " << options.scenes);
+    return -1;
+  }
+  options.workers = std::min(options.workers, scenes.size());
+
+  //contiguous shards keep the scenes of a worker in recording order
+  rs::StopWatch clock;
+  std::vector<pid_t> children;
+  const size_t shard = (scenes.size() + options.workers - 1) / options.workers;
+  options.workers = (scenes.size() + shard - 1) / shard;
+  options.threads = std::max<size_t>(1, std::max(1u, std::thread::hardware_concurrency()) / options.workers);
+  outInfo("Running " << scenes.size() << " scenes through " << options.pipelines.size() << " pipelines on "
+          << options.workers << " workers with " << options.threads << " threads each.");
+  for(size_t w = 0; w < options.workers; ++w)
+  {
+    const size_t first = std::min(w * shard, scenes.size()), last = std::min(first + shard, scenes.size());
+    const pid_t pid = fork();
+    if(pid == 0)
+    {
+      _exit(runWorker(argc, argv, options, w, first, last));
+    }
+    if(pid < 0)
+    {
+      outError("fork: " << strerror(errno));
+      break;
+    }
+    children.push_back(pid);
+  }
+
+  bool failed = children.size() < options.workers;
+  for(const pid_t pid : children)
+  {
+    int status;
+    if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      outError("Worker " << pid << " failed.");
+      failed = true;
+    }
+  }
+  const double wallMs = clock.getTime();
+
+  size_t frameRows = 0, detectionRows = 0;
+  failed = !mergeShards(options.out + "_frames.tab", children.size(), options.csv ? options.out + "_frames.csv" : "",
+                        frameRows) || failed;
+  failed = !mergeShards(options.out + "_detections.tab", children.size(),
+                        options.csv ? options.out + "_detections.csv" : "", detectionRows) || failed;
+  outInfo("Processed " << frameRows << " scene runs with " << detectionRows << " detections in " << wallMs / 1000.0
+          << " s, " << frameRows * 1000.0 / wallMs << " runs/s.");
+  return failed ? 1 : 0;
+}
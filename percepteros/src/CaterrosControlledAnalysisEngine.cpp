@@ -1,19 +1,93 @@
 #include <percepteros/CaterrosControlledAnalysisEngine.h>
+#include <percepteros/FrameDeadline.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/SceneIndex.h>
+
+#include <rs/utils/time.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace
+{
+
+//the engines of a pool may load annotators at the same time
+std::mutex creation_mutex;
+
+}
 
 /**
  * @brief CaterrosControlledAnalysisEngine::init Initialize The ControlledAnalysisEngine, using the given aefile
- * as a definition of the existing annotators and the lowLvlPipeline as the default pipeline
+ * as a definition of the existing annotators and the lowLvlPipeline as the default pipeline. A lazy engine only
+ * creates the annotators of lowLvlPipeline.
  * @param AEFile definition of the existing annotators
  * @param lowLvlPipeline the default pipeline
  */
 void CaterrosControlledAnalysisEngine::init(const std::string &AEFile, const std::vector<std::string> &lowLvlPipeline)
 {
+  rs::StopWatch clock;
+  std::string file = AEFile;
+  if(lazy_ && !descriptor_.load(AEFile))
+  {
+    outError("Could not read " << AEFile << ", creating all annotators: " << descriptor_.getError());
+    lazy_ = false;
+  }
+  if(lazy_)
+  {
+    loaded_ = std::set<std::string>(lowLvlPipeline.begin(), lowLvlPipeline.end());
+    file = descriptor_.writeTrimmedTemporary(loaded_);
+    if(file.empty())
+    {
+      outError("Could not trim " << AEFile << ", creating all annotators: " << descriptor_.getError());
+      file = AEFile;
+      lazy_ = false;
+    }
+  }
+
+  //init is called again when the analysis engine is reset
+  releaseEngine();
+  createEngine(file);
+  if(file != AEFile)
+  {
+    unlink(file.c_str());
+  }
+
+  // After all annotators have been initialized, pick the default pipeline
+
+  rspm->setDefaultPipelineOrdering(lowLvlPipeline);
+  rspm->setPipelineOrdering(lowLvlPipeline);
+  default_pipeline_order = lowLvlPipeline;
+  current_pipeline_order = lowLvlPipeline;
+  deadlineMs_ = nextDeadlineMs_;
+  alwaysRun_ = nextAlwaysRun_;
+  if(deadlineMs_ > 0)
+  {
+    outInfo("Pipeline deadline: " << deadlineMs_ << " ms");
+  }
+
+  outInfo("initialization done: " << name << std::endl
+          << std::endl << FG_YELLOW << "********************************************************************************" << std::endl);
+  currentAEName = AEFile;
+  reportInit(clock.getTime());
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::createEngine Creates the engine, its annotators and the CAS
+ * @param file definition of the annotators
+ */
+void CaterrosControlledAnalysisEngine::createEngine(const std::string &file)
+{
+  std::lock_guard<std::mutex> lock(creation_mutex);
   uima::ErrorInfo errorInfo;
 
-  size_t pos = AEFile.rfind('/');
-  outInfo("Creating analysis engine: " FG_BLUE << (pos == AEFile.npos ? AEFile : AEFile.substr(pos)));
+  size_t pos = file.rfind('/');
+  outInfo("Creating analysis engine: " FG_BLUE << (pos == file.npos ? file : file.substr(pos)));
 
-  engine = uima::Framework::createAnalysisEngine(AEFile.c_str(), errorInfo);
+  engine = uima::Framework::createAnalysisEngine(file.c_str(), errorInfo);
 
   if(errorInfo.getErrorId() != UIMA_ERR_NONE)
   {
@@ -35,10 +109,6 @@ void CaterrosControlledAnalysisEngine::init(const std::string &AEFile, const std
   rspm->aengine->getNbrOfAnnotators();
   outInfo("*** Number of Annotators in AnnotatorManager: " << rspm->aengine->getNbrOfAnnotators());
 
-  // After all annotators have been initialized, pick the default pipeline
-
-  rspm->setDefaultPipelineOrdering(lowLvlPipeline);
-  rspm->setPipelineOrdering(lowLvlPipeline);
   // Get a new CAS
   outInfo("Creating a new CAS");
   cas = engine->newCAS();
@@ -51,10 +121,129 @@ void CaterrosControlledAnalysisEngine::init(const std::string &AEFile, const std
     engine = NULL;
     throw uima::Exception(uima::ErrorMessage(UIMA_ERR_ENGINE_NO_CAS), UIMA_ERR_ENGINE_NO_CAS, uima::ErrorInfo::unrecoverable);
   }
+}
 
-  outInfo("initialization done: " << name << std::endl
-          << std::endl << FG_YELLOW << "********************************************************************************" << std::endl);
-  currentAEName = AEFile;
+/**
+ * @brief CaterrosControlledAnalysisEngine::releaseEngine Destroys the engine, its annotators and the CAS
+ */
+void CaterrosControlledAnalysisEngine::releaseEngine()
+{
+  std::lock_guard<std::mutex> lock(creation_mutex);
+  if(cas)
+  {
+    delete cas;
+    cas = NULL;
+  }
+  if(engine)
+  {
+    engine->destroy();
+    delete engine;
+    engine = NULL;
+  }
+  if(rspm)
+  {
+    delete rspm;
+    rspm = NULL;
+  }
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::loadAnnotators Recreates a lazy engine if the pipeline uses annotators
+ * it does not contain yet. UIMA has no way to add delegates to a running engine, so the annotators which were
+ * loaded before start over with a fresh state, which is why lazy loading has to be asked for.
+ */
+void CaterrosControlledAnalysisEngine::loadAnnotators(const std::vector<std::string> &pipeline)
+{
+  if(!lazy_ || !rspm)
+  {
+    return;
+  }
+  std::set<std::string> needed = loaded_;
+  std::vector<std::string> missing;
+  for(const std::string &annotator : pipeline)
+  {
+    if(needed.insert(annotator).second)
+    {
+      missing.push_back(annotator);
+    }
+  }
+  if(missing.empty())
+  {
+    return;
+  }
+
+  rs::StopWatch clock;
+  const std::string file = descriptor_.writeTrimmedTemporary(needed);
+  if(file.empty())
+  {
+    outError("Could not trim " << currentAEName << ": " << descriptor_.getError());
+    return;
+  }
+  releaseEngine();
+  createEngine(file);
+  unlink(file.c_str());
+  loaded_ = needed;
+  rspm->setDefaultPipelineOrdering(default_pipeline_order);
+  rspm->setPipelineOrdering(current_pipeline_order);
+
+  std::ostringstream names;
+  for(const std::string &annotator : missing)
+  {
+    names << " " << annotator;
+  }
+  outInfo("Loaded" << names.str() << " in " << clock.getTime() << " ms.");
+  reportInit(clock.getTime());
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::reportInit Logs the start up time of the engine. With the init report
+ * enabled, every annotator is created once more on its own to tell how much of it is spent where.
+ * @param engineMs time it took to create the engine
+ */
+void CaterrosControlledAnalysisEngine::reportInit(const double engineMs)
+{
+  const size_t annotators = rspm->aengine->getNbrOfAnnotators();
+  outInfo("Created " << annotators << " annotators in " << engineMs << " ms.");
+  if(!initReport_)
+  {
+    return;
+  }
+  if(!lazy_ && !descriptor_.load(currentAEName))
+  {
+    outError("No init report: " << descriptor_.getError());
+    return;
+  }
+
+  std::vector<std::pair<double, std::string>> times;
+  for(const std::string &annotator : descriptor_.getDelegates())
+  {
+    if(lazy_ && !loaded_.count(annotator))
+    {
+      continue;
+    }
+    const std::string file = descriptor_.getDelegateFile(annotator);
+    rs::StopWatch clock;
+    uima::ErrorInfo errorInfo;
+    uima::AnalysisEngine *single = uima::Framework::createAnalysisEngine(file.c_str(), errorInfo);
+    const double took = clock.getTime();
+    if(errorInfo.getErrorId() != UIMA_ERR_NONE || !single)
+    {
+      outError("Could not create " << annotator << " on its own: " << errorInfo.asString());
+      continue;
+    }
+    single->destroy();
+    delete single;
+    times.push_back(std::make_pair(took, annotator));
+  }
+
+  std::sort(times.rbegin(), times.rend());
+  std::ostringstream report;
+  report << "Init report, each annotator on its own:";
+  for(const std::pair<double, std::string> &time : times)
+  {
+    report << std::endl << "  " << time.second << ": " << time.first << " ms";
+  }
+  outInfo(report.str());
 }
 
 /**
@@ -63,9 +252,65 @@ void CaterrosControlledAnalysisEngine::init(const std::string &AEFile, const std
  */
 void CaterrosControlledAnalysisEngine::process(bool reset_pipeline_after_process){
     cas->reset();
+    percepteros::FrameArena::reset();
+    percepteros::SceneIndex::reset();
     UnicodeString ustrInputText;
     ustrInputText.fromUTF8(name);
     cas->setDocumentText(uima::UnicodeStringRef(ustrInputText));
+    if(deadlineMs_ > 0)
+    {
+      processWithDeadline();
+    }
+    else if(profile_)
+    {
+      std::vector<StageTiming> stages;
+      processStepwise(stages);
+    }
+    else
+    {
+      runEngine();
+    }
+    updateSignature();
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::updateSignature Describes the scene of the frame in the CAS. Also frames
+ * which were stopped by a filter carry the sensor data.
+ */
+void CaterrosControlledAnalysisEngine::updateSignature()
+{
+  //the same blocks as SceneChangeGate, a cached result becomes the reference of the gate
+  const int gridStep = percepteros::SceneSignature::GRID_STEP;
+  try
+  {
+    rs::SceneCas sceneCas(*cas);
+    cv::Mat depth;
+    if(!sceneCas.get(VIEW_DEPTH_IMAGE, depth) || depth.empty())
+    {
+      signature_ = percepteros::SceneSignature();
+      return;
+    }
+    rs::Scene scene = sceneCas.getScene();
+    tf::StampedTransform viewpoint;
+    const bool hasViewpoint = scene.viewPoint.has();
+    if(hasViewpoint)
+    {
+      rs::conversion::from(scene.viewPoint.get(), viewpoint);
+    }
+    signature_.compute(depth, gridStep, hasViewpoint ? &viewpoint : NULL);
+  }
+  catch(...)
+  {
+    outError("Could not describe the scene of the frame.");
+    signature_ = percepteros::SceneSignature();
+  }
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::runEngine Runs the current pipeline ordering on the CAS
+ * @return false if the frame has to be aborted
+ */
+bool CaterrosControlledAnalysisEngine::runEngine(){
     try
        {
          uima::CASIterator casIter = engine->processAndOutputNewCASes(*cas);
@@ -77,6 +322,7 @@ void CaterrosControlledAnalysisEngine::process(bool reset_pipeline_after_process
            outInfo("release CAS " << i);
            engine->getAnnotatorContext().releaseCAS(outCas);
          }
+         return true;
        }
      catch(const rs::FrameFilterException &)
      {
@@ -98,4 +344,222 @@ void CaterrosControlledAnalysisEngine::process(bool reset_pipeline_after_process
      {
        outError("Unknown exception!");
    }
+   return false;
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::runAnnotator Runs a single annotator on the CAS. In profiling mode the
+ * performance counters of the thread are read around it.
+ * @return false if the frame has to be aborted
+ */
+bool CaterrosControlledAnalysisEngine::runAnnotator(const std::string &annotator)
+{
+  rspm->setPipelineOrdering(std::vector<std::string>(1, annotator));
+  if(!profile_)
+  {
+    return runEngine();
+  }
+
+  //counters only count the thread which opened them
+  if(!perf_)
+  {
+    perf_.reset(new percepteros::PerfCounters);
+    if(!perf_->open())
+    {
+      outInfo("No performance counters available, profiling latency only.");
+    }
+  }
+  percepteros::PerfCounters::Sample sample;
+  rs::StopWatch clock;
+  perf_->start();
+  const bool ok = runEngine();
+  perf_->stop(sample);
+  const double took = clock.getTime();
+
+  std::lock_guard<std::mutex> lock(*profile_mutex_);
+  AnnotatorProfile &profile = profiles_[annotator];
+  ++profile.runs;
+  profile.totalMs += took;
+  for(int i = 0; i < percepteros::PerfCounters::COUNT; ++i)
+  {
+    if(sample.valid[i])
+    {
+      profile.counters[i] += sample.values[i];
+      ++profile.counted[i];
+    }
+  }
+  return ok;
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::getProfile Formats latency, IPC and miss rates of every annotator
+ * profiled so far. Miss rates are given per thousand instructions, missing counters as -.
+ */
+std::string CaterrosControlledAnalysisEngine::getProfile()
+{
+  typedef percepteros::PerfCounters PC;
+  std::lock_guard<std::mutex> lock(*profile_mutex_);
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(2);
+  out << "annotator runs ms IPC LLC-MPKI branch-MPKI switches";
+  for(const std::pair<const std::string, AnnotatorProfile> &entry : profiles_)
+  {
+    const AnnotatorProfile &profile = entry.second;
+    const bool cycles = profile.counted[PC::CYCLES] > 0;
+    const bool instructions = profile.counted[PC::INSTRUCTIONS] > 0 && profile.counters[PC::INSTRUCTIONS] > 0;
+    const double kiloInstructions = profile.counters[PC::INSTRUCTIONS] / 1000.0;
+
+    out << std::endl << entry.first << " " << profile.runs << " " << profile.totalMs / profile.runs << " ";
+    if(cycles && instructions && profile.counters[PC::CYCLES] > 0)
+    {
+      out << (double)profile.counters[PC::INSTRUCTIONS] / profile.counters[PC::CYCLES] << " ";
+    }
+    else
+    {
+      out << "- ";
+    }
+    const PC::Counter misses[] = {PC::CACHE_MISSES, PC::BRANCH_MISSES};
+    for(const PC::Counter counter : misses)
+    {
+      if(instructions && profile.counted[counter] > 0)
+      {
+        out << profile.counters[counter] / kiloInstructions << " ";
+      }
+      else
+      {
+        out << "- ";
+      }
+    }
+    if(profile.counted[PC::CONTEXT_SWITCHES] > 0)
+    {
+      out << (double)profile.counters[PC::CONTEXT_SWITCHES] / profile.counted[PC::CONTEXT_SWITCHES];
+    }
+    else
+    {
+      out << "-";
+    }
+  }
+  return out.str();
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::processStepwise Executes the pipeline one annotator at a time and
+ * measures each of them. Expects a reset CAS.
+ */
+bool CaterrosControlledAnalysisEngine::processStepwise(std::vector<StageTiming> &stages)
+{
+  const std::vector<std::string> order = current_pipeline_order;
+  bool ok = true;
+
+  stages.clear();
+  rs::StopWatch clock;
+  for(size_t i = 0; i < order.size() && ok; ++i)
+  {
+    const double start = clock.getTime();
+    ok = runAnnotator(order[i]);
+    StageTiming stage;
+    stage.annotator = order[i];
+    stage.ms = clock.getTime() - start;
+    stages.push_back(stage);
+  }
+  rspm->setPipelineOrdering(order);
+  return ok;
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::processOnce Executes the given pipeline on the next frame and hands out
+ * its result. The detections of a one-off pipeline are never repeated for the current one.
+ */
+bool CaterrosControlledAnalysisEngine::processOnce(const std::vector<std::string> &pipeline,
+                                                   percepteros::ObjectDetectionArray &detections,
+                                                   std::vector<StageTiming> &stages)
+{
+  const std::vector<std::string> current = current_pipeline_order;
+  loadAnnotators(pipeline);
+  rspm->setPipelineOrdering(pipeline);
+  current_pipeline_order = pipeline;
+  percepteros::LastDetections::invalidate();
+
+  cas->reset();
+  percepteros::FrameArena::reset();
+  percepteros::SceneIndex::reset();
+  UnicodeString ustrInputText;
+  ustrInputText.fromUTF8(name);
+  cas->setDocumentText(uima::UnicodeStringRef(ustrInputText));
+  processStepwise(stages);
+  updateSignature();
+  const bool published = percepteros::LastDetections::get(detections);
+
+  rspm->setPipelineOrdering(current);
+  current_pipeline_order = current;
+  percepteros::LastDetections::invalidate();
+  return published;
+}
+
+/**
+ * @brief CaterrosControlledAnalysisEngine::processWithDeadline Executes the pipeline one annotator at a time.
+ * Every annotator gets a share of the remaining time proportional to its historical latency. Annotators
+ * that no longer fit are skipped, except the ones in alwaysRun_, and the frame is published as degraded.
+ */
+void CaterrosControlledAnalysisEngine::processWithDeadline()
+{
+  //weight of the newest run in the latency average
+  const double alpha = 0.2;
+  const std::vector<std::string> order = current_pipeline_order;
+
+  rs::StopWatch clock;
+  percepteros::FrameDeadline::beginFrame(deadlineMs_);
+  for(size_t i = 0; i < order.size(); ++i)
+  {
+    const std::string &annotator = order[i];
+    AnnotatorTiming &timing = timings_[annotator];
+    //the first annotator reads the data everything else depends on
+    const bool required = i == 0 || alwaysRun_.count(annotator);
+    const double remaining = deadlineMs_ - clock.getTime();
+
+    double expectedLeft = 0;
+    for(size_t j = i; j < order.size(); ++j)
+    {
+      expectedLeft += timings_[order[j]].expectedMs;
+    }
+    if(!required && (remaining <= 0 || (timing.runs > 0 && timing.expectedMs > remaining)))
+    {
+      ++timing.skipped;
+      percepteros::FrameDeadline::markDegraded();
+      outInfo("Skipping " << annotator << ", " << remaining << " ms left, expected " << timing.expectedMs << " ms.");
+      continue;
+    }
+
+    const double budget = expectedLeft > 0 && timing.expectedMs > 0 ? remaining * timing.expectedMs / expectedLeft : remaining;
+    percepteros::FrameDeadline::beginStage(std::max(budget, 0.0), timing.expectedMs);
+
+    const double start = clock.getTime();
+    const bool ok = runAnnotator(annotator);
+    const double took = clock.getTime() - start;
+
+    //runs which were cut short say nothing about the full latency
+    if(percepteros::FrameDeadline::stageDegraded())
+    {
+      ++timing.degraded;
+    }
+    if(timing.runs == 0)
+    {
+      timing.expectedMs = took;
+    }
+    else if(!percepteros::FrameDeadline::stageDegraded())
+    {
+      timing.expectedMs = alpha * took + (1 - alpha) * timing.expectedMs;
+    }
+    ++timing.runs;
+
+    if(!ok)
+    {
+      break;
+    }
+  }
+  rspm->setPipelineOrdering(order);
+
+  const bool degraded = percepteros::FrameDeadline::degraded();
+  percepteros::FrameDeadline::endFrame();
+  outInfo("Frame took " << clock.getTime() << " of " << deadlineMs_ << " ms" << (degraded ? ", results are degraded." : "."));
 }
@@ -0,0 +1,155 @@
+#include <percepteros/CaterrosEngineWorker.h>
+#include <percepteros/LastDetections.h>
+
+#include <unistd.h>
+
+/**
+ * @brief CaterrosEngineWorker::init Creates the engine with the given pipeline as its default pipeline
+ */
+void CaterrosEngineWorker::init(const std::string &xmlFile, const std::vector<std::string> &pipeline,
+                                const std::string &pipelineName, double deadline, const std::vector<std::string> &alwaysRun)
+{
+  engine.setNextDeadline(deadline, alwaysRun);
+  engine.init(xmlFile, pipeline);
+  pipelineName_ = pipelineName;
+  requestedName_ = pipelineName;
+  lastRequest_ = ros::WallTime::now();
+}
+
+void CaterrosEngineWorker::request(const std::string &pipelineName, const std::vector<std::string> &pipeline, double deadline,
+                                   const std::vector<std::string> &alwaysRun, const percepteros::ObjectDetectionArray *cached,
+                                   const percepteros::SceneSignature &scene)
+{
+  std::lock_guard<std::mutex> lock(request_mutex_);
+  nextPipelineName_ = pipelineName;
+  nextPipeline_ = pipeline;
+  nextDeadline_ = deadline;
+  nextAlwaysRun_ = alwaysRun;
+  hasCachedDetections_ = cached != NULL;
+  if(cached)
+  {
+    cachedDetections_ = *cached;
+    cachedScene_ = scene;
+  }
+  requestedName_ = pipelineName;
+  lastRequest_ = ros::WallTime::now();
+  queued_ = true;
+}
+
+void CaterrosEngineWorker::release()
+{
+  std::lock_guard<std::mutex> lock(request_mutex_);
+  nextPipelineName_.clear();
+  hasCachedDetections_ = false;
+  requestedName_.clear();
+  queued_ = true;
+}
+
+std::string CaterrosEngineWorker::getPipelineName()
+{
+  std::lock_guard<std::mutex> lock(request_mutex_);
+  return requestedName_;
+}
+
+ros::WallTime CaterrosEngineWorker::getLastRequest()
+{
+  std::lock_guard<std::mutex> lock(request_mutex_);
+  return lastRequest_;
+}
+
+/**
+ * @brief CaterrosEngineWorker::applyRequest Switches to the queued pipeline. If its result was found in the cache,
+ * it becomes the last result with the scene it was found for as reference, so SceneChangeGate repeats it instead
+ * of running the pipeline while the scene stays the same.
+ */
+void CaterrosEngineWorker::applyRequest()
+{
+  std::lock_guard<std::mutex> lock(request_mutex_);
+  if(!queued_)
+  {
+    return;
+  }
+  queued_ = false;
+  pipelineName_ = nextPipelineName_;
+  if(pipelineName_.empty())
+  {
+    engine.resetPipelineOrdering();
+    return;
+  }
+  engine.setNextPipeline(nextPipeline_);
+  engine.setNextDeadline(nextDeadline_, nextAlwaysRun_);
+  engine.applyNextPipeline();
+  if(hasCachedDetections_)
+  {
+    //switching the pipeline dropped the reference, the cached result brings its own
+    percepteros::LastDetections::beginScene(cachedScene_);
+    percepteros::LastDetections::store(cachedDetections_);
+    hasCachedDetections_ = false;
+  }
+}
+
+bool CaterrosEngineWorker::step()
+{
+  applyRequest();
+  if(pipelineName_.empty())
+  {
+    return false;
+  }
+  percepteros::LastDetections::setPipeline(pipelineName_);
+  engine.process(true);
+  cacheResult();
+  return true;
+}
+
+/**
+ * @brief CaterrosEngineWorker::cacheResult Stores the result of a complete run of the current pipeline
+ */
+void CaterrosEngineWorker::cacheResult()
+{
+  percepteros::ObjectDetectionArray detections;
+  if(!percepteros::LastDetections::get(detections) || detections.degraded)
+  {
+    return;
+  }
+  //repeated results were already cached when their run finished
+  if(hasLastCachedFrame_ && detections.frame == lastCachedFrame_)
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    resultCache_.insert(pipelineName_, engine.getSceneSignature(), detections);
+  }
+  lastCachedFrame_ = detections.frame;
+  hasLastCachedFrame_ = true;
+}
+
+void CaterrosEngineWorker::start()
+{
+  if(running_)
+  {
+    return;
+  }
+  running_ = true;
+  thread_ = std::thread(&CaterrosEngineWorker::loop, this);
+}
+
+void CaterrosEngineWorker::stop()
+{
+  running_ = false;
+  if(thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+void CaterrosEngineWorker::loop()
+{
+  while(running_ && ros::ok())
+  {
+    if(paused_ || !step())
+    {
+      usleep(100000);
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <percepteros/ModelStore.h>
+#include <percepteros/ModelSources.h>
+
+void help()
+{
+  std::cout << "Usage: caterrosModelCompiler output.models source.yaml [...]" << std::endl
+            << "Compiles the object templates (templates, scales) and color classes (color_classes)" << std::endl
+            << "of the yaml sources into a model store mapped by the annotators." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3)
+  {
+    help();
+    return 1;
+  }
+
+  std::vector<percepteros::ObjectTemplate> objects;
+  std::vector<percepteros::ColorClass> classes;
+  percepteros::TemplateIndex::Scales scales;
+  for(int i = 2; i < argc; ++i)
+  {
+    std::string error;
+    cv::FileStorage fs(argv[i], cv::FileStorage::READ);
+    if(!fs.isOpened())
+    {
+      std::cerr << "Could not open " << argv[i] << std::endl;
+      return 1;
+    }
+    if(!percepteros::readTemplates(fs, objects, scales, error) || !percepteros::readColorClasses(fs, classes, error))
+    {
+      std::cerr << argv[i] << ": " << error << std::endl;
+      return 1;
+    }
+  }
+
+  percepteros::ModelStoreWriter writer;
+  percepteros::TemplateIndex templates;
+  if(!objects.empty())
+  {
+    templates.build(objects, scales);
+    templates.save(writer);
+  }
+  if(!classes.empty())
+  {
+    percepteros::ColorClassTable(classes).save(writer);
+  }
+  if(!writer.write(argv[1]))
+  {
+    std::cerr << writer.getError() << std::endl;
+    return 1;
+  }
+  std::cout << "Compiled " << objects.size() << " templates and " << classes.size() << " color classes into " << argv[1]
+            << std::endl;
+  return 0;
+}
@@ -1,28 +1,285 @@
 #include <percepteros/CaterrosPipelineManager.h>
+#include <percepteros/LastDetections.h>
+
+#include <rs/utils/time.h>
 
 /**
- * @brief CaterrosPipelineManager::run Runs the pipeline. Checks first, whether a new pipeline was selected and
- * applies the new pipeline if needed.
+ * @brief CaterrosPipelineManager::init Creates the engines. A single engine runs the complete pipeline, a pool
+ * gets a feeder engine for the shared annotators and idle engines except for the first one.
+ * @param xmlFile definition of the existing annotators
+ * @param configFile the default pipeline
+ */
+void CaterrosPipelineManager::init(std::string &xmlFile, std::string &configFile)
+{
+  this->configFile = configFile;
+  cv::FileStorage fs(configFile, cv::FileStorage::READ);
+  if(lowLvlPipeline_.empty()) //if not set programatically, load from a config file
+  {
+    fs["annotators"] >> lowLvlPipeline_;
+  }
+  double deadline;
+  std::vector<std::string> alwaysRun;
+  readDeadline(fs, deadline, alwaysRun);
+  if(!fs["cache_size"].empty())
+  {
+    int cacheSize;
+    fs["cache_size"] >> cacheSize;
+    resultCache_.setCapacity(std::max(cacheSize, 1));
+  }
+  if(!fs["shared_annotators"].empty())
+  {
+    sharedAnnotators_.clear();
+    fs["shared_annotators"] >> sharedAnnotators_;
+  }
+
+  workers_.clear();
+  for(size_t i = 0; i < poolSize_; ++i)
+  {
+    workers_.emplace_back(new CaterrosEngineWorker(nh_, resultCache_, cacheMutex_));
+    workers_.back()->setLazy(lazy_);
+    workers_.back()->setInitReport(initReport_ && i == 0);
+    workers_.back()->setProfiling(profile_);
+    //idle engines of a lazy pool load their annotators with the first request
+    const std::vector<std::string> pipeline = i == 0 || !lazy_ ? workerPipeline(lowLvlPipeline_)
+                                                               : std::vector<std::string>(1, "SharedFrameReader");
+    workers_.back()->init(xmlFile, pipeline, i == 0 ? "config" : "", deadline, alwaysRun);
+  }
+  if(poolSize_ > 1)
+  {
+    std::vector<std::string> feederPipeline = sharedAnnotators_;
+    feederPipeline.push_back("SharedFrameWriter");
+    feeder_.setLazy(lazy_);
+    feeder_.setInitReport(initReport_);
+    feeder_.setProfiling(profile_);
+    feeder_.init(xmlFile, feederPipeline);
+    for(auto &worker : workers_)
+    {
+      worker->start();
+    }
+    outInfo("Running a pool of " << poolSize_ << " engines.");
+  }
+  if(useVisualizer_)
+  {
+    visualizer_.start();
+  }
+}
+
+/**
+ * @brief CaterrosPipelineManager::run Runs the pipeline. A single engine is stepped here and applies a newly
+ * selected pipeline before its next frame, a pool only needs the feeder to be run.
  */
 void CaterrosPipelineManager::run()
 {
   for(; ros::ok();)
   {
-    if(waitForServiceCall_ || pause_)
+    const bool idle = waitForServiceCall_ || pause_;
+    if(workers_.size() > 1)
+    {
+      //the engines of a pool run in their own threads
+      for(auto &worker : workers_)
+      {
+        worker->setPaused(idle);
+      }
+    }
+    if(idle)
     {
       usleep(100000);
     }
-    else
+    else if(workers_.size() == 1)
     {
-      if(engine.queued){
-        engine.applyNextPipeline();
+      if(!workers_[0]->step())
+      {
+        usleep(100000);
       }
-      engine.process(true);
+    }
+    else
+    {
+      feeder_.process(true);
     }
     ros::spinOnce();
   }
 }
 
+/**
+ * @brief CaterrosPipelineManager::workerPipeline Replaces the shared annotators of a pipeline by SharedFrameReader
+ * if the engines of a pool run it
+ */
+std::vector<std::string> CaterrosPipelineManager::workerPipeline(const std::vector<std::string> &pipeline) const
+{
+  if(poolSize_ < 2)
+  {
+    return pipeline;
+  }
+  std::vector<std::string> result(1, "SharedFrameReader");
+  for(const std::string &annotator : pipeline)
+  {
+    if(std::find(sharedAnnotators_.begin(), sharedAnnotators_.end(), annotator) == sharedAnnotators_.end())
+    {
+      result.push_back(annotator);
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief CaterrosPipelineManager::selectWorker Picks the engine for a request: the one already running the
+ * pipeline, otherwise an idle one, otherwise the one that was asked the longest time ago
+ */
+CaterrosEngineWorker &CaterrosPipelineManager::selectWorker(const std::string &pipelineName)
+{
+  CaterrosEngineWorker *idle = NULL, *oldest = NULL;
+  ros::WallTime oldestRequest;
+  for(auto &worker : workers_)
+  {
+    const std::string name = worker->getPipelineName();
+    if(name == pipelineName)
+    {
+      return *worker;
+    }
+    if(name.empty() && !idle)
+    {
+      idle = worker.get();
+    }
+    const ros::WallTime lastRequest = worker->getLastRequest();
+    if(!oldest || lastRequest < oldestRequest)
+    {
+      oldest = worker.get();
+      oldestRequest = lastRequest;
+    }
+  }
+  return idle ? *idle : *oldest;
+}
+
+/**
+ * @brief CaterrosPipelineManager::currentScene The scene the next request will see, computed by the engine that
+ * reads the frames
+ */
+const percepteros::SceneSignature &CaterrosPipelineManager::currentScene() const
+{
+  return workers_.size() == 1 ? workers_[0]->getSceneSignature() : feeder_.getSceneSignature();
+}
+
+/**
+ * @brief CaterrosPipelineManager::runQueryCallback The query runs in the thread which reads the frames, a pool keeps
+ * running the requested pipelines meanwhile.
+ */
+bool CaterrosPipelineManager::runQueryCallback(percepteros::RunQuery::Request &req, percepteros::RunQuery::Response &res)
+{
+  std::vector<std::string> pipeline;
+  for(const std::string &object : req.objects)
+  {
+    const std::string pipelineName = pipelineForObject(object);
+    cv::FileStorage fs(ros::package::getPath("percepteros") + "/config/" + pipelineName + ".yaml", cv::FileStorage::READ);
+    std::vector<std::string> lowLvlPipeline;
+    fs["annotators"] >> lowLvlPipeline;
+    mergePipeline(pipeline, lowLvlPipeline);
+  }
+  if(pipeline.empty())
+  {
+    res.success = false;
+    res.message = "No pipeline found for the requested objects.";
+    return true;
+  }
+
+  std::vector<CaterrosControlledAnalysisEngine::StageTiming> stages;
+  rs::StopWatch clock;
+  percepteros::LastDetections::setPipeline("run_query");
+  if(workers_.size() == 1)
+  {
+    res.success = workers_[0]->processOnce(pipeline, res.detections, stages);
+  }
+  else
+  {
+    res.success = feeder_.processOnce(pipeline, res.detections, stages);
+  }
+  res.total_ms = clock.getTime();
+  for(const CaterrosControlledAnalysisEngine::StageTiming &stage : stages)
+  {
+    res.stages.push_back(stage.annotator);
+    res.stage_ms.push_back(stage.ms);
+  }
+  if(!res.success && stages.size() == pipeline.size())
+  {
+    res.message = "The pipeline did not publish any detections.";
+  }
+  else if(!res.success)
+  {
+    res.message = "The frame was aborted by " + (stages.empty() ? std::string("the engine") : stages.back().annotator) + ".";
+  }
+  outInfo("Query for " << req.objects.size() << " objects took " << res.total_ms << " ms.");
+  return true;
+}
+
+bool CaterrosPipelineManager::annotatorStatsCallback(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res)
+{
+  if(!profile_)
+  {
+    res.success = false;
+    res.message = "Profiling is disabled, start caterrosRun with -perf.";
+    return true;
+  }
+  std::ostringstream stats;
+  if(workers_.size() > 1)
+  {
+    stats << "feeder:" << std::endl << feeder_.getProfile() << std::endl;
+  }
+  for(size_t i = 0; i < workers_.size(); ++i)
+  {
+    stats << "engine " << i << ":" << std::endl << workers_[i]->getProfile() << std::endl;
+  }
+  res.success = true;
+  res.message = stats.str();
+  return true;
+}
+
+std::string CaterrosPipelineManager::pipelineForObject(const std::string &object)
+{
+  if(object == "cake")
+  {
+    return "cake";
+  }
+  else if(object == "cylinder")
+  {
+    return "cylinder";
+  }
+  else if(object == "knife")
+  {
+    return "knife";
+  }
+  else if(object == "end")
+  {
+    return "end";
+  }
+  else if(object == "spatula")
+  {
+    return "spatulaRecognition";
+  }
+  else if(object == "plate")
+  {
+    return "plate";
+  }
+  else if(object == "board")
+  {
+    return "board";
+  }
+  outInfo("No Corresponding Object found, setting pipelineName to 'config'!");
+  return "config";
+}
+
+void CaterrosPipelineManager::mergePipeline(std::vector<std::string> &merged, const std::vector<std::string> &pipeline)
+{
+  size_t insertAt = 0;
+  for(const std::string &annotator : pipeline)
+  {
+    std::vector<std::string>::iterator it = std::find(merged.begin(), merged.end(), annotator);
+    if(it == merged.end())
+    {
+      it = merged.insert(merged.begin() + insertAt, annotator);
+    }
+    insertAt = std::max<size_t>(insertAt, it - merged.begin() + 1);
+  }
+}
+
 /**
  * @brief CaterrosPipelineManager::resetAE Resets the AnalysisEngine.
  * @param newPipelineName The name of the new AnalysisEngine
@@ -26,6 +26,11 @@ void help()
             << "  -wait If using piepline set this to wait for a service call" << std::endl
             << "  -cwa use the list of objects from [pkg_path]/config/config.yaml to set a closed world assumption"
             << "  -visualizer  Enable visualization" << std::endl
+            << "  -engines N   Run up to N pipelines concurrently, each in its own engine" << std::endl
+            << "  -lazy        Create annotators when a pipeline first uses them instead of at start up. Every pipeline" << std::endl
+            << "               that needs new annotators recreates the engine and resets the state of all annotators" << std::endl
+            << "  -init_report Log the initialization time of every annotator" << std::endl
+            << "  -perf        Profile every annotator with the performance counters, see the annotator_stats service" << std::endl
             << "  -save PATH   Path for storing images" << std::endl;
 }
 
@@ -48,6 +53,10 @@ int main(int argc, char *argv[])
     bool waitForServiceCall = false;
     bool useCWAssumption = false;
     bool useObjIDRes = false;
+    int poolSize = 1;
+    bool lazy = false;
+    bool initReport = false;
+    bool profile = false;
     std::string savePath = getenv("HOME");
 
     size_t argO = 0;
@@ -71,6 +80,26 @@ int main(int argc, char *argv[])
       {
         useObjIDRes = true;
       }
+      else if(arg == "-lazy")
+      {
+        lazy = true;
+      }
+      else if(arg == "-init_report")
+      {
+        initReport = true;
+      }
+      else if(arg == "-perf")
+      {
+        profile = true;
+      }
+      else if(arg == "-engines")
+      {
+        if(++argI >= args.size() || (poolSize = atoi(args[argI].c_str())) < 1)
+        {
+          outError("-engines needs a positive number of engines!");
+          return -1;
+        }
+      }
       else if(arg == "-save")
       {
         if(++argI < args.size())
@@ -114,8 +143,11 @@ int main(int argc, char *argv[])
     ros::NodeHandle n("~");
     try
     {
-      CaterrosPipelineManager manager(useVisualizer, savePath, waitForServiceCall, n);
+      CaterrosPipelineManager manager(useVisualizer, savePath, waitForServiceCall, n, poolSize);
       manager.setUseIdentityResolution(useObjIDRes);
+      manager.setLazy(lazy);
+      manager.setInitReport(initReport);
+      manager.setProfiling(profile);
       manager.pause();
       manager.init(analysisEngineFile, configFile);
       manager.run();
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <string>
+
+#include <percepteros/ColumnTable.h>
+
+void help()
+{
+  std::cout << "Usage: caterrosTable table.tab [output.csv]" << std::endl
+            << "Converts a column table written by caterrosBatch to CSV, written to standard output" << std::endl
+            << "if no output file is given." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2 || argc > 3)
+  {
+    help();
+    return 1;
+  }
+
+  percepteros::ColumnTable table;
+  if(!table.read(argv[1]))
+  {
+    std::cerr << table.getError() << std::endl;
+    return 1;
+  }
+  if(argc == 2)
+  {
+    table.writeCsv(std::cout);
+    return std::cout ? 0 : 1;
+  }
+  if(!table.writeCsv(argv[2]))
+  {
+    std::cerr << table.getError() << std::endl;
+    return 1;
+  }
+  std::cerr << "Wrote " << table.rows() << " rows of " << table.columns() << " columns to " << argv[2] << std::endl;
+  return 0;
+}
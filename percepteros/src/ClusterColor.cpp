@@ -0,0 +1,336 @@
+#include <percepteros/ClusterColor.h>
+#include <percepteros/ModelSources.h>
+
+#include <rs/utils/output.h>
+
+#include <ros/package.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+namespace percepteros
+{
+
+namespace
+{
+
+std::mutex sharedMutex;
+//NULL until configured or loaded on first use
+std::shared_ptr<const ColorClassTable> sharedTable;
+std::string loadError;
+std::once_flag reportOnce;
+
+//unit vectors of the hue bin centers for the circular mean
+struct HueCircle
+{
+  float cosine[ColorClassTable::HUE_BINS];
+  float sine[ColorClassTable::HUE_BINS];
+
+  HueCircle()
+  {
+    for(int i = 0; i < ColorClassTable::HUE_BINS; ++i)
+    {
+      const double angle = (i + 0.5) * 2.0 * M_PI / ColorClassTable::HUE_BINS;
+      cosine[i] = std::cos(angle);
+      sine[i] = std::sin(angle);
+    }
+  }
+};
+
+const HueCircle hueCircle;
+
+}
+
+bool ColorClass::contains(float h, float s, float v) const
+{
+  const bool hueInside = minHue <= maxHue ? (h >= minHue && h <= maxHue) : (h >= minHue || h <= maxHue);
+  return hueInside && s >= minSaturation && s <= maxSaturation && v >= minValue && v <= maxValue;
+}
+
+bool ColorClass::parse(const std::string &text, ColorClass &colorClass)
+{
+  std::istringstream stream(text);
+  stream >> colorClass.name >> colorClass.minHue >> colorClass.maxHue >> colorClass.minSaturation >> colorClass.maxSaturation
+         >> colorClass.minValue >> colorClass.maxValue;
+  return !stream.fail() && !colorClass.name.empty();
+}
+
+ColorClassTable::ColorClassTable(const std::vector<ColorClass> &classes) : colorClasses(classes), ownLut(BINS, 0)
+{
+  lut = ownLut.data();
+  //ids are stored in a byte, 0 is no class
+  if(colorClasses.size() > 254)
+  {
+    colorClasses.resize(254);
+  }
+  for(int hb = 0; hb < HUE_BINS; ++hb)
+  {
+    const float h = (hb + 0.5f) * 360.0f / HUE_BINS;
+    for(int sb = 0; sb < SATURATION_BINS; ++sb)
+    {
+      const float s = (sb + 0.5f) / SATURATION_BINS;
+      for(int vb = 0; vb < VALUE_BINS; ++vb)
+      {
+        const float v = (vb + 0.5f) / VALUE_BINS;
+        for(size_t c = 0; c < colorClasses.size(); ++c)
+        {
+          if(colorClasses[c].contains(h, s, v))
+          {
+            ownLut[(hb * SATURATION_BINS + sb) * VALUE_BINS + vb] = c + 1;
+            break;
+          }
+        }
+      }
+    }
+  }
+}
+
+ColorClassTable::ColorClassTable(const std::shared_ptr<const ModelStore> &store) : lut(NULL)
+{
+  size_t classCount, binCount;
+  const ColorClassRecord *records = store->section<ColorClassRecord>("color_classes", classCount);
+  const uint8_t *bins = store->section<uint8_t>("color_lut", binCount);
+  if(!records || !bins || binCount != BINS)
+  {
+    //no class for any bin
+    ownLut.assign(BINS, 0);
+    lut = ownLut.data();
+    return;
+  }
+  for(size_t i = 0; i < classCount; ++i)
+  {
+    const ColorClassRecord &record = records[i];
+    ColorClass colorClass;
+    colorClass.name = std::string(record.name, strnlen(record.name, sizeof(record.name)));
+    colorClass.minHue = record.minHue;
+    colorClass.maxHue = record.maxHue;
+    colorClass.minSaturation = record.minSaturation;
+    colorClass.maxSaturation = record.maxSaturation;
+    colorClass.minValue = record.minValue;
+    colorClass.maxValue = record.maxValue;
+    colorClasses.push_back(colorClass);
+  }
+  lut = bins;
+  this->store = store;
+}
+
+void ColorClassTable::save(ModelStoreWriter &writer) const
+{
+  std::vector<ColorClassRecord> records(colorClasses.size());
+  for(size_t i = 0; i < colorClasses.size(); ++i)
+  {
+    const ColorClass &colorClass = colorClasses[i];
+    ColorClassRecord &record = records[i];
+    memset(&record, 0, sizeof(record));
+    strncpy(record.name, colorClass.name.c_str(), sizeof(record.name) - 1);
+    record.minHue = colorClass.minHue;
+    record.maxHue = colorClass.maxHue;
+    record.minSaturation = colorClass.minSaturation;
+    record.maxSaturation = colorClass.maxSaturation;
+    record.minValue = colorClass.minValue;
+    record.maxValue = colorClass.maxValue;
+  }
+  writer.add("color_classes", records);
+  writer.add("color_lut", lut, BINS);
+}
+
+void ColorClassTable::configure(const std::vector<ColorClass> &classes)
+{
+  configure(std::make_shared<ColorClassTable>(classes));
+}
+
+void ColorClassTable::configure(const std::shared_ptr<const ColorClassTable> &table)
+{
+  std::lock_guard<std::mutex> lock(sharedMutex);
+  sharedTable = table;
+}
+
+std::shared_ptr<const ColorClassTable> ColorClassTable::shared()
+{
+  std::lock_guard<std::mutex> lock(sharedMutex);
+  if(!sharedTable)
+  {
+    sharedTable = load("models/percepteros.models", loadError);
+    if(!sharedTable)
+    {
+      //no class for any bin, reported by the annotators using it
+      sharedTable = std::make_shared<ColorClassTable>();
+    }
+  }
+  return sharedTable;
+}
+
+std::shared_ptr<const ColorClassTable> ColorClassTable::load(const std::string &storeName, std::string &error)
+{
+  const std::string file = ros::package::getPath("percepteros") + "/config/colors.yaml";
+  std::shared_ptr<const ModelStore> store = ModelStore::compiled(storeName, std::vector<std::string>(1, file), error);
+  if(store)
+  {
+    std::shared_ptr<const ColorClassTable> table = std::make_shared<ColorClassTable>(store);
+    if(!table->classes().empty())
+    {
+      return table;
+    }
+  }
+  outWarn("No color classes in model store " << storeName << (error.empty() ? "" : ": " + error) << ", reading " << file);
+  error.clear();
+
+  std::vector<ColorClass> classes;
+  cv::FileStorage fs(file, cv::FileStorage::READ);
+  if(!fs.isOpened())
+  {
+    error = "no color classes in the model store and " + file + " could not be read";
+    return std::shared_ptr<const ColorClassTable>();
+  }
+  if(!readColorClasses(fs, classes, error))
+  {
+    error = file + ": " + error;
+    return std::shared_ptr<const ColorClassTable>();
+  }
+  if(classes.empty())
+  {
+    error = "no color classes in the model store or in " + file;
+    return std::shared_ptr<const ColorClassTable>();
+  }
+  return std::make_shared<ColorClassTable>(classes);
+}
+
+void ClusterColor::compute(const pcl::PointCloud<pcl::PointXYZHSV> &cloud, const std::vector<int> &indices, const ColorClassTable &table)
+{
+  Buffers &buffers = resize(indices.size());
+  for(size_t i = 0; i < indices.size(); ++i)
+  {
+    const pcl::PointXYZHSV &point = cloud.points[indices[i]];
+    buffers.h[i] = point.h;
+    buffers.s[i] = point.s;
+    buffers.v[i] = point.v;
+  }
+  accumulate(buffers, indices.size(), table);
+}
+
+ColorStatistics ClusterColor::annotate(uima::CAS &tcas, const ColorClassTable &table) const
+{
+  std::vector<std::string> names;
+  for(const ColorClass &colorClass : table.classes())
+  {
+    names.push_back(colorClass.name);
+  }
+  ColorStatistics statistics = rs::create<ColorStatistics>(tcas);
+  statistics.points.set((int)points);
+  statistics.hue.set(hue);
+  statistics.saturation.set(saturation);
+  statistics.value.set(value);
+  statistics.histogram.set(histogram);
+  statistics.color.set(names);
+  statistics.ratio.set(ratios);
+  return statistics;
+}
+
+float ClusterColor::ratio(ColorStatistics &statistics, const std::string &name)
+{
+  const std::vector<std::string> names = statistics.color.get();
+  const std::vector<float> ratios = statistics.ratio.get();
+  for(size_t i = 0; i < names.size() && i < ratios.size(); ++i)
+  {
+    if(names[i] == name)
+    {
+      return ratios[i];
+    }
+  }
+  return 0;
+}
+
+void ClusterColor::reportNoClasses()
+{
+  //once per process, every cluster of every frame would report it otherwise
+  std::call_once(reportOnce, []()
+  {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    outError("No color classes, every color ratio is 0" << (loadError.empty() ? "." : ": " + loadError));
+  });
+}
+
+ClusterColor::Buffers &ClusterColor::resize(size_t size)
+{
+  //reused by all clusters of the thread, grows to the largest one
+  static thread_local Buffers buffers;
+  if(buffers.h.size() < size)
+  {
+    buffers.r.resize(size);
+    buffers.g.resize(size);
+    buffers.b.resize(size);
+    buffers.h.resize(size);
+    buffers.s.resize(size);
+    buffers.v.resize(size);
+  }
+  return buffers;
+}
+
+void ClusterColor::rgbToHsv(Buffers &buffers, size_t size)
+{
+  //same conversion as pcl::PointXYZRGBtoXYZHSV, written without branches
+  const float *r = buffers.r.data(), *g = buffers.g.data(), *b = buffers.b.data();
+  float *h = buffers.h.data(), *s = buffers.s.data(), *v = buffers.v.data();
+  for(size_t i = 0; i < size; ++i)
+  {
+    const float max = std::max(r[i], std::max(g[i], b[i]));
+    const float min = std::min(r[i], std::min(g[i], b[i]));
+    const float diff = max - min;
+    const float invDiff = diff > 0 ? 1.0f / diff : 0.0f;
+    const float hr = (g[i] - b[i]) * invDiff;
+    const float hg = 2.0f + (b[i] - r[i]) * invDiff;
+    const float hb = 4.0f + (r[i] - g[i]) * invDiff;
+    float hue = max == r[i] ? hr : (max == g[i] ? hg : hb);
+    hue = diff > 0 ? hue * 60.0f : 0.0f;
+    h[i] = hue < 0 ? hue + 360.0f : hue;
+    s[i] = max > 0 ? diff / max : 0.0f;
+    v[i] = max / 255.0f;
+  }
+}
+
+void ClusterColor::accumulate(const Buffers &buffers, size_t size, const ColorClassTable &table)
+{
+  const float *h = buffers.h.data(), *s = buffers.s.data(), *v = buffers.v.data();
+  const size_t classes = table.classes().size();
+  std::vector<size_t> classCounts(classes + 1, 0);
+  std::vector<size_t> histogramCounts(ColorClassTable::HISTOGRAM_BINS, 0);
+  float sumCos = 0, sumSin = 0, sumS = 0, sumV = 0;
+
+  for(size_t i = 0; i < size; ++i)
+  {
+    const int hb = ColorClassTable::hueBin(h[i]);
+    const int sb = ColorClassTable::unitBin(s[i], ColorClassTable::SATURATION_BINS);
+    const int vb = ColorClassTable::unitBin(v[i], ColorClassTable::VALUE_BINS);
+    sumCos += hueCircle.cosine[hb];
+    sumSin += hueCircle.sine[hb];
+    sumS += s[i];
+    sumV += v[i];
+    ++classCounts[table.classOf((hb * ColorClassTable::SATURATION_BINS + sb) * ColorClassTable::VALUE_BINS + vb)];
+    const int histogramBin = ((hb * ColorClassTable::HISTOGRAM_HUE / ColorClassTable::HUE_BINS) * ColorClassTable::HISTOGRAM_SATURATION
+                              + sb * ColorClassTable::HISTOGRAM_SATURATION / ColorClassTable::SATURATION_BINS) * ColorClassTable::HISTOGRAM_VALUE
+                             + vb * ColorClassTable::HISTOGRAM_VALUE / ColorClassTable::VALUE_BINS;
+    ++histogramCounts[histogramBin];
+  }
+
+  points = size;
+  const float norm = size > 0 ? 1.0f / size : 0.0f;
+  float meanHue = std::atan2(sumSin, sumCos) * 180.0f / M_PI;
+  hue = meanHue < 0 ? meanHue + 360.0f : meanHue;
+  saturation = sumS * norm;
+  value = sumV * norm;
+  histogram.resize(ColorClassTable::HISTOGRAM_BINS);
+  for(size_t i = 0; i < histogramCounts.size(); ++i)
+  {
+    histogram[i] = histogramCounts[i] * norm;
+  }
+  ratios.resize(classes);
+  for(size_t c = 0; c < classes; ++c)
+  {
+    ratios[c] = classCounts[c + 1] * norm;
+  }
+}
+
+}
@@ -0,0 +1,76 @@
+#include <uima/api.hpp>
+
+//RS
+#include <rs/scene_cas.h>
+#include <rs/utils/time.h>
+#include <rs/utils/output.h>
+
+#include <percepteros/ClusterColor.h>
+#include <percepteros/SceneIndex.h>
+
+using namespace uima;
+
+/**
+ * Computes the color statistics of every cluster once per frame: circular
+ * hue mean, saturation and value means, an HSV histogram and the share of
+ * the configured color classes. The classes are defined in
+ * config/colors.yaml and used from the model store they are compiled into,
+ * or read from colors.yaml if the store is missing or older. Color gated
+ * annotators read the ColorStatistics annotation of their clusters instead
+ * of converting the points themselves.
+ */
+class ClusterColorStatistics : public Annotator
+{
+private:
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+
+public:
+
+  ClusterColorStatistics() : cloud(new pcl::PointCloud<pcl::PointXYZRGBA>)
+  {
+  }
+
+  TyErrorId initialize(AnnotatorContext &ctx)
+  {
+    outInfo("initialize");
+    std::string storeFile = "models/percepteros.models";
+    if(ctx.isParameterDefined("model_store")) ctx.extractValue("model_store", storeFile);
+
+    std::string error;
+    std::shared_ptr<const percepteros::ColorClassTable> table = percepteros::ColorClassTable::load(storeFile, error);
+    if(!table)
+    {
+      outError("Could not load the color classes: " << error);
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
+    percepteros::ColorClassTable::configure(table);
+    outInfo("Configured " << table->classes().size() << " color classes.");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId destroy()
+  {
+    outInfo("destroy");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId process(CAS &tcas, ResultSpecification const &res_spec)
+  {
+    rs::StopWatch clock;
+    rs::SceneCas cas(tcas);
+    rs::Scene scene = cas.getScene();
+    cas.get(VIEW_CLOUD, *cloud);
+
+    percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
+    for(size_t c = 0; c < index.clusters().size(); ++c)
+    {
+      percepteros::ClusterColor::of(tcas, index, c, *cloud);
+    }
+
+    outInfo("Color statistics of " << index.clusters().size() << " clusters in " << clock.getTime() << " ms.");
+    return UIMA_ERR_NONE;
+  }
+};
+
+// This macro exports an entry point that is used to create the annotator.
+MAKE_AE(ClusterColorStatistics)
@@ -27,6 +27,9 @@
 #include <percepteros/types/all_types.h>
 #include <percepteros/HueClusterComparator.h>
 #include <percepteros/ValueClusterComparator.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/ClusterColor.h>
 
 //PCL
 #include <pcl/point_cloud.h>
@@ -66,69 +69,28 @@ class ColorClusterer : public DrawingAnnotator {
 		std::vector<pcl::PointIndices> hue_indices;
 		std::vector<pcl::PointIndices> value_indices;
 
+		//visualization
+		percepteros::OverlayBuffer overlay;
+		percepteros::OverlayRenderer renderer;
+		double pointSize = 1;
+
 		//parameters
 		float DISTANCE_THRESHOLD;
-		int HUE_LOWER_BOUND, HUE_UPPER_BOUND, HUE_THRESHOLD, VALUE_THRESHOLD, POINT_THRESHOLD, CLUSTER_THRESHOLD;
-
-		/**
-		 * Gets the average hue value of a cluster.
-		 * @method getAverageHue
-		 * @param  cloud         Point cloud containing the scene points.
-		 * @param  indices       Indices of the cluster points.
-		 * @return               The average hue as an int value.
-		 */
-		int getAverageHue(PCH::Ptr cloud, pcl::PointIndices indices) {
-			float average = 0;
-			int size = indices.indices.size();
-
-			for (size_t i = 0; i < size; i++) {
-				average += cloud->points[indices.indices[i]].h / size;
-			}
-
-			return (int) average;
-		}
-
-		/**
-		 * Gets the average value value of a cluster.
-		 * @method getAverageValue
-		 * @param  cloud         Point cloud containing the scene points.
-		 * @param  indices       Indices of the cluster points.
-		 * @return               The average value as an int value.
-		 */
-		float getAverageValue(PCH::Ptr cloud, pcl::PointIndices indices) {
-			float average = 0;
-			int size = indices.indices.size();
-
-			for (size_t i = 0; i < size; i++) {
-				average += cloud->points[indices.indices[i]].v / size;
-			}
-
-			return average;
-		}
+		int HUE_THRESHOLD, VALUE_THRESHOLD, POINT_THRESHOLD, CLUSTER_THRESHOLD;
 
 		/**
 		 * Checks if a cluster is the rack based on color.
 		 * @method checkCluster
-		 * @param  clust        The indices of the cluster.
+		 * @param  tcas         The scene containing points and cluster information.
+		 * @param  index        The index of the scene containing the cluster.
+		 * @param  c            Index of the cluster in the scene index.
 		 * @param  cloud_ptr    The point cloud containing the scene points.
 		 * @return              Boolean indicating if the cluster is the rack.
 		 */
-		bool checkCluster(rs::Cluster clust, PCH::Ptr cloud_ptr) {
-			pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
-			rs::ReferenceClusterPoints clusterpoints(clust.points());
-			rs::conversion::from(clusterpoints.indices(), *cluster_indices);
-
-			PointH temp;
-			int count = 0;
-
-			//Counts points of right color.
-			for (std::vector<int>::const_iterator pit = cluster_indices->indices.begin();
-					 pit != cluster_indices->indices.end(); pit++) {
-				temp = cloud_ptr->points[*pit];
-				if (temp.h > HUE_LOWER_BOUND && temp.h < HUE_UPPER_BOUND) {
-					count++;
-				}
-			}
+		bool checkCluster(CAS &tcas, percepteros::SceneIndex &index, size_t c, PCH::Ptr cloud_ptr) {
+			//the rack color is configured as color class of the statistics
+			percepteros::ColorStatistics stats = percepteros::ClusterColor::of(tcas, index, c, *cloud_ptr);
+			int count = percepteros::ClusterColor::ratio(stats, "rack") * stats.points.get();
 
 			//Checks if there are enough points of fitting color.
 			if (count > POINT_THRESHOLD) {
@@ -141,11 +103,13 @@ class ColorClusterer : public DrawingAnnotator {
 		/**
 		 * Annotates the rack cluster with average surface normal.
 		 * @method annotateCluster
-		 * @param  clust           The cluster object for the rack cluster.
+		 * @param  index           The index of the scene containing the rack cluster.
+		 * @param  c               Index of the rack cluster in the scene index.
 		 * @param  normals         Surface normals of scene points.
 		 * @param  tcas            The scene containing points and cluster information.
 		 */
-		void annotateCluster(rs::Cluster clust, PCN::Ptr normals, CAS &tcas) {
+		void annotateCluster(percepteros::SceneIndex &index, size_t c, PCN::Ptr normals, CAS &tcas) {
+			rs::Cluster clust = index.cluster(c);
 			//convert cluster indices to PCL indices
 			pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
 			rs::ReferenceClusterPoints clusterpoints(clust.points());
@@ -172,7 +136,7 @@ class ColorClusterer : public DrawingAnnotator {
 			percepteros::RackObject rA = rs::create<percepteros::RackObject>(tcas);
 			rA.name.set("Rack");
 			rA.normal.set(normal);
-			clust.annotations.append(rA);
+			index.append(c, rA);
 		}
 
 		/**
@@ -211,9 +175,7 @@ class ColorClusterer : public DrawingAnnotator {
 	  TyErrorId initialize(AnnotatorContext &ctx) {
 	    outInfo("Initialize ColorClusterer.");
 
-			//extract color parameters
-			ctx.extractValue("minHue", HUE_LOWER_BOUND);
-			ctx.extractValue("maxHue", HUE_UPPER_BOUND);
+			//extract color parameters, the rack color is a class of ClusterColorStatistics
 			ctx.extractValue("diffHue", HUE_THRESHOLD);
 			ctx.extractValue("diffVal", VALUE_THRESHOLD);
 
@@ -249,10 +211,10 @@ class ColorClusterer : public DrawingAnnotator {
 			//get clusters
 	    	rs::SceneCas cas(tcas);
 			rs::Scene scene = cas.getScene();
-			std::vector<rs::Cluster> clusters;
-			scene.identifiables.filter(clusters);
+			percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
 
-			//clear pointclouds
+			//clear pointclouds, the last scene may still be shown by the visualizer
+			percepteros::detachCloud<PointR>(temp);
 			temp->clear();
 			normals->clear();
 			cloud->clear();
@@ -264,8 +226,10 @@ class ColorClusterer : public DrawingAnnotator {
 			//helpers
 			bool found = false;
 
-			for (auto clust : clusters) {
-				found = checkCluster(clust, cloud);
+			const size_t clusterCount = index.clusters().size();
+			for (size_t c = 0; c < clusterCount; ++c) {
+				rs::Cluster clust = index.cluster(c);
+				found = checkCluster(tcas, index, c, cloud);
 				if (found) {
 					outInfo("Found rack!"); found = true;
 
@@ -280,7 +244,7 @@ class ColorClusterer : public DrawingAnnotator {
 					ex.filterDirectly(cloud);
 
 					//annotate rack cluster
-					annotateCluster(clust, normals, tcas);
+					annotateCluster(index, c, normals, tcas);
 					pcl::PointCloud<pcl::Label>::Ptr output_labels(new pcl::PointCloud<pcl::Label>);
 
 					//cluster rack for hue
@@ -353,15 +317,14 @@ class ColorClusterer : public DrawingAnnotator {
 						uimaCluster.points.set(rcp);
 						uimaCluster.source.set("HueClustering");
 
+						size_t k = index.appendCluster(scene, uimaCluster);
+						percepteros::ColorStatistics stats = percepteros::ClusterColor::of(tcas, index, k, *cloud);
+
 						percepteros::ToolObject tool = rs::create<percepteros::ToolObject>(tcas);
 						tool.name.set("HueClustering");
-						int averageHue = getAverageHue(cloud, indices);
-						float averageValue = getAverageValue(cloud, indices);
-						tool.hue.set(averageHue);
-						tool.value.set(averageValue);
-						uimaCluster.annotations.append(tool);
-
-						scene.identifiables.append(uimaCluster);
+						tool.hue.set((int) stats.hue.get());
+						tool.value.set(stats.value.get());
+						index.append(k, tool);
 					}
 
 					for	(size_t i = 0; i < value_indices.size(); ++i) {
@@ -376,15 +339,14 @@ class ColorClusterer : public DrawingAnnotator {
 						uimaCluster.points.set(rcp);
 						uimaCluster.source.set("ValueClustering");
 
+						size_t k = index.appendCluster(scene, uimaCluster);
+						percepteros::ColorStatistics stats = percepteros::ClusterColor::of(tcas, index, k, *cloud);
+
 						percepteros::ToolObject tool = rs::create<percepteros::ToolObject>(tcas);
 						tool.name.set("ValueClustering");
-						int averageHue = getAverageHue(cloud, indices);
-						float averageValue = getAverageValue(cloud, indices);
-						tool.hue.set(averageHue);
-						tool.value.set(averageValue);
-						uimaCluster.annotations.append(tool);
-
-						scene.identifiables.append(uimaCluster);
+						tool.hue.set((int) stats.hue.get());
+						tool.value.set(stats.value.get());
+						index.append(k, tool);
 					}
 					break;
 				}
@@ -394,45 +356,37 @@ class ColorClusterer : public DrawingAnnotator {
 				outInfo("No rack found in " << clock.getTime() << "ms.");
 			}
 
+			publishOverlay();
+
 			outInfo("Finished rack clustering in " << clock.getTime() << "ms.");
 	    return UIMA_ERR_NONE;
 	  }
 
 		/**
-		 * Visualizes results by coloring clustered points.
-		 * @method fillVisualizerWithLock
-		 * @param  visualizer             Visualizer oject containing points.
-		 * @param  firstRun               Specifies if the visualizer is run for the first time.
+		 * Hands the scene and the hue and value clusters to the visualizer, also if no rack was found.
+		 * @method publishOverlay
 		 */
-		void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun) {
-			//colors hue clusters in scene
-			const std::string &cloudname = this->name;
+		void publishOverlay() {
+			percepteros::VisualizationOverlay &o = overlay.back();
+			o.cloud = temp;
+			//colors hue clusters, then value clusters
 			for (size_t i = 0; i < hue_indices.size(); ++i) {
-				const pcl::PointIndices &indices = hue_indices[i];
-				for (size_t j = 0; j < indices.indices.size(); ++j) {
-					size_t index = indices.indices[j];
-					temp->points[index].rgba = rs::common::colors[i % rs::common::numberOfColors];
-				}
+				o.addHighlight(hue_indices[i].indices, rs::common::colors[i % rs::common::numberOfColors]);
 			}
-
-			//colors value clusters in scene
 			for (size_t i = 0; i < value_indices.size(); ++i) {
-				const pcl::PointIndices &indices = value_indices[i];
-				for (size_t j = 0; j < indices.indices.size(); ++j) {
-					size_t index = indices.indices[j];
-					temp->points[index].rgba = rs::common::colors[(i + hue_indices.size()) % rs::common::numberOfColors];
-				}
+				o.addHighlight(value_indices[i].indices, rs::common::colors[(i + hue_indices.size()) % rs::common::numberOfColors]);
 			}
+			overlay.publish();
+		}
 
-			//adds or updates scene points to visualizer
-			double pointSize = 1;
-			if (firstRun) {
-				visualizer.addPointCloud(temp, cloudname);
-				visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-			} else {
-				visualizer.updatePointCloud(temp, cloudname);
-				visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-			}
+		/**
+		 * Visualizes results by coloring clustered points.
+		 * @method fillVisualizerWithLock
+		 * @param  visualizer             Visualizer oject containing points.
+		 * @param  firstRun               Specifies if the visualizer is run for the first time.
+		 */
+		void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun) {
+			renderer.render(overlay, visualizer, this->name, pointSize, firstRun);
 		}
 };
 
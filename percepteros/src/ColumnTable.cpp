@@ -0,0 +1,411 @@
+#include <percepteros/ColumnTable.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <ostream>
+
+namespace percepteros
+{
+
+namespace
+{
+
+struct Header
+{
+  uint32_t magic, version;
+  uint32_t columns, reserved;
+  uint64_t rows;
+};
+
+struct ColumnHeader
+{
+  uint32_t type, nameLength;
+};
+
+struct FileCloser
+{
+  void operator()(FILE *file) const
+  {
+    fclose(file);
+  }
+};
+
+typedef std::unique_ptr<FILE, FileCloser> File;
+
+/**
+ * @brief writeCsvField Writes a field, quoted if it contains a separator, a quote or a line break
+ */
+void writeCsvField(std::ostream &out, const std::string &value)
+{
+  if(value.find_first_of(",\"\r\n") == std::string::npos)
+  {
+    out << value;
+    return;
+  }
+  out << '"';
+  for(char c : value)
+  {
+    if(c == '"')
+    {
+      out << '"';
+    }
+    out << c;
+  }
+  out << '"';
+}
+
+}
+
+ColumnTable::ColumnTable() : rowCount(0)
+{
+}
+
+int ColumnTable::find(const std::string &name) const
+{
+  for(size_t i = 0; i < data.size(); ++i)
+  {
+    if(data[i].name == name)
+    {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+int ColumnTable::column(const std::string &name, Type type)
+{
+  const int index = find(name);
+  if(index >= 0)
+  {
+    return data[index].type == type ? index : -1;
+  }
+  Column column;
+  column.name = name;
+  column.type = type;
+  resize(column, rowCount);
+  data.push_back(column);
+  return (int)data.size() - 1;
+}
+
+void ColumnTable::resize(Column &column, size_t rows) const
+{
+  switch(column.type)
+  {
+  case DOUBLE:
+    column.doubles.resize(rows, std::numeric_limits<double>::quiet_NaN());
+    break;
+  case INTEGER:
+    column.integers.resize(rows, 0);
+    break;
+  case STRING:
+    column.strings.resize(rows);
+    break;
+  }
+}
+
+void ColumnTable::addRow()
+{
+  ++rowCount;
+  for(Column &column : data)
+  {
+    resize(column, rowCount);
+  }
+}
+
+/**
+ * @brief ColumnTable::cell The column a value of the last row is set in, NULL if there is no row or the column
+ * has another type
+ */
+ColumnTable::Column *ColumnTable::cell(const std::string &name, Type type)
+{
+  const int index = column(name, type);
+  if(index < 0 || rowCount == 0)
+  {
+    return NULL;
+  }
+  return &data[index];
+}
+
+void ColumnTable::set(const std::string &name, double value)
+{
+  Column *column = cell(name, DOUBLE);
+  if(column)
+  {
+    column->doubles.back() = value;
+  }
+}
+
+void ColumnTable::set(const std::string &name, int64_t value)
+{
+  Column *column = cell(name, INTEGER);
+  if(column)
+  {
+    column->integers.back() = value;
+  }
+}
+
+void ColumnTable::set(const std::string &name, const std::string &value)
+{
+  Column *column = cell(name, STRING);
+  if(column)
+  {
+    column->strings.back() = value;
+  }
+}
+
+bool ColumnTable::append(const ColumnTable &other)
+{
+  std::vector<int> targets(other.data.size());
+  for(size_t i = 0; i < other.data.size(); ++i)
+  {
+    targets[i] = column(other.data[i].name, other.data[i].type);
+    if(targets[i] < 0)
+    {
+      error = "column " + other.data[i].name + " has different types";
+      return false;
+    }
+  }
+
+  const size_t first = rowCount;
+  rowCount += other.rowCount;
+  for(Column &column : data)
+  {
+    resize(column, rowCount);
+  }
+  for(size_t i = 0; i < other.data.size(); ++i)
+  {
+    const Column &source = other.data[i];
+    Column &target = data[targets[i]];
+    switch(source.type)
+    {
+    case DOUBLE:
+      std::copy(source.doubles.begin(), source.doubles.end(), target.doubles.begin() + first);
+      break;
+    case INTEGER:
+      std::copy(source.integers.begin(), source.integers.end(), target.integers.begin() + first);
+      break;
+    case STRING:
+      std::copy(source.strings.begin(), source.strings.end(), target.strings.begin() + first);
+      break;
+    }
+  }
+  return true;
+}
+
+bool ColumnTable::write(const std::string &path)
+{
+  const std::string temporary = path + ".tmp";
+  File out(fopen(temporary.c_str(), "wb"));
+  if(!out)
+  {
+    error = "fopen " + temporary + ": " + strerror(errno);
+    return false;
+  }
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.columns = data.size();
+  header.rows = rowCount;
+  bool written = fwrite(&header, sizeof(header), 1, out.get()) == 1;
+  for(const Column &column : data)
+  {
+    ColumnHeader columnHeader;
+    columnHeader.type = column.type;
+    columnHeader.nameLength = column.name.size();
+    written = written && fwrite(&columnHeader, sizeof(columnHeader), 1, out.get()) == 1
+              && fwrite(column.name.data(), 1, column.name.size(), out.get()) == column.name.size();
+  }
+  for(const Column &column : data)
+  {
+    switch(column.type)
+    {
+    case DOUBLE:
+      written = written && fwrite(column.doubles.data(), sizeof(double), rowCount, out.get()) == rowCount;
+      break;
+    case INTEGER:
+      written = written && fwrite(column.integers.data(), sizeof(int64_t), rowCount, out.get()) == rowCount;
+      break;
+    case STRING:
+    {
+      std::vector<uint64_t> offsets(rowCount + 1, 0);
+      for(size_t r = 0; r < rowCount; ++r)
+      {
+        offsets[r + 1] = offsets[r] + column.strings[r].size();
+      }
+      written = written && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out.get()) == offsets.size();
+      for(const std::string &value : column.strings)
+      {
+        written = written && fwrite(value.data(), 1, value.size(), out.get()) == value.size();
+      }
+      break;
+    }
+    }
+  }
+
+  if(fclose(out.release()) != 0 || !written)
+  {
+    error = "write " + temporary + ": " + strerror(errno);
+    unlink(temporary.c_str());
+    return false;
+  }
+  if(rename(temporary.c_str(), path.c_str()) != 0)
+  {
+    error = "rename " + temporary + ": " + strerror(errno);
+    unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ColumnTable::read(const std::string &path)
+{
+  data.clear();
+  rowCount = 0;
+  File in(fopen(path.c_str(), "rb"));
+  if(!in)
+  {
+    error = "fopen " + path + ": " + strerror(errno);
+    return false;
+  }
+
+  Header header;
+  if(fread(&header, sizeof(header), 1, in.get()) != 1 || header.magic != MAGIC)
+  {
+    error = path + " is not a column table";
+    return false;
+  }
+  if(header.version != VERSION)
+  {
+    error = path + " has version " + std::to_string(header.version) + ", expected " + std::to_string(VERSION);
+    return false;
+  }
+
+  std::vector<Column> columns(header.columns);
+  for(Column &column : columns)
+  {
+    ColumnHeader columnHeader;
+    if(fread(&columnHeader, sizeof(columnHeader), 1, in.get()) != 1 || columnHeader.type > STRING)
+    {
+      error = path + " is truncated";
+      return false;
+    }
+    column.type = (Type)columnHeader.type;
+    column.name.resize(columnHeader.nameLength);
+    if(fread(&column.name[0], 1, columnHeader.nameLength, in.get()) != columnHeader.nameLength)
+    {
+      error = path + " is truncated";
+      return false;
+    }
+  }
+
+  const size_t rows = header.rows;
+  bool complete = true;
+  for(Column &column : columns)
+  {
+    resize(column, rows);
+    switch(column.type)
+    {
+    case DOUBLE:
+      complete = complete && fread(column.doubles.data(), sizeof(double), rows, in.get()) == rows;
+      break;
+    case INTEGER:
+      complete = complete && fread(column.integers.data(), sizeof(int64_t), rows, in.get()) == rows;
+      break;
+    case STRING:
+    {
+      std::vector<uint64_t> offsets(rows + 1);
+      complete = complete && fread(offsets.data(), sizeof(uint64_t), offsets.size(), in.get()) == offsets.size();
+      for(size_t r = 0; r < rows && complete; ++r)
+      {
+        if(offsets[r + 1] < offsets[r])
+        {
+          complete = false;
+          break;
+        }
+        column.strings[r].resize(offsets[r + 1] - offsets[r]);
+        complete = column.strings[r].empty()
+                   || fread(&column.strings[r][0], 1, column.strings[r].size(), in.get()) == column.strings[r].size();
+      }
+      break;
+    }
+    }
+  }
+  if(!complete)
+  {
+    error = path + " is truncated";
+    return false;
+  }
+  data.swap(columns);
+  rowCount = rows;
+  return true;
+}
+
+void ColumnTable::writeCsv(std::ostream &out) const
+{
+  const std::streamsize precision = out.precision(std::numeric_limits<double>::max_digits10);
+  for(size_t c = 0; c < data.size(); ++c)
+  {
+    if(c > 0)
+    {
+      out << ',';
+    }
+    writeCsvField(out, data[c].name);
+  }
+  out << "\r\n";
+  for(size_t r = 0; r < rowCount; ++r)
+  {
+    for(size_t c = 0; c < data.size(); ++c)
+    {
+      const Column &column = data[c];
+      if(c > 0)
+      {
+        out << ',';
+      }
+      switch(column.type)
+      {
+      case DOUBLE:
+        if(!std::isnan(column.doubles[r]))
+        {
+          out << column.doubles[r];
+        }
+        break;
+      case INTEGER:
+        out << column.integers[r];
+        break;
+      case STRING:
+        writeCsvField(out, column.strings[r]);
+        break;
+      }
+    }
+    out << "\r\n";
+  }
+  out.precision(precision);
+}
+
+bool ColumnTable::writeCsv(const std::string &path)
+{
+  std::ofstream out(path.c_str(), std::ios::binary);
+  if(out)
+  {
+    writeCsv(out);
+    out.close();
+  }
+  if(!out)
+  {
+    error = "write " + path + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+}
@@ -7,6 +7,7 @@
   {
     outInfo("initialize");
     cloud_ptr = pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>);
+    if(ctx.isParameterDefined("threads")) ctx.extractValue("threads", ransac.getParameters().threads);
     return UIMA_ERR_NONE;
   }
 
@@ -22,25 +23,35 @@
     rs::StopWatch clock;
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
-    std::vector<rs::Cluster> clusters;
-    scene.identifiables.filter(clusters);
+    percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
 
-    pcl::PointCloud<pcl::Normal>::Ptr normal_ptr(new pcl::PointCloud<pcl::Normal>);
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_cluster_normal (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+    pcl::PointCloud<pcl::Normal>::Ptr normal_ptr = percepteros::FrameArena::get<pcl::PointCloud<pcl::Normal>>();
+    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_cluster_normal = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBNormal>>();
 
+    percepteros::detachCloud<PointT>(cloud_ptr);
     cas.get(VIEW_CLOUD, *cloud_ptr);
     cas.get(VIEW_NORMALS, *normal_ptr);
 
     clusterIndices.clear();
 
-    for(auto cluster : clusters)
+    //clusters appended below are not checked again
+    const size_t clusterCount = index.clusters().size();
+    for(size_t c = 0; c < clusterCount; ++c)
     {
-      pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
+      if(percepteros::FrameDeadline::expired())
+      {
+        outInfo("Deadline reached, skipping remaining clusters.");
+        percepteros::FrameDeadline::markDegraded();
+        break;
+      }
+
+      rs::Cluster cluster = index.cluster(c);
+      pcl::PointIndices::Ptr cluster_indices = percepteros::FrameArena::get<pcl::PointIndices>();
       rs::ReferenceClusterPoints clusterpoints(cluster.points());
       rs::conversion::from(clusterpoints.indices(), *cluster_indices);
 
-      pcl::PointCloud<PointT>::Ptr cluster_cloud(new pcl::PointCloud<PointT>());
-      pcl::PointCloud<pcl::Normal>::Ptr cluster_normal(new pcl::PointCloud<pcl::Normal>());
+      pcl::PointCloud<PointT>::Ptr cluster_cloud = percepteros::FrameArena::get<pcl::PointCloud<PointT>>();
+      pcl::PointCloud<pcl::Normal>::Ptr cluster_normal = percepteros::FrameArena::get<pcl::PointCloud<pcl::Normal>>();
 
       for(std::vector<int>::const_iterator pit = cluster_indices->indices.begin();
           pit != cluster_indices->indices.end(); pit++)
@@ -55,23 +66,13 @@
       cluster_normal->height = 1;
       cluster_normal->is_dense = true;
 
-      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_clusterRGB (new pcl::PointCloud<pcl::PointXYZRGB>);
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_clusterRGB = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGB>>();
 
       pcl::copyPointCloud(*cluster_cloud,*cloud_clusterRGB);
       pcl::concatenateFields (*cloud_clusterRGB, *cluster_normal, *cloud_cluster_normal);
-      // Create the filtering object
-      /*pcl::VoxelGrid<pcl::PointXYZRGBNormal> sor;
-      sor.setInputCloud (cloud_cluster_normal);
-      sor.setLeafSize (0.01f, 0.01f, 0.01f);
-      sor.filter (*cloud_cluster_normal);*/
-
-       pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZRGBNormal> ());
-
-       // Create the filtering object
-       /*pcl::VoxelGrid<pcl::PointXYZRGBNormal> sor;
-       sor.setInputCloud (cloud_cluster_normal);
-       sor.setLeafSize (0.01f, 0.01f, 0.01f);
-       sor.filter (*cloud_filtered);*/
+      pyramid = &Pyramid::of(index, c, *cloud_cluster_normal);
+      clusterPixels = &cluster_indices->indices;
+      imageWidth = cloud_ptr->width;
 
       geometry_msgs::PoseStamped pose;
       percepteros::RecognitionObject o = rs::create<percepteros::RecognitionObject>(tcas);
@@ -82,7 +83,7 @@
           clusterIndices.push_back(*cluster_indices);
           outInfo("Pose:x:" << pose.pose.position.x << " y:" << pose.pose.position.y << " z:" << pose.pose.position.z);
           outInfo("took: " << clock.getTime() << " ms.");
-          cluster.annotations.append(o);
+          index.append(c, o);
 
 
           tf::StampedTransform camToWorld;
@@ -99,35 +100,43 @@
           poseAnnotation.camera.set(rs::conversion::to(tcas, camera));
           poseAnnotation.world.set(rs::conversion::to(tcas, world));
           poseAnnotation.source.set("3DEstimate");
-          cluster.annotations.append(poseAnnotation);
-          scene.identifiables.append(cluster);
+          index.append(c, poseAnnotation);
+          index.appendCluster(scene, cluster);
       }
 
     }
+
+    percepteros::VisualizationOverlay &o = overlay.back();
+    o.cloud = cloud_ptr;
+    for(size_t i = 0; i < clusterIndices.size(); ++i)
+    {
+      o.addHighlight(clusterIndices[i].indices, rs::common::colors[i % rs::common::numberOfColors]);
+    }
+    overlay.publish();
     return UIMA_ERR_NONE;
   }
 
   int CylinderAnnotator::segmentPlane(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_input,
-                               int model_type,
+                               percepteros::Ransac::Model model_type,
                                double distance,
                                pcl::ModelCoefficients::Ptr coefficients,
                                pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_remaining,
                                Eigen::Vector3f axis,
                                double epsilon)
   {
-    pcl::SACSegmentation <pcl::PointXYZRGBNormal> seg;
-    pcl::PointIndices::Ptr inliers(new pcl::PointIndices());
+    pcl::PointIndices::Ptr inliers = percepteros::FrameArena::get<pcl::PointIndices>();
     pcl::ExtractIndices <pcl::PointXYZRGBNormal> extract;
 
-    seg.setInputCloud(cloud_input);
-    seg.setModelType(model_type);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(MAX_SEGMENTATION_ITERATIONS);
-    seg.setDistanceThreshold(distance);
-    seg.setAxis(axis);
-    seg.setEpsAngle(epsilon);
-    seg.setOptimizeCoefficients(true);
-    seg.segment(*inliers, *coefficients);
+    percepteros::Ransac::Parameters &parameters = ransac.getParameters();
+    parameters.model = model_type;
+    parameters.normalWeight = 0;
+    parameters.maxIterations = percepteros::FrameDeadline::capIterations(MAX_SEGMENTATION_ITERATIONS);
+    parameters.distance = distance;
+    parameters.axis = axis;
+    parameters.epsAngle = epsilon;
+    parameters.optimize = true;
+    ransac.setInputCloud(*cloud_input);
+    ransac.segment(*inliers, *coefficients);
 
     extract.setInputCloud(cloud_input);
     extract.setIndices(inliers);
@@ -152,19 +161,29 @@
                                        pcl::ModelCoefficients::Ptr coefficients,
                                        pcl::PointIndices::Ptr cluster_indices)
   {
-    pcl::SACSegmentationFromNormals <pcl::PointXYZRGBNormal, pcl::PointXYZRGBNormal> seg;
-    pcl::ExtractIndices <pcl::PointXYZRGBNormal> extract;
-
-    seg.setOptimizeCoefficients(true);
-    seg.setModelType(pcl::SACMODEL_CYLINDER);
-    seg.setNormalDistanceWeight(normal_weight);
-    seg.setRadiusLimits(radius_min, radius_max);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(MAX_SEGMENTATION_ITERATIONS);
-    seg.setDistanceThreshold(distance);
-    seg.setInputCloud(cloud_input);
-    seg.setInputNormals(cloud_input);
-    seg.segment(*cluster_indices, *coefficients);
+    percepteros::Ransac::Parameters &parameters = ransac.getParameters();
+    parameters.model = percepteros::Ransac::CYLINDER;
+    parameters.normalWeight = normal_weight;
+    parameters.minRadius = radius_min;
+    parameters.maxRadius = radius_max;
+    parameters.maxIterations = percepteros::FrameDeadline::capIterations(MAX_SEGMENTATION_ITERATIONS);
+    parameters.distance = distance;
+    parameters.optimize = true;
+    //fit on the medium level of the pyramid, then select and refit the inliers among the points of the cluster
+    const Pyramid::Level level = Pyramid::MEDIUM;
+    ransac.setInputCloud(*pyramid->cloud(level));
+    ransac.setInputNormals(*pyramid->cloud(level));
+    const bool found = ransac.segment(*cluster_indices, *coefficients);
+    //a model carried by the voxel centroids only, keep at least half of the points they stand for
+    const size_t support = found ? pyramid->support(cluster_indices->indices, level) : 0;
+    ransac.setInputCloud(*cloud_input);
+    ransac.setInputNormals(*cloud_input);
+    if(!found || !ransac.refine(*cluster_indices, *coefficients, support / 2))
+    {
+      //local samples are drawn around the pixels of the cluster
+      ransac.setGrid(*clusterPixels, imageWidth);
+      ransac.segment(*cluster_indices, *coefficients);
+    }
 
     return (int)cluster_indices->indices.size();
   }
@@ -174,9 +193,9 @@ int CylinderAnnotator::isCylinder(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr c
                                   geometry_msgs::PoseStamped &pose, percepteros::RecognitionObject &o, CAS &tcas,
                                   tf::Transform& transform) {
 
-  pcl::ModelCoefficients::Ptr coefficients_cylinder(new pcl::ModelCoefficients);
+  pcl::ModelCoefficients::Ptr coefficients_cylinder = percepteros::FrameArena::get<pcl::ModelCoefficients>();
 
-  pcl::PointIndices::Ptr point_indices(new pcl::PointIndices());
+  pcl::PointIndices::Ptr point_indices = percepteros::FrameArena::get<pcl::PointIndices>();
 
   int cylinder_size = segmentCylinder(cloud_object, CYLINDER_NORMAL_WEIGHT, CYLINDER_MIN_RADIUS, CYLINDER_MAX_RADIUS,
                                       CYLINDER_DISTANCE_THRESHOLD,coefficients_cylinder, point_indices);
@@ -196,7 +215,7 @@ int CylinderAnnotator::isCylinder(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr c
     return 0;
   }
   outInfo("Found Cylinder.");
-  //segmentPlane(cloud_rem1, pcl::SACMODEL_PERPENDICULAR_PLANE, CYLINDER_PLANE_DISTANCE_THRESHOLD,
+  //segmentPlane(cloud_rem1, percepteros::Ransac::PERPENDICULAR_PLANE, CYLINDER_PLANE_DISTANCE_THRESHOLD,
   //             coefficients_plane, cloud_rem2, cylinder_axis_direction, EPSILON_ANGLE);
 
 
@@ -284,27 +303,7 @@ int CylinderAnnotator::isCylinder(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr c
 
 void CylinderAnnotator::fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
 {
-  const std::string &cloudname = this->name;
-  for(size_t i = 0; i < clusterIndices.size(); ++i)
-  {
-    const pcl::PointIndices &indices = clusterIndices[i];
-    for(size_t j = 0; j < indices.indices.size(); ++j)
-    {
-      size_t index = indices.indices[j];
-      cloud_ptr->points[index].rgba = rs::common::colors[i % rs::common::numberOfColors];
-    }
-  }
-
-  if(firstRun)
-  {
-    visualizer.addPointCloud(cloud_ptr, cloudname);
-    visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-  }
-  else
-  {
-    visualizer.updatePointCloud(cloud_ptr, cloudname);
-    visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-  }
+  renderer.render(overlay, visualizer, this->name, pointSize, firstRun);
 }
 // This macro exports an entry point that is used to create the annotator.
 MAKE_AE(CylinderAnnotator)
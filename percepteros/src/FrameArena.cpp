@@ -0,0 +1,30 @@
+#include <percepteros/FrameArena.h>
+
+namespace percepteros
+{
+
+std::vector<FrameArena::PoolBase *> &FrameArena::pools()
+{
+  static thread_local std::vector<PoolBase *> pools;
+  return pools;
+}
+
+void FrameArena::reset()
+{
+  for(PoolBase *pool : pools())
+  {
+    pool->next = 0;
+  }
+}
+
+size_t FrameArena::size()
+{
+  size_t size = 0;
+  for(const PoolBase *pool : pools())
+  {
+    size += pool->size();
+  }
+  return size;
+}
+
+}
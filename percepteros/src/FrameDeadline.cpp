@@ -0,0 +1,119 @@
+#include <percepteros/FrameDeadline.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace percepteros
+{
+
+typedef std::chrono::steady_clock Clock;
+
+namespace
+{
+
+struct DeadlineState
+{
+  bool active = false;
+  bool degraded = false;
+  bool stageDegraded = false;
+  Clock::time_point frameEnd, stageEnd;
+  double stageBudgetMs = 0;
+  double stageExpectedMs = 0;
+};
+
+thread_local DeadlineState state;
+
+inline Clock::time_point after(double ms)
+{
+  return Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+}
+
+void FrameDeadline::beginFrame(double deadlineMs)
+{
+  state.active = true;
+  state.degraded = false;
+  state.stageDegraded = false;
+  state.frameEnd = after(deadlineMs);
+  state.stageEnd = state.frameEnd;
+  state.stageBudgetMs = deadlineMs;
+  state.stageExpectedMs = 0;
+}
+
+void FrameDeadline::endFrame()
+{
+  //frames without a deadline are never degraded
+  state.active = false;
+  state.degraded = false;
+  state.stageDegraded = false;
+}
+
+void FrameDeadline::beginStage(double budgetMs, double expectedMs)
+{
+  state.stageDegraded = false;
+  state.stageEnd = std::min(after(budgetMs), state.frameEnd);
+  state.stageBudgetMs = budgetMs;
+  state.stageExpectedMs = expectedMs;
+}
+
+bool FrameDeadline::active()
+{
+  return state.active;
+}
+
+bool FrameDeadline::expired()
+{
+  return state.active && Clock::now() >= state.stageEnd;
+}
+
+double FrameDeadline::remainingMs()
+{
+  if(!state.active)
+  {
+    return 0;
+  }
+  return std::chrono::duration<double, std::milli>(state.stageEnd - Clock::now()).count();
+}
+
+int FrameDeadline::capIterations(int iterations, int minIterations)
+{
+  if(!state.active)
+  {
+    return iterations;
+  }
+  const int lower = std::min(iterations, minIterations);
+  if(expired())
+  {
+    markDegraded();
+    return lower;
+  }
+  //the budget is given for the whole annotator, all of its runs shrink alike
+  if(state.stageExpectedMs <= 0 || state.stageBudgetMs >= state.stageExpectedMs)
+  {
+    return iterations;
+  }
+  markDegraded();
+  return std::max(lower, (int)(iterations * state.stageBudgetMs / state.stageExpectedMs));
+}
+
+void FrameDeadline::markDegraded()
+{
+  if(state.active)
+  {
+    state.degraded = true;
+    state.stageDegraded = true;
+  }
+}
+
+bool FrameDeadline::degraded()
+{
+  return state.active && state.degraded;
+}
+
+bool FrameDeadline::stageDegraded()
+{
+  return state.stageDegraded;
+}
+
+}
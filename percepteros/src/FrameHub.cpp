@@ -0,0 +1,38 @@
+#include <percepteros/FrameHub.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace percepteros
+{
+
+namespace
+{
+
+std::mutex mutex;
+std::condition_variable newFrame;
+FrameHub::FramePtr newest;
+uint64_t lastId = 0;
+
+}
+
+void FrameHub::publish(const std::shared_ptr<SharedSensorFrame> &frame)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    frame->id = ++lastId;
+    newest = frame;
+  }
+  newFrame.notify_all();
+}
+
+FrameHub::FramePtr FrameHub::waitNewer(uint64_t id, double timeoutMs)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  const bool arrived = newFrame.wait_for(lock, std::chrono::duration<double, std::milli>(timeoutMs),
+                                         [id]() { return newest && newest->id > id; });
+  return arrived ? newest : FramePtr();
+}
+
+}
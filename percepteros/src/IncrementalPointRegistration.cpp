@@ -25,6 +25,8 @@
 
 #include <pcl/visualization/pcl_visualizer.h>
 
+#include <percepteros/OrganizedNormals.h>
+
 using namespace uima;
 
 using pcl::visualization::PointCloudColorHandlerGenericField;
@@ -49,10 +51,15 @@ private:
   PointCloud::Ptr lastResult;
   double pointSize = 1;
 
+  percepteros::OrganizedNormals organizedNormals;
+
 public:
 
   IncrementalPointRegistration(): DrawingAnnotator(__func__){
       lastResult = PointCloud::Ptr(new PointCloud);
+      percepteros::OrganizedNormals::Parameters parameters;
+      parameters.method = percepteros::OrganizedNormals::COVARIANCE;
+      organizedNormals = percepteros::OrganizedNormals(parameters);
   }
 
   TyErrorId initialize(AnnotatorContext &ctx)
@@ -157,53 +164,95 @@ public:
 
 
 
-  ////////////////////////////////////////////////////////////////////////////////
-  /** \brief Align a pair of PointCloud datasets and return the result
-    * \param cloud_src the source PointCloud
-    * \param cloud_tgt the target PointCloud
-    * \param output the resultant aligned source PointCloud
-    * \param final_transform the resultant transform between source and target
+  /** \brief Downsample a cloud and estimate its normals and curvature
+    * \param cloud the input cloud
+    * \param result the points with their normals
+    * \param downsample whether to apply a 5 cm voxel grid
+    *
+    * Organized clouds, like the incoming frame, get their normals from the
+    * integral images on the full grid before downsampling, the accumulated
+    * and already voxelized target has to use a k nearest neighbour search.
     */
-  void pairAlign (const PointCloud::Ptr cloud_src, const PointCloud::Ptr cloud_tgt, PointCloud::Ptr output, Eigen::Matrix4f &final_transform, bool downsample = false)
+  void computeNormals (const PointCloud::Ptr cloud, PointCloudWithNormals &result, bool downsample)
   {
-    //
-    // Downsample for consistency and speed
-    // \note enable this for large datasets
-    PointCloud::Ptr src (new PointCloud);
-    PointCloud::Ptr tgt (new PointCloud);
-    pcl::VoxelGrid<PointT> grid;
+    if (cloud->isOrganized ())
+    {
+      pcl::PointCloud<pcl::Normal> normals;
+      organizedNormals.compute (*cloud, normals);
+
+      PointCloudWithNormals::Ptr valid (new PointCloudWithNormals);
+      valid->points.reserve (cloud->points.size ());
+      for (size_t i = 0; i < cloud->points.size (); ++i)
+      {
+        const PointT &p = cloud->points[i];
+        const pcl::Normal &n = normals.points[i];
+        if (!pcl::isFinite (p) || !std::isfinite (n.normal_x))
+          continue;
+        PointNormalT point;
+        point.x = p.x;
+        point.y = p.y;
+        point.z = p.z;
+        point.normal_x = n.normal_x;
+        point.normal_y = n.normal_y;
+        point.normal_z = n.normal_z;
+        point.curvature = n.curvature;
+        valid->points.push_back (point);
+      }
+      valid->width = valid->points.size ();
+      valid->height = 1;
+      valid->header = cloud->header;
+
+      if (downsample)
+      {
+        pcl::VoxelGrid<PointNormalT> grid;
+        grid.setLeafSize (0.05, 0.05, 0.05);
+        grid.setInputCloud (valid);
+        grid.filter (result);
+      }
+      else
+      {
+        result = *valid;
+      }
+      return;
+    }
+
+    PointCloud::Ptr points (new PointCloud);
     if (downsample)
     {
+      pcl::VoxelGrid<PointT> grid;
       grid.setLeafSize (0.05, 0.05, 0.05);
-      grid.setInputCloud (cloud_src);
-      grid.filter (*src);
-
-      grid.setInputCloud (cloud_tgt);
-      grid.filter (*tgt);
+      grid.setInputCloud (cloud);
+      grid.filter (*points);
     }
     else
     {
-      src = cloud_src;
-      tgt = cloud_tgt;
+      points = cloud;
     }
 
-
-    // Compute surface normals and curvature
-    PointCloudWithNormals::Ptr points_with_normals_src (new PointCloudWithNormals);
-    PointCloudWithNormals::Ptr points_with_normals_tgt (new PointCloudWithNormals);
-
     pcl::NormalEstimation<PointT, PointNormalT> norm_est;
     pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
     norm_est.setSearchMethod (tree);
     norm_est.setKSearch (30);
+    norm_est.setInputCloud (points);
+    norm_est.compute (result);
+    pcl::copyPointCloud (*points, result);
+  }
 
-    norm_est.setInputCloud (src);
-    norm_est.compute (*points_with_normals_src);
-    pcl::copyPointCloud (*src, *points_with_normals_src);
 
-    norm_est.setInputCloud (tgt);
-    norm_est.compute (*points_with_normals_tgt);
-    pcl::copyPointCloud (*tgt, *points_with_normals_tgt);
+  ////////////////////////////////////////////////////////////////////////////////
+  /** \brief Align a pair of PointCloud datasets and return the result
+    * \param cloud_src the source PointCloud
+    * \param cloud_tgt the target PointCloud
+    * \param output the resultant aligned source PointCloud
+    * \param final_transform the resultant transform between source and target
+    */
+  void pairAlign (const PointCloud::Ptr cloud_src, const PointCloud::Ptr cloud_tgt, PointCloud::Ptr output, Eigen::Matrix4f &final_transform, bool downsample = false)
+  {
+    // Compute surface normals and curvature, downsampled for consistency and speed
+    PointCloudWithNormals::Ptr points_with_normals_src (new PointCloudWithNormals);
+    PointCloudWithNormals::Ptr points_with_normals_tgt (new PointCloudWithNormals);
+    computeNormals (cloud_src, *points_with_normals_src, downsample);
+    computeNormals (cloud_tgt, *points_with_normals_tgt, downsample);
 
     //
     // Instantiate our custom point representation (defined above) ...
@@ -6,26 +6,63 @@
 #include <rs/scene_cas.h>
 #include <rs/utils/time.h>
 
-using namespace uima;
+#include <sensor_msgs/CameraInfo.h>
+#include <tf_conversions/tf_eigen.h>
+
+#include <percepteros/TSDFVolume.h>
 
+#include <memory>
 
+using namespace uima;
+
+/**
+ * Fuses the incoming depth images into a sparse TSDF volume and replaces the
+ * view cloud with the surface raycasted from the current camera pose. The
+ * fused cloud is organized like the kinect cloud, but averaged over several
+ * frames, so the following annotators have to deal with far less noise.
+ * Frames without a camera pose are passed through unfused.
+ */
 class KinectFusion : public Annotator
 {
 private:
-  float test_param;
+  float voxel_size, truncation, max_weight, max_depth;
+  int max_blocks, threads;
+  bool overwrite_cloud;
+
+  std::unique_ptr<percepteros::TSDFVolume> volume;
+
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr;
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr fused_ptr;
 
 public:
 
+  KinectFusion() : voxel_size(0.005), truncation(0.02), max_weight(64), max_depth(2.0),
+    max_blocks(10000), threads(4), overwrite_cloud(true)
+  {
+    cloud_ptr = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    fused_ptr = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
+  }
+
   TyErrorId initialize(AnnotatorContext &ctx)
   {
     outInfo("initialize");
-    ctx.extractValue("test_param", test_param);
+    if(ctx.isParameterDefined("voxel_size")) ctx.extractValue("voxel_size", voxel_size);
+    if(ctx.isParameterDefined("truncation")) ctx.extractValue("truncation", truncation);
+    if(ctx.isParameterDefined("max_weight")) ctx.extractValue("max_weight", max_weight);
+    if(ctx.isParameterDefined("max_depth")) ctx.extractValue("max_depth", max_depth);
+    if(ctx.isParameterDefined("max_blocks")) ctx.extractValue("max_blocks", max_blocks);
+    if(ctx.isParameterDefined("threads")) ctx.extractValue("threads", threads);
+    if(ctx.isParameterDefined("overwrite_cloud")) ctx.extractValue("overwrite_cloud", overwrite_cloud);
+
+    volume.reset(new percepteros::TSDFVolume(voxel_size, truncation, max_weight, max_blocks, threads));
+    outInfo("TSDF volume with " << max_blocks << " blocks of " << voxel_size << " m voxels.");
     return UIMA_ERR_NONE;
   }
 
   TyErrorId destroy()
   {
     outInfo("destroy");
+    volume.reset();
     return UIMA_ERR_NONE;
   }
 
@@ -34,12 +71,59 @@ public:
     outInfo("process start");
     rs::StopWatch clock;
     rs::SceneCas cas(tcas);
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    outInfo("Test param =  " << test_param);
-    cas.get(VIEW_CLOUD,*cloud_ptr);
+    rs::Scene scene = cas.getScene();
+
+    cv::Mat depth_image;
+    sensor_msgs::CameraInfo cam_info;
+    cas.get(VIEW_DEPTH_IMAGE, depth_image);
+    cas.get(VIEW_CAMERA_INFO, cam_info);
+    cas.get(VIEW_CLOUD, *cloud_ptr);
+
+    if(depth_image.empty() || cam_info.width == 0)
+    {
+      outInfo("No depth image or camera info, skipping fusion.");
+      return UIMA_ERR_NONE;
+    }
+
+    //camera info may belong to a different resolution than the depth image
+    const double scale = (double)depth_image.cols / cam_info.width;
+    percepteros::TSDFVolume::Intrinsics intrinsics;
+    intrinsics.fx = cam_info.K[0] * scale;
+    intrinsics.fy = cam_info.K[4] * scale;
+    intrinsics.cx = cam_info.K[2] * scale;
+    intrinsics.cy = cam_info.K[5] * scale;
+    intrinsics.width = depth_image.cols;
+    intrinsics.height = depth_image.rows;
+
+    //fusing a moving camera in its own frame would corrupt the volume, the cloud is passed through instead
+    if(!scene.viewPoint.has())
+    {
+      outWarn("No camera to world transformation, skipping fusion.");
+      return UIMA_ERR_NONE;
+    }
+    tf::StampedTransform camToWorld;
+    rs::conversion::from(scene.viewPoint.get(), camToWorld);
+    Eigen::Affine3d eigenTransform;
+    tf::transformTFToEigen(camToWorld, eigenTransform);
+    const Eigen::Affine3f pose = eigenTransform.cast<float>();
+
+    volume->integrate(depth_image, *cloud_ptr, intrinsics, pose, max_depth);
+    const double integrated = clock.getTime();
+
+    volume->raycast(intrinsics, pose, max_depth, *fused_ptr);
+    fused_ptr->header = cloud_ptr->header;
+
+    if(overwrite_cloud)
+    {
+      cas.set(VIEW_CLOUD, *fused_ptr);
+    }
+    else
+    {
+      cas.set("fused_cloud", *fused_ptr);
+    }
 
-    outInfo("Cloud size: " << cloud_ptr->points.size());
-    outInfo("took: " << clock.getTime() << " ms.");
+    outInfo("Blocks in use: " << volume->getNumberOfBlocks() << "/" << volume->getMaxBlocks());
+    outInfo("integration took: " << integrated << " ms, raycast took: " << clock.getTime() - integrated << " ms.");
     return UIMA_ERR_NONE;
   }
 };
@@ -35,8 +35,6 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types_conversion.h>
 #include <pcl/common/geometry.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/filters/extract_indices.h>
 
 //ROS
 #include <geometry_msgs/PoseStamped.h>
@@ -49,6 +47,10 @@
 
 //SUTURO
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/ClusterPyramid.h>
 
 /** NAMESPACES **/
 using namespace uima;
@@ -71,6 +73,11 @@ class KnifeAnnotator : public DrawingAnnotator {
 		PC::Ptr blade = PC::Ptr(new PC);
 		PC::Ptr rack = PC::Ptr(new PC);
 
+		//visualization
+		percepteros::OverlayBuffer overlay;
+		percepteros::OverlayRenderer renderer;
+		double pointSize = 1;
+
 		//parameters
 		int HUE_UPPER_BOUND, HUE_LOWER_BOUND;
 
@@ -78,10 +85,6 @@ class KnifeAnnotator : public DrawingAnnotator {
 		tf::Vector3 x, y, z;
 		PointN highest, lowest;
 
-		//helper classes
-		pcl::ExtractIndices<PointN> ex;
-		pcl::VoxelGrid<PointN> filter;
-
 	/**
 	 * Sets highest and lowest point of the knife by looking for the two points with biggest distance.
 	 * @method setEndpoints
@@ -122,7 +125,7 @@ class KnifeAnnotator : public DrawingAnnotator {
 	 */
 	tf::Vector3 getY(PC::Ptr object) {
 		tf::Vector3 object_normal(0, 0, 0);
-		PC::Ptr temp = PC::Ptr(new PC);
+		PC::Ptr temp = percepteros::FrameArena::get<PC>();
 		std::vector<int> indices;
 		pcl::removeNaNNormalsFromPointCloud(*object, *temp, indices);
 		int size = temp->size();
@@ -137,21 +140,19 @@ class KnifeAnnotator : public DrawingAnnotator {
 	}
 
 	/**
-	 * Extracts the points belonging to the knife cluster from the scene points.
+	 * Extracts the points belonging to the knife cluster from the scene points, downsampled to 1 cm.
 	 * @method extractPoints
-	 * @param  cluster       The robosherlock cluster with indices for the cluster points.
+	 * @param  index         The scene index holding the cluster.
+	 * @param  c             Index of the cluster with indices for the cluster points.
 	 * @param  container     The point cloud for the cluster.
 	 */
-	void extractPoints(rs::Cluster cluster, PC::Ptr container) {
-		pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
-		rs::ReferenceClusterPoints clusterpoints(cluster.points());
+	void extractPoints(percepteros::SceneIndex &index, size_t c, PC::Ptr container) {
+		pcl::PointIndices::Ptr cluster_indices = percepteros::FrameArena::get<pcl::PointIndices>();
+		rs::ReferenceClusterPoints clusterpoints(index.cluster(c).points());
 		rs::conversion::from(clusterpoints.indices(), *cluster_indices);
 
-		ex.setIndices(cluster_indices);
-		ex.filter(*container);
-
-		filter.setInputCloud(container);
-		filter.filter(*container);
+		typedef percepteros::ClusterPyramid<PointN> Pyramid;
+		*container = *Pyramid::of(index, c, *cloud, cluster_indices->indices).cloud(Pyramid::COARSE);
 	}
 
 	/**
@@ -222,7 +223,8 @@ class KnifeAnnotator : public DrawingAnnotator {
 		outInfo("Starting KnifeAnnotator");
 		rs::StopWatch clock;
 
-		//clear clouds
+		//clear clouds, the last scene may still be shown by the visualizer
+		percepteros::detachCloud<PointR>(cloud_r);
 		cloud_r->clear();
 		cloud_n->clear();
 		cloud->clear();
@@ -234,53 +236,45 @@ class KnifeAnnotator : public DrawingAnnotator {
 		rs::Scene scene = cas.getScene();
 		cas.get(VIEW_CLOUD, *cloud_r);
 		cas.get(VIEW_NORMALS, *cloud_n);
-		pcl::PointCloud<pcl::PointXYZ>::Ptr temp(new pcl::PointCloud<pcl::PointXYZ>);
+		pcl::PointCloud<pcl::PointXYZ>::Ptr temp = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZ>>();
 		pcl::copyPointCloud(*cloud_r, *temp);
 		pcl::concatenateFields(*temp, *cloud_n, *cloud);
 
-		//tool clusters
-		std::vector<rs::Cluster> tool_clusters;
-		std::vector<std::vector<percepteros::ToolObject>> tool_annotations;
-		scene.identifiables.filter(tool_clusters, tool_annotations);
-
-		//rack clusters
-		std::vector<rs::Cluster> rack_clusters;
-		std::vector<std::vector<percepteros::RackObject>> rack_annotations;
-		scene.identifiables.filter(rack_clusters, rack_annotations);
+		//tool and rack clusters
+		percepteros::SceneIndex &index = percepteros::SceneIndex::of(scene);
+		const std::vector<percepteros::SceneIndex::Entry<percepteros::ToolObject>> &tools = index.annotations<percepteros::ToolObject>();
+		const std::vector<percepteros::SceneIndex::Entry<percepteros::RackObject>> &racks = index.annotations<percepteros::RackObject>();
 
 		//helper bools
 		bool foundRack = false;
 		bool foundKnife = false;
 
 		//get y vector from rack if present
-		if (rack_clusters.size() > 0) {
+		if (racks.size() > 0) {
 			foundRack = true;
 			outInfo("Found rack. Using average normal for y-Vector.");
-			if (rack_clusters.size() > 1) {
+			if (racks.size() > 1) {
 				outInfo("Found multiple racks! Using first one for y-Vector.");
 			}
 
-			std::vector<float> yv = rack_annotations[0][0].normal.get();
+			percepteros::RackObject rack = racks[0].annotation;
+			std::vector<float> yv = rack.normal.get();
 			y.setX(yv[0]);
 			y.setY(yv[1]);
 			y.setZ(yv[2]);
 		}
 
-		//prepare helpers
-		ex.setInputCloud(cloud);
-		filter.setLeafSize(0.01f, 0.01f, 0.01f);
-
-		int cluster_index = 0;
+		size_t cluster_index = 0;
 		//search for knife
-		if (tool_clusters.size() > 0) {
-			for (int i = 0; i < tool_clusters.size(); i++) {
-				percepteros::ToolObject tool = tool_annotations[i][0];
+		if (tools.size() > 0) {
+			for (size_t i = 0; i < tools.size(); i++) {
+				percepteros::ToolObject tool = tools[i].annotation;
 				//checks cluster for being the knife for checking average hue value
 				if (tool.hue.get() > HUE_LOWER_BOUND && tool.hue.get() < HUE_UPPER_BOUND) {
 					outInfo("Found knife cluster.");
 					foundKnife = true;
-					cluster_index = i;
-					extractPoints(tool_clusters[i], blade);
+					cluster_index = tools[i].cluster;
+					extractPoints(index, cluster_index, blade);
 
 					//calculating highest and lowest point of knife cluster
 					setEndpoints(blade);
@@ -328,6 +322,7 @@ class KnifeAnnotator : public DrawingAnnotator {
 		//if knife is not found, return an error
 		if (!foundKnife) {
 			outInfo("No knife found in " << clock.getTime() << "ms.");
+			publishOverlay(false);
 			return UIMA_ERR_NONE;
 		}
 
@@ -371,13 +366,30 @@ class KnifeAnnotator : public DrawingAnnotator {
 		poseA.camera.set(rs::conversion::to(tcas, camera));
 		poseA.world.set(rs::conversion::to(tcas, world));
 
-		tool_clusters[cluster_index].annotations.append(poseA);
-		tool_clusters[cluster_index].annotations.append(recA);
+		index.append(cluster_index, poseA);
+		index.append(cluster_index, recA);
 
 		outInfo("Finished looking for knife in " << clock.getTime() << "ms.");
+		publishOverlay(true);
 		return UIMA_ERR_NONE;
 	}
 
+	/**
+	 * Hands the scene points and, if the knife was found, the three axes of its orientation to the visualizer.
+	 * @method publishOverlay
+	 * @param  foundKnife     Specifies if the knife was found in this frame.
+	 */
+	void publishOverlay(bool foundKnife) {
+		percepteros::VisualizationOverlay &o = overlay.back();
+		o.cloud = cloud_r;
+		if (foundKnife) {
+			o.addCone("x", getCoefficients(x, highest), 1, 0, 0);
+			o.addCone("y", getCoefficients(y, highest), 0, 1, 0);
+			o.addCone("z", getCoefficients(z, highest), 0, 0, 1);
+		}
+		overlay.publish();
+	}
+
 	/**
 	 * Method used to fill the visualizer with points illustrating the workings of the Annotator. The visualizer adds the scene points and three cones starting at the origin and pointing in the direction of the three axes of the orientation.
 	 * @method fillVisualizerWithLock
@@ -385,23 +397,7 @@ class KnifeAnnotator : public DrawingAnnotator {
 	 * @param  firstRun               Specifies if this is the first time the visualizer is run.
 	 */
 	void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun) {
-		//updates or adds the scene points.
-		if (firstRun) {
-			visualizer.addPointCloud(cloud_r, "scene points");
-		} else {
-			visualizer.updatePointCloud(cloud_r, "scene points");
-			visualizer.removeAllShapes();
-		}
-
-		//adds the cones visualizing the three axes of the orientation. (X-R/Y-G/Z-B)
-		visualizer.addCone(getCoefficients(x, highest), "x");
-		visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-
-		visualizer.addCone(getCoefficients(y, highest), "y");
-		visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-
-		visualizer.addCone(getCoefficients(z, highest), "z");
-		visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
+		renderer.render(overlay, visualizer, "scene points", pointSize, firstRun);
 	}
 };
 
@@ -0,0 +1,68 @@
+#include <percepteros/LastDetections.h>
+
+namespace percepteros
+{
+
+namespace
+{
+
+//every engine of the pool runs its annotators in its own thread
+thread_local ObjectDetectionArray last;
+thread_local bool valid = false;
+//scene of the running frame and of the stored detections
+thread_local SceneSignature pending, lastScene;
+thread_local std::string pipeline;
+
+}
+
+void LastDetections::store(const ObjectDetectionArray &detections)
+{
+  last = detections;
+  lastScene = pending;
+  pending = SceneSignature();
+  valid = true;
+}
+
+void LastDetections::beginScene(const SceneSignature &scene)
+{
+  pending = scene;
+}
+
+bool LastDetections::get(ObjectDetectionArray &detections)
+{
+  if(!valid)
+  {
+    return false;
+  }
+  detections = last;
+  return true;
+}
+
+bool LastDetections::get(ObjectDetectionArray &detections, SceneSignature &scene)
+{
+  if(!get(detections))
+  {
+    return false;
+  }
+  scene = lastScene;
+  return true;
+}
+
+void LastDetections::setPipeline(const std::string &name)
+{
+  pipeline = name;
+}
+
+const std::string &LastDetections::getPipeline()
+{
+  return pipeline;
+}
+
+void LastDetections::invalidate()
+{
+  valid = false;
+  pending = SceneSignature();
+  lastScene = SceneSignature();
+}
+
+}
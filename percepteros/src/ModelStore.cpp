@@ -0,0 +1,245 @@
+#include <percepteros/ModelStore.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace percepteros
+{
+
+static inline size_t align64(size_t size)
+{
+  return (size + 63) & ~(size_t)63;
+}
+
+ModelStore::ModelStore() : fd(-1), size(0), header(NULL)
+{
+}
+
+ModelStore::~ModelStore()
+{
+  close();
+}
+
+bool ModelStore::fail(const std::string &what)
+{
+  error = what + ": " + strerror(errno);
+  close();
+  return false;
+}
+
+bool ModelStore::open(const std::string &path)
+{
+  close();
+  this->path = path;
+  fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    return fail("open " + path);
+  }
+  struct stat fileStat;
+  if(fstat(fd, &fileStat) != 0)
+  {
+    return fail("fstat " + path);
+  }
+  size = fileStat.st_size;
+  if(size < sizeof(Header))
+  {
+    errno = EINVAL;
+    return fail("store " + path + " too small");
+  }
+  void *memory = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    size = 0;
+    return fail("mmap " + path);
+  }
+  header = static_cast<const Header *>(memory);
+  if(header->magic != MAGIC || header->version != VERSION || header->size != size ||
+     sizeof(Header) + header->sections * sizeof(Section) > size)
+  {
+    errno = EPROTO;
+    return fail("store " + path + " has an incompatible layout");
+  }
+  const Section *sections = reinterpret_cast<const Section *>(header + 1);
+  for(uint32_t i = 0; i < header->sections; ++i)
+  {
+    if(sections[i].offset > size || sections[i].count * sections[i].recordSize > size - sections[i].offset)
+    {
+      errno = EPROTO;
+      return fail("store " + path + " is truncated");
+    }
+  }
+  //the mapping stays valid without the descriptor
+  ::close(fd);
+  fd = -1;
+  return true;
+}
+
+void ModelStore::close()
+{
+  if(header)
+  {
+    munmap(const_cast<Header *>(header), size);
+    header = NULL;
+    size = 0;
+  }
+  if(fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+std::shared_ptr<const ModelStore> ModelStore::shared(const std::string &path, std::string &error)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<const ModelStore>> stores;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<const ModelStore> store = stores[path].lock();
+  if(!store)
+  {
+    std::shared_ptr<ModelStore> opened = std::make_shared<ModelStore>();
+    if(!opened->open(path))
+    {
+      error = opened->getError();
+      return std::shared_ptr<const ModelStore>();
+    }
+    store = opened;
+    stores[path] = store;
+  }
+  return store;
+}
+
+std::shared_ptr<const ModelStore> ModelStore::compiled(const std::string &name, const std::vector<std::string> &sources,
+                                                       std::string &error)
+{
+  //the workspaces in the order catkin overlays them, like catkin_find
+  const char *prefixes = getenv("CMAKE_PREFIX_PATH");
+  std::istringstream stream(prefixes ? prefixes : "");
+  std::string prefix, path;
+  struct stat storeStat;
+  while(std::getline(stream, prefix, ':'))
+  {
+    const std::string candidate = prefix + "/share/percepteros/" + name;
+    if(!prefix.empty() && stat(candidate.c_str(), &storeStat) == 0)
+    {
+      path = candidate;
+      break;
+    }
+  }
+  if(path.empty())
+  {
+    error = name + " is in no share directory of CMAKE_PREFIX_PATH";
+    return std::shared_ptr<const ModelStore>();
+  }
+
+  //a source edited after the build would be ignored silently otherwise
+  for(const std::string &source : sources)
+  {
+    struct stat sourceStat;
+    if(stat(source.c_str(), &sourceStat) == 0 && sourceStat.st_mtime > storeStat.st_mtime)
+    {
+      error = source + " is newer than " + path + ", rebuild the package";
+      return std::shared_ptr<const ModelStore>();
+    }
+  }
+  return shared(path, error);
+}
+
+const void *ModelStore::find(const std::string &name, size_t recordSize, size_t &count) const
+{
+  count = 0;
+  if(!header)
+  {
+    return NULL;
+  }
+  const Section *sections = reinterpret_cast<const Section *>(header + 1);
+  for(uint32_t i = 0; i < header->sections; ++i)
+  {
+    if(name == std::string(sections[i].name, strnlen(sections[i].name, sizeof(sections[i].name))))
+    {
+      if(sections[i].recordSize != recordSize)
+      {
+        return NULL;
+      }
+      count = sections[i].count;
+      return reinterpret_cast<const char *>(header) + sections[i].offset;
+    }
+  }
+  return NULL;
+}
+
+void ModelStoreWriter::addSection(const std::string &name, size_t recordSize, const void *records, size_t count)
+{
+  Data data;
+  memset(&data.section, 0, sizeof(data.section));
+  strncpy(data.section.name, name.c_str(), sizeof(data.section.name) - 1);
+  data.section.recordSize = recordSize;
+  data.section.count = count;
+  const char *bytes = static_cast<const char *>(records);
+  data.bytes.assign(bytes, bytes + recordSize * count);
+  sections.push_back(data);
+}
+
+bool ModelStoreWriter::write(const std::string &path)
+{
+  ModelStore::Header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = ModelStore::MAGIC;
+  header.version = ModelStore::VERSION;
+  header.sections = sections.size();
+
+  size_t offset = align64(sizeof(header) + sections.size() * sizeof(ModelStore::Section));
+  for(Data &data : sections)
+  {
+    data.section.offset = offset;
+    offset = align64(offset + data.bytes.size());
+  }
+  header.size = offset;
+
+  std::vector<char> file(offset, 0);
+  memcpy(file.data(), &header, sizeof(header));
+  for(size_t i = 0; i < sections.size(); ++i)
+  {
+    memcpy(file.data() + sizeof(header) + i * sizeof(ModelStore::Section), &sections[i].section, sizeof(ModelStore::Section));
+    if(!sections[i].bytes.empty())
+    {
+      memcpy(file.data() + sections[i].section.offset, sections[i].bytes.data(), sections[i].bytes.size());
+    }
+  }
+
+  const std::string temporary = path + ".tmp";
+  FILE *out = fopen(temporary.c_str(), "wb");
+  if(!out)
+  {
+    error = "fopen " + temporary + ": " + strerror(errno);
+    return false;
+  }
+  const bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+  if(fclose(out) != 0 || !written)
+  {
+    error = "write " + temporary + ": " + strerror(errno);
+    unlink(temporary.c_str());
+    return false;
+  }
+  if(rename(temporary.c_str(), path.c_str()) != 0)
+  {
+    error = "rename " + temporary + ": " + strerror(errno);
+    unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+}
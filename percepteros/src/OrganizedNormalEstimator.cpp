@@ -0,0 +1,151 @@
+#include <uima/api.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/features/normal_3d.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/search/kdtree.h>
+
+//RS
+#include <rs/scene_cas.h>
+#include <rs/utils/time.h>
+#include <rs/utils/output.h>
+
+#include <percepteros/OrganizedNormals.h>
+#include <percepteros/FrameArena.h>
+
+#include <cmath>
+
+using namespace uima;
+
+/**
+ * Replaces the NormalEstimator of the pipelines. Kinect clouds arrive
+ * organized, so the normals are estimated on the image grid from integral
+ * images, in bands of rows processed by several threads, and written to
+ * VIEW_NORMALS. Unorganized clouds fall back to a k nearest neighbour
+ * estimation.
+ *
+ * With compare set, the integral image estimator of pcl that NormalEstimator
+ * uses also runs on every frame, and both times are logged together with
+ * the mean angle between the two results.
+ */
+class OrganizedNormalEstimator : public Annotator
+{
+private:
+  typedef pcl::PointXYZRGBA PointT;
+
+  percepteros::OrganizedNormals estimator;
+  bool compare;
+  int kNeighbours;
+
+  pcl::PointCloud<PointT>::Ptr cloud;
+
+public:
+
+  OrganizedNormalEstimator() : compare(false), kNeighbours(30), cloud(new pcl::PointCloud<PointT>)
+  {
+  }
+
+  TyErrorId initialize(AnnotatorContext &ctx)
+  {
+    outInfo("initialize");
+    percepteros::OrganizedNormals::Parameters parameters;
+    std::string method = "gradient";
+    if(ctx.isParameterDefined("method")) ctx.extractValue("method", method);
+    if(ctx.isParameterDefined("smoothing")) ctx.extractValue("smoothing", parameters.smoothing);
+    if(ctx.isParameterDefined("depth_dependent")) ctx.extractValue("depth_dependent", parameters.depthDependent);
+    if(ctx.isParameterDefined("max_radius")) ctx.extractValue("max_radius", parameters.maxRadius);
+    if(ctx.isParameterDefined("max_depth_change")) ctx.extractValue("max_depth_change", parameters.maxDepthChange);
+    if(ctx.isParameterDefined("threads")) ctx.extractValue("threads", parameters.threads);
+    if(ctx.isParameterDefined("k_neighbours")) ctx.extractValue("k_neighbours", kNeighbours);
+    if(ctx.isParameterDefined("compare")) ctx.extractValue("compare", compare);
+
+    if(method == "covariance")
+    {
+      parameters.method = percepteros::OrganizedNormals::COVARIANCE;
+    }
+    else if(method != "gradient")
+    {
+      outError("Unknown method " << method << ", use gradient or covariance.");
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
+    estimator = percepteros::OrganizedNormals(parameters);
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId destroy()
+  {
+    outInfo("destroy");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId process(CAS &tcas, ResultSpecification const &res_spec)
+  {
+    rs::StopWatch clock;
+    rs::SceneCas cas(tcas);
+    cas.get(VIEW_CLOUD, *cloud);
+
+    pcl::PointCloud<pcl::Normal>::Ptr normals = percepteros::FrameArena::get<pcl::PointCloud<pcl::Normal>>();
+    if(!cloud->isOrganized())
+    {
+      pcl::NormalEstimation<PointT, pcl::Normal> fallback;
+      fallback.setSearchMethod(pcl::search::KdTree<PointT>::Ptr(new pcl::search::KdTree<PointT>));
+      fallback.setKSearch(kNeighbours);
+      fallback.setInputCloud(cloud);
+      fallback.compute(*normals);
+      cas.set(VIEW_NORMALS, *normals);
+      outInfo("Cloud is not organized, estimated normals of " << cloud->size() << " points from " << kNeighbours
+              << " neighbours in " << clock.getTime() << " ms.");
+      return UIMA_ERR_NONE;
+    }
+
+    estimator.compute(*cloud, *normals);
+    normals->header = cloud->header;
+    const double time = clock.getTime();
+    cas.set(VIEW_NORMALS, *normals);
+    outInfo("Estimated " << cloud->width << "x" << cloud->height << " normals in " << time << " ms.");
+
+    if(compare)
+    {
+      compareWithPcl(*normals, time);
+    }
+    return UIMA_ERR_NONE;
+  }
+
+private:
+  /**
+   * @brief compareWithPcl Runs the estimator of NormalEstimator on the same cloud and logs both times
+   */
+  void compareWithPcl(const pcl::PointCloud<pcl::Normal> &normals, double time)
+  {
+    rs::StopWatch clock;
+    pcl::PointCloud<pcl::Normal>::Ptr reference = percepteros::FrameArena::get<pcl::PointCloud<pcl::Normal>>();
+    pcl::IntegralImageNormalEstimation<PointT, pcl::Normal> ne;
+    ne.setNormalEstimationMethod(pcl::IntegralImageNormalEstimation<PointT, pcl::Normal>::AVERAGE_3D_GRADIENT);
+    ne.setMaxDepthChangeFactor(0.02f);
+    ne.setNormalSmoothingSize(10.0f);
+    ne.setInputCloud(cloud);
+    ne.compute(*reference);
+    const double referenceTime = clock.getTime();
+
+    double angles = 0;
+    size_t both = 0, valid = 0, referenceValid = 0;
+    for(size_t i = 0; i < normals.size(); ++i)
+    {
+      const pcl::Normal &a = normals.points[i], &b = reference->points[i];
+      const bool aValid = std::isfinite(a.normal_x), bValid = std::isfinite(b.normal_x);
+      valid += aValid;
+      referenceValid += bValid;
+      if(aValid && bValid)
+      {
+        const float dot = a.normal_x * b.normal_x + a.normal_y * b.normal_y + a.normal_z * b.normal_z;
+        angles += std::acos(std::max(-1.0f, std::min(1.0f, std::abs(dot))));
+        ++both;
+      }
+    }
+    outInfo("Organized normals " << time << " ms (" << valid << " valid), pcl " << referenceTime << " ms ("
+            << referenceValid << " valid), mean deviation " << (both ? angles / both * 180.0 / M_PI : 0.0) << " deg.");
+  }
+};
+
+// This macro exports an entry point that is used to create the annotator.
+MAKE_AE(OrganizedNormalEstimator)
@@ -0,0 +1,231 @@
+#include <percepteros/OrganizedNormals.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include <Eigen/Eigenvalues>
+
+namespace percepteros
+{
+
+OrganizedNormals::OrganizedNormals() : width(0), height(0), channels(0)
+{
+}
+
+OrganizedNormals::OrganizedNormals(const Parameters &parameters) : parameters(parameters), width(0), height(0), channels(0)
+{
+}
+
+template<typename Function>
+void OrganizedNormals::parallel(int size, Function function)
+{
+  const int threads = std::max(1, std::min(parameters.threads, size));
+  if(threads == 1)
+  {
+    function(0, size);
+    return;
+  }
+  std::vector<std::thread> workers;
+  const int perThread = (size + threads - 1) / threads;
+  for(int t = 0; t < threads; ++t)
+  {
+    const int begin = t * perThread;
+    const int end = std::min(size, begin + perThread);
+    workers.push_back(std::thread(function, begin, end));
+  }
+  for(std::thread &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void OrganizedNormals::compute(int width, int height, pcl::PointCloud<pcl::Normal> &normals)
+{
+  this->width = width;
+  this->height = height;
+  channels = parameters.method == COVARIANCE ? (int)CHANNELS : SZ + 1;
+  //every cell but the first row is written by integrateRows
+  integral.resize((size_t)channels * (width + 1) * (height + 1));
+  for(int c = 0; c < channels; ++c)
+  {
+    std::fill_n(integral.begin() + (size_t)c * (width + 1) * (height + 1), width + 1, 0.0);
+  }
+
+  //rows and then columns are independent of each other
+  parallel(height, [this](int begin, int end)
+  {
+    integrateRows(begin, end);
+  });
+  parallel(width, [this](int begin, int end)
+  {
+    integrateColumns(begin, end);
+  });
+
+  normals.width = width;
+  normals.height = height;
+  normals.is_dense = false;
+  normals.points.resize((size_t)width * height);
+  parallel(height, [this, &normals](int begin, int end)
+  {
+    estimateRows(begin, end, normals);
+  });
+}
+
+void OrganizedNormals::integrateRows(int begin, int end)
+{
+  const size_t plane = (size_t)(width + 1) * (height + 1);
+  const int stride = width + 1;
+  for(int v = begin; v < end; ++v)
+  {
+    double sums[CHANNELS] = {0};
+    double *row = integral.data() + (size_t)(v + 1) * stride;
+    for(int c = 0; c < channels; ++c)
+    {
+      row[c * plane] = 0;
+    }
+    for(int u = 0; u < width; ++u)
+    {
+      const size_t i = (size_t)v * width + u;
+      if(std::isfinite(z[i]))
+      {
+        const double px = x[i], py = y[i], pz = z[i];
+        sums[COUNT] += 1;
+        sums[SX] += px;
+        sums[SY] += py;
+        sums[SZ] += pz;
+        if(channels == CHANNELS)
+        {
+          sums[SXX] += px * px;
+          sums[SXY] += px * py;
+          sums[SXZ] += px * pz;
+          sums[SYY] += py * py;
+          sums[SYZ] += py * pz;
+          sums[SZZ] += pz * pz;
+        }
+      }
+      for(int c = 0; c < channels; ++c)
+      {
+        row[c * plane + u + 1] = sums[c];
+      }
+    }
+  }
+}
+
+void OrganizedNormals::integrateColumns(int begin, int end)
+{
+  const size_t plane = (size_t)(width + 1) * (height + 1);
+  const int stride = width + 1;
+  for(int c = 0; c < channels; ++c)
+  {
+    double *data = integral.data() + c * plane;
+    for(int v = 2; v <= height; ++v)
+    {
+      double *row = data + (size_t)v * stride;
+      const double *above = row - stride;
+      for(int u = begin + 1; u <= end; ++u)
+      {
+        row[u] += above[u];
+      }
+    }
+  }
+}
+
+void OrganizedNormals::estimateRows(int begin, int end, pcl::PointCloud<pcl::Normal> &normals) const
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for(int v = begin; v < end; ++v)
+  {
+    for(int u = 0; u < width; ++u)
+    {
+      const size_t i = (size_t)v * width + u;
+      pcl::Normal &normal = normals.points[i];
+      const float size = parameters.depthDependent ? parameters.smoothing * z[i] : parameters.smoothing;
+      const int radius = std::max(1, std::min(parameters.maxRadius, (int)std::lround(0.5f * size)));
+      if(!std::isfinite(z[i]) || !estimate(u, v, radius, normal))
+      {
+        normal.normal_x = normal.normal_y = normal.normal_z = normal.curvature = nan;
+      }
+    }
+  }
+}
+
+bool OrganizedNormals::estimate(int u, int v, int radius, pcl::Normal &normal) const
+{
+  const size_t i = (size_t)v * width + u;
+  const Eigen::Vector3d point(x[i], y[i], z[i]);
+
+  for(int r = radius; r >= 1; r /= 2)
+  {
+    const int u0 = std::max(0, u - r), u1 = std::min(width, u + r + 1);
+    const int v0 = std::max(0, v - r), v1 = std::min(height, v + r + 1);
+    const double count = sum(COUNT, u0, v0, u1, v1);
+    if(count < 3)
+    {
+      return false;
+    }
+    //on one surface the window mean stays close to the point, a depth jump pulls it away
+    if(std::abs(sum(SZ, u0, v0, u1, v1) / count - point.z()) > parameters.maxDepthChange * point.z())
+    {
+      continue;
+    }
+
+    Eigen::Vector3d n;
+    float curvature = 0;
+    if(parameters.method == AVERAGE_3D_GRADIENT)
+    {
+      //mean of the right minus the left half and of the lower minus the upper half
+      const double right = sum(COUNT, u + 1, v0, u1, v1), left = sum(COUNT, u0, v0, u, v1);
+      const double lower = sum(COUNT, u0, v + 1, u1, v1), upper = sum(COUNT, u0, v0, u1, v);
+      if(right == 0 || left == 0 || lower == 0 || upper == 0)
+      {
+        continue;
+      }
+      const Eigen::Vector3d gu = Eigen::Vector3d(sum(SX, u + 1, v0, u1, v1), sum(SY, u + 1, v0, u1, v1), sum(SZ, u + 1, v0, u1, v1)) / right
+                               - Eigen::Vector3d(sum(SX, u0, v0, u, v1), sum(SY, u0, v0, u, v1), sum(SZ, u0, v0, u, v1)) / left;
+      const Eigen::Vector3d gv = Eigen::Vector3d(sum(SX, u0, v + 1, u1, v1), sum(SY, u0, v + 1, u1, v1), sum(SZ, u0, v + 1, u1, v1)) / lower
+                               - Eigen::Vector3d(sum(SX, u0, v0, u1, v), sum(SY, u0, v0, u1, v), sum(SZ, u0, v0, u1, v)) / upper;
+      n = gu.cross(gv);
+      if(n.squaredNorm() == 0)
+      {
+        continue;
+      }
+    }
+    else
+    {
+      const Eigen::Vector3d mean = Eigen::Vector3d(sum(SX, u0, v0, u1, v1), sum(SY, u0, v0, u1, v1), sum(SZ, u0, v0, u1, v1)) / count;
+      Eigen::Matrix3d covariance;
+      covariance(0, 0) = sum(SXX, u0, v0, u1, v1) / count - mean.x() * mean.x();
+      covariance(0, 1) = sum(SXY, u0, v0, u1, v1) / count - mean.x() * mean.y();
+      covariance(0, 2) = sum(SXZ, u0, v0, u1, v1) / count - mean.x() * mean.z();
+      covariance(1, 1) = sum(SYY, u0, v0, u1, v1) / count - mean.y() * mean.y();
+      covariance(1, 2) = sum(SYZ, u0, v0, u1, v1) / count - mean.y() * mean.z();
+      covariance(2, 2) = sum(SZZ, u0, v0, u1, v1) / count - mean.z() * mean.z();
+      covariance(1, 0) = covariance(0, 1);
+      covariance(2, 0) = covariance(0, 2);
+      covariance(2, 1) = covariance(1, 2);
+
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+      solver.computeDirect(covariance);
+      n = solver.eigenvectors().col(0);
+      const double total = solver.eigenvalues().sum();
+      curvature = total > 0 ? std::max(0.0, solver.eigenvalues()[0] / total) : 0;
+    }
+
+    //point towards the camera
+    n.normalize();
+    if(n.dot(point) > 0)
+    {
+      n = -n;
+    }
+    normal.normal_x = n.x();
+    normal.normal_y = n.y();
+    normal.normal_z = n.z();
+    normal.curvature = curvature;
+    return true;
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,151 @@
+#include <percepteros/PerfCounters.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+namespace percepteros
+{
+
+#ifdef __linux__
+namespace
+{
+
+int openCounter(uint32_t type, uint64_t config, bool userOnly)
+{
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  //user space only, allowed up to perf_event_paranoid 2
+  attr.exclude_kernel = userOnly;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  //pid 0 and cpu -1: the calling thread on any cpu
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+}
+#endif
+
+PerfCounters::PerfCounters()
+{
+  for(int i = 0; i < COUNT; ++i)
+  {
+    fds[i] = -1;
+  }
+}
+
+PerfCounters::~PerfCounters()
+{
+  close();
+}
+
+bool PerfCounters::open()
+{
+  close();
+#ifdef __linux__
+  fds[CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true);
+  fds[INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, true);
+  fds[CACHE_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, true);
+  fds[BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, true);
+  //switches happen in the kernel, they are not seen in user space only mode
+  fds[CONTEXT_SWITCHES] = openCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, false);
+#endif
+  return available();
+}
+
+void PerfCounters::close()
+{
+  for(int i = 0; i < COUNT; ++i)
+  {
+#ifdef __linux__
+    if(fds[i] >= 0)
+    {
+      ::close(fds[i]);
+    }
+#endif
+    fds[i] = -1;
+  }
+}
+
+bool PerfCounters::available() const
+{
+  for(int i = 0; i < COUNT; ++i)
+  {
+    if(fds[i] >= 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PerfCounters::start()
+{
+#ifdef __linux__
+  for(int i = 0; i < COUNT; ++i)
+  {
+    if(fds[i] >= 0)
+    {
+      ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+void PerfCounters::stop(Sample &sample)
+{
+  for(int i = 0; i < COUNT; ++i)
+  {
+    sample.values[i] = 0;
+    sample.valid[i] = false;
+#ifdef __linux__
+    if(fds[i] < 0)
+    {
+      continue;
+    }
+    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    //value, time enabled, time running
+    uint64_t data[3];
+    if(read(fds[i], data, sizeof(data)) != sizeof(data))
+    {
+      continue;
+    }
+    if(data[2] > 0)
+    {
+      sample.values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+      sample.valid[i] = true;
+    }
+#endif
+  }
+}
+
+const char *PerfCounters::name(Counter counter)
+{
+  switch(counter)
+  {
+  case CYCLES:
+    return "cycles";
+  case INSTRUCTIONS:
+    return "instructions";
+  case CACHE_MISSES:
+    return "LLC misses";
+  case BRANCH_MISSES:
+    return "branch misses";
+  case CONTEXT_SWITCHES:
+    return "context switches";
+  default:
+    return "";
+  }
+}
+
+}
@@ -24,6 +24,12 @@
 
 //SUTURO
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/FrameDeadline.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/ClusterColor.h>
+#include <percepteros/Ransac.h>
 
 //ROS
 #include <geometry_msgs/PoseStamped.h>
@@ -32,11 +38,6 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/point_types_conversion.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/sample_consensus/ransac.h>
-#include <pcl/sample_consensus/sac_model_circle.h>
 #include <pcl/filters/extract_indices.h>
 
 //C++
@@ -66,20 +67,27 @@ class PlateAnnotator : public DrawingAnnotator {
 		//poses of plates
 		std::vector<std::vector<tf::Vector3>> poses;
 
+		//visualization
+		percepteros::OverlayBuffer overlay;
+		percepteros::OverlayRenderer renderer;
+		double pointSize = 1;
+
 		//parameters
 		int HUE_LOWER_BOUND, HUE_UPPER_BOUND;
+		int threads = percepteros::Ransac::Parameters().threads;
 
 		/**
 		 * Adds an annotation to the plate cluster.
 		 * @method addAnnotation
 		 * @param  tcas          Object containing points and cluster information.
-		 * @param  cluster       Object containing cluster indices.
+		 * @param  index         Index of the scene the cluster belongs to.
+		 * @param  c             Index of the cluster in the scene index.
 		 * @param  co            Model coefficients for circle representing plate.
 		 * @param  circ          Middle point of circle.
 		 */
-		void addAnnotation(CAS &tcas, rs::Cluster cluster, pcl::ModelCoefficients co, PointN circ) {
+		void addAnnotation(CAS &tcas, percepteros::SceneIndex &index, size_t c, pcl::ModelCoefficients co, PointN circ) {
 			//calculate average normal
-			extractCluster(clust, cloud, cluster);
+			extractCluster(clust, cloud, index.cluster(c));
 			std::vector<int> indices;
 			removeNaNNormalsFromPointCloud(*clust, *clust, indices);
 
@@ -142,8 +150,8 @@ class PlateAnnotator : public DrawingAnnotator {
 			o.height.set(0);
 			o.depth.set(0);
 
-			cluster.annotations.append(poseA);
-			cluster.annotations.append(o);
+			index.append(c, poseA);
+			index.append(c, o);
 		}
 
 		/**
@@ -188,7 +196,7 @@ class PlateAnnotator : public DrawingAnnotator {
 		 */
 		void extractCluster(PC::Ptr clust, PC::Ptr cloud, rs::Cluster cluster) {
 			clust->clear();
-			pcl::PointIndices::Ptr clix(new pcl::PointIndices);
+			pcl::PointIndices::Ptr clix = percepteros::FrameArena::get<pcl::PointIndices>();
 			rs::ReferenceClusterPoints clups(cluster.points());
 			rs::conversion::from(clups.indices(), *clix);
 
@@ -209,25 +217,18 @@ class PlateAnnotator : public DrawingAnnotator {
 		}
 
 		/**
-		 * Adds the pose of one plate to the visualizer.
+		 * Adds the pose of one plate to the overlay.
 		 * @method addPose
 		 * @param  pose       Vector containing pose information.
-		 * @param  visualizer Visualizer object to add visualiziations to.
+		 * @param  o          Overlay to add visualiziations to.
 		 * @param  index      Index of plate for keeping names individual.
 		 */
-		void addPose(std::vector<tf::Vector3> pose, pcl::visualization::PCLVisualizer &visualizer, int index) {
+		void addPose(const std::vector<tf::Vector3> &pose, percepteros::VisualizationOverlay &o, int index) {
 			std::ostringstream ss;
-			ss << "x" << index;
-			visualizer.addCone(getCoefficients(pose[0], pose[3]), ss.str());
-			visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, ss.str());
-
-			ss << "y" << index;
-			visualizer.addCone(getCoefficients(pose[1], pose[3]), ss.str());
-			visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, ss.str());
-
-			ss << "z" << index;
-			visualizer.addCone(getCoefficients(pose[2], pose[3]), ss.str());
-			visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, ss.str());
+			ss << index;
+			o.addCone("x" + ss.str(), getCoefficients(pose[0], pose[3]), 1, 0, 0);
+			o.addCone("y" + ss.str(), getCoefficients(pose[1], pose[3]), 0, 1, 0);
+			o.addCone("z" + ss.str(), getCoefficients(pose[2], pose[3]), 0, 0, 1);
 		}
 
 		/**
@@ -278,6 +279,7 @@ class PlateAnnotator : public DrawingAnnotator {
 			//extract color parameters
 			ctx.extractValue("minHue", HUE_LOWER_BOUND);
 			ctx.extractValue("maxHue", HUE_UPPER_BOUND);
+			if (ctx.isParameterDefined("threads")) ctx.extractValue("threads", threads);
 
 	    return UIMA_ERR_NONE;
 	  }
@@ -306,52 +308,57 @@ class PlateAnnotator : public DrawingAnnotator {
 			//get clusters
 	    rs::SceneCas cas(tcas);
 			rs::Scene scene = cas.getScene();
-			std::vector<rs::Cluster> clusters;
-			clusters.clear();
-			scene.identifiables.filter(clusters);
+			percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
 
-			//get scene points
+			//get scene points, the last scene may still be shown by the visualizer
+			percepteros::detachCloud<PointR>(cloud_r);
 			cas.get(VIEW_CLOUD, *cloud_r);
 			cas.get(VIEW_NORMALS, *cloud_n);
-			pcl::PointCloud<pcl::PointXYZ>::Ptr temp(new pcl::PointCloud<pcl::PointXYZ>);
+			pcl::PointCloud<pcl::PointXYZ>::Ptr temp = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZ>>();
 			pcl::copyPointCloud(*cloud_r, *temp);
 			pcl::concatenateFields(*temp, *cloud_n, *cloud);
 
 			//prepare segmenter
-			pcl::SACSegmentation<PointN> seg;
-			seg.setOptimizeCoefficients(true);
-			seg.setMethodType(pcl::SAC_RANSAC);
-			seg.setMaxIterations(500);
-			seg.setModelType(pcl::SACMODEL_CIRCLE3D);
-			seg.setDistanceThreshold(0.005);
-			seg.setRadiusLimits(0.025, 0.13);
+			percepteros::Ransac::Parameters parameters;
+			parameters.model = percepteros::Ransac::CIRCLE3D;
+			parameters.maxIterations = percepteros::FrameDeadline::capIterations(500);
+			parameters.distance = 0.005;
+			parameters.minRadius = 0.025;
+			parameters.maxRadius = 0.13;
+			parameters.threads = threads;
+			percepteros::Ransac seg(parameters);
 
 			//prepare extractor
 			pcl::ExtractIndices<PointN> ex;
 			ex.setNegative(true);
 
-			std::vector<rs::Shape> shapes;
 			poses.clear();
-			for (auto it = clusters.begin(); it != clusters.end(); ++it) {
-				auto cluster = *it;
-				shapes.clear();
-				cluster.annotations.filter(shapes);
+			const size_t clusterCount = index.clusters().size();
+			for (size_t c = 0; c < clusterCount; ++c) {
+				//stop looking once the time budget is used up
+				if (percepteros::FrameDeadline::expired()) {
+					outInfo("Deadline reached, skipping remaining clusters.");
+					percepteros::FrameDeadline::markDegraded();
+					break;
+				}
+				rs::Cluster cluster = index.cluster(c);
+				const std::vector<rs::Shape> &shapes = index.annotations<rs::Shape>(c);
 				if (cluster.source.get().compare(0, 13, "HueClustering") > -1 &&
 						shapes.size() > 0 &&
-						shapes[0].shape.get().compare("round") > -1) {
+						rs::Shape(shapes[0]).shape.get().compare("round") > -1) {
 						outInfo("Found a cluster");
 						//could be a plate - check for two circles
 						//extract cluster
 						extractCluster(clust, cloud, cluster);
 						//variables
-						pcl::PointIndices::Ptr cin1(new pcl::PointIndices());
-						pcl::PointIndices::Ptr cin2(new pcl::PointIndices());
+						pcl::PointIndices::Ptr cin1 = percepteros::FrameArena::get<pcl::PointIndices>();
+						pcl::PointIndices::Ptr cin2 = percepteros::FrameArena::get<pcl::PointIndices>();
 
-						pcl::ModelCoefficients::Ptr cco1(new pcl::ModelCoefficients());
-						pcl::ModelCoefficients::Ptr cco2(new pcl::ModelCoefficients());
+						pcl::ModelCoefficients::Ptr cco1 = percepteros::FrameArena::get<pcl::ModelCoefficients>();
+						pcl::ModelCoefficients::Ptr cco2 = percepteros::FrameArena::get<pcl::ModelCoefficients>();
 
 						//first circle
-						seg.setInputCloud(clust);
+						seg.setInputCloud(*clust);
 						seg.segment(*cin1, *cco1);
 
 						//printCoefficients("First circle", cco1);
@@ -362,18 +369,27 @@ class PlateAnnotator : public DrawingAnnotator {
 						ex.filter(*clust_filtered);
 
 						//second circle
-						seg.setInputCloud(clust_filtered);
+						seg.setInputCloud(*clust_filtered);
 						seg.segment(*cin2, *cco2);
 
 						//printCoefficients("Second circle", cco2);
 
 
-						if 	(isPlate(cco1, cco2, (int) std::strtof(cluster.source.get().erase(0, 15).data(), NULL))) {
+						percepteros::ColorStatistics stats = percepteros::ClusterColor::of(tcas, index, c, *cloud_r);
+						if 	(isPlate(cco1, cco2, (int) stats.hue.get())) {
 							outInfo("Found a plate in " << clock.getTime() << "ms.");
-							addAnnotation(tcas, cluster, *cco1, clust->points[cin1->indices[0]]);
+							addAnnotation(tcas, index, c, *cco1, clust->points[cin1->indices[0]]);
 						}
 					}
 				}
+
+				percepteros::VisualizationOverlay &o = overlay.back();
+				o.cloud = cloud_r;
+				int i = 0;
+				for (auto pose : poses) {
+					addPose(pose, o, i++);
+				}
+				overlay.publish();
 				return UIMA_ERR_NONE;
 			}
 
@@ -384,17 +400,7 @@ class PlateAnnotator : public DrawingAnnotator {
 			 * @param  firstRun               Indicates if visualizer is run for the first time.
 			 */
 			void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun) {
-				if (firstRun) {
-					visualizer.addPointCloud(cloud_r, "scene");
-				} else {
-					visualizer.updatePointCloud(cloud_r, "scene");
-					visualizer.removeAllShapes();
-				}
-
-				int i = 0;
-				for (auto pose : poses) {
-					addPose(pose, visualizer, i++);
-				}
+				renderer.render(overlay, visualizer, "scene", pointSize, firstRun);
 			}
 };
 
@@ -10,31 +10,123 @@
 #include "std_msgs/String.h"
 #include <percepteros/types/all_types.h>
 #include <suturo_perception_msgs/ObjectDetection.h>
+#include <percepteros/ObjectDetectionArray.h>
 #include <tf_conversions/tf_eigen.h>
 #include <tf/transform_listener.h>
 #include "geometry_msgs/PoseStamped.h"
+#include <sensor_msgs/CameraInfo.h>
+#include <percepteros/SharedDetectionRing.h>
+#include <percepteros/FrameDeadline.h>
+#include <percepteros/LastDetections.h>
+#include <percepteros/SceneIndex.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstring>
 
 using namespace uima;
 
+namespace
+{
+
+//the engines of a pool publish into the same segment, one frame at a time
+struct RingWriter
+{
+  percepteros::SharedDetectionRing ring;
+  std::mutex mutex;
+};
+
+std::mutex writersMutex;
+std::map<std::string, std::weak_ptr<RingWriter>> writers;
+
+/**
+ * @brief openWriter Returns the writer of the segment, creating the segment for the first publisher of the process
+ * @return empty on error
+ */
+std::shared_ptr<RingWriter> openWriter(const std::string &name, int slots, int maxDetections, int maxPoints)
+{
+  std::lock_guard<std::mutex> lock(writersMutex);
+  std::shared_ptr<RingWriter> writer = writers[name].lock();
+  if(writer)
+  {
+    return writer;
+  }
+  writer.reset(new RingWriter);
+  if(!writer->ring.create(name, slots, maxDetections, maxPoints))
+  {
+    outError("Could not create shared memory channel: " << writer->ring.getError());
+    return std::shared_ptr<RingWriter>();
+  }
+  writers[name] = writer;
+  return writer;
+}
+
+//the engines of a pool publish on the same topic, their frames are counted together
+std::atomic<uint32_t> frameCount(0);
+
+}
+
 class ROSPublisher : public Annotator
 {
 private:
 
   ros::NodeHandle n;
   ros::Publisher chatter_pub;
+  ros::Publisher batch_pub;
   tf::TransformListener listener;
 
-  tf::StampedTransform camToWorld, worldToCam;
+  tf::StampedTransform camToWorld;
+
+  std::string targetFrame;
+  float tfTimeout;
+  //offline runs have no tf, the recorded viewpoint of the scene gives the pose of the camera then
+  bool useViewpoint;
+
+  //optional shared memory channel for consumers on the same host
+  std::string shmName;
+  int shmSlots, shmMaxDetections, shmMaxPoints;
+  std::shared_ptr<RingWriter> writer;
+  percepteros::SharedDetectionRing *ring;
+  std::vector<percepteros::SharedPoint> shmPoints;
+  pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr;
 
 
 public:
 
+  ROSPublisher() : targetFrame("/odom_combined"), tfTimeout(0.1), useViewpoint(false),
+    shmName(""), shmSlots(8), shmMaxDetections(64), shmMaxPoints(0), ring(NULL)
+  {
+    cloud_ptr = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
+  }
+
   TyErrorId initialize(AnnotatorContext &ctx)
   {
+    if(ctx.isParameterDefined("target_frame")) ctx.extractValue("target_frame", targetFrame);
+    if(ctx.isParameterDefined("tf_timeout")) ctx.extractValue("tf_timeout", tfTimeout);
+    if(ctx.isParameterDefined("use_viewpoint")) ctx.extractValue("use_viewpoint", useViewpoint);
+    if(ctx.isParameterDefined("shm_name")) ctx.extractValue("shm_name", shmName);
+    if(ctx.isParameterDefined("shm_slots")) ctx.extractValue("shm_slots", shmSlots);
+    if(ctx.isParameterDefined("shm_max_detections")) ctx.extractValue("shm_max_detections", shmMaxDetections);
+    if(ctx.isParameterDefined("shm_max_points")) ctx.extractValue("shm_max_points", shmMaxPoints);
+
+    if(!shmName.empty())
+    {
+      writer = openWriter(shmName, shmSlots, shmMaxDetections, shmMaxPoints);
+      if(writer)
+      {
+        ring = &writer->ring;
+        outInfo("Writing detections to shared memory " << shmName);
+      }
+    }
+
     int argc=0;
     char* argv[0];
     ros::init(argc, argv, "detected_objects");
     chatter_pub = n.advertise<suturo_perception_msgs::ObjectDetection>("percepteros/object_detection", 1000);
+    //latched, so late subscribers get the current scene right away
+    batch_pub = n.advertise<percepteros::ObjectDetectionArray>("percepteros/object_detections", 1, true);
 
     outInfo("initialize");
     return UIMA_ERR_NONE;
@@ -43,6 +135,8 @@ public:
   TyErrorId destroy()
   {
     outInfo("destroy");
+    ring = NULL;
+    writer.reset();
     return UIMA_ERR_NONE;
   }
 
@@ -51,37 +145,71 @@ private:
   {
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
-
-    std::vector<rs::Cluster> clusters;
-    scene.identifiables.filter(clusters);
+    percepteros::SceneIndex &index = percepteros::SceneIndex::of(scene);
 
     camToWorld.setIdentity();
     if(scene.viewPoint.has())
     {
       rs::conversion::from(scene.viewPoint.get(), camToWorld);
     }
-    else
+
+    //the camera info carries frame and stamp of the current frame
+    sensor_msgs::CameraInfo camInfo;
+    cas.get(VIEW_CAMERA_INFO, camInfo);
+    std::string cameraFrame = camInfo.header.frame_id;
+    ros::Time stamp = camInfo.header.stamp;
+    if(cameraFrame.empty())
+    {
+      cameraFrame = camToWorld.child_frame_id_;
+      stamp = camToWorld.stamp_;
+    }
+
+    Eigen::Affine3d camToTarget;
+    std::string frameId = targetFrame;
+    if(useViewpoint && scene.viewPoint.has())
+    {
+      tf::transformTFToEigen(camToWorld, camToTarget);
+      frameId = camToWorld.frame_id_;
+    }
+    else if(!lookupCameraToTarget(cameraFrame, stamp, camToTarget))
+    {
+      return UIMA_ERR_NONE;
+    }
+
+    //one message per frame, also if nothing was found
+    percepteros::ObjectDetectionArray batchMsg;
+    batchMsg.header.frame_id = frameId;
+    batchMsg.header.stamp = stamp;
+    batchMsg.frame = frameCount++;
+    batchMsg.pipeline = percepteros::LastDetections::getPipeline();
+    //annotators were skipped or cut short to meet the pipeline deadline
+    batchMsg.degraded = percepteros::FrameDeadline::degraded();
+
+    std::unique_lock<std::mutex> ringLock;
+    if(ring)
     {
-      outInfo("No camera to world transformation!!!");
+      ringLock = std::unique_lock<std::mutex>(writer->mutex);
+      ring->beginFrame(stamp.toNSec(), frameId, batchMsg.degraded ? percepteros::SharedDetectionRing::FLAG_DEGRADED : 0);
+      if(shmMaxPoints > 0)
+      {
+        cas.get(VIEW_CLOUD, *cloud_ptr);
+      }
     }
-    worldToCam = tf::StampedTransform(camToWorld.inverse(), camToWorld.stamp_, camToWorld.child_frame_id_, camToWorld.frame_id_);
-    Eigen::Affine3d eigenTransform;
-    tf::transformTFToEigen(camToWorld, eigenTransform);
-
-    tf::StampedTransform kinectToOdom;
-    Eigen::Affine3d kinectToOdomEigen;
-
-     for(rs::Cluster c: clusters){
-        std::vector<percepteros::RecognitionObject> objects;
-        std::vector<rs::PoseAnnotation> poses;
-        
-        c.annotations.filter(objects);
-        c.annotations.filter(poses);
-        
+
+     for(size_t c = 0; c < index.clusters().size(); ++c){
+        const std::vector<percepteros::RecognitionObject> &objects = index.annotations<percepteros::RecognitionObject>(c);
+        const std::vector<rs::PoseAnnotation> &poses = index.annotations<rs::PoseAnnotation>(c);
+
         if(objects.size()!=0 && objects.size() == poses.size()){
+            uint32_t pointOffset = 0, pointCount = 0;
+            if(ring && shmMaxPoints > 0)
+            {
+              pointOffset = writeClusterPoints(index.cluster(c), camToTarget, pointCount);
+            }
             for(int i = 0; i < objects.size(); i++){
             	percepteros::RecognitionObject recObj  = objects[i];
-                rs::StampedPose pose = poses[i].camera.get();
+                rs::PoseAnnotation poseA = poses[i];
+                rs::StampedPose pose = poseA.camera.get();
             	std::vector<double> translation = pose.translation.get();
             	std::vector<double> rotation = pose.rotation.get();
 
@@ -90,27 +218,27 @@ private:
             			rotation[3], rotation[4], rotation[5],
                         rotation[6], rotation[7], rotation[8];
                 Eigen::Vector3d trans(translation[0],translation[1],translation[2]);
-                Eigen::Quaterniond q(mat);
-				q.normalize();
-            	
+
+                Eigen::Affine3d objectToTarget = camToTarget * (Eigen::Translation3d(trans) * mat);
+                Eigen::Quaterniond q(objectToTarget.rotation());
+                q.normalize();
+                trans = objectToTarget.translation();
+
                 outInfo(recObj.name.get());
 
                 suturo_perception_msgs::ObjectDetection objectDetectionMsg;
-                
-                objectDetectionMsg.pose.header.frame_id = "/head_mount_kinect_rgb_optical_frame";
+
+                objectDetectionMsg.pose.header.frame_id = frameId;
+                objectDetectionMsg.pose.header.stamp = stamp;
 
                 objectDetectionMsg.pose.pose.position.x=trans[0];
                 objectDetectionMsg.pose.pose.position.y=trans[1];
                 objectDetectionMsg.pose.pose.position.z=trans[2];
-                
+
                 objectDetectionMsg.pose.pose.orientation.x=q.x();
                 objectDetectionMsg.pose.pose.orientation.y=q.y();
                 objectDetectionMsg.pose.pose.orientation.z=q.z();
                 objectDetectionMsg.pose.pose.orientation.w=q.w();
-				
-				geometry_msgs::PoseStamped nPose;
-				listener.transformPose("/odom_combined", objectDetectionMsg.pose, nPose);
-				objectDetectionMsg.pose = nPose;
 
                 objectDetectionMsg.name=recObj.name.get();
                 objectDetectionMsg.type=recObj.type.get();
@@ -119,12 +247,108 @@ private:
                 objectDetectionMsg.depth=recObj.depth.get();
 
                 chatter_pub.publish(objectDetectionMsg);
+                batchMsg.detections.push_back(objectDetectionMsg);
+
+                if(ring)
+                {
+                  percepteros::SharedDetection detection;
+                  strncpy(detection.name, objectDetectionMsg.name.c_str(), sizeof(detection.name) - 1);
+                  detection.name[sizeof(detection.name) - 1] = '\0';
+                  detection.type = objectDetectionMsg.type;
+                  detection.width = objectDetectionMsg.width;
+                  detection.height = objectDetectionMsg.height;
+                  detection.depth = objectDetectionMsg.depth;
+                  detection.position[0] = trans[0];
+                  detection.position[1] = trans[1];
+                  detection.position[2] = trans[2];
+                  detection.orientation[0] = q.x();
+                  detection.orientation[1] = q.y();
+                  detection.orientation[2] = q.z();
+                  detection.orientation[3] = q.w();
+                  detection.pointOffset = pointOffset;
+                  detection.pointCount = pointCount;
+                  if(!ring->addDetection(detection))
+                  {
+                    outError("Shared memory slot is full, increase shm_max_detections.");
+                  }
+                }
             }
         }
     }
+    batch_pub.publish(batchMsg);
+    //repeated by SceneChangeGate as long as the scene does not change
+    percepteros::LastDetections::store(batchMsg);
+    if(ring)
+    {
+      ring->commitFrame();
+    }
     return UIMA_ERR_NONE;
   }
 
+  /**
+   * @brief writeClusterPoints Copies the points of a cluster, transformed into the target frame, into the shared memory slot
+   * @param count number of points written, less than the cluster size if the slot is full
+   * @return offset of the first point in the slot
+   */
+  uint32_t writeClusterPoints(rs::Cluster &cluster, const Eigen::Affine3d &camToTarget, uint32_t &count)
+  {
+    count = 0;
+    if(!cluster.points.has())
+    {
+      return 0;
+    }
+    pcl::PointIndices cluster_indices;
+    rs::ReferenceClusterPoints clusterpoints(cluster.points());
+    rs::conversion::from(clusterpoints.indices(), cluster_indices);
+
+    const Eigen::Affine3f transform = camToTarget.cast<float>();
+    shmPoints.clear();
+    for(size_t i = 0; i < cluster_indices.indices.size(); ++i)
+    {
+      if(cluster_indices.indices[i] >= (int)cloud_ptr->points.size())
+      {
+        continue;
+      }
+      const pcl::PointXYZRGBA &p = cloud_ptr->points[cluster_indices.indices[i]];
+      const Eigen::Vector3f t = transform * p.getVector3fMap();
+      percepteros::SharedPoint point;
+      point.x = t.x();
+      point.y = t.y();
+      point.z = t.z();
+      point.rgba = p.rgba;
+      shmPoints.push_back(point);
+    }
+    count = shmPoints.size();
+    return ring->addPoints(shmPoints.data(), count);
+  }
+
+  /**
+   * @brief lookupCameraToTarget Resolves the camera pose in the target frame once per frame
+   * @param cameraFrame frame of the detected poses
+   * @param stamp time of the frame, waits up to tf_timeout seconds for it
+   * @param camToTarget the resulting transformation
+   * @return false if the transformation is not available
+   */
+  bool lookupCameraToTarget(const std::string &cameraFrame, const ros::Time &stamp, Eigen::Affine3d &camToTarget)
+  {
+    tf::StampedTransform transform;
+    try
+    {
+      if(tfTimeout > 0)
+      {
+        listener.waitForTransform(targetFrame, cameraFrame, stamp, ros::Duration(tfTimeout));
+      }
+      listener.lookupTransform(targetFrame, cameraFrame, stamp, transform);
+    }
+    catch(tf::TransformException &ex)
+    {
+      outError("No transformation from " << cameraFrame << " to " << targetFrame << ", skipping frame: " << ex.what());
+      return false;
+    }
+    tf::transformTFToEigen(transform, camToTarget);
+    return true;
+  }
+
 };
 
 MAKE_AE(ROSPublisher)
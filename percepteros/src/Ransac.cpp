@@ -0,0 +1,674 @@
+#include <percepteros/Ransac.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <Eigen/Eigenvalues>
+
+namespace percepteros
+{
+
+//cost of drawing and fitting a hypothesis, in checked points
+static const double MODEL_COST = 100.0;
+//hypotheses a thread scores per round
+static const int ROUND_SIZE = 32;
+//fewer valid points per thread are not worth a thread
+static const int POINTS_PER_THREAD = 1000;
+
+/**
+ * @brief angleBetweenLines Angle between two directions, ignoring their sign
+ */
+static float angleBetweenLines(const Eigen::Vector3f &a, const Eigen::Vector3f &b)
+{
+  const float norms = a.norm() * b.norm();
+  if(norms == 0)
+  {
+    return 0;
+  }
+  return std::acos(std::min(1.0f, std::abs(a.dot(b)) / norms));
+}
+
+/**
+ * @brief fitCircle Least squares circle x² + y² + d·x + e·y + f = 0 of 2D points
+ */
+static bool fitCircle(const std::vector<Eigen::Vector2d> &points, Eigen::Vector2d &center, double &radius)
+{
+  Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+  Eigen::Vector3d b = Eigen::Vector3d::Zero();
+  for(const Eigen::Vector2d &p : points)
+  {
+    const Eigen::Vector3d row(p.x(), p.y(), 1.0);
+    A += row * row.transpose();
+    b -= row * p.squaredNorm();
+  }
+  Eigen::LDLT<Eigen::Matrix3d> solver(A);
+  if(solver.info() != Eigen::Success)
+  {
+    return false;
+  }
+  const Eigen::Vector3d def = solver.solve(b);
+  center = -0.5 * def.head<2>();
+  const double squared = center.squaredNorm() - def.z();
+  if(!std::isfinite(squared) || squared <= 0)
+  {
+    return false;
+  }
+  radius = std::sqrt(squared);
+  return true;
+}
+
+Ransac::Ransac() : gridWidth(0), iterations(0), rejected(0)
+{
+}
+
+Ransac::Ransac(const Parameters &parameters) : parameters(parameters), gridWidth(0), iterations(0), rejected(0)
+{
+}
+
+void Ransac::setGrid(const std::vector<int> &pixels, int width)
+{
+  this->pixels = pixels;
+  grid.resize(pixels.size());
+  for(size_t i = 0; i < pixels.size(); ++i)
+  {
+    grid[i] = std::make_pair(pixels[i], (int)i);
+  }
+  std::sort(grid.begin(), grid.end());
+  gridWidth = width;
+}
+
+void Ransac::setGrid(int width)
+{
+  pixels.resize(x.size());
+  grid.resize(x.size());
+  for(size_t i = 0; i < x.size(); ++i)
+  {
+    pixels[i] = (int)i;
+    grid[i] = std::make_pair((int)i, (int)i);
+  }
+  gridWidth = width;
+}
+
+void Ransac::clearGrid()
+{
+  pixels.clear();
+  grid.clear();
+  gridWidth = 0;
+}
+
+int Ransac::sampleSize() const
+{
+  return parameters.model == CYLINDER ? 2 : 3;
+}
+
+int Ransac::coefficientCount() const
+{
+  return parameters.model == CYLINDER || parameters.model == CIRCLE3D ? 7 : 4;
+}
+
+bool Ransac::usesNormals() const
+{
+  return parameters.model == CYLINDER || (parameters.normalWeight > 0 && parameters.model != CIRCLE3D);
+}
+
+bool Ransac::segment(std::vector<int> &inliers, std::vector<float> &coefficients)
+{
+  inliers.clear();
+  coefficients.clear();
+  iterations = rejected = 0;
+  if(!collectValid())
+  {
+    return false;
+  }
+  const int size = (int)valid.size();
+
+  //the order is fixed for a call, so every hypothesis checks the same points first
+  std::minstd_rand random(size);
+  order = valid;
+  std::shuffle(order.begin(), order.end(), random);
+
+  const int threads = std::max(1, std::min(parameters.threads, size / POINTS_PER_THREAD));
+  const double logFailure = std::log(1.0 - std::min(0.9999, (double)parameters.probability));
+  double required = parameters.maxIterations;
+  //probability of a point to be an inlier of a bad model, estimated from the hypotheses which were beaten
+  double delta = 0.05, badInliers = 0, badPoints = 0;
+
+  //one generator per thread for the whole call, seeded through seed_seq so neighbouring threads draw unrelated samples
+  std::vector<std::minstd_rand> randoms;
+  for(int t = 0; t < threads; ++t)
+  {
+    std::seed_seq seed{size, t};
+    randoms.push_back(std::minstd_rand(seed));
+  }
+
+  //the calling thread scores as thread 0, the others wait for the next round
+  Round r;
+  std::vector<Scores> scores(threads);
+  std::mutex mutex;
+  std::condition_variable started, finished;
+  unsigned round = 0;
+  int running = 0;
+  bool done = false;
+  std::vector<std::thread> workers;
+  for(int t = 1; t < threads; ++t)
+  {
+    workers.push_back(std::thread([&, t]()
+    {
+      for(unsigned next = 1;; ++next)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          started.wait(lock, [&]() { return done || round == next; });
+          if(done)
+          {
+            return;
+          }
+        }
+        score(r, randoms[t], scores[t]);
+        std::lock_guard<std::mutex> lock(mutex);
+        if(--running == 0)
+        {
+          finished.notify_one();
+        }
+      }
+    }));
+  }
+
+  Hypothesis best;
+  best.inliers = 0;
+  while(iterations < std::min(required, (double)parameters.maxIterations))
+  {
+    r.hypotheses = std::max(1, std::min(ROUND_SIZE, (int)std::ceil((std::min(required, (double)parameters.maxIterations) - iterations) / threads)));
+    r.best = best.inliers;
+    r.threshold = std::numeric_limits<double>::infinity();
+    r.inlierFactor = r.outlierFactor = 1;
+    const double epsilon = (double)best.inliers / size;
+    if(best.inliers > 0 && delta < epsilon && epsilon < 1)
+    {
+      //Wald's threshold A, the fixed point of A = K + log(A)
+      const double C = (1 - delta) * std::log((1 - delta) / (1 - epsilon)) + delta * std::log(delta / epsilon);
+      const double K = MODEL_COST * C + 1;
+      double A = K;
+      for(int i = 0; i < 10; ++i)
+      {
+        A = K + std::log(A);
+      }
+      r.threshold = A;
+      r.inlierFactor = delta / epsilon;
+      r.outlierFactor = (1 - delta) / (1 - epsilon);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++round;
+      running = threads - 1;
+    }
+    started.notify_all();
+    score(r, randoms[0], scores[0]);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&]() { return running == 0; });
+    }
+
+    //merged in thread order, so the result does not depend on which thread finished first
+    for(const Scores &s : scores)
+    {
+      iterations += s.evaluated;
+      rejected += s.rejected;
+      badInliers += s.badInliers;
+      badPoints += s.badPoints;
+      if(s.best.inliers > best.inliers)
+      {
+        best = s.best;
+      }
+    }
+    if(badPoints > 0)
+    {
+      delta = std::max(1e-4, std::min(0.5, badInliers / badPoints));
+    }
+
+    if(best.inliers > 0)
+    {
+      //a good sample can still be rejected by the SPRT, with a probability of at most 1 / A
+      const double inlierRatio = (double)best.inliers / size;
+      const double goodSample = std::pow(inlierRatio, sampleSize()) *
+                                (std::isfinite(r.threshold) ? 1.0 - 1.0 / r.threshold : 1.0);
+      required = goodSample >= 1.0 ? 0.0 : goodSample <= 0.0 ? required : logFailure / std::log(1.0 - goodSample);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  started.notify_all();
+  for(std::thread &worker : workers)
+  {
+    worker.join();
+  }
+
+  if(best.inliers == 0)
+  {
+    return false;
+  }
+  finish(best, inliers, coefficients);
+  return true;
+}
+
+bool Ransac::refine(std::vector<int> &inliers, std::vector<float> &coefficients, size_t minInliers)
+{
+  inliers.clear();
+  iterations = rejected = 0;
+  if((int)coefficients.size() != coefficientCount() || !collectValid())
+  {
+    coefficients.clear();
+    return false;
+  }
+  Hypothesis model;
+  std::copy(coefficients.begin(), coefficients.end(), model.c);
+  finish(model, inliers, coefficients);
+  return !inliers.empty() && inliers.size() >= minInliers;
+}
+
+bool Ransac::collectValid()
+{
+  const bool normals = usesNormals();
+  valid.clear();
+  if(normals && nx.size() != x.size())
+  {
+    return false;
+  }
+  for(size_t i = 0; i < x.size(); ++i)
+  {
+    if(std::isfinite(x[i]) && std::isfinite(y[i]) && std::isfinite(z[i]) &&
+       (!normals || (std::isfinite(nx[i]) && std::isfinite(ny[i]) && std::isfinite(nz[i]))))
+    {
+      valid.push_back((int)i);
+    }
+  }
+  return (int)valid.size() >= sampleSize();
+}
+
+void Ransac::finish(Hypothesis &best, std::vector<int> &inliers, std::vector<float> &coefficients) const
+{
+  select(best, inliers);
+  if(parameters.optimize)
+  {
+    Hypothesis refined = best;
+    std::vector<int> refinedInliers;
+    if(refit(inliers, refined) && satisfiesConstraints(refined))
+    {
+      select(refined, refinedInliers);
+      //a refit pulled away by outliers of the threshold is not used
+      if(refinedInliers.size() >= inliers.size() / 2)
+      {
+        best = refined;
+        inliers.swap(refinedInliers);
+      }
+    }
+  }
+  coefficients.assign(best.c, best.c + coefficientCount());
+}
+
+void Ransac::score(const Round &round, std::minstd_rand &random, Scores &scores) const
+{
+  const int size = (int)order.size();
+  scores.best.inliers = 0;
+  scores.evaluated = scores.rejected = 0;
+  scores.badInliers = scores.badPoints = 0;
+  int best = round.best;
+
+  int sample[3];
+  for(int h = 0; h < round.hypotheses; ++h)
+  {
+    ++scores.evaluated;
+    Hypothesis hypothesis;
+    //every other sample is drawn from the grid around its first point
+    if(!drawSample(random, (h & 1) == 0, sample) || !fit(sample, hypothesis) || !satisfiesConstraints(hypothesis))
+    {
+      continue;
+    }
+
+    double likelihood = 1;
+    int inliers = 0, checked = 0;
+    bool abandoned = false;
+    for(; checked < size; ++checked)
+    {
+      if(distance(hypothesis, order[checked]) <= parameters.distance)
+      {
+        ++inliers;
+        likelihood *= round.inlierFactor;
+      }
+      else
+      {
+        likelihood *= round.outlierFactor;
+      }
+      //bad according to the SPRT, or it can no longer beat the best one
+      if(likelihood > round.threshold || inliers + (size - checked - 1) <= best)
+      {
+        abandoned = true;
+        ++checked;
+        break;
+      }
+    }
+
+    if(!abandoned && inliers > best)
+    {
+      hypothesis.inliers = inliers;
+      scores.best = hypothesis;
+      best = inliers;
+    }
+    else
+    {
+      scores.rejected += abandoned;
+      scores.badInliers += inliers;
+      scores.badPoints += checked;
+    }
+  }
+}
+
+bool Ransac::drawSample(std::minstd_rand &random, bool local, int *sample) const
+{
+  const int n = sampleSize();
+  std::uniform_int_distribution<int> uniform(0, (int)valid.size() - 1);
+  sample[0] = valid[uniform(random)];
+
+  const bool onGrid = local && !grid.empty() && parameters.neighbourhood > 0 && gridWidth > 0;
+  const int pixel = onGrid ? pixels[sample[0]] : 0;
+  std::uniform_int_distribution<int> offset(-parameters.neighbourhood, parameters.neighbourhood);
+
+  for(int s = 1; s < n; ++s)
+  {
+    sample[s] = -1;
+    for(int attempt = 0; onGrid && attempt < 8 && sample[s] < 0; ++attempt)
+    {
+      const int du = offset(random), dv = offset(random);
+      const int u = pixel % gridWidth + du;
+      if(u < 0 || u >= gridWidth)
+      {
+        continue;
+      }
+      const int target = pixel + dv * gridWidth + du;
+      std::vector<std::pair<int, int>>::const_iterator it =
+        std::lower_bound(grid.begin(), grid.end(), std::make_pair(target, std::numeric_limits<int>::min()));
+      if(it == grid.end() || it->first != target)
+      {
+        continue;
+      }
+      const int candidate = it->second;
+      if(std::isfinite(z[candidate]) && std::find(sample, sample + s, candidate) == sample + s &&
+         (nx.empty() || std::isfinite(nx[candidate])))
+      {
+        sample[s] = candidate;
+      }
+    }
+    for(int attempt = 0; attempt < 16 && sample[s] < 0; ++attempt)
+    {
+      const int candidate = valid[uniform(random)];
+      if(std::find(sample, sample + s, candidate) == sample + s)
+      {
+        sample[s] = candidate;
+      }
+    }
+    if(sample[s] < 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Ransac::fit(const int *sample, Hypothesis &hypothesis) const
+{
+  float *c = hypothesis.c;
+  hypothesis.inliers = 0;
+  const Eigen::Vector3f p0 = point(sample[0]), p1 = point(sample[1]);
+
+  switch(parameters.model)
+  {
+  case PLANE:
+  case PERPENDICULAR_PLANE:
+  case PARALLEL_PLANE:
+  {
+    Eigen::Vector3f n = (p1 - p0).cross(point(sample[2]) - p0);
+    const float norm = n.norm();
+    if(norm < 1e-12f)
+    {
+      return false;
+    }
+    n /= norm;
+    c[0] = n.x();
+    c[1] = n.y();
+    c[2] = n.z();
+    c[3] = -n.dot(p0);
+    return true;
+  }
+  case CYLINDER:
+  {
+    //closest points of the two lines along the normals give the axis
+    const Eigen::Vector3f n0 = normal(sample[0]), n1 = normal(sample[1]);
+    const Eigen::Vector3f w = n0 + p0 - p1;
+    const float a = n0.dot(n0), b = n0.dot(n1), cc = n1.dot(n1), d = n0.dot(w), e = n1.dot(w);
+    const float denominator = a * cc - b * b;
+    float sc, tc;
+    if(denominator < 1e-8f)
+    {
+      sc = 0;
+      tc = b > cc ? d / b : e / cc;
+    }
+    else
+    {
+      sc = (b * e - cc * d) / denominator;
+      tc = (a * e - b * d) / denominator;
+    }
+    const Eigen::Vector3f linePoint = p0 + n0 + sc * n0;
+    Eigen::Vector3f lineDirection = p1 + tc * n1 - linePoint;
+    const float length = lineDirection.norm();
+    if(!std::isfinite(length) || length < 1e-12f)
+    {
+      return false;
+    }
+    lineDirection /= length;
+    const float radius = (p0 - linePoint).cross(lineDirection).norm();
+    c[0] = linePoint.x();
+    c[1] = linePoint.y();
+    c[2] = linePoint.z();
+    c[3] = lineDirection.x();
+    c[4] = lineDirection.y();
+    c[5] = lineDirection.z();
+    c[6] = radius;
+    return true;
+  }
+  case CIRCLE3D:
+  {
+    //circumcenter of the triangle
+    const Eigen::Vector3f a = p1 - p0, b = point(sample[2]) - p0;
+    const Eigen::Vector3f n = a.cross(b);
+    const float squared = n.squaredNorm();
+    if(squared < 1e-16f)
+    {
+      return false;
+    }
+    const Eigen::Vector3f center = p0 + (a.squaredNorm() * b.cross(n) + b.squaredNorm() * n.cross(a)) / (2 * squared);
+    const Eigen::Vector3f axis = n.normalized();
+    c[0] = center.x();
+    c[1] = center.y();
+    c[2] = center.z();
+    c[3] = (p0 - center).norm();
+    c[4] = axis.x();
+    c[5] = axis.y();
+    c[6] = axis.z();
+    return true;
+  }
+  }
+  return false;
+}
+
+bool Ransac::refit(const std::vector<int> &inliers, Hypothesis &hypothesis) const
+{
+  if((int)inliers.size() <= sampleSize())
+  {
+    return false;
+  }
+  float *c = hypothesis.c;
+
+  Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+  for(int i : inliers)
+  {
+    mean += point(i).cast<double>();
+  }
+  mean /= inliers.size();
+
+  //plane through the mean with the direction of least variance as normal, for circles the plane of the circle
+  Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+  if(parameters.model == CYLINDER)
+  {
+    //the normals of a cylinder are perpendicular to its axis
+    for(int i : inliers)
+    {
+      const Eigen::Vector3d n = normal(i).cast<double>();
+      scatter += n * n.transpose();
+    }
+  }
+  else
+  {
+    for(int i : inliers)
+    {
+      const Eigen::Vector3d d = point(i).cast<double>() - mean;
+      scatter += d * d.transpose();
+    }
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+  solver.computeDirect(scatter);
+  Eigen::Vector3d axis = solver.eigenvectors().col(0);
+
+  if(parameters.model == PLANE || parameters.model == PERPENDICULAR_PLANE || parameters.model == PARALLEL_PLANE)
+  {
+    if(axis.dot(Eigen::Vector3d(c[0], c[1], c[2])) < 0)
+    {
+      axis = -axis;
+    }
+    c[0] = axis.x();
+    c[1] = axis.y();
+    c[2] = axis.z();
+    c[3] = -axis.dot(mean);
+    return true;
+  }
+
+  //circle in the plane perpendicular to the axis
+  const Eigen::Vector3d previous = parameters.model == CYLINDER ? Eigen::Vector3d(c[3], c[4], c[5]) : Eigen::Vector3d(c[4], c[5], c[6]);
+  if(axis.dot(previous) < 0)
+  {
+    axis = -axis;
+  }
+  const Eigen::Vector3d u = axis.unitOrthogonal(), v = axis.cross(u);
+  std::vector<Eigen::Vector2d> projected;
+  projected.reserve(inliers.size());
+  for(int i : inliers)
+  {
+    const Eigen::Vector3d d = point(i).cast<double>() - mean;
+    projected.push_back(Eigen::Vector2d(d.dot(u), d.dot(v)));
+  }
+  Eigen::Vector2d center2d;
+  double radius;
+  if(!fitCircle(projected, center2d, radius))
+  {
+    return false;
+  }
+  const Eigen::Vector3d center = mean + center2d.x() * u + center2d.y() * v;
+  c[0] = center.x();
+  c[1] = center.y();
+  c[2] = center.z();
+  if(parameters.model == CYLINDER)
+  {
+    c[3] = axis.x();
+    c[4] = axis.y();
+    c[5] = axis.z();
+    c[6] = radius;
+  }
+  else
+  {
+    c[3] = radius;
+    c[4] = axis.x();
+    c[5] = axis.y();
+    c[6] = axis.z();
+  }
+  return true;
+}
+
+bool Ransac::satisfiesConstraints(const Hypothesis &hypothesis) const
+{
+  const float *c = hypothesis.c;
+  switch(parameters.model)
+  {
+  case PLANE:
+    return true;
+  case PERPENDICULAR_PLANE:
+    //like pcl, an angle of 0 means any orientation
+    return parameters.epsAngle <= 0 ||
+           angleBetweenLines(Eigen::Vector3f(c[0], c[1], c[2]), parameters.axis) <= parameters.epsAngle;
+  case PARALLEL_PLANE:
+    return parameters.epsAngle <= 0 ||
+           std::abs((float)M_PI_2 - angleBetweenLines(Eigen::Vector3f(c[0], c[1], c[2]), parameters.axis)) <= parameters.epsAngle;
+  case CYLINDER:
+    return c[6] >= parameters.minRadius && c[6] <= parameters.maxRadius;
+  case CIRCLE3D:
+    return c[3] >= parameters.minRadius && c[3] <= parameters.maxRadius;
+  }
+  return false;
+}
+
+float Ransac::distance(const Hypothesis &hypothesis, int i) const
+{
+  const float *c = hypothesis.c;
+  const Eigen::Vector3f p = point(i);
+  switch(parameters.model)
+  {
+  case PLANE:
+  case PERPENDICULAR_PLANE:
+  case PARALLEL_PLANE:
+  {
+    const Eigen::Vector3f n(c[0], c[1], c[2]);
+    const float euclidean = std::abs(n.dot(p) + c[3]);
+    if(parameters.normalWeight <= 0)
+    {
+      return euclidean;
+    }
+    return parameters.normalWeight * angleBetweenLines(normal(i), n) + (1 - parameters.normalWeight) * euclidean;
+  }
+  case CYLINDER:
+  {
+    const Eigen::Vector3f linePoint(c[0], c[1], c[2]), lineDirection(c[3], c[4], c[5]);
+    const Eigen::Vector3f v = p - linePoint;
+    const Eigen::Vector3f radial = v - lineDirection.dot(v) * lineDirection;
+    const float euclidean = std::abs(radial.norm() - c[6]);
+    return parameters.normalWeight * angleBetweenLines(normal(i), radial) + (1 - parameters.normalWeight) * euclidean;
+  }
+  case CIRCLE3D:
+  {
+    const Eigen::Vector3f center(c[0], c[1], c[2]), n(c[4], c[5], c[6]);
+    const Eigen::Vector3f v = p - center;
+    const float height = n.dot(v);
+    const float inPlane = (v - height * n).norm();
+    return std::sqrt(height * height + (inPlane - c[3]) * (inPlane - c[3]));
+  }
+  }
+  return std::numeric_limits<float>::infinity();
+}
+
+void Ransac::select(const Hypothesis &hypothesis, std::vector<int> &inliers) const
+{
+  inliers.clear();
+  for(int i : valid)
+  {
+    if(distance(hypothesis, i) <= parameters.distance)
+    {
+      inliers.push_back(i);
+    }
+  }
+}
+
+}
@@ -0,0 +1,124 @@
+#include <percepteros/RecordedScenes.h>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <pcl/io/pcd_io.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace percepteros
+{
+
+bool RecordedScenes::open(const std::string &directory)
+{
+  this->directory = directory;
+  names.clear();
+  DIR *dir = opendir(directory.c_str());
+  if(!dir)
+  {
+    error = "opendir " + directory + ": " + strerror(errno);
+    return false;
+  }
+  const std::string extension = ".pcd";
+  for(dirent *entry = readdir(dir); entry; entry = readdir(dir))
+  {
+    const std::string file = entry->d_name;
+    if(file.size() > extension.size() && file.compare(file.size() - extension.size(), extension.size(), extension) == 0)
+    {
+      names.push_back(file.substr(0, file.size() - extension.size()));
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  return true;
+}
+
+bool RecordedScenes::load(size_t scene, SharedSensorFrame &frame)
+{
+  const std::string base = directory + "/" + names[scene];
+
+  frame.id = 0;
+  frame.timestamp = 0;
+  frame.cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+  frame.normals.reset();
+  if(pcl::io::loadPCDFile(base + ".pcd", *frame.cloud) != 0)
+  {
+    error = "Could not read " + base + ".pcd";
+    return false;
+  }
+
+  const pcl::PointCloud<pcl::PointXYZRGBA> &cloud = *frame.cloud;
+  if(cloud.isOrganized())
+  {
+    frame.color.create(cloud.height, cloud.width, CV_8UC3);
+    for(size_t r = 0; r < cloud.height; ++r)
+    {
+      cv::Vec3b *row = frame.color.ptr<cv::Vec3b>(r);
+      for(size_t c = 0; c < cloud.width; ++c)
+      {
+        const pcl::PointXYZRGBA &p = cloud.points[r * cloud.width + c];
+        row[c] = cv::Vec3b(p.b, p.g, p.r);
+      }
+    }
+  }
+  else
+  {
+    frame.color = cv::Mat();
+  }
+  frame.cameraInfo = sensor_msgs::CameraInfo();
+  frame.cameraInfo.width = cloud.width;
+  frame.cameraInfo.height = cloud.height;
+  frame.cameraInfo.header.frame_id = cloud.header.frame_id;
+
+  struct stat fileStat;
+  const std::string depthFile = base + "_depth.png";
+  frame.depth = stat(depthFile.c_str(), &fileStat) ? cv::Mat() : cv::imread(depthFile, cv::IMREAD_ANYDEPTH);
+
+  frame.hasViewpoint = false;
+  const std::string viewpointFile = base + "_viewpoint.yml";
+  if(stat(viewpointFile.c_str(), &fileStat))
+  {
+    return true;
+  }
+  cv::FileStorage fs(viewpointFile, cv::FileStorage::READ);
+  if(!fs.isOpened())
+  {
+    error = "Could not read " + viewpointFile;
+    return false;
+  }
+  //written as string, cv::FileStorage has no 64 bit integers
+  std::string stamp;
+  fs["stamp"] >> stamp;
+  frame.timestamp = strtoull(stamp.c_str(), NULL, 10);
+  int hasViewpoint = 0;
+  fs["has_viewpoint"] >> hasViewpoint;
+  if(hasViewpoint)
+  {
+    cv::Mat translation, rotation;
+    fs["frame_id"] >> frame.viewpoint.frame_id_;
+    fs["child_frame_id"] >> frame.viewpoint.child_frame_id_;
+    fs["translation"] >> translation;
+    fs["rotation"] >> rotation;
+    if(translation.total() != 3 || rotation.total() != 4)
+    {
+      error = viewpointFile + " has no valid viewpoint";
+      return false;
+    }
+    translation.convertTo(translation, CV_64F);
+    rotation.convertTo(rotation, CV_64F);
+    frame.viewpoint.setOrigin(tf::Vector3(translation.at<double>(0), translation.at<double>(1), translation.at<double>(2)));
+    frame.viewpoint.setRotation(tf::Quaternion(rotation.at<double>(0), rotation.at<double>(1), rotation.at<double>(2),
+                                               rotation.at<double>(3)));
+    frame.viewpoint.stamp_.fromNSec(frame.timestamp);
+    frame.hasViewpoint = true;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,73 @@
+#include <percepteros/ResultCache.h>
+
+#include <algorithm>
+
+namespace percepteros
+{
+
+ResultCache::ResultCache(size_t capacity) :
+  capacity(std::max<size_t>(capacity, 1)), hits(0), misses(0), evictions(0)
+{
+}
+
+bool ResultCache::lookup(const std::string &pipeline, const SceneSignature &scene, ObjectDetectionArray &detections)
+{
+  auto it = index.find(pipeline);
+  if(it == index.end() || scene.empty() ||
+     scene.cameraMoved(it->second->scene, tolerances.maxTranslation, tolerances.maxRotation) ||
+     scene.depthChanged(it->second->scene, tolerances.depthThreshold, tolerances.changeRatio))
+  {
+    ++misses;
+    return false;
+  }
+  entries.splice(entries.begin(), entries, it->second);
+  detections = it->second->detections;
+  ++hits;
+  return true;
+}
+
+void ResultCache::insert(const std::string &pipeline, const SceneSignature &scene, const ObjectDetectionArray &detections)
+{
+  auto it = index.find(pipeline);
+  if(it != index.end())
+  {
+    entries.splice(entries.begin(), entries, it->second);
+    it->second->scene = scene;
+    //the caller reuses its grid for the next frame
+    it->second->scene.grid = scene.grid.clone();
+    it->second->detections = detections;
+    return;
+  }
+
+  if(entries.size() >= capacity)
+  {
+    index.erase(entries.back().pipeline);
+    entries.pop_back();
+    ++evictions;
+  }
+  entries.push_front(Entry());
+  entries.front().pipeline = pipeline;
+  entries.front().scene = scene;
+  entries.front().scene.grid = scene.grid.clone();
+  entries.front().detections = detections;
+  index[pipeline] = entries.begin();
+}
+
+void ResultCache::setCapacity(size_t capacity)
+{
+  this->capacity = std::max<size_t>(capacity, 1);
+  while(entries.size() > this->capacity)
+  {
+    index.erase(entries.back().pipeline);
+    entries.pop_back();
+    ++evictions;
+  }
+}
+
+void ResultCache::clear()
+{
+  entries.clear();
+  index.clear();
+}
+
+}
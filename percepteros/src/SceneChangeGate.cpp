@@ -0,0 +1,144 @@
+#include <uima/api.hpp>
+
+//RS
+#include <rs/scene_cas.h>
+#include <rs/utils/time.h>
+#include <rs/utils/exception.h>
+
+#include <ros/ros.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <suturo_perception_msgs/ObjectDetection.h>
+#include <tf/transform_datatypes.h>
+
+#include <percepteros/ObjectDetectionArray.h>
+#include <percepteros/LastDetections.h>
+#include <percepteros/SceneSignature.h>
+
+#include <algorithm>
+
+using namespace uima;
+
+/**
+ * Runs right after the CollectionReader and stops the pipeline for frames in
+ * which nothing changed. The depth image is reduced to the mean depth of
+ * grid_step x grid_step blocks and compared to the one of the last complete
+ * run, together with the camera pose. The scene of a run is only kept once
+ * ROSPublisher stored its result, a frame which ended early never becomes
+ * the reference. If both are within the thresholds and
+ * the current pipeline already produced a result, that result is published
+ * again and rs::FrameFilterException ends the frame. A pipeline change
+ * invalidates the result, so the next frame runs completely, unless the
+ * result cache had one for the new pipeline and scene. Those are only
+ * repeated with the default grid_step, the one the engines describe scenes
+ * with.
+ */
+class SceneChangeGate : public Annotator
+{
+private:
+  int gridStep;
+  float depthThreshold, changeRatio, maxTranslation, maxRotation;
+
+  percepteros::SceneSignature current;
+
+  size_t processed, skipped;
+
+  ros::NodeHandle n;
+  ros::Publisher chatter_pub;
+  ros::Publisher batch_pub;
+
+public:
+
+  SceneChangeGate() : gridStep(percepteros::SceneSignature::GRID_STEP), depthThreshold(0.02), changeRatio(0.01), maxTranslation(0.01),
+    maxRotation(0.02), processed(0), skipped(0)
+  {
+  }
+
+  TyErrorId initialize(AnnotatorContext &ctx)
+  {
+    outInfo("initialize");
+    if(ctx.isParameterDefined("grid_step")) ctx.extractValue("grid_step", gridStep);
+    if(ctx.isParameterDefined("depth_threshold")) ctx.extractValue("depth_threshold", depthThreshold);
+    if(ctx.isParameterDefined("change_ratio")) ctx.extractValue("change_ratio", changeRatio);
+    if(ctx.isParameterDefined("max_translation")) ctx.extractValue("max_translation", maxTranslation);
+    if(ctx.isParameterDefined("max_rotation")) ctx.extractValue("max_rotation", maxRotation);
+    gridStep = std::max(gridStep, 1);
+
+    //the same topics ROSPublisher uses, repeated results look like fresh ones
+    chatter_pub = n.advertise<suturo_perception_msgs::ObjectDetection>("percepteros/object_detection", 1000);
+    batch_pub = n.advertise<percepteros::ObjectDetectionArray>("percepteros/object_detections", 1, true);
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId destroy()
+  {
+    outInfo("destroy");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId process(CAS &tcas, ResultSpecification const &res_spec)
+  {
+    rs::StopWatch clock;
+    rs::SceneCas cas(tcas);
+    rs::Scene scene = cas.getScene();
+
+    cv::Mat depth;
+    cas.get(VIEW_DEPTH_IMAGE, depth);
+    if(depth.empty())
+    {
+      outInfo("No depth image, not gating.");
+      return UIMA_ERR_NONE;
+    }
+
+    tf::StampedTransform viewpoint;
+    const bool hasViewpoint = scene.viewPoint.has();
+    if(hasViewpoint)
+    {
+      rs::conversion::from(scene.viewPoint.get(), viewpoint);
+    }
+    current.compute(depth, gridStep, hasViewpoint ? &viewpoint : NULL);
+
+    percepteros::ObjectDetectionArray detections;
+    percepteros::SceneSignature reference;
+    const bool cached = percepteros::LastDetections::get(detections, reference) && !detections.degraded;
+    if(cached && !reference.empty() && !current.cameraMoved(reference, maxTranslation, maxRotation) &&
+       !current.depthChanged(reference, depthThreshold, changeRatio))
+    {
+      ++skipped;
+      sensor_msgs::CameraInfo camInfo;
+      cas.get(VIEW_CAMERA_INFO, camInfo);
+      republish(detections, camInfo.header.stamp);
+      outInfo("Scene unchanged, repeated " << detections.detections.size() << " detections ("
+              << skipped << " skipped, " << processed << " processed) in " << clock.getTime() << " ms.");
+      throw rs::FrameFilterException();
+    }
+
+    //becomes the new reference once the result of this frame is stored
+    ++processed;
+    percepteros::LastDetections::beginScene(current);
+    outInfo("Scene changed, running pipeline (" << clock.getTime() << " ms).");
+    return UIMA_ERR_NONE;
+  }
+
+private:
+
+  /**
+   * @brief republish Sends the detections of the last complete run again, stamped with the current frame.
+   * frame keeps the number of the run that produced them.
+   */
+  void republish(percepteros::ObjectDetectionArray &detections, const ros::Time &stamp)
+  {
+    if(!stamp.isZero())
+    {
+      detections.header.stamp = stamp;
+    }
+    for(suturo_perception_msgs::ObjectDetection &detection : detections.detections)
+    {
+      detection.pose.header.stamp = detections.header.stamp;
+      chatter_pub.publish(detection);
+    }
+    batch_pub.publish(detections);
+  }
+};
+
+// This macro exports an entry point that is used to create the annotator.
+MAKE_AE(SceneChangeGate)
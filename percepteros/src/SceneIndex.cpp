@@ -0,0 +1,129 @@
+#include <percepteros/SceneIndex.h>
+
+namespace percepteros
+{
+
+namespace
+{
+
+//every engine of the pool runs its annotators in its own thread
+thread_local SceneIndex sceneIndex;
+
+}
+
+SceneIndex &SceneIndex::of(rs::Scene &scene)
+{
+  SceneIndex &index = sceneIndex;
+  if(!index.valid_ || index.timestamp_ != scene.timestamp())
+  {
+    index.rebuild(scene);
+  }
+  return index;
+}
+
+SceneIndex &SceneIndex::refresh(rs::Scene &scene)
+{
+  SceneIndex &index = sceneIndex;
+  if(!index.valid_ || index.timestamp_ != scene.timestamp())
+  {
+    index.rebuild(scene);
+    return index;
+  }
+
+  //annotators not using the index may have added clusters or annotations
+  if(scene.identifiables.size() != index.identifiableCount_)
+  {
+    index.rebuild(scene);
+    return index;
+  }
+  for(size_t i = 0; i < index.clusters_.size(); ++i)
+  {
+    if(index.clusters_[i].annotations.size() != index.annotationCounts_[i])
+    {
+      index.scan(i);
+    }
+  }
+  return index;
+}
+
+void SceneIndex::reset()
+{
+  sceneIndex.valid_ = false;
+  sceneIndex.clusters_.clear();
+  sceneIndex.annotationCounts_.clear();
+  sceneIndex.types_.clear();
+  sceneIndex.recognized_.clear();
+  sceneIndex.recognizedValid_ = false;
+  sceneIndex.derived_.clear();
+}
+
+const std::vector<size_t> &SceneIndex::recognized(int type)
+{
+  if(!recognizedValid_)
+  {
+    recognized_.clear();
+    const TypeIndex<RecognitionObject> &objects = typeIndex<RecognitionObject>();
+    for(size_t i = 0; i < objects.byCluster.size(); ++i)
+    {
+      for(RecognitionObject object : objects.byCluster[i])
+      {
+        addRecognized(i, object.type.get());
+      }
+    }
+    recognizedValid_ = true;
+  }
+  return recognized_[type];
+}
+
+size_t SceneIndex::appendCluster(rs::Scene &scene, rs::Cluster &cluster)
+{
+  scene.identifiables.append(cluster);
+  ++identifiableCount_;
+  clusters_.push_back(cluster);
+  annotationCounts_.push_back(0);
+  scan(clusters_.size() - 1);
+  return clusters_.size() - 1;
+}
+
+void SceneIndex::rebuild(rs::Scene &scene)
+{
+  reset();
+  timestamp_ = scene.timestamp();
+  identifiableCount_ = scene.identifiables.size();
+  scene.identifiables.filter(clusters_);
+  annotationCounts_.resize(clusters_.size());
+  for(size_t i = 0; i < clusters_.size(); ++i)
+  {
+    annotationCounts_[i] = clusters_[i].annotations.size();
+  }
+  valid_ = true;
+}
+
+void SceneIndex::scan(size_t index)
+{
+  annotationCounts_[index] = clusters_[index].annotations.size();
+  for(auto &type : types_)
+  {
+    type.second->scan(index, clusters_[index]);
+  }
+  recognizedValid_ = false;
+}
+
+void SceneIndex::appended(size_t cluster, RecognitionObject &object)
+{
+  if(recognizedValid_)
+  {
+    addRecognized(cluster, object.type.get());
+  }
+}
+
+void SceneIndex::addRecognized(size_t cluster, int type)
+{
+  std::vector<size_t> &clusters = recognized_[type];
+  if(clusters.empty() || clusters.back() != cluster)
+  {
+    clusters.push_back(cluster);
+  }
+}
+
+}
@@ -0,0 +1,87 @@
+#include <percepteros/SceneSignature.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace percepteros
+{
+
+void SceneSignature::compute(const cv::Mat &depth, int gridStep, const tf::Transform *viewpoint)
+{
+  gridStep = std::max(gridStep, 1);
+  hasViewpoint = viewpoint != NULL;
+  if(hasViewpoint)
+  {
+    this->viewpoint = *viewpoint;
+  }
+
+  const int rows = depth.rows / gridStep, cols = depth.cols / gridStep;
+  const bool millimeters = depth.type() == CV_16UC1;
+  grid.create(rows, cols, CV_32FC1);
+  std::vector<float> sum(cols);
+  std::vector<int> count(cols);
+
+  for(int r = 0; r < rows; ++r)
+  {
+    std::fill(sum.begin(), sum.end(), 0.0f);
+    std::fill(count.begin(), count.end(), 0);
+    for(int y = r * gridStep; y < (r + 1) * gridStep; ++y)
+    {
+      for(int x = 0; x < cols * gridStep; ++x)
+      {
+        const float d = millimeters ? depth.at<uint16_t>(y, x) * 0.001f : depth.at<float>(y, x);
+        if(d > 0 && std::isfinite(d))
+        {
+          sum[x / gridStep] += d;
+          ++count[x / gridStep];
+        }
+      }
+    }
+    float *row = grid.ptr<float>(r);
+    for(int c = 0; c < cols; ++c)
+    {
+      row[c] = count[c] * 2 >= gridStep * gridStep ? sum[c] / count[c] : 0.0f;
+    }
+  }
+}
+
+bool SceneSignature::depthChanged(const SceneSignature &other, float depthThreshold, float changeRatio) const
+{
+  if(grid.size() != other.grid.size() || grid.empty())
+  {
+    return true;
+  }
+  size_t changed = 0;
+  for(int r = 0; r < grid.rows; ++r)
+  {
+    const float *a = other.grid.ptr<float>(r);
+    const float *b = grid.ptr<float>(r);
+    for(int c = 0; c < grid.cols; ++c)
+    {
+      if((a[c] > 0) != (b[c] > 0) || std::abs(a[c] - b[c]) > depthThreshold)
+      {
+        ++changed;
+      }
+    }
+  }
+  return changed > changeRatio * grid.total();
+}
+
+bool SceneSignature::cameraMoved(const SceneSignature &other, float maxTranslation, float maxRotation) const
+{
+  if(hasViewpoint != other.hasViewpoint)
+  {
+    return true;
+  }
+  if(!hasViewpoint)
+  {
+    return false;
+  }
+  const tf::Transform delta = other.viewpoint.inverseTimes(viewpoint);
+  double angle = delta.getRotation().getAngle();
+  angle = std::min(angle, 2 * M_PI - angle);
+  return delta.getOrigin().length() > maxTranslation || angle > maxRotation;
+}
+
+}
@@ -0,0 +1,259 @@
+#include <percepteros/SharedDetectionRing.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+namespace percepteros
+{
+
+static inline size_t align64(size_t size)
+{
+  return (size + 63) & ~(size_t)63;
+}
+
+SharedDetectionRing::SharedDetectionRing() :
+  owner(false), fd(-1), size(0), header(NULL), lastRead(0), current(NULL), currentFrame(0)
+{
+}
+
+SharedDetectionRing::~SharedDetectionRing()
+{
+  close();
+}
+
+size_t SharedDetectionRing::headerSize()
+{
+  return align64(sizeof(Header));
+}
+
+size_t SharedDetectionRing::slotSize(uint32_t maxDetections, uint32_t maxPoints)
+{
+  return align64(align64(sizeof(SlotHeader)) + maxDetections * sizeof(SharedDetection) + maxPoints * sizeof(SharedPoint));
+}
+
+bool SharedDetectionRing::fail(const std::string &what)
+{
+  error = what + ": " + strerror(errno);
+  close();
+  return false;
+}
+
+bool SharedDetectionRing::create(const std::string &name, uint32_t slots, uint32_t maxDetections, uint32_t maxPoints)
+{
+  close();
+  slots = std::max<uint32_t>(2, slots);
+  this->name = name;
+  size = headerSize() + slots * slotSize(maxDetections, maxPoints);
+
+  //a stale segment of a crashed writer may have a different layout
+  shm_unlink(name.c_str());
+  fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if(fd < 0)
+  {
+    return fail("shm_open " + name);
+  }
+  owner = true;
+  if(ftruncate(fd, size) != 0)
+  {
+    return fail("ftruncate " + name);
+  }
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    return fail("mmap " + name);
+  }
+  //the segment is zero filled, the atomics only have to be constructed
+  header = static_cast<Header *>(memory);
+  header->magic = MAGIC;
+  header->version = VERSION;
+  header->slots = slots;
+  header->maxDetections = maxDetections;
+  header->maxPoints = maxPoints;
+  header->slotSize = slotSize(maxDetections, maxPoints);
+  for(uint32_t i = 0; i < slots; ++i)
+  {
+    new(&slot(i)->seq) std::atomic<uint64_t>(0);
+  }
+  new(&header->frames) std::atomic<uint64_t>(0);
+  return true;
+}
+
+bool SharedDetectionRing::open(const std::string &name)
+{
+  close();
+  this->name = name;
+  fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if(fd < 0)
+  {
+    return fail("shm_open " + name);
+  }
+  struct stat fileStat;
+  if(fstat(fd, &fileStat) != 0)
+  {
+    return fail("fstat " + name);
+  }
+  size = fileStat.st_size;
+  if(size < headerSize())
+  {
+    errno = EINVAL;
+    return fail("segment " + name + " too small");
+  }
+  void *memory = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if(memory == MAP_FAILED)
+  {
+    return fail("mmap " + name);
+  }
+  header = static_cast<Header *>(memory);
+  if(header->magic != MAGIC || header->version != VERSION ||
+     size < headerSize() + header->slots * header->slotSize)
+  {
+    errno = EPROTO;
+    return fail("segment " + name + " has an incompatible layout");
+  }
+  //only frames committed after opening are new
+  lastRead = header->frames.load(std::memory_order_acquire);
+  return true;
+}
+
+void SharedDetectionRing::close()
+{
+  if(header)
+  {
+    munmap(header, size);
+    header = NULL;
+  }
+  if(fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+  if(owner)
+  {
+    shm_unlink(name.c_str());
+    owner = false;
+  }
+  current = NULL;
+}
+
+SharedDetectionRing::SlotHeader *SharedDetectionRing::slot(uint64_t frame) const
+{
+  char *base = reinterpret_cast<char *>(header) + headerSize();
+  return reinterpret_cast<SlotHeader *>(base + (frame % header->slots) * header->slotSize);
+}
+
+SharedDetection *SharedDetectionRing::detections(SlotHeader *slot) const
+{
+  return reinterpret_cast<SharedDetection *>(reinterpret_cast<char *>(slot) + align64(sizeof(SlotHeader)));
+}
+
+SharedPoint *SharedDetectionRing::points(SlotHeader *slot) const
+{
+  return reinterpret_cast<SharedPoint *>(detections(slot) + header->maxDetections);
+}
+
+void SharedDetectionRing::beginFrame(uint64_t stamp, const std::string &frameId, uint32_t flags)
+{
+  if(!header || !owner)
+  {
+    return;
+  }
+  currentFrame = header->frames.load(std::memory_order_relaxed);
+  current = slot(currentFrame);
+
+  current->seq.store(2 * currentFrame + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  current->frame = currentFrame;
+  current->stamp = stamp;
+  strncpy(current->frameId, frameId.c_str(), sizeof(current->frameId) - 1);
+  current->frameId[sizeof(current->frameId) - 1] = '\0';
+  current->detections = 0;
+  current->points = 0;
+  current->flags = flags;
+}
+
+uint32_t SharedDetectionRing::addPoints(const SharedPoint *source, uint32_t &count)
+{
+  if(!current)
+  {
+    count = 0;
+    return 0;
+  }
+  const uint32_t offset = current->points;
+  count = std::min(count, header->maxPoints - offset);
+  memcpy(points(current) + offset, source, count * sizeof(SharedPoint));
+  current->points += count;
+  return offset;
+}
+
+bool SharedDetectionRing::addDetection(const SharedDetection &detection)
+{
+  if(!current || current->detections >= header->maxDetections)
+  {
+    return false;
+  }
+  detections(current)[current->detections++] = detection;
+  return true;
+}
+
+void SharedDetectionRing::commitFrame()
+{
+  if(!current)
+  {
+    return;
+  }
+  current->seq.store(2 * currentFrame + 2, std::memory_order_release);
+  header->frames.store(currentFrame + 1, std::memory_order_release);
+  current = NULL;
+}
+
+bool SharedDetectionRing::read(SharedFrame &frame)
+{
+  if(!header)
+  {
+    return false;
+  }
+
+  while(true)
+  {
+    const uint64_t frames = header->frames.load(std::memory_order_acquire);
+    if(frames == 0 || frames == lastRead)
+    {
+      return false;
+    }
+    const uint64_t newest = frames - 1;
+    SlotHeader *source = slot(newest);
+
+    const uint64_t seq = source->seq.load(std::memory_order_acquire);
+    if(seq != 2 * newest + 2)
+    {
+      //the writer already reuses the slot, start over with the next frame
+      continue;
+    }
+
+    const uint32_t numDetections = std::min(source->detections, header->maxDetections);
+    const uint32_t numPoints = std::min(source->points, header->maxPoints);
+    frame.frame = source->frame;
+    frame.stamp = source->stamp;
+    frame.frameId.assign(source->frameId, strnlen(source->frameId, sizeof(source->frameId)));
+    frame.flags = source->flags;
+    frame.detections.assign(detections(source), detections(source) + numDetections);
+    frame.points.assign(points(source), points(source) + numPoints);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(source->seq.load(std::memory_order_relaxed) == seq)
+    {
+      lastRead = frames;
+      return true;
+    }
+  }
+}
+
+}
@@ -0,0 +1,103 @@
+#include <uima/api.hpp>
+
+//RS
+#include <rs/scene_cas.h>
+#include <rs/utils/time.h>
+#include <rs/utils/exception.h>
+
+#include <percepteros/FrameHub.h>
+
+using namespace uima;
+
+/**
+ * First annotator of every engine in the pool, takes the place of the
+ * CollectionReader. Waits for a frame the engine has not processed yet and
+ * writes its views into the CAS. The clouds are set from the shared frame,
+ * annotators get their own copies through cas.get as usual.
+ */
+class SharedFrameReader : public Annotator
+{
+private:
+  float timeout;
+  uint64_t lastId;
+
+public:
+
+  SharedFrameReader() : timeout(1000), lastId(0)
+  {
+  }
+
+  TyErrorId initialize(AnnotatorContext &ctx)
+  {
+    outInfo("initialize");
+    if(ctx.isParameterDefined("timeout")) ctx.extractValue("timeout", timeout);
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId destroy()
+  {
+    outInfo("destroy");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId process(CAS &tcas, ResultSpecification const &res_spec)
+  {
+    rs::StopWatch clock;
+    percepteros::FrameHub::FramePtr frame = percepteros::FrameHub::waitNewer(lastId, timeout);
+    if(!frame)
+    {
+      outInfo("No new frame within " << timeout << " ms.");
+      throw rs::FrameFilterException();
+    }
+    if(frame->id > lastId + 1 && lastId != 0)
+    {
+      outInfo("Skipped " << frame->id - lastId - 1 << " frames.");
+    }
+    lastId = frame->id;
+
+    rs::SceneCas cas(tcas);
+    cas.set(VIEW_CLOUD, *frame->cloud);
+    if(frame->normals)
+    {
+      cas.set(VIEW_NORMALS, *frame->normals);
+    }
+    if(!frame->color.empty())
+    {
+      cas.set(VIEW_COLOR_IMAGE, frame->color);
+    }
+    if(!frame->depth.empty())
+    {
+      cas.set(VIEW_DEPTH_IMAGE, frame->depth);
+    }
+    cas.set(VIEW_CAMERA_INFO, frame->cameraInfo);
+    if(!frame->mask.empty())
+    {
+      cas.set(VIEW_MASK, frame->mask);
+    }
+    if(!frame->colorHD.empty())
+    {
+      cas.set(VIEW_COLOR_IMAGE_HD, frame->colorHD);
+    }
+    if(!frame->depthHD.empty())
+    {
+      cas.set(VIEW_DEPTH_IMAGE_HD, frame->depthHD);
+    }
+    if(frame->cameraInfoHD.width != 0)
+    {
+      cas.set(VIEW_CAMERA_INFO_HD, frame->cameraInfoHD);
+    }
+
+    rs::Scene scene = cas.getScene();
+    scene.timestamp.set(frame->timestamp);
+    if(frame->hasViewpoint)
+    {
+      scene.viewPoint.set(rs::conversion::to(tcas, frame->viewpoint));
+    }
+
+    outInfo("Read shared frame " << frame->id << " in " << clock.getTime() << " ms.");
+    return UIMA_ERR_NONE;
+  }
+};
+
+// This macro exports an entry point that is used to create the annotator.
+MAKE_AE(SharedFrameReader)
@@ -0,0 +1,75 @@
+#include <uima/api.hpp>
+
+//RS
+#include <rs/scene_cas.h>
+#include <rs/utils/time.h>
+
+#include <percepteros/FrameHub.h>
+
+using namespace uima;
+
+/**
+ * Last annotator of the feeder engine. Hands the views produced by the
+ * shared annotators (CollectionReader, preprocessing) to the engine pool,
+ * every engine of the pool then starts from the same frame. Only the views
+ * of SharedSensorFrame are handed on: cloud, normals, color, depth and mask
+ * images, the HD images and both camera infos.
+ */
+class SharedFrameWriter : public Annotator
+{
+public:
+
+  TyErrorId initialize(AnnotatorContext &ctx)
+  {
+    outInfo("initialize");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId destroy()
+  {
+    outInfo("destroy");
+    return UIMA_ERR_NONE;
+  }
+
+  TyErrorId process(CAS &tcas, ResultSpecification const &res_spec)
+  {
+    rs::StopWatch clock;
+    rs::SceneCas cas(tcas);
+    rs::Scene scene = cas.getScene();
+
+    //a new frame every time, the engines may still read the last one
+    std::shared_ptr<percepteros::SharedSensorFrame> frame(new percepteros::SharedSensorFrame);
+    frame->cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+    if(!cas.get(VIEW_CLOUD, *frame->cloud))
+    {
+      outInfo("No cloud in the CAS, nothing to share.");
+      return UIMA_ERR_NONE;
+    }
+    frame->normals.reset(new pcl::PointCloud<pcl::Normal>);
+    if(!cas.get(VIEW_NORMALS, *frame->normals))
+    {
+      frame->normals.reset();
+    }
+    cas.get(VIEW_COLOR_IMAGE, frame->color);
+    cas.get(VIEW_DEPTH_IMAGE, frame->depth);
+    cas.get(VIEW_CAMERA_INFO, frame->cameraInfo);
+    cas.get(VIEW_MASK, frame->mask);
+    cas.get(VIEW_COLOR_IMAGE_HD, frame->colorHD);
+    cas.get(VIEW_DEPTH_IMAGE_HD, frame->depthHD);
+    cas.get(VIEW_CAMERA_INFO_HD, frame->cameraInfoHD);
+
+    frame->timestamp = scene.timestamp();
+    frame->hasViewpoint = scene.viewPoint.has();
+    if(frame->hasViewpoint)
+    {
+      rs::conversion::from(scene.viewPoint.get(), frame->viewpoint);
+    }
+
+    percepteros::FrameHub::publish(frame);
+    outInfo("Shared frame " << frame->id << " in " << clock.getTime() << " ms.");
+    return UIMA_ERR_NONE;
+  }
+};
+
+// This macro exports an entry point that is used to create the annotator.
+MAKE_AE(SharedFrameWriter)
@@ -9,6 +9,10 @@
 #include <rs/utils/time.h>
 
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/ClusterPyramid.h>
 
 #include <geometry_msgs/PoseStamped.h>
 #include <pcl/point_cloud.h>
@@ -16,7 +20,6 @@
 #include <pcl/point_types_conversion.h>
 #include <pcl/common/geometry.h>
 #include <iostream>
-#include <pcl/filters/voxel_grid.h>
 #include <pcl/common/pca.h>
 
 #include <cmath>
@@ -46,6 +49,11 @@ private:
 	PC::Ptr spatula_projected = PC::Ptr(new PC);
 	float VAL_UPPER_BOUND, VAL_LOWER_BOUND;
 
+	//visualization
+	percepteros::OverlayBuffer overlay;
+	percepteros::OverlayRenderer renderer;
+	double pointSize = 1;
+
 public:
 	tf::Vector3 x, y, z;
 	PointN highest, lowest;
@@ -76,10 +84,10 @@ public:
 	//get clusters
     rs::SceneCas cas(tcas);
 	rs::Scene scene = cas.getScene();
-	std::vector<rs::Cluster> clusters;
-	scene.identifiables.filter(clusters);
+	percepteros::SceneIndex &index = percepteros::SceneIndex::of(scene);
 
-	//get scene points
+	//get scene points, the last scene may still be shown by the visualizer
+	percepteros::detachCloud<PointR>(cloud_r);
 	cas.get(VIEW_CLOUD, *cloud_r);
 	cas.get(VIEW_NORMALS, *cloud_n);
 	pcl::PointCloud<pcl::PointXYZ>::Ptr temp(new pcl::PointCloud<pcl::PointXYZ>);
@@ -91,18 +99,15 @@ public:
 	bool foundSpatula = false;
 	bool foundRack = false;
 
-	std::vector<percepteros::ToolObject> tools;
-	std::vector<percepteros::RackObject> racks;
-	for (auto it = clusters.begin(); it != clusters.end(); ++it) {
-		auto cluster = *it;
-		tools.clear();
-		racks.clear();
-		cluster.annotations.filter(tools);
-		cluster.annotations.filter(racks);
+	const size_t clusterCount = index.clusters().size();
+	for (size_t c = 0; c < clusterCount; ++c) {
+		const std::vector<percepteros::ToolObject> &tools = index.annotations<percepteros::ToolObject>(c);
+		const std::vector<percepteros::RackObject> &racks = index.annotations<percepteros::RackObject>(c);
 		if (racks.size() > 0) {
 			outInfo("Found rack!");
 			foundRack = true;
-			std::vector<float> yv = racks[0].normal.get();
+			percepteros::RackObject rack = racks[0];
+			std::vector<float> yv = rack.normal.get();
 			y.setX(yv[0]);
 			y.setY(yv[1]);
 			y.setZ(yv[2]);
@@ -111,11 +116,11 @@ public:
 			percepteros::ToolObject tool = tools[0];
 			if (tool.value.get() > VAL_LOWER_BOUND && tool.value.get() < VAL_UPPER_BOUND) {
 				outInfo("Found spatula cluster!");
-				extractPoints(cloud, cluster, spatula);
+				extractPoints(cloud, index, c, spatula);
 				foundSpatula = true;
 			}
 		}
-		if ((foundSpatula && foundRack) || (foundSpatula && std::next(it) == clusters.end())) {
+		if ((foundSpatula && foundRack) || (foundSpatula && c + 1 == clusterCount)) {
 			rs::PoseAnnotation poseA = rs::create<rs::PoseAnnotation>(tcas);
 			percepteros::RecognitionObject recA = rs::create<percepteros::RecognitionObject>(tcas);
 			tf::StampedTransform camToWorld;
@@ -178,8 +183,8 @@ public:
 			poseA.camera.set(rs::conversion::to(tcas, camera));
 			poseA.world.set(rs::conversion::to(tcas, world));
 		
-			cluster.annotations.append(poseA);
-			cluster.annotations.append(recA);
+			index.append(c, poseA);
+			index.append(c, recA);
 			outInfo("Finished");
 			break;
 		}
@@ -187,12 +192,25 @@ public:
 
 	if (!foundSpatula) {
 		outInfo("No spatula found.");
+		publishOverlay(false);
 		return UIMA_ERR_NONE;
 	}
 		
+	publishOverlay(true);
     return UIMA_ERR_NONE;
 }
 
+	void publishOverlay(bool foundSpatula) {
+		percepteros::VisualizationOverlay &o = overlay.back();
+		o.cloud = cloud_r;
+		if (foundSpatula) {
+			o.addCone("x", getCoefficients(x, highest), 1, 0, 0);
+			o.addCone("y", getCoefficients(y, highest), 0, 1, 0);
+			o.addCone("z", getCoefficients(z, highest), 0, 0, 1);
+		}
+		overlay.publish();
+	}
+
 	void setEndpoints(PC::Ptr spat) {
 		PointN begin, end;
 		std::vector<PointN> endpoints(2);
@@ -250,37 +268,18 @@ public:
 		return object_normal;
 	}
 
-	void extractPoints(PC::Ptr cloud, rs::Cluster cluster, PC::Ptr container) {
-		pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
-		rs::ReferenceClusterPoints clusterpoints(cluster.points());
+	void extractPoints(PC::Ptr cloud, percepteros::SceneIndex &index, size_t c, PC::Ptr container) {
+		pcl::PointIndices::Ptr cluster_indices = percepteros::FrameArena::get<pcl::PointIndices>();
+		rs::ReferenceClusterPoints clusterpoints(index.cluster(c).points());
 		rs::conversion::from(clusterpoints.indices(), *cluster_indices);
 
-		for (std::vector<int>::const_iterator pit = cluster_indices->indices.begin(); pit != cluster_indices->indices.end(); pit++) {
-			container->push_back(cloud->points[*pit]);
-		}
-		
-		pcl::VoxelGrid<PointN> filter;
-		filter.setLeafSize(0.01f, 0.01f, 0.01f);
-		filter.setInputCloud(container);
-		filter.filter(*container);
+		//1 cm voxels, shared with the other annotators of the frame
+		typedef percepteros::ClusterPyramid<PointN> Pyramid;
+		*container = *Pyramid::of(index, c, *cloud, cluster_indices->indices).cloud(Pyramid::COARSE);
 	}
 
 	void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun) {
-		if (firstRun) {
-			visualizer.addPointCloud(cloud_r, "scene points");
-		} else {
-			visualizer.updatePointCloud(cloud_r, "scene points");
-			visualizer.removeAllShapes();
-		}
-				
-		visualizer.addCone(getCoefficients(x, highest), "x");
-		visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-		
-		visualizer.addCone(getCoefficients(y, highest), "y");
-		visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-
-		visualizer.addCone(getCoefficients(z, highest), "z");
-		visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
+		renderer.render(overlay, visualizer, "scene points", pointSize, firstRun);
 	}
 
 	pcl::ModelCoefficients getCoefficients(tf::Vector3 axis, PointN highest) {
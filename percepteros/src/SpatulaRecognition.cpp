@@ -16,9 +16,21 @@
 #include <rs/scene_cas.h>
 #include <rs/utils/time.h>
 
+#include <ros/package.h>
+#include <opencv2/core/core.hpp>
+
 //CATERROS
 #include <geometry_msgs/PoseStamped.h>
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/FrameArena.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/TemplateIndex.h>
+#include <percepteros/ModelStore.h>
+#include <percepteros/ModelSources.h>
+
+#include <cmath>
+#include <cstring>
 
 
 using namespace uima;
@@ -40,27 +52,32 @@ private:
   pcl::PointCloud<pcl::PointXYZ>::Ptr spatula;
   std::vector<Eigen::Vector3f>  obj_position;
   std::vector<featureSet> obj_feats;
-  std::vector<rs::Cluster> clusters;
-  featureSet spatula_features;
+  percepteros::TemplateIndex templates;
   float range;
+  float radius;
   float vector_length;
   Eigen::Vector3f spatula_pos; //this one describes the cluster center
 
-  //spatula description
+  //description of the last recognized object
   bool found_spat;
+  std::string found_name;
   tf::Transform spat_transf;
   tf::Vector3 spat_x, spat_y, spat_z;
   pcl::PointXYZ spatula_origin; //this one describes the highest point in the spatula cluster
 
+  //visualization
+  percepteros::OverlayBuffer overlay;
+  percepteros::OverlayRenderer renderer;
+
   featureSet computeFeatures(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr);
-  bool hasSimilarFS(featureSet , featureSet);
   pcl::PointXYZ getOrigin(pcl::PointCloud<pcl::PointXYZ>::Ptr);
   pcl::ModelCoefficients getCoefficients(tf::Vector3 axis, pcl::PointXYZ origin);
+  void publishOverlay();
 
 
 public:
 
-  SpatulaRecognition(): DrawingAnnotator(__func__), pointSize(1){
+  SpatulaRecognition(): DrawingAnnotator(__func__), pointSize(1), range(30), radius(1){
 
       cloud_ptr = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
   }
@@ -75,39 +92,84 @@ public:
 TyErrorId SpatulaRecognition::initialize(AnnotatorContext &ctx)
 {
   if(ctx.isParameterDefined("range")) ctx.extractValue("range", range);
+  if(ctx.isParameterDefined("radius")) ctx.extractValue("radius", radius);
   if(ctx.isParameterDefined("vector_length")) ctx.extractValue("vector_length", vector_length);
 
-  if(ctx.isParameterDefined("eigen_vec_0") && ctx.isParameterDefined("eigen_vec_1") && ctx.isParameterDefined("eigen_vec_2"))
+  std::string storeFile, templateFile;
+  if(ctx.isParameterDefined("model_store")) ctx.extractValue("model_store", storeFile);
+  if(ctx.isParameterDefined("templates")) ctx.extractValue("templates", templateFile);
+
+  //the compiled store is mapped once per process, its tree is used as is unless the templates were edited since
+  if(!storeFile.empty())
   {
-    float eigen_vec_0, eigen_vec_1, eigen_vec_2;
-    ctx.extractValue("eigen_vec_0", eigen_vec_0);
-    ctx.extractValue("eigen_vec_1", eigen_vec_1);
-    ctx.extractValue("eigen_vec_2", eigen_vec_2);
-    this->spatula_features.pca_eigen_vec(0,0) = eigen_vec_0;
-    this->spatula_features.pca_eigen_vec(1,0) = eigen_vec_1;
-    this->spatula_features.pca_eigen_vec(2,0) = eigen_vec_2;
-    outInfo("set vaule: eigen_vec_0, eigen_vec_1, eigen_vec_2");
+    std::string error;
+    std::vector<std::string> sources;
+    if(!templateFile.empty())
+    {
+      sources.push_back(ros::package::getPath("percepteros") + "/config/" + templateFile);
+    }
+    std::shared_ptr<const percepteros::ModelStore> store = percepteros::ModelStore::compiled(storeFile, sources, error);
+    if(store && templates.attach(store))
+    {
+      outInfo("using " << templates.size() << " templates of " << storeFile);
+      outInfo("initialize");
+      return UIMA_ERR_NONE;
+    }
+    outWarn("No templates in model store " << storeFile << (error.empty() ? "" : ": " + error) << ", reading the sources.");
   }
 
-  if(ctx.isParameterDefined("eigen_val_0") && ctx.isParameterDefined("eigen_val_0") && ctx.isParameterDefined("eigen_val_0"))
+  std::vector<percepteros::ObjectTemplate> objects;
+  //every feature group of the single template had to be within range (squared distance)
+  percepteros::TemplateIndex::Scales scales;
+  scales.axis = scales.eigenValues = scales.hue = scales.saturation = scales.value = std::sqrt(range);
+
+  if(!templateFile.empty())
   {
-    float eigen_val_0, eigen_val_1, eigen_val_2;
-    ctx.extractValue("eigen_val_0", eigen_val_0);
-    ctx.extractValue("eigen_val_1", eigen_val_1);
-    ctx.extractValue("eigen_val_2", eigen_val_2);
-    this->spatula_features.pca_eigen_vals = Eigen::Vector3f(eigen_val_0, eigen_val_1, eigen_val_2);
-    outInfo("set vaule: , eigen_val_1, eigen_val_2");
+    std::string error;
+    cv::FileStorage fs(ros::package::getPath("percepteros") + "/config/" + templateFile, cv::FileStorage::READ);
+    if(!fs.isOpened() || !percepteros::readTemplates(fs, objects, scales, error))
+    {
+      outError("Could not read templates from " << templateFile << ": " << error);
+      return UIMA_ERR_USER_ANNOTATOR_COULD_NOT_INIT;
+    }
+    outInfo("loaded " << objects.size() << " templates from " << templateFile);
   }
-
-  if(ctx.isParameterDefined("h_val") && ctx.isParameterDefined("s_val") && ctx.isParameterDefined("v_val"))
+  else
   {
-    float h, s, v;
-    ctx.extractValue("h_val", h);
-    ctx.extractValue("s_val", s);
-    ctx.extractValue("v_val", v);
-    this->spatula_features.hsv_means = Eigen::Vector3f(h, s, v);
-    outInfo("set vaule: h_val, s_val, v_val");
+    //single spatula template given as parameters
+    percepteros::ObjectTemplate spatula;
+    memset(&spatula, 0, sizeof(spatula));
+    strncpy(spatula.name, "cakeSpatula", sizeof(spatula.name) - 1);
+    spatula.type = 8;
+    spatula.size[0] = 0.28f;
+    spatula.size[1] = 0.056f;
+    spatula.size[2] = 0.03f;
+    if(ctx.isParameterDefined("eigen_vec_0") && ctx.isParameterDefined("eigen_vec_1") && ctx.isParameterDefined("eigen_vec_2"))
+    {
+      ctx.extractValue("eigen_vec_0", spatula.axis[0]);
+      ctx.extractValue("eigen_vec_1", spatula.axis[1]);
+      ctx.extractValue("eigen_vec_2", spatula.axis[2]);
+      outInfo("set vaule: eigen_vec_0, eigen_vec_1, eigen_vec_2");
+    }
+
+    if(ctx.isParameterDefined("eigen_val_0") && ctx.isParameterDefined("eigen_val_1") && ctx.isParameterDefined("eigen_val_2"))
+    {
+      ctx.extractValue("eigen_val_0", spatula.eigenValues[0]);
+      ctx.extractValue("eigen_val_1", spatula.eigenValues[1]);
+      ctx.extractValue("eigen_val_2", spatula.eigenValues[2]);
+      outInfo("set vaule: eigen_val_0, eigen_val_1, eigen_val_2");
+    }
+
+    if(ctx.isParameterDefined("h_val") && ctx.isParameterDefined("s_val") && ctx.isParameterDefined("v_val"))
+    {
+      ctx.extractValue("h_val", spatula.hsv[0]);
+      ctx.extractValue("s_val", spatula.hsv[1]);
+      ctx.extractValue("v_val", spatula.hsv[2]);
+      outInfo("set vaule: h_val, s_val, v_val");
+    }
+    objects.push_back(spatula);
   }
+  templates.build(objects, scales);
 
   outInfo("initialize");
   return UIMA_ERR_NONE;
@@ -124,7 +186,6 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
   outInfo("process start");
 
   //clearing data from last run
-  this->clusters.clear();
   this->obj_position.clear();
   this->obj_feats.clear();
   found_spat = false;
@@ -136,6 +197,8 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
   //setting up scene variables
   rs::SceneCas cas(tcas);
   rs::Scene scene = cas.getScene();
+  //the last scene may still be shown by the visualizer
+  percepteros::detachCloud<PointXYZRGBA>(cloud_ptr);
   cas.get(VIEW_CLOUD,*cloud_ptr);
 
   //getting "up-achis" of scene
@@ -154,15 +217,18 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
   tf::Matrix3x3 matrix = worldToCam.getBasis();
   tf::Vector3 scene_z = matrix*tf::Vector3(0,0,1);
 
-  scene.identifiables.filter(clusters);
+  percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
 
-  for (rs::Cluster cluster : clusters)
+  //clusters appended below are not checked again
+  const size_t clusterCount = index.clusters().size();
+  for (size_t c = 0; c < clusterCount; ++c)
   {
-    pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
+    rs::Cluster cluster = index.cluster(c);
+    pcl::PointIndices::Ptr cluster_indices = percepteros::FrameArena::get<pcl::PointIndices>();
     rs::ReferenceClusterPoints clusterpoints(cluster.points());
     rs::conversion::from(clusterpoints.indices(), *cluster_indices);
 
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp(new pcl::PointCloud<pcl::PointXYZRGBA>());
+    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZRGBA>>();
 
     for(std::vector<int>::const_iterator pit = cluster_indices->indices.begin();
         pit != cluster_indices->indices.end(); pit++)
@@ -170,7 +236,7 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
       temp->points.push_back(cloud_ptr->points[*pit]);
     }
 
-    pcl::PointCloud<pcl::PointXYZ>::Ptr object_cloud(new pcl::PointCloud<pcl::PointXYZ>());
+    pcl::PointCloud<pcl::PointXYZ>::Ptr object_cloud = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZ>>();
     pcl::copyPointCloud(*temp, *object_cloud);
 
     object_cloud->width = object_cloud->points.size();
@@ -185,10 +251,13 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
     centroid << center_temp.x(), center_temp.y(), center_temp.z();
     obj_position.push_back(centroid);
 
-    if (hasSimilarFS(spatula_features, computed_fs))
+    const percepteros::TemplateIndex::Descriptor descriptor =
+        templates.describe(computed_fs.pca_eigen_vec.col(0), computed_fs.pca_eigen_vals, computed_fs.hsv_means);
+    const int match = templates.nearest(descriptor, radius);
+    if (match >= 0)
     {
-      outInfo("Spatula detected");
-      found_spat = true;
+      const percepteros::ObjectTemplate &object = templates.at(match);
+      outInfo(object.name << " detected");
       this->spatula_pos = centroid;
       spatula_origin = getOrigin(object_cloud);
 
@@ -209,9 +278,11 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
         std::isnan(spat_z[0]) || std::isnan(spat_z[1]) || std::isnan(spat_z[2])
         )
       {
-        outError("Found wrong orientation. Abort.");
-        break;
+        outError("Found wrong orientation. Skipping " << object.name << ".");
+        continue;
       }
+      found_spat = true;
+      found_name = object.name;
 
       tf::Matrix3x3 spat_rot;
       spat_rot.setValue(
@@ -228,20 +299,19 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
       poseAnnotation.camera.set(rs::conversion::to(tcas, camera));
       poseAnnotation.world.set(rs::conversion::to(tcas, world));
       poseAnnotation.source.set("3DEstimate");
-      cluster.annotations.append(poseAnnotation);
+      index.append(c, poseAnnotation);
 
       //append RecognitionObject
-      percepteros::RecognitionObject spatulaObj = rs::create<percepteros::RecognitionObject>(tcas);
-      spatulaObj.name.set("cakeSpatula");
-      spatulaObj.type.set(8);
-      // HOTFIX: PLEASE REMOVE IF NOT NEEDED
-      spatulaObj.width.set(0.28f);
-      spatulaObj.height.set(0.056f);
-      spatulaObj.depth.set(0.03f);
-      cluster.annotations.append(spatulaObj);
-
-      //put spatula into scene
-      scene.identifiables.append(cluster);
+      percepteros::RecognitionObject recognized = rs::create<percepteros::RecognitionObject>(tcas);
+      recognized.name.set(object.name);
+      recognized.type.set(object.type);
+      recognized.width.set(object.size[0]);
+      recognized.height.set(object.size[1]);
+      recognized.depth.set(object.size[2]);
+      index.append(c, recognized);
+
+      //put object into scene
+      index.appendCluster(scene, cluster);
 
     }
   }
@@ -249,58 +319,44 @@ TyErrorId SpatulaRecognition::processWithLock(CAS &tcas, ResultSpecification con
   if (obj_feats.size() != obj_position.size())
   {
     outInfo("Number of available object positions does not match number of availabe object feature sets!");
+    publishOverlay();
     return UIMA_ERR_NONE;
   }
 
+  outInfo("total obj no " + std::to_string(obj_feats.size()));
+  publishOverlay();
   outInfo("process stop");
   return UIMA_ERR_NONE;
 }
 
-
-void SpatulaRecognition::fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
+/**
+ * @brief publishOverlay Hands the scene points and the pose of the last recognized object to the visualizer
+ */
+void SpatulaRecognition::publishOverlay()
 {
-
-  std::string cloudname("scene points");
-
-  if (firstRun){
-    outInfo("1Cloud size: " << cloud_ptr->points.size());
-    visualizer.addPointCloud(cloud_ptr, cloudname);
-    visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-  } else {
-    outInfo("0Cloud size: " << cloud_ptr->points.size());
-    visualizer.updatePointCloud(cloud_ptr, cloudname);
-    visualizer.removeAllShapes();
-    visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-  }
-
-  outInfo("total obj no " + std::to_string(obj_feats.size()));
-
+  percepteros::VisualizationOverlay &o = overlay.back();
+  o.cloud = cloud_ptr;
   if (this->found_spat)
   {
-    visualizer.addText3D("spatula", pcl::PointXYZ(this->spatula_pos.x(), this->spatula_pos.y(), this->spatula_pos.z()), 0.02);;
-    visualizer.addCone(getCoefficients(spat_x, spatula_origin), "x");
-    visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-    visualizer.addCone(getCoefficients(spat_y, spatula_origin), "y");
-    visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-    visualizer.addCone(getCoefficients(spat_z, spatula_origin), "z");
-    visualizer.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
+    o.addText("spatula", found_name, pcl::PointXYZ(this->spatula_pos.x(), this->spatula_pos.y(), this->spatula_pos.z()), 0.02);
+    o.addCone("x", getCoefficients(spat_x, spatula_origin), 1, 0, 0);
+    o.addCone("y", getCoefficients(spat_y, spatula_origin), 0, 1, 0);
+    o.addCone("z", getCoefficients(spat_z, spatula_origin), 0, 0, 1);
   }
+  overlay.publish();
+}
 
-  if (obj_feats.size() == obj_position.size() )
-  {
-    for (int i = 0; i < obj_feats.size(); i++)
-    {
-      std::string obj_desc("");
-      obj_desc += "eV: " + std::to_string(obj_feats[i].pca_eigen_vec(0,0)) + ", " + std::to_string(obj_feats[i].pca_eigen_vec(1,0)) + ", " + std::to_string(obj_feats[i].pca_eigen_vec(2,0)) + "/n" ;
-    }
-  }
+
+void SpatulaRecognition::fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
+{
+  renderer.render(overlay, visualizer, "scene points", pointSize, firstRun);
 }
 
 featureSet SpatulaRecognition::computeFeatures(pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cluster)
 {
   featureSet cluster_feats;
 
-  pcl::PointCloud<pcl::PointXYZ>::Ptr space_cloud(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::PointCloud<pcl::PointXYZ>::Ptr space_cloud = percepteros::FrameArena::get<pcl::PointCloud<pcl::PointXYZ>>();
   pcl::copyPointCloud(*cluster, *space_cloud);
 
   space_cloud->width = space_cloud->points.size();
@@ -315,7 +371,7 @@ featureSet SpatulaRecognition::computeFeatures(pcl::PointCloud<pcl::PointXYZRGBA
   //compute their magnitude
   cluster_feats.pca_eigen_vals = cluster_axis.getEigenValues();
 
-  //compute rgb centroid
+  //compute rgb centroid, the templates describe its color and not the mean hue of the points
   pcl::CentroidPoint<pcl::PointXYZRGBA> centroidComputer;
   for(auto point = cluster->begin(); point != cluster->end(); point++)
     centroidComputer.add(*point);
@@ -329,33 +385,6 @@ featureSet SpatulaRecognition::computeFeatures(pcl::PointCloud<pcl::PointXYZRGBA
   return cluster_feats;
 }
 
-bool SpatulaRecognition::hasSimilarFS(featureSet compared, featureSet comparing)
-{
-  //outInfo("hasSimilarFS started");
-  //check eigenvectors
-  Eigen::Vector3f compared_eigen_vec;
-  compared_eigen_vec << compared.pca_eigen_vec(0,0), compared.pca_eigen_vec(1,0), compared.pca_eigen_vec(2,0);
-  Eigen::Vector3f comparing_eigen_vec;
-  comparing_eigen_vec << comparing.pca_eigen_vec(0,0), comparing.pca_eigen_vec(1,0), comparing.pca_eigen_vec(2,0);
-  float eigen_vec_dist = (compared_eigen_vec - comparing_eigen_vec).squaredNorm();
-  //outInfo("vec distance" << eigen_vec_dist);
-  if (eigen_vec_dist>range) return false;
-
-  //check EigenValues
-  float eigen_val_dist = (compared.pca_eigen_vals - comparing.pca_eigen_vals).squaredNorm();
-  //outInfo("val distance" << eigen_val_dist);
-  if (eigen_val_dist > range) return false;
-
-  //check hsv
-  float hsv_dist = (compared.hsv_means- comparing.hsv_means).squaredNorm();
-  //outInfo("hsv distance" << hsv_dist);
-  if (hsv_dist > range) return false;
-
-  //outInfo("hasSimilarFS ended");
-
-  return true;
-}
-
 pcl::ModelCoefficients SpatulaRecognition::getCoefficients(tf::Vector3 axis, pcl::PointXYZ origin) {
   pcl::ModelCoefficients coeffs;
   //point
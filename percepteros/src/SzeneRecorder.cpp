@@ -8,91 +8,137 @@
 #include <std_srvs/Empty.h>
 #include <suturo_perception_msgs/PerceiveAction.h>
 #include <ros/time.h>
+#include <tf/transform_datatypes.h>
 
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/filters/filter.h>
-
-#include <pcl/features/normal_3d.h>
-
-#include <pcl/registration/icp.h>
-#include <pcl/registration/icp_nl.h>
-#include <pcl/registration/transforms.h>
 #include <pcl/point_cloud.h>
-#include <pcl/point_representation.h>
 #include <pcl/visualization/pcl_visualizer.h>
 #include <rs/DrawingAnnotator.h>
 #include <rs/utils/common.h>
 
-#include <pcl/point_cloud.h>
-#include <pcl/octree/octree.h>
+#include <percepteros/AsyncSceneWriter.h>
 
-#include <pcl/io/pcd_io.h>
+#include <percepteros/VoxelChangeDetector.h>
 
 #include <iostream>
 #include <vector>
-#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
 
 using namespace uima;
 
-
+/**
+ * Keeps the last ring_size frames (cloud, depth image, viewpoint) in a
+ * preallocated ring buffer. The before_action and perceive_action_effect
+ * services only mark a point in time, the first frame recorded at or after
+ * that time is pinned as before/after snapshot. Pinned slots are skipped when
+ * the ring wraps around, so selecting a snapshot never copies a cloud.
+ * Snapshots (or with record_all every frame) are handed to a background
+ * writer, the pipeline never waits for the disk.
+ */
 class SzeneRecorder : public DrawingAnnotator
 {
 private:
 
-    typedef pcl::PointXYZRGBA PointT;
-    typedef pcl::PointCloud<PointT> PointCloud;
-    typedef pcl::PointNormal PointNormalT;
-    typedef pcl::PointCloud<PointNormalT> PointCloudWithNormals;
-    double pointSize = 1;
+  typedef pcl::PointXYZRGBA PointT;
+  typedef pcl::PointCloud<PointT> PointCloud;
+  double pointSize = 1;
 
+  struct Frame
+  {
+    uint64_t stamp;
+    PointCloud::Ptr cloud;
+    cv::Mat depth;
+    tf::StampedTransform viewpoint;
+    bool hasViewpoint;
+    bool valid;
+    //the buffers are referenced by the writer and must not be reused
+    bool handedOut;
+  };
 
-    pcl::PointIndices clusterIndices;
+  int ringSize = 10;
+  std::vector<Frame> ring;
+  size_t head = 0;
 
-    struct SavedSzene{
+  //ring slots of the snapshots, -1 if not selected yet
+  int beforeSlot = -1, afterSlot = -1;
 
-        cv::Mat beforeDepthImage;
-        PointCloud::Ptr beforeActionPC;
-        ros::Time beforeTime;
+  //requested snapshot times, 0 if nothing is pending
+  uint64_t beforeRequest = 0, afterRequest = 0;
 
-        cv::Mat afterDepthImage;
-        PointCloud::Ptr afterActionPC;
-        ros::Time afterTime;
-    };
+  //guards the requests and snapshot slots, the services are called from the spinner thread
+  std::mutex snapshotMutex;
 
-    ros::NodeHandle nh_;
+  std::string savePath = ".";
+  bool saveSnapshots = true, recordAll = false, compress = true;
+  int writerQueueSize = 4;
+  std::unique_ptr<percepteros::AsyncSceneWriter> writer;
+  size_t lastDropped = 0;
 
-    ros::ServiceServer beforeActionService, actionEndedService;
+  //side length of the change detection voxels and points needed to count a voxel as new
+  percepteros::VoxelChangeDetector<PointT> changeDetector{0.05f, 60};
+  //snapshots the reference and the cached result belong to
+  int referenceSlot = -1, comparedSlot = -1;
+  uint64_t referenceStamp = 0, comparedStamp = 0;
 
-    bool queueSaveImage = false;
+  pcl::PointIndices clusterIndices;
+  PointCloud::Ptr dispCloud;
 
-    bool firstRun = true;
+  ros::NodeHandle nh_;
 
-    SavedSzene savedSzene;
+  ros::ServiceServer beforeActionService, actionEndedService;
 
 public:
 
-  SzeneRecorder() :DrawingAnnotator(__func__){}
+  SzeneRecorder() : DrawingAnnotator(__func__)
+  {
+    dispCloud = PointCloud::Ptr(new PointCloud);
+  }
 
   TyErrorId initialize(AnnotatorContext &ctx)
   {
     outInfo("initialize");
 
+    if(ctx.isParameterDefined("ring_size")) ctx.extractValue("ring_size", ringSize);
+    //two slots may be pinned, at least one has to stay writable
+    ringSize = std::max(ringSize, 3);
+    if(ctx.isParameterDefined("save_path")) ctx.extractValue("save_path", savePath);
+    if(ctx.isParameterDefined("save_snapshots")) ctx.extractValue("save_snapshots", saveSnapshots);
+    if(ctx.isParameterDefined("record_all")) ctx.extractValue("record_all", recordAll);
+    if(ctx.isParameterDefined("compress")) ctx.extractValue("compress", compress);
+    if(ctx.isParameterDefined("writer_queue_size")) ctx.extractValue("writer_queue_size", writerQueueSize);
+
+    ring.resize(ringSize);
+    for(size_t i = 0; i < ring.size(); ++i)
+    {
+      ring[i].cloud = PointCloud::Ptr(new PointCloud);
+      ring[i].stamp = 0;
+      ring[i].hasViewpoint = false;
+      ring[i].valid = false;
+      ring[i].handedOut = false;
+    }
+
+    if(saveSnapshots || recordAll)
+    {
+      writer.reset(new percepteros::AsyncSceneWriter(savePath, writerQueueSize, compress));
+      outInfo("Writing scenes to " << savePath);
+    }
+
     nh_ = ros::NodeHandle("~");
 
     beforeActionService = nh_.advertiseService("before_action", &SzeneRecorder::beforeActionCallback, this);
     actionEndedService = nh_.advertiseService("perceive_action_effect", &SzeneRecorder::perceiveActionEffectCallback, this);
-
-    savedSzene.beforeActionPC = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    savedSzene.afterActionPC = pcl::PointCloud<pcl::PointXYZRGBA>::Ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    pcl::io::loadPCDFile("/home/surxz/pcds/beforeGood/testbefore2.pcd",*savedSzene.beforeActionPC);
-    pcl::io::loadPCDFile("/home/surxz/pcds/afterGood/testafter2.pcd",*savedSzene.afterActionPC);
     return UIMA_ERR_NONE;
   }
 
   TyErrorId destroy()
   {
     outInfo("destroy");
+    if(writer)
+    {
+      outInfo("Waiting for " << writer->pending() << " scenes to be written.");
+      writer.reset();
+    }
     return UIMA_ERR_NONE;
   }
 
@@ -102,36 +148,48 @@ public:
     rs::StopWatch clock;
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
+    std::lock_guard<std::mutex> guard(snapshotMutex);
+
+    const int slot = record(cas, scene);
+    const Frame &frame = ring[slot];
+    outInfo("Cloud size: " << frame.cloud->points.size() << " stored in slot " << slot);
+
+    if(beforeRequest != 0 && frame.stamp >= beforeRequest)
+    {
+      beforeRequest = 0;
+      beforeSlot = slot;
+      outInfo("Selected slot " << slot << " as before snapshot.");
+      if(saveSnapshots) save("before", slot);
+    }
+    if(afterRequest != 0 && frame.stamp >= afterRequest)
+    {
+      afterRequest = 0;
+      afterSlot = slot;
+      outInfo("Selected slot " << slot << " as after snapshot.");
+      if(saveSnapshots) save("after", slot);
+    }
+    if(recordAll)
+    {
+      save("frame", slot);
+    }
+    if(writer)
+    {
+      reportWriter();
+    }
 
-    cv::Mat depth_image;
-
-    cas.get(VIEW_DEPTH_IMAGE, depth_image);
-
-    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_ptr(new pcl::PointCloud<pcl::PointXYZRGBA>);
-    cas.get(VIEW_CLOUD,*cloud_ptr);
-
-    outInfo("Cloud size: " << cloud_ptr->points.size());
-    outInfo("took: " << clock.getTime() << " ms.");
-    if(queueSaveImage){
-        queueSaveImage = false;
-        if(firstRun){
-            firstRun = false;
-            savedSzene.beforeActionPC = cloud_ptr;
-            savedSzene.beforeDepthImage = depth_image;
-            pcl::io::savePCDFileASCII ("testbefore.pcd", *cloud_ptr);
-        }
-        else{
-            savedSzene.afterActionPC = cloud_ptr;
-            savedSzene.afterDepthImage = depth_image;
-            pcl::io::savePCDFileASCII ("testafter.pcd", *cloud_ptr);
-
-
-
-        }
+    if(beforeSlot < 0 || afterSlot < 0)
+    {
+      clusterIndices.indices.clear();
+      comparedSlot = -1;
+      outInfo("took: " << clock.getTime() << " ms.");
+      return UIMA_ERR_NONE;
+    }
 
+    if(detectChange())
+    {
+      outInfo("Detected " << clusterIndices.indices.size() << " changed points.");
     }
-    pcl::PointIndices indices = detectChange();
-    clusterIndices = indices;
+    const pcl::PointIndices &indices = clusterIndices;
 
     rs::Cluster uimaCluster = rs::create<rs::Cluster>(tcas);
     rs::ReferenceClusterPoints rcp = rs::create<rs::ReferenceClusterPoints>(tcas);
@@ -143,84 +201,158 @@ public:
     uimaCluster.source.set("ChangeDetection");
 
     scene.identifiables.append(uimaCluster);
+    outInfo("took: " << clock.getTime() << " ms.");
     return UIMA_ERR_NONE;
   }
 
-  pcl::PointIndices detectChange(){
-      srand ((unsigned int) time (NULL));
-
-      // Octree resolution - side length of octree voxels
-      float resolution = 0.05f;
-
-      // Instantiate octree-based point cloud change detection class
-      pcl::octree::OctreePointCloudChangeDetector<pcl::PointXYZRGBA> octree (resolution);
-
-      // Add points from cloudA to octree
-      octree.setInputCloud (savedSzene.beforeActionPC);
-      octree.addPointsFromInputCloud ();
-
-      // Switch octree buffers: This resets octree but keeps previous tree structure in memory.
-      octree.switchBuffers ();
-
-      // Add points from cloudB to octree
-      octree.setInputCloud (savedSzene.afterActionPC);
-      octree.addPointsFromInputCloud ();
+  /**
+   * @brief record Writes the current frame into the next unpinned ring slot
+   * @return the slot index
+   */
+  int record(rs::SceneCas &cas, rs::Scene &scene)
+  {
+    while((int)head == beforeSlot || (int)head == afterSlot)
+    {
+      head = (head + 1) % ring.size();
+    }
+    const int slot = head;
+    head = (head + 1) % ring.size();
+
+    //cas.get resizes the slot buffers, which keeps their allocation once the ring is warm
+    Frame &frame = ring[slot];
+    if(frame.handedOut)
+    {
+      frame.cloud.reset(new PointCloud);
+      frame.depth.release();
+      frame.handedOut = false;
+    }
+    cas.get(VIEW_CLOUD, *frame.cloud);
+    cas.get(VIEW_DEPTH_IMAGE, frame.depth);
 
-      std::vector<int> newPointIdxVector;
+    frame.hasViewpoint = scene.viewPoint.has();
+    if(frame.hasViewpoint)
+    {
+      rs::conversion::from(scene.viewPoint.get(), frame.viewpoint);
+    }
 
-      // Get vector of point indices from octree voxels which did not exist in previous buffer
-      octree.getPointIndicesFromNewVoxels (newPointIdxVector,60);
+    //pcl stamps are microseconds
+    frame.stamp = frame.cloud->header.stamp * 1000;
+    frame.valid = true;
+    return slot;
+  }
 
-      pcl::PointIndices indices;
-      indices.indices = newPointIdxVector;
+  /**
+   * @brief save Hands a ring slot to the writer without copying it
+   */
+  void save(const std::string &prefix, int slot)
+  {
+    if(!writer || ring[slot].handedOut)
+    {
+      return;
+    }
+    Frame &frame = ring[slot];
+    std::ostringstream name;
+    name << prefix << "_" << frame.stamp;
+
+    percepteros::AsyncSceneWriter::Scene scene;
+    scene.name = name.str();
+    scene.stamp = frame.stamp;
+    scene.cloud = frame.cloud;
+    scene.depth = frame.depth;
+    scene.hasViewpoint = frame.hasViewpoint;
+    scene.viewpoint = frame.viewpoint;
+    if(writer->push(scene))
+    {
+      frame.handedOut = true;
+    }
+  }
 
-      // Output points
-      std::cout << "Output from getPointIndicesFromNewVoxels:" << std::endl;
-      /*for (size_t i = 0; i < newPointIdxVector.size (); ++i)
-        std::cout << i << "# Index:" << newPointIdxVector[i]
-                  << "  Point:" << savedSzene.afterActionPC->points[newPointIdxVector[i]].x << " "
-                  << savedSzene.afterActionPC->points[newPointIdxVector[i]].y << " "
-                  << savedSzene.afterActionPC->points[newPointIdxVector[i]].z << std::endl;*/
-      return indices;
+  void reportWriter()
+  {
+    const size_t dropped = writer->getDropped();
+    if(dropped != lastDropped)
+    {
+      outError("Scene writer can not keep up, dropped " << dropped - lastDropped << " scenes ("
+               << dropped << " total). Increase writer_queue_size or disable record_all.");
+      lastDropped = dropped;
+    }
+    outInfo("Scene writer: " << writer->pending() << "/" << writer->getMaxQueue() << " queued (max "
+            << writer->getHighWater() << "), " << writer->getWritten() << " written, "
+            << writer->getFailed() << " failed, " << dropped << " dropped.");
   }
 
+  /**
+   * @brief detectChange Updates clusterIndices if one of the snapshots changed
+   * @return false if the cached result was still valid
+   */
+  bool detectChange()
+  {
+    const Frame &before = ring[beforeSlot];
+    const Frame &after = ring[afterSlot];
+    if(comparedSlot == afterSlot && comparedStamp == after.stamp &&
+       referenceSlot == beforeSlot && referenceStamp == before.stamp)
+    {
+      return false;
+    }
 
+    if(referenceSlot != beforeSlot || referenceStamp != before.stamp)
+    {
+      changeDetector.setReference(*before.cloud);
+      referenceSlot = beforeSlot;
+      referenceStamp = before.stamp;
+    }
+    changeDetector.detect(*after.cloud, clusterIndices.indices);
+    comparedSlot = afterSlot;
+    comparedStamp = after.stamp;
+    return true;
+  }
 
   bool beforeActionCallback(std_srvs::Empty::Request& request,
                                      std_srvs::Empty::Response& res){
-      queueSaveImage = true;
-      savedSzene.beforeTime = ros::Time::now();
+      std::lock_guard<std::mutex> guard(snapshotMutex);
+      beforeRequest = ros::Time::now().toNSec();
+      //release the old snapshots, a new action starts
+      beforeSlot = -1;
+      afterSlot = -1;
       return true;
   }
 
   bool perceiveActionEffectCallback(suturo_perception_msgs::PerceiveAction::Request &req,
                                     suturo_perception_msgs::PerceiveAction::Response &res){
-      queueSaveImage = true;
-      savedSzene.afterTime = ros::Time::now();
+      std::lock_guard<std::mutex> guard(snapshotMutex);
+      afterRequest = ros::Time::now().toNSec();
+      afterSlot = -1;
       return true;
   }
 
   void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &visualizer, const bool firstRun)
   {
-  const std::string &cloudname = this->name;
-  const pcl::PointIndices &indices = clusterIndices;
-  for(size_t j = 0; j < indices.indices.size(); ++j)
-  {
-    size_t index = indices.indices[j];
-    savedSzene.afterActionPC->points[index].rgba = rs::common::colors[0];
-  }
+    const std::string &cloudname = this->name;
+    {
+      std::lock_guard<std::mutex> guard(snapshotMutex);
+      if(afterSlot < 0)
+      {
+        return;
+      }
+
+      //colour a copy, the snapshot itself has to stay untouched
+      *dispCloud = *ring[afterSlot].cloud;
+      const pcl::PointIndices &indices = clusterIndices;
+      for(size_t j = 0; j < indices.indices.size(); ++j)
+      {
+        size_t index = indices.indices[j];
+        dispCloud->points[index].rgba = rs::common::colors[0];
+      }
+    }
 
-    if(savedSzene.afterActionPC && savedSzene.afterActionPC->points.size()!=0){
-        if(firstRun)
-        {
-          visualizer.addPointCloud(savedSzene.afterActionPC, cloudname);
-          visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-        }
-        else
-        {
-          visualizer.updatePointCloud(savedSzene.afterActionPC, cloudname);
-          visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
-        }
+    if(!visualizer.updatePointCloud(dispCloud, cloudname))
+    {
+      visualizer.addPointCloud(dispCloud, cloudname);
+      visualizer.setPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
+    }
+    else
+    {
+      visualizer.getPointCloudRenderingProperties(pcl::visualization::PCL_VISUALIZER_POINT_SIZE, pointSize, cloudname);
     }
   }
 
@@ -0,0 +1,359 @@
+#include <percepteros/TSDFVolume.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace percepteros
+{
+
+/**
+ * @brief TSDFVolume::TSDFVolume Creates the volume and allocates the block pool
+ * @param voxelSize edge length of one voxel in meters
+ * @param truncation distance in meters at which the signed distance is truncated
+ * @param maxWeight upper limit for the integration weight, lower values adapt faster to changes
+ * @param maxBlocks size of the block pool
+ * @param threads number of threads used for integration and raycasting
+ */
+TSDFVolume::TSDFVolume(float voxelSize, float truncation, float maxWeight, size_t maxBlocks, int threads) :
+  voxelSize(voxelSize), truncation(truncation), maxWeight(maxWeight), threads(std::max(1, threads)), frame(0)
+{
+  blocks.resize(maxBlocks);
+  blockMap.reserve(maxBlocks);
+  visibleBlocks.reserve(maxBlocks);
+  reset();
+}
+
+/**
+ * @brief TSDFVolume::reset Releases all blocks, the pool itself stays allocated
+ */
+void TSDFVolume::reset()
+{
+  blockMap.clear();
+  freeBlocks.clear();
+  freeBlocks.reserve(blocks.size());
+  for(size_t i = blocks.size(); i > 0; --i)
+  {
+    freeBlocks.push_back(i - 1);
+  }
+}
+
+void TSDFVolume::integrate(const cv::Mat &depth, const pcl::PointCloud<pcl::PointXYZRGBA> &colors,
+                           const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld, float maxDepth)
+{
+  ++frame;
+
+  //work on metric depth, so the inner loops do not have to care about the image type
+  cv::Mat depthMeters;
+  if(depth.type() == CV_16UC1)
+  {
+    depth.convertTo(depthMeters, CV_32FC1, 0.001);
+  }
+  else
+  {
+    depthMeters = depth;
+  }
+
+  allocateBlocks(depthMeters, intrinsics, camToWorld, maxDepth);
+
+  const Eigen::Affine3f worldToCam = camToWorld.inverse();
+  const bool useColors = colors.width == (uint32_t)depthMeters.cols && colors.height == (uint32_t)depthMeters.rows;
+  const pcl::PointCloud<pcl::PointXYZRGBA> empty;
+  const pcl::PointCloud<pcl::PointXYZRGBA> &colorSource = useColors ? colors : empty;
+
+  //blocks are independent of each other, so every thread takes every n-th block
+  std::vector<std::thread> workers;
+  for(int t = 0; t < threads; ++t)
+  {
+    workers.push_back(std::thread([&, t]()
+    {
+      for(size_t i = t; i < visibleBlocks.size(); i += threads)
+      {
+        integrateBlock(blocks[visibleBlocks[i]], depthMeters, colorSource, intrinsics, worldToCam, maxDepth);
+      }
+    }));
+  }
+  for(std::thread &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+/**
+ * @brief TSDFVolume::allocateBlocks Collects all blocks inside the truncation band of the current measurement
+ * and allocates the missing ones, recycling the least recently seen blocks if the pool is exhausted.
+ */
+void TSDFVolume::allocateBlocks(const cv::Mat &depth, const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld, float maxDepth)
+{
+  std::vector<uint64_t> keys;
+  std::vector<Eigen::Vector3i> coords;
+  keys.reserve(visibleBlocks.size() * 2 + 1024);
+
+  //a block is several times larger than a pixel footprint, so every second pixel is enough
+  for(int v = 0; v < depth.rows; v += 2)
+  {
+    const float *row = depth.ptr<float>(v);
+    for(int u = 0; u < depth.cols; u += 2)
+    {
+      const float d = row[u];
+      if(!(d > 0.0f) || d > maxDepth)
+      {
+        continue;
+      }
+      const Eigen::Vector3f ray((u - intrinsics.cx) / intrinsics.fx, (v - intrinsics.cy) / intrinsics.fy, 1.0f);
+      for(int s = -1; s <= 1; ++s)
+      {
+        keys.push_back(key(blockCoords(camToWorld * (ray * (d + s * truncation)))));
+      }
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  visibleBlocks.clear();
+  std::vector<uint64_t> missing;
+  for(uint64_t k : keys)
+  {
+    auto it = blockMap.find(k);
+    if(it != blockMap.end())
+    {
+      blocks[it->second].lastSeen = frame;
+      visibleBlocks.push_back(it->second);
+    }
+    else
+    {
+      missing.push_back(k);
+    }
+  }
+
+  //free the oldest blocks in one pass instead of searching for each missing block
+  if(missing.size() > freeBlocks.size())
+  {
+    std::vector<std::pair<uint64_t, uint64_t>> candidates;
+    candidates.reserve(blockMap.size());
+    for(const auto &entry : blockMap)
+    {
+      if(blocks[entry.second].lastSeen < frame)
+      {
+        candidates.push_back(std::make_pair(blocks[entry.second].lastSeen, entry.first));
+      }
+    }
+    const size_t evict = std::min(candidates.size(), missing.size() - freeBlocks.size());
+    std::nth_element(candidates.begin(), candidates.begin() + evict, candidates.end());
+    for(size_t i = 0; i < evict; ++i)
+    {
+      auto it = blockMap.find(candidates[i].second);
+      freeBlocks.push_back(it->second);
+      blockMap.erase(it);
+    }
+  }
+
+  for(uint64_t k : missing)
+  {
+    if(freeBlocks.empty())
+    {
+      break;
+    }
+    const Eigen::Vector3i c((int)((k >> 42) & 0x1FFFFF) - (1 << 20),
+                            (int)((k >> 21) & 0x1FFFFF) - (1 << 20),
+                            (int)(k & 0x1FFFFF) - (1 << 20));
+    visibleBlocks.push_back(acquireBlock(c));
+  }
+}
+
+size_t TSDFVolume::acquireBlock(const Eigen::Vector3i &coords)
+{
+  const size_t index = freeBlocks.back();
+  freeBlocks.pop_back();
+
+  Block &block = blocks[index];
+  std::fill(block.tsdf, block.tsdf + BLOCK_VOXELS, 1.0f);
+  std::fill(block.weight, block.weight + BLOCK_VOXELS, 0.0f);
+  std::fill(block.r, block.r + BLOCK_VOXELS, 0);
+  std::fill(block.g, block.g + BLOCK_VOXELS, 0);
+  std::fill(block.b, block.b + BLOCK_VOXELS, 0);
+  block.coords = coords;
+  block.lastSeen = frame;
+
+  blockMap[key(coords)] = index;
+  return index;
+}
+
+void TSDFVolume::integrateBlock(Block &block, const cv::Mat &depth, const pcl::PointCloud<pcl::PointXYZRGBA> &colors,
+                                const Intrinsics &intrinsics, const Eigen::Affine3f &worldToCam, float maxDepth)
+{
+  const Eigen::Matrix3f rotation = worldToCam.linear();
+  const Eigen::Vector3f stepX = rotation.col(0) * voxelSize;
+  const Eigen::Vector3f origin = block.coords.cast<float>() * (voxelSize * BLOCK_SIZE);
+  const bool useColors = !colors.points.empty();
+
+  for(int z = 0; z < BLOCK_SIZE; ++z)
+  {
+    for(int y = 0; y < BLOCK_SIZE; ++y)
+    {
+      //voxel centers of one row are equally spaced in camera coordinates as well
+      const Eigen::Vector3f rowStart = worldToCam * (origin + Eigen::Vector3f(0.5f, y + 0.5f, z + 0.5f) * voxelSize);
+      const int offset = (z * BLOCK_SIZE + y) * BLOCK_SIZE;
+
+      for(int x = 0; x < BLOCK_SIZE; ++x)
+      {
+        const Eigen::Vector3f p = rowStart + stepX * (float)x;
+        if(p.z() <= 0.0f)
+        {
+          continue;
+        }
+        const int u = (int)(intrinsics.fx * p.x() / p.z() + intrinsics.cx + 0.5f);
+        const int v = (int)(intrinsics.fy * p.y() / p.z() + intrinsics.cy + 0.5f);
+        if(u < 0 || v < 0 || u >= depth.cols || v >= depth.rows)
+        {
+          continue;
+        }
+        const float d = depth.at<float>(v, u);
+        if(!(d > 0.0f) || d > maxDepth)
+        {
+          continue;
+        }
+        const float sdf = d - p.z();
+        if(sdf < -truncation)
+        {
+          continue;
+        }
+
+        const int i = offset + x;
+        const float w = block.weight[i];
+        const float tsdf = std::min(1.0f, sdf / truncation);
+        block.tsdf[i] = (block.tsdf[i] * w + tsdf) / (w + 1.0f);
+        block.weight[i] = std::min(w + 1.0f, maxWeight);
+
+        if(useColors)
+        {
+          const pcl::PointXYZRGBA &c = colors.points[v * depth.cols + u];
+          block.r[i] = (uint8_t)((block.r[i] * w + c.r) / (w + 1.0f));
+          block.g[i] = (uint8_t)((block.g[i] * w + c.g) / (w + 1.0f));
+          block.b[i] = (uint8_t)((block.b[i] * w + c.b) / (w + 1.0f));
+        }
+      }
+    }
+  }
+}
+
+const TSDFVolume::Block *TSDFVolume::findBlock(const Eigen::Vector3i &coords) const
+{
+  auto it = blockMap.find(key(coords));
+  return it == blockMap.end() ? NULL : &blocks[it->second];
+}
+
+/**
+ * @brief TSDFVolume::sample Looks up the voxel containing p. The last block is cached, since
+ * consecutive samples along a ray mostly fall into the same block.
+ * @return false if the voxel was never observed
+ */
+bool TSDFVolume::sample(const Eigen::Vector3f &p, float &tsdf, const Block *&cached, Eigen::Vector3i &cachedCoords, int &voxel) const
+{
+  const Eigen::Vector3i v((int)std::floor(p.x() / voxelSize), (int)std::floor(p.y() / voxelSize), (int)std::floor(p.z() / voxelSize));
+  const Eigen::Vector3i b((v.x() >> BLOCK_SHIFT), (v.y() >> BLOCK_SHIFT), (v.z() >> BLOCK_SHIFT));
+  if(b != cachedCoords)
+  {
+    cached = findBlock(b);
+    cachedCoords = b;
+  }
+  if(!cached)
+  {
+    return false;
+  }
+  const Eigen::Vector3i local = v - b * BLOCK_SIZE;
+  voxel = (local.z() * BLOCK_SIZE + local.y()) * BLOCK_SIZE + local.x();
+  if(cached->weight[voxel] <= 0.0f)
+  {
+    return false;
+  }
+  tsdf = cached->tsdf[voxel];
+  return true;
+}
+
+void TSDFVolume::raycast(const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld, float maxDepth,
+                         pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const
+{
+  cloud.width = intrinsics.width;
+  cloud.height = intrinsics.height;
+  cloud.is_dense = false;
+  cloud.points.resize(intrinsics.width * intrinsics.height);
+
+  std::vector<std::thread> workers;
+  const int rowsPerThread = (intrinsics.height + threads - 1) / threads;
+  for(int t = 0; t < threads; ++t)
+  {
+    const int begin = t * rowsPerThread;
+    const int end = std::min(intrinsics.height, begin + rowsPerThread);
+    workers.push_back(std::thread(&TSDFVolume::raycastRows, this, begin, end, std::cref(intrinsics),
+                                  std::cref(camToWorld), maxDepth, std::ref(cloud)));
+  }
+  for(std::thread &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void TSDFVolume::raycastRows(int rowBegin, int rowEnd, const Intrinsics &intrinsics, const Eigen::Affine3f &camToWorld,
+                             float maxDepth, pcl::PointCloud<pcl::PointXYZRGBA> &cloud) const
+{
+  const float bad = std::numeric_limits<float>::quiet_NaN();
+  const float minDepth = 0.2f;
+  const float blockLength = voxelSize * BLOCK_SIZE;
+  const Eigen::Matrix3f rotation = camToWorld.linear();
+  const Eigen::Vector3f origin = camToWorld.translation();
+
+  for(int v = rowBegin; v < rowEnd; ++v)
+  {
+    for(int u = 0; u < intrinsics.width; ++u)
+    {
+      pcl::PointXYZRGBA &point = cloud.points[v * intrinsics.width + u];
+      point.x = point.y = point.z = bad;
+      point.rgba = 0;
+
+      //direction is scaled to z = 1, so t is the depth of the sample
+      const Eigen::Vector3f dirCam((u - intrinsics.cx) / intrinsics.fx, (v - intrinsics.cy) / intrinsics.fy, 1.0f);
+      const Eigen::Vector3f dir = rotation * dirCam;
+
+      const Block *cached = NULL;
+      Eigen::Vector3i cachedCoords(std::numeric_limits<int>::max(), 0, 0);
+      int voxel = 0;
+      float prevTsdf = 0.0f, prevT = 0.0f;
+      bool prevValid = false;
+
+      for(float t = minDepth; t < maxDepth;)
+      {
+        float tsdf;
+        if(!sample(origin + dir * t, tsdf, cached, cachedCoords, voxel))
+        {
+          //unobserved space, skip ahead faster
+          prevValid = false;
+          t += cached ? voxelSize : blockLength * 0.5f;
+          continue;
+        }
+
+        if(prevValid && prevTsdf > 0.0f && tsdf <= 0.0f)
+        {
+          const float hit = prevT + (t - prevT) * prevTsdf / (prevTsdf - tsdf);
+          const Eigen::Vector3f p = dirCam * hit;
+          point.x = p.x();
+          point.y = p.y();
+          point.z = p.z();
+          point.r = cached->r[voxel];
+          point.g = cached->g[voxel];
+          point.b = cached->b[voxel];
+          point.a = 255;
+          break;
+        }
+
+        prevTsdf = tsdf;
+        prevT = t;
+        prevValid = true;
+        t += std::max(voxelSize, tsdf * truncation * 0.8f);
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,156 @@
+#include <percepteros/TemplateIndex.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace percepteros
+{
+
+TemplateIndex::TemplateIndex() : templates_(NULL), descriptors_(NULL), nodes_(NULL), size_(0)
+{
+}
+
+void TemplateIndex::build(const std::vector<ObjectTemplate> &templates, const Scales &scales)
+{
+  store_.reset();
+  ownTemplates_ = templates;
+  scales_ = scales;
+  ownDescriptors_.clear();
+  ownNodes_.clear();
+
+  std::vector<int> items(ownTemplates_.size());
+  for(size_t i = 0; i < ownTemplates_.size(); ++i)
+  {
+    const ObjectTemplate &t = ownTemplates_[i];
+    ownDescriptors_.push_back(describe(Eigen::Vector3f::Map(t.axis), Eigen::Vector3f::Map(t.eigenValues), Eigen::Vector3f::Map(t.hsv)));
+    items[i] = i;
+  }
+  descriptors_ = ownDescriptors_.data();
+  ownNodes_.reserve(items.size());
+  buildNode(items, 0, items.size());
+
+  templates_ = ownTemplates_.data();
+  nodes_ = ownNodes_.data();
+  size_ = ownTemplates_.size();
+}
+
+void TemplateIndex::save(ModelStoreWriter &writer) const
+{
+  writer.add("templates", templates_, size_);
+  writer.add("template_scales", &scales_, 1);
+  writer.add("template_descriptors", descriptors_, size_);
+  writer.add("template_nodes", nodes_, size_);
+}
+
+bool TemplateIndex::attach(const std::shared_ptr<const ModelStore> &store)
+{
+  size_t templateCount, scaleCount, descriptorCount, nodeCount;
+  const ObjectTemplate *templates = store->section<ObjectTemplate>("templates", templateCount);
+  const Scales *scales = store->section<Scales>("template_scales", scaleCount);
+  const Descriptor *descriptors = store->section<Descriptor>("template_descriptors", descriptorCount);
+  const Node *nodes = store->section<Node>("template_nodes", nodeCount);
+  if(!templates || !scales || !descriptors || !nodes || templateCount == 0 || scaleCount != 1 ||
+     descriptorCount != templateCount || nodeCount != templateCount)
+  {
+    return false;
+  }
+
+  ownTemplates_.clear();
+  ownDescriptors_.clear();
+  ownNodes_.clear();
+  store_ = store;
+  templates_ = templates;
+  scales_ = *scales;
+  descriptors_ = descriptors;
+  nodes_ = nodes;
+  size_ = templateCount;
+  return true;
+}
+
+TemplateIndex::Descriptor TemplateIndex::describe(const Eigen::Vector3f &axis, const Eigen::Vector3f &eigenValues,
+                                                  const Eigen::Vector3f &hsv) const
+{
+  Descriptor descriptor;
+  descriptor.segment<3>(0) = axis / scales_.axis;
+  descriptor.segment<3>(3) = eigenValues / scales_.eigenValues;
+  //chord of the unit circle is about the angle in radians for near hues
+  const float angle = hsv[0] * M_PI / 180.0f;
+  const float radius = 180.0f / M_PI / scales_.hue;
+  descriptor[6] = std::cos(angle) * radius;
+  descriptor[7] = std::sin(angle) * radius;
+  descriptor[8] = hsv[1] / scales_.saturation;
+  descriptor[9] = hsv[2] / scales_.value;
+  return descriptor;
+}
+
+int TemplateIndex::nearest(const Descriptor &descriptor, float radius, float *distance) const
+{
+  int best = -1;
+  float bestDistance = radius * radius;
+  if(size_ > 0)
+  {
+    search(0, descriptor, best, bestDistance);
+  }
+  if(best >= 0 && distance)
+  {
+    *distance = std::sqrt(bestDistance);
+  }
+  return best;
+}
+
+int TemplateIndex::buildNode(std::vector<int> &items, size_t begin, size_t end)
+{
+  if(begin >= end)
+  {
+    return -1;
+  }
+
+  //split along the dimension with the largest spread at the median
+  Descriptor min = descriptors_[items[begin]], max = min;
+  for(size_t i = begin + 1; i < end; ++i)
+  {
+    min = min.cwiseMin(descriptors_[items[i]]);
+    max = max.cwiseMax(descriptors_[items[i]]);
+  }
+  int dimension;
+  (max - min).maxCoeff(&dimension);
+  const size_t median = begin + (end - begin) / 2;
+  std::nth_element(items.begin() + begin, items.begin() + median, items.begin() + end, [&](int a, int b)
+  {
+    return descriptors_[a][dimension] < descriptors_[b][dimension];
+  });
+
+  const int node = ownNodes_.size();
+  ownNodes_.push_back(Node{items[median], dimension, -1, -1});
+  const int left = buildNode(items, begin, median);
+  const int right = buildNode(items, median + 1, end);
+  ownNodes_[node].left = left;
+  ownNodes_[node].right = right;
+  return node;
+}
+
+void TemplateIndex::search(int node, const Descriptor &descriptor, int &best, float &bestDistance) const
+{
+  const Node &n = nodes_[node];
+  const float distance = (descriptors_[n.item] - descriptor).squaredNorm();
+  if(distance <= bestDistance)
+  {
+    best = n.item;
+    bestDistance = distance;
+  }
+
+  const float offset = descriptor[n.dimension] - descriptors_[n.item][n.dimension];
+  const int nearSide = offset < 0 ? n.left : n.right;
+  const int farSide = offset < 0 ? n.right : n.left;
+  if(nearSide >= 0)
+  {
+    search(nearSide, descriptor, best, bestDistance);
+  }
+  //the other side can only hold closer templates if the split plane is closer
+  if(farSide >= 0 && offset * offset <= bestDistance)
+  {
+    search(farSide, descriptor, best, bestDistance);
+  }
+}
+
+}
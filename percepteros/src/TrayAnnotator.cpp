@@ -39,6 +39,9 @@
 
 // OTHER
 #include <percepteros/types/all_types.h>
+#include <percepteros/VisualizationOverlay.h>
+#include <percepteros/SceneIndex.h>
+#include <percepteros/ClusterColor.h>
 #include <rs/segmentation/ImageSegmentation.h>
 #include <tf/transform_datatypes.h>
 #include <tf_conversions/tf_eigen.h>
@@ -59,6 +62,11 @@ private:
 	tf::Vector3 origin;
 	Eigen::Matrix3f ev;
 
+	//visualization
+	percepteros::OverlayBuffer overlay;
+	percepteros::OverlayRenderer renderer;
+	double pointSize = 1;
+
 public:
   TrayAnnotator() : DrawingAnnotator(__func__)
   {
@@ -89,10 +97,12 @@ private:
     rs::SceneCas cas(tcas);
     rs::Scene scene = cas.getScene();
 
+    //the last scene may still be shown by the visualizer
+    percepteros::detachCloud<PointR>(cloud);
     cas.get(VIEW_CLOUD, *cloud);
+    overlay.back().cloud = cloud;
 
-	std::vector<rs::Cluster> clusters;
-	scene.identifiables.filter(clusters);
+	percepteros::SceneIndex &index = percepteros::SceneIndex::refresh(scene);
 
 	pcl::PCA<PointR> pca; 
 
@@ -104,16 +114,20 @@ private:
 		outInfo("No camera to world transformation!!!");
 	}
 
-	for (auto cluster : clusters) {
+	const size_t clusterCount = index.clusters().size();
+	for (size_t c = 0; c < clusterCount; ++c) {
+		rs::Cluster cluster = index.cluster(c);
 		if (cluster.source.get().compare(0, 13, "HueClustering") == 0) {
 			pcl::PointIndices::Ptr cluster_indices(new pcl::PointIndices);
 			rs::ReferenceClusterPoints clusterpoints(cluster.points());
 			rs::conversion::from(clusterpoints.indices(), *cluster_indices);
 
 			extractPoints(cloud, tray, cluster_indices);
-			float hue = std::strtof(cluster.source.get().substr(15).data(), NULL);
+			//red and yellow are color classes of ClusterColorStatistics
+			percepteros::ColorStatistics stats = percepteros::ClusterColor::of(tcas, index, c, *cloud);
+			float colored = percepteros::ClusterColor::ratio(stats, "red") + percepteros::ClusterColor::ratio(stats, "yellow");
 
-			if (hue < 10 || hue > 320 || (hue > 40 && hue < 80)) {
+			if (colored > 0.5f) {
 				pca.setInputCloud(tray);
 				percepteros::RecognitionObject o = rs::create<percepteros::RecognitionObject>(tcas);
 					
@@ -144,11 +158,18 @@ private:
 				o.height.set(0.29);
 				o.depth.set(0);
 
-				cluster.annotations.append(poseA);
-				cluster.annotations.append(o);
+				index.append(c, poseA);
+				index.append(c, o);
+
+				//one set of axes per tray
+				const std::string id = std::to_string(overlay.back().cones.size() / 3);
+				overlay.back().addCone("x" + id, getCoefficients(0, ev, origin), 1, 0, 0);
+				overlay.back().addCone("y" + id, getCoefficients(1, ev, origin), 0, 1, 0);
+				overlay.back().addCone("z" + id, getCoefficients(2, ev, origin), 0, 0, 1);
 				}
 			}
 		}
+		overlay.publish();
 		return UIMA_ERR_NONE;
 	}
 
@@ -160,22 +181,7 @@ private:
 	}
 
 	void fillVisualizerWithLock(pcl::visualization::PCLVisualizer &vis, const bool firstRun) {
-		if (firstRun) {
-			vis.addPointCloud(cloud, "scene points");
-		} else {
-			vis.updatePointCloud(cloud, "scene points");
-			vis.removeAllShapes();
-		}
-
-		vis.addCone(getCoefficients(0, ev, origin), "x");
-		vis.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 1, 0, 0, "x");
-
-
-		vis.addCone(getCoefficients(1, ev, origin), "y");
-		vis.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 1, 0, "y");
-
-		vis.addCone(getCoefficients(2, ev, origin), "z");
-		vis.setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_COLOR, 0, 0, 1, "z");
+		renderer.render(overlay, vis, "scene points", pointSize, firstRun);
 	}
 
 	pcl::ModelCoefficients getCoefficients(int start, Eigen::Matrix3f rot, tf::Vector3 origin) {
@@ -1,192 +1,164 @@
 #include "ros/ros.h"
 #include <suturo_perception_msgs/ObjectDetection.h>
-#include "std_msgs/String.h"
+#include <percepteros/ObjectDetectionArray.h>
 #include "geometry_msgs/PoseStamped.h"
 #include <tf/transform_broadcaster.h>
-#include "tf2_geometry_msgs/tf2_geometry_msgs.h"
+#include <tf/transform_datatypes.h>
 #include "visualization_msgs/Marker.h"
+#include "visualization_msgs/MarkerArray.h"
 #include <iostream>
-
-ros::Publisher vis_pub1;
-ros::Publisher vis_pub2;
-tf::TransformBroadcaster* br;
-
+#include <cmath>
+#include <map>
+#include <vector>
 
 /**
- * This tutorial demonstrates simple receipt of messages over the ROS system.
+ * How objects of one RecognitionObject type are shown in RViz.
  */
-void subscriber(const suturo_perception_msgs::ObjectDetection& msg)
+struct MarkerStyle
+{
+  //visualization_msgs::Marker type of the body, -1 for arrow only
+  int shape;
+  bool broadcastTF;
+};
+
+//detections of types without a style are not visualized
+const std::map<int, MarkerStyle> styles = {
+  {1, {visualization_msgs::Marker::CUBE, false}},
+  {2, {visualization_msgs::Marker::CYLINDER, true}},
+  {6, {-1, true}}
+};
+
+struct SentTransform
 {
+  tf::Transform transform;
+  ros::Time sent;
+};
 
-    if(msg.type==1){
-        geometry_msgs::PoseStamped pose;
-
-        pose = msg.pose;
-
-        //tf::Transform transform;
-
-        tf::Stamped<tf::Pose> transform;
-        //tf2::convert
-
-        tf::poseStampedMsgToTF(pose, transform);
-
-        //br->sendTransform(tf::StampedTransform(transform, ros::Time::now(), pose.header.frame_id, msg.name));
-
-        visualization_msgs::Marker marker;
-        marker.header = pose.header;
-        marker.ns = "percepteros";
-        marker.id = 0;
-        marker.type = visualization_msgs::Marker::ARROW;
-        marker.action = visualization_msgs::Marker::ADD;
-        marker.pose = pose.pose;
-        // Set the scale of the marker -- 1x1x1 here means 1m on a side
-        marker.scale.x = 0.1;
-        marker.scale.y = 0.01;
-        marker.scale.z = 0.01;
-
-        // Set the color -- be sure to set alpha to something non-zero!
-        marker.color.r = 0.0f;
-        marker.color.g = 1.0f;
-        marker.color.b = 0.0f;
-        marker.color.a = 1.0;
-        std::cout<<"Publishing";
-
-        visualization_msgs::Marker markerCyl;
-        markerCyl.header = pose.header;
-        markerCyl.id=2;
-        markerCyl.type = visualization_msgs::Marker::CUBE;
-        markerCyl.ns = "percepteros";
-        markerCyl.pose = pose.pose;
-        markerCyl.scale.x = msg.width;
-        markerCyl.scale.y = msg.depth;
-        markerCyl.scale.z = msg.height;
-        // Set the color -- be sure to set alpha to something non-zero!
-        markerCyl.color.r = 1.0f;
-        markerCyl.color.g = 1.0f;
-        markerCyl.color.b = 0.0f;
-        markerCyl.color.a = 1.0;
-
-
-        vis_pub1.publish(marker);
-        vis_pub2.publish(markerCyl);
-    }
+ros::Publisher marker_pub;
+tf::TransformBroadcaster* br;
 
-    if(msg.type==2){
-      geometry_msgs::PoseStamped pose;
+//markers of the last frame, ids beyond the current count get deleted
+int lastMarkerCount = 0;
 
-      pose = msg.pose;
+double tfRate, tfKeepAlive;
+ros::Time lastTFBroadcast;
+std::map<std::string, SentTransform> sentTransforms;
 
-      //tf::Transform transform;
+visualization_msgs::Marker makeMarker(const geometry_msgs::PoseStamped &pose, int id, int type)
+{
+  visualization_msgs::Marker marker;
+  marker.header = pose.header;
+  marker.ns = "percepteros";
+  marker.id = id;
+  marker.type = type;
+  marker.action = visualization_msgs::Marker::ADD;
+  marker.pose = pose.pose;
+  marker.color.a = 1.0;
+  return marker;
+}
 
-      tf::Stamped<tf::Pose> transform;
-      //tf2::convert
+bool samePose(const tf::Transform &a, const tf::Transform &b)
+{
+  return a.getOrigin().distance2(b.getOrigin()) < 1e-8 &&
+         std::abs(a.getRotation().dot(b.getRotation())) > 1.0 - 1e-8;
+}
 
-      tf::poseStampedMsgToTF(pose, transform);
+/**
+ * Sends the object frames of one detection frame as a single batch. Frames
+ * are sent at most tfRate times a second, unchanged poses only every
+ * tfKeepAlive seconds.
+ */
+void broadcastTransforms(const std::vector<tf::StampedTransform> &transforms)
+{
+  const ros::Time now = ros::Time::now();
+  if(tfRate > 0 && (now - lastTFBroadcast).toSec() < 1.0 / tfRate)
+  {
+    return;
+  }
+
+  std::vector<tf::StampedTransform> batch;
+  for(const tf::StampedTransform &transform : transforms)
+  {
+    std::map<std::string, SentTransform>::iterator it = sentTransforms.find(transform.child_frame_id_);
+    if(it != sentTransforms.end() && samePose(it->second.transform, transform) &&
+       (now - it->second.sent).toSec() < tfKeepAlive)
+    {
+      continue;
+    }
+    SentTransform &sent = sentTransforms[transform.child_frame_id_];
+    sent.transform = transform;
+    sent.sent = now;
+    batch.push_back(tf::StampedTransform(transform, now, transform.frame_id_, transform.child_frame_id_));
+  }
+
+  if(!batch.empty())
+  {
+    br->sendTransform(batch);
+    lastTFBroadcast = now;
+  }
+}
 
-      br->sendTransform(tf::StampedTransform(transform, ros::Time::now(), pose.header.frame_id, msg.name));
-
-      visualization_msgs::Marker marker;
-      marker.header = pose.header;
-      marker.ns = "percepteros";
-      marker.id = 0;
-      marker.type = visualization_msgs::Marker::ARROW;
-      marker.action = visualization_msgs::Marker::ADD;
-      marker.pose = pose.pose;
-      // Set the scale of the marker -- 1x1x1 here means 1m on a side
-      marker.scale.x = 0.1;
-      marker.scale.y = 0.01;
-      marker.scale.z = 0.01;
-
-      // Set the color -- be sure to set alpha to something non-zero!
-      marker.color.r = 0.0f;
-      marker.color.g = 1.0f;
-      marker.color.b = 0.0f;
-      marker.color.a = 1.0;
-      std::cout<<"Publishing";
-
-      visualization_msgs::Marker markerCyl;
-      markerCyl.header = pose.header;
-      markerCyl.id=1;
-      markerCyl.type = visualization_msgs::Marker::CYLINDER;
-      markerCyl.ns = "percepteros";
-      markerCyl.pose = pose.pose;
-      markerCyl.scale.x = msg.width;
-      markerCyl.scale.y = msg.depth;
-      markerCyl.scale.z = msg.height;
-      // Set the color -- be sure to set alpha to something non-zero!
-      markerCyl.color.r = 1.0f;
-      markerCyl.color.g = 1.0f;
-      markerCyl.color.b = 0.0f;
-      markerCyl.color.a = 1.0;
-
-
-      vis_pub1.publish(marker);
-      vis_pub2.publish(markerCyl);
-    } 
-	if(msg.type==6){
-      geometry_msgs::PoseStamped pose;
-
-      pose = msg.pose;
-
-      //tf::Transform transform;
+/**
+ * Converts all detections of a frame into one MarkerArray: an arrow for the
+ * pose and, depending on the type, a body with the detected dimensions.
+ */
+void subscriber(const percepteros::ObjectDetectionArray& msg)
+{
+  visualization_msgs::MarkerArray markers;
+  std::vector<tf::StampedTransform> transforms;
+  int id = 0;
+
+  for(const suturo_perception_msgs::ObjectDetection &detection : msg.detections)
+  {
+    std::map<int, MarkerStyle>::const_iterator style = styles.find(detection.type);
+    if(style == styles.end())
+    {
+      continue;
+    }
+    const geometry_msgs::PoseStamped &pose = detection.pose;
+
+    visualization_msgs::Marker arrow = makeMarker(pose, id++, visualization_msgs::Marker::ARROW);
+    arrow.scale.x = 0.1;
+    arrow.scale.y = 0.01;
+    arrow.scale.z = 0.01;
+    arrow.color.g = 1.0f;
+    markers.markers.push_back(arrow);
+
+    if(style->second.shape >= 0)
+    {
+      visualization_msgs::Marker body = makeMarker(pose, id++, style->second.shape);
+      body.scale.x = detection.width;
+      body.scale.y = detection.depth;
+      body.scale.z = detection.height;
+      body.color.r = 1.0f;
+      body.color.g = 1.0f;
+      markers.markers.push_back(body);
+    }
 
+    if(style->second.broadcastTF)
+    {
       tf::Stamped<tf::Pose> transform;
-      //tf2::convert
-
       tf::poseStampedMsgToTF(pose, transform);
-
-      br->sendTransform(tf::StampedTransform(transform, ros::Time::now(), pose.header.frame_id, msg.name));
-
-      visualization_msgs::Marker marker;
-      marker.header = pose.header;
-      marker.ns = "percepteros";
-      marker.id = 0;
-      marker.type = visualization_msgs::Marker::ARROW;
-      marker.action = visualization_msgs::Marker::ADD;
-      marker.pose = pose.pose;
-      // Set the scale of the marker -- 1x1x1 here means 1m on a side
-      marker.scale.x = 0.1;
-      marker.scale.y = 0.01;
-      marker.scale.z = 0.01;
-
-      // Set the color -- be sure to set alpha to something non-zero!
-      marker.color.r = 0.0f;
-      marker.color.g = 1.0f;
-      marker.color.b = 0.0f;
-      marker.color.a = 1.0;
-      std::cout<<"Publishing";
-
-      vis_pub1.publish(marker);
-    }/*else if (msg.type==5) {
-    	geometry_msgs::PoseStamped pose;
-
-      	pose = msg.pose;
-
-      	tf::TransformBroadcaster br;
-
-      	tf::Stamped<tf::Pose> transform;
-
-      	tf::poseStampedMsgToTF(pose, transform);
-
-      	br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "head_mount_kinect_rgb_optical_frame", msg.name));
-
-     	visualization_msgs::Marker markerTray;
-      	markerTray.header = pose.header;
-      	markerTray.id=2;
-      	markerTray.type = visualization_msgs::Marker::CUBE;
-      	markerTray.ns = "percepteros";
-      	markerTray.pose = pose.pose;
-      	markerTray.scale.x = msg.width;
-      	markerTray.scale.y = msg.depth;
-      	markerTray.scale.z = 0.1;
-      	// Set the color -- be sure to set alpha to something non-zero!
-      	markerTray.color.r = 1.0f;
-      	markerTray.color.g = 1.0f;
-      	markerTray.color.b = 0.0f;
-      	markerTray.color.a = 1.0;
-
-      	vis_pub2.publish(markerTray);
-    }*/
+      transforms.push_back(tf::StampedTransform(transform, transform.stamp_, pose.header.frame_id, detection.name));
+    }
+  }
+
+  for(int staleId = id; staleId < lastMarkerCount; ++staleId)
+  {
+    visualization_msgs::Marker marker;
+    marker.header = msg.header;
+    marker.ns = "percepteros";
+    marker.id = staleId;
+    marker.action = visualization_msgs::Marker::DELETE;
+    markers.markers.push_back(marker);
+  }
+  lastMarkerCount = id;
+
+  if(!markers.markers.empty())
+  {
+    marker_pub.publish(markers);
+  }
+  broadcastTransforms(transforms);
 }
 
 int main(int argc, char **argv)
@@ -197,14 +169,15 @@ int main(int argc, char **argv)
   br = &bro;
 
   ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+  pn.param("tf_rate", tfRate, 10.0);
+  pn.param("tf_keep_alive", tfKeepAlive, 1.0);
 
-  ros::Subscriber sub = n.subscribe("percepteros/object_detection", 1000, subscriber);
+  ros::Subscriber sub = n.subscribe("percepteros/object_detections", 10, subscriber);
 
-  vis_pub1= n.advertise<visualization_msgs::Marker>( "visualization_marker", 0 );
-  vis_pub2= n.advertise<visualization_msgs::Marker>( "visualization_marker", 0 );
+  marker_pub = n.advertise<visualization_msgs::MarkerArray>("visualization_marker_array", 1);
 
   ros::spin();
 
   return 0;
 }
-